@@ -0,0 +1,402 @@
+/*
+ * cj - a tiny and simple JSON parsing library for C
+ * Copyright (c) 2022 spazzylemons
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Benchmarks parsing whole files with each reader and allocator. Run with
+ * --generate DIR to write the synthetic corpora into DIR, or with a list of
+ * files to benchmark them. Files ending in .ndjson are parsed as a stream of
+ * values. Results are written to stdout as one JSON object per line.
+ */
+
+#include "cj.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Each benchmark runs for at least this many seconds. */
+#define MIN_SECONDS 0.5
+
+/* Keeps allocations aligned after the size header of counting_allocate. */
+typedef union {
+    size_t size;
+    long double d;
+    void *p;
+} Header;
+
+/* Statistics on the memory obtained from the counting allocator. */
+static size_t allocations, live_bytes, peak_bytes;
+
+/*
+ * Every allocation, whether made by cj directly or by an arena or pool on its
+ * behalf, goes through here, so that allocations and memory use are counted
+ * the same way for every allocator.
+ */
+static void *counting_allocate(CJAllocator *allocator, void *ptr, size_t size) {
+    Header *header = ptr == NULL ? NULL : (Header*) ptr - 1;
+    (void) allocator;
+    if (header != NULL) live_bytes -= header->size;
+    if (size == 0) {
+        free(header);
+        return NULL;
+    }
+    if (header == NULL) ++allocations;
+    Header *new_header = realloc(header, sizeof(Header) + size);
+    if (new_header == NULL) {
+        /* a failed resize leaves the allocation as it was */
+        if (header != NULL) live_bytes += header->size;
+        return NULL;
+    }
+    new_header->size = size;
+    live_bytes += size;
+    if (live_bytes > peak_bytes) peak_bytes = live_bytes;
+    return new_header + 1;
+}
+
+static CJAllocator counting_allocator = { counting_allocate };
+
+/* A file being benchmarked. */
+typedef struct {
+    const char *path;
+    char *contents;
+    size_t length;
+    FILE *file;
+    CJ_BOOL stream;
+} Corpus;
+
+/* The allocators and readers to benchmark with. */
+enum { DEFAULT, ARENA, POOL, ALLOCATOR_COUNT };
+enum { STRING, BUFFER, FILE_SMALL, FILE_MEDIUM, FILE_LARGE, MAPPED,
+    READER_COUNT };
+
+static const char *allocator_names[] = { "default", "arena", "pool" };
+static const char *reader_names[] = { "string", "buffer", "file512",
+    "file4096", "file65536", "mmap" };
+static const size_t file_buffer_sizes[] = { 512, 4096, 65536 };
+
+/* The allocator of the current pass, and what to do after each document. */
+typedef struct {
+    CJAllocator *allocator;
+    unsigned flags;
+    CJArena arena;
+    CJPool *pool;
+} PassAllocator;
+
+static void start_allocator(PassAllocator *pa, int kind) {
+    pa->flags = 0;
+    pa->pool = NULL;
+    switch (kind) {
+        case ARENA:
+            cj_arena_init(&pa->arena, &counting_allocator, 0);
+            pa->allocator = &pa->arena.allocator;
+            pa->flags = CJ_PARSE_ARENA;
+            break;
+        case POOL:
+            pa->pool = cj_pool_new(&counting_allocator, 0);
+            if (pa->pool == NULL) abort();
+            pa->allocator = cj_pool_allocator(pa->pool);
+            break;
+        default:
+            pa->allocator = &counting_allocator;
+            break;
+    }
+}
+
+static void free_document(PassAllocator *pa, CJValue *value) {
+    if (pa->flags & CJ_PARSE_ARENA) {
+        cj_arena_reset(&pa->arena);
+    } else {
+        cj_free(pa->allocator, value);
+    }
+}
+
+static void finish_allocator(PassAllocator *pa) {
+    if (pa->flags & CJ_PARSE_ARENA) cj_arena_release(&pa->arena);
+    if (pa->pool != NULL) cj_pool_delete(pa->pool);
+}
+
+/* Parse every document of a corpus with a reader, returning how many. */
+static size_t parse_reader(
+    Corpus *corpus,
+    PassAllocator *pa,
+    CJReader *reader
+) {
+    CJValue value;
+    size_t documents = 0;
+    if (corpus->stream) {
+        CJStream *stream = cj_stream_new(pa->allocator, reader, pa->flags);
+        CJParseResult result;
+        if (stream == NULL) abort();
+        while ((result = cj_parse_next(stream, &value)) == CJ_SUCCESS) {
+            free_document(pa, &value);
+            ++documents;
+        }
+        cj_stream_delete(stream);
+        if (result != CJ_END_OF_STREAM) return 0;
+    } else {
+        if (cj_parse_ex(pa->allocator, reader, &value, pa->flags)
+                != CJ_SUCCESS) {
+            return 0;
+        }
+        free_document(pa, &value);
+        documents = 1;
+    }
+    return documents;
+}
+
+/* Parse a corpus once, returning the number of documents, or 0 on failure. */
+static size_t run_pass(Corpus *corpus, int reader_kind, int allocator_kind) {
+    PassAllocator pa;
+    size_t documents = 0;
+    start_allocator(&pa, allocator_kind);
+    switch (reader_kind) {
+        case STRING: {
+            CJStringReader string_reader;
+            cj_init_string_reader(&string_reader, corpus->contents,
+                corpus->length);
+            documents = parse_reader(corpus, &pa, &string_reader.reader);
+            break;
+        }
+        case BUFFER: {
+            CJValue value;
+            if (cj_parse_buffer_ex(pa.allocator, corpus->contents,
+                    corpus->length, &value, pa.flags) == CJ_SUCCESS) {
+                free_document(&pa, &value);
+                documents = 1;
+            }
+            break;
+        }
+        case MAPPED: {
+            CJMappedFileReader mapped_reader;
+            if (cj_open_mapped_file_reader(&mapped_reader, corpus->path,
+                    &counting_allocator)) {
+                documents = parse_reader(corpus, &pa, &mapped_reader.reader);
+                cj_close_mapped_file_reader(&mapped_reader);
+            }
+            break;
+        }
+        default: {
+            size_t size = file_buffer_sizes[reader_kind - FILE_SMALL];
+            char *buffer = malloc(size);
+            CJFileReader file_reader;
+            if (buffer == NULL) abort();
+            rewind(corpus->file);
+            cj_init_file_reader(&file_reader, corpus->file, buffer, size);
+            documents = parse_reader(corpus, &pa, &file_reader.reader);
+            free(buffer);
+            break;
+        }
+    }
+    finish_allocator(&pa);
+    return documents;
+}
+
+/* Benchmark a corpus with one reader and allocator, printing the results. */
+static void run_benchmark(Corpus *corpus, int reader_kind, int allocator_kind) {
+    size_t documents, passes = 0;
+    double seconds;
+    clock_t start;
+    /* the first pass warms up the caches and isn't measured */
+    documents = run_pass(corpus, reader_kind, allocator_kind);
+    if (documents == 0) {
+        fprintf(stderr, "%s: failed to parse with %s reader and %s "
+            "allocator\n", corpus->path, reader_names[reader_kind],
+            allocator_names[allocator_kind]);
+        return;
+    }
+    allocations = 0;
+    peak_bytes = live_bytes;
+    start = clock();
+    do {
+        run_pass(corpus, reader_kind, allocator_kind);
+        ++passes;
+        seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    } while (seconds < MIN_SECONDS);
+    printf("{\"corpus\":\"%s\",\"reader\":\"%s\",\"allocator\":\"%s\","
+        "\"bytes\":%zu,\"documents\":%zu,\"passes\":%zu,\"seconds\":%.6f,"
+        "\"mb_per_s\":%.2f,\"documents_per_s\":%.1f,"
+        "\"allocations_per_document\":%.2f,\"peak_bytes\":%zu}\n",
+        corpus->path, reader_names[reader_kind],
+        allocator_names[allocator_kind], corpus->length, documents, passes,
+        seconds, (double) corpus->length * passes / seconds / 1e6,
+        (double) documents * passes / seconds,
+        (double) allocations / ((double) documents * passes), peak_bytes);
+    fflush(stdout);
+}
+
+/* Load a corpus, returning 0 on failure. */
+static int load_corpus(Corpus *corpus, const char *path) {
+    size_t length = strlen(path);
+    long size;
+    corpus->path = path;
+    corpus->stream = length >= 7 && strcmp(path + length - 7, ".ndjson") == 0;
+    corpus->file = fopen(path, "rb");
+    if (corpus->file == NULL) return 0;
+    if (fseek(corpus->file, 0, SEEK_END) != 0
+            || (size = ftell(corpus->file)) < 0) {
+        fclose(corpus->file);
+        return 0;
+    }
+    rewind(corpus->file);
+    corpus->length = (size_t) size;
+    corpus->contents = malloc(corpus->length + 1);
+    if (corpus->contents == NULL
+            || fread(corpus->contents, 1, corpus->length, corpus->file)
+                != corpus->length) {
+        free(corpus->contents);
+        fclose(corpus->file);
+        return 0;
+    }
+    return 1;
+}
+
+/* A cheap random number generator, so that the corpora are reproducible. */
+static unsigned long next_random(unsigned long *state) {
+    *state = *state * 1103515245 + 12345;
+    return (*state >> 16) & 0x7FFF;
+}
+
+/* Nested arrays and objects, close to the default depth limit. */
+static void generate_deep(FILE *f, unsigned long *state) {
+    const int depth = CJ_MAX_DEPTH - 24;
+    (void) state;
+    fputc('[', f);
+    for (int i = 0; i < 100; i++) {
+        if (i > 0) fputc(',', f);
+        for (int d = 0; d < depth; d++) fputs(d % 2 ? "{\"a\":" : "[", f);
+        fprintf(f, "%d", i);
+        for (int d = depth - 1; d >= 0; d--) fputs(d % 2 ? "}" : ",null]", f);
+    }
+    fputs("]\n", f);
+}
+
+/* One log record per line. */
+static void generate_log(FILE *f, unsigned long *state) {
+    static const char *levels[] = { "debug", "info", "warn", "error" };
+    static const char *paths[] = { "/users", "/orders", "/search", "/health" };
+    for (int i = 0; i < 20000; i++) {
+        unsigned long r = next_random(state);
+        fprintf(f, "{\"time\":\"2022-06-%02dT%02d:%02d:%02d.%03luZ\","
+            "\"level\":\"%s\",\"service\":\"api\",\"path\":\"%s/%lu\","
+            "\"status\":%d,\"latency_ms\":%lu.%lu,"
+            "\"message\":\"request handled\",\"tags\":[\"http\",\"v2\"]}\n",
+            1 + i / 5000 % 28, i / 3600 % 24, i / 60 % 60, i % 60, r % 1000,
+            levels[r % 4], paths[r / 4 % 4], next_random(state),
+            r % 16 == 0 ? 500 : 200, r % 300, next_random(state) % 100);
+    }
+}
+
+/* Strings of many lengths, with escapes and multibyte characters. */
+static void generate_strings(FILE *f, unsigned long *state) {
+    static const char *pieces[] = { "lorem ", "ipsum ", "\\\"", "\\n",
+        "\\u00e9", "\xc3\xa9", "\xe2\x82\xac", "dolor sit amet " };
+    fputc('[', f);
+    for (int i = 0; i < 20000; i++) {
+        int count = (int) (next_random(state) % 32);
+        if (i > 0) fputc(',', f);
+        fputc('"', f);
+        for (int j = 0; j < count; j++) {
+            unsigned long r = next_random(state);
+            /* mostly plain text, as in real data */
+            fputs(pieces[r % 16 < 12 ? (r % 2 ? 0 : 7) : 1 + r % 6], f);
+        }
+        fputc('"', f);
+    }
+    fputs("]\n", f);
+}
+
+/* Integers, decimals, and numbers with exponents. */
+static void generate_numbers(FILE *f, unsigned long *state) {
+    fputc('[', f);
+    for (int i = 0; i < 100000; i++) {
+        unsigned long a = next_random(state) * 32768 + next_random(state);
+        unsigned long b = next_random(state);
+        if (i > 0) fputc(',', f);
+        switch (i % 4) {
+            case 0: fprintf(f, "%lu", a); break;
+            case 1: fprintf(f, "-%lu.%lu", a % 1000, b); break;
+            case 2: fprintf(f, "%lu.%lue%d", a % 10, b, (int) (b % 40) - 20);
+                break;
+            default: fprintf(f, "0.%lu%lu", a, b); break;
+        }
+    }
+    fputs("]\n", f);
+}
+
+/* A synthetic corpus. */
+typedef struct {
+    const char *name;
+    void (*generate)(FILE *f, unsigned long *state);
+} Generator;
+
+static const Generator generators[] = {
+    { "deep.json", generate_deep },
+    { "log.ndjson", generate_log },
+    { "strings.json", generate_strings },
+    { "numbers.json", generate_numbers },
+};
+
+/* Write the synthetic corpora into a directory. */
+static int generate(const char *dir) {
+    for (size_t i = 0; i < sizeof(generators) / sizeof(generators[0]); i++) {
+        char path[4096];
+        unsigned long state = 1;
+        FILE *f;
+        snprintf(path, sizeof(path), "%s/%s", dir, generators[i].name);
+        f = fopen(path, "wb");
+        if (f == NULL) {
+            perror(path);
+            return 1;
+        }
+        generators[i].generate(f, &state);
+        if (fclose(f) != 0) {
+            perror(path);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--generate") == 0) {
+        return generate(argv[2]);
+    }
+    for (int i = 1; i < argc; i++) {
+        Corpus corpus;
+        if (!load_corpus(&corpus, argv[i])) {
+            perror(argv[i]);
+            return 1;
+        }
+        for (int r = 0; r < READER_COUNT; r++) {
+            /* a stream of values can't be parsed from a single buffer */
+            if (r == BUFFER && corpus.stream) continue;
+            for (int a = 0; a < ALLOCATOR_COUNT; a++) {
+                run_benchmark(&corpus, r, a);
+            }
+        }
+        free(corpus.contents);
+        fclose(corpus.file);
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/bash
+
+# benchmark every corpus in bench_data, or the given files, writing one line of
+# JSON per corpus, reader, and allocator to stdout
+#
+# with --download, fetch the standard corpora into bench_data instead, which is
+# the only step that uses the network; set CORPUS_REF to a commit of the corpus
+# repository to fetch that version of them
+
+DATA_DIR=bench_data
+CORPUS_REF=${CORPUS_REF:-master}
+CORPUS_URL=https://raw.githubusercontent.com/miloyip/nativejson-benchmark/$CORPUS_REF/data
+
+if [ "$1" = "--download" ]; then
+    mkdir -p "$DATA_DIR"
+    for name in twitter.json canada.json citm_catalog.json; do
+        if ! curl -fsSL "$CORPUS_URL/$name" -o "$DATA_DIR/$name"; then
+            rm -f "$DATA_DIR/$name"
+            echo "could not download $name" >&2
+            exit 1
+        fi
+    done
+    exit 0
+fi
+
+if ! cc -O2 -Wall -Werror benchmark.c cj.o -o benchmark; then
+    exit 1
+fi
+
+if [ $# -eq 0 ]; then
+    mkdir -p "$DATA_DIR"
+    if ! ./benchmark --generate "$DATA_DIR"; then
+        rm benchmark
+        exit 1
+    fi
+    # the standard corpora are only there if they were downloaded first
+    for name in twitter.json canada.json citm_catalog.json; do
+        if [ ! -f "$DATA_DIR/$name" ]; then
+            echo "skipping $name, as it has not been downloaded" >&2
+        fi
+    done
+    set -- "$DATA_DIR"/*.json "$DATA_DIR"/*.ndjson
+fi
+
+./benchmark "$@"
+status=$?
+rm benchmark
+exit $status
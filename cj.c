@@ -21,16 +21,30 @@
  * SOFTWARE.
  */
 
+/* for mapping files, which must be requested before any header is included */
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+/* for pinning threads to processors on Linux, which is an extension */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "cj.h"
 
 /* for error handling */
 #include <setjmp.h>
 /* for strtod */
 #include <stdlib.h>
+/* for checking the number formats */
+#include <float.h>
+#include <limits.h>
 
-#ifdef CJ_STRING_READER
+/* for memcpy */
 #include <string.h>
-#endif
+/* for sprintf */
+#include <stdio.h>
 
 #ifdef __STDC_VERSION__
     /* c99 or greater */
@@ -38,7 +52,6 @@
     typedef int_least32_t Codepoint;
 #else
     /* c89 */
-    #include <limits.h>
     #if INT_MAX >= 0x1fffff
         typedef int Codepoint;
     #elif LONG_MAX >= 0x1fffff
@@ -51,22 +64,284 @@
     #define SIZE_MAX (((size_t) 0) - 1)
 #endif
 
+/* the system interfaces for mapping files and starting threads */
+#if defined(_WIN32)
+    #if defined(CJ_MAPPED_FILE_READER) || defined(CJ_THREADS)
+        #define WIN32_LEAN_AND_MEAN
+        #define NOMINMAX
+        #include <windows.h>
+    #endif
+    #ifdef CJ_MAPPED_FILE_READER
+        #define MAPPING_WINDOWS
+    #endif
+    #ifdef CJ_THREADS
+        #define THREADS_WINDOWS
+    #endif
+#elif defined(__unix__) || defined(__APPLE__)
+    #ifdef CJ_MAPPED_FILE_READER
+        #define MAPPING_POSIX
+        #include <fcntl.h>
+        #include <sys/mman.h>
+        #include <sys/stat.h>
+        #include <unistd.h>
+    #endif
+    #ifdef CJ_THREADS
+        #define THREADS_POSIX
+        #include <pthread.h>
+        #include <unistd.h>
+    #endif
+#endif
+
+/* A 64-bit unsigned integer type, if there is one. */
+#if defined(__STDC_VERSION__) && defined(UINT64_MAX)
+    typedef uint64_t U64;
+    #define HAVE_U64
+#elif (ULONG_MAX >> 31 >> 31) >= 3
+    typedef unsigned long U64;
+    #define HAVE_U64
+#elif defined(_MSC_VER)
+    typedef unsigned __int64 U64;
+    #define HAVE_U64
+#endif
+
+/* Construct a 64-bit integer from two 32-bit halves. */
+#define U64_C(hi, lo) (((U64) (hi) << 32) | (U64) (lo))
+
+/*
+ * Numbers are converted without strtod if there is a 64-bit integer type and
+ * doubles are IEEE 754 binary64.
+ */
+#if defined(HAVE_U64) && FLT_RADIX == 2 && DBL_MANT_DIG == 53 \
+        && DBL_MAX_EXP == 1024
+    #define FAST_NUMBERS
+#endif
+
+/* Vector instructions, used to scan through the input in bulk. */
+#if !defined(CJ_SIMD)
+    /* disabled */
+#elif defined(__AVX2__)
+    #include <immintrin.h>
+    #define SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) \
+        || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+    #define SIMD_NEON
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define FIRST_SET_BIT(mask) __builtin_ctz(mask)
+#elif defined(_MSC_VER)
+    #include <intrin.h>
+    static int first_set_bit(unsigned long mask) {
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (int) index;
+    }
+    #define FIRST_SET_BIT(mask) first_set_bit(mask)
+#endif
+
+/* The same for 64-bit masks, which must not be zero. */
+#if defined(__GNUC__) || defined(__clang__)
+    #define FIRST_SET_BIT64(mask) __builtin_ctzll(mask)
+#elif defined(FIRST_SET_BIT) && defined(HAVE_U64)
+    static int first_set_bit64(U64 mask) {
+        unsigned long low = (unsigned long) (mask & 0xFFFFFFFF);
+        if (low != 0) return FIRST_SET_BIT(low);
+        return 32 + FIRST_SET_BIT((unsigned long) (mask >> 32));
+    }
+    #define FIRST_SET_BIT64(mask) first_set_bit64(mask)
+#elif defined(HAVE_U64)
+    static int first_set_bit64(U64 mask) {
+        int index = 0;
+        while (!(mask & 1)) {
+            mask >>= 1;
+            ++index;
+        }
+        return index;
+    }
+    #define FIRST_SET_BIT64(mask) first_set_bit64(mask)
+#endif
+
+#if !defined(SIMD_AVX2) && !defined(SIMD_SSE2) && !defined(SIMD_NEON)
+/*
+ * Word-at-a-time operations for when vector instructions are unavailable. Each
+ * byte of a word is treated as its own lane.
+ */
+typedef unsigned long Word;
+
+/* A word with every byte set to the given byte. */
+#define WORD_REPEAT(c) ((~(Word) 0 / 0xFF) * (Word) (c))
+
+/* Nonzero if any byte in the word is less than n, where n <= 0x80. */
+#define WORD_HAS_LESS(w, n)\
+    (((w) - WORD_REPEAT(n)) & ~(w) & WORD_REPEAT(0x80))
+
+/* Nonzero if any byte in the word is equal to c. */
+#define WORD_HAS_BYTE(w, c) WORD_HAS_LESS((w) ^ WORD_REPEAT(c), 1)
+
+/* The high bit of each byte of the word is set if that byte is zero. */
+#define WORD_ZERO_BYTES(w) ~((((w) & WORD_REPEAT(0x7F)) + WORD_REPEAT(0x7F))\
+    | (w) | WORD_REPEAT(0x7F))
+
+/* The high bit of each byte of the word is set if that byte is equal to c. */
+#define WORD_EQ_BYTES(w, c) WORD_ZERO_BYTES((w) ^ WORD_REPEAT(c))
+
+/* Load a word from a possibly unaligned pointer. */
+static Word load_word(const char *ptr) {
+    Word w;
+    memcpy(&w, ptr, sizeof(Word));
+    return w;
+}
+#endif
+
+/*
+ * A structural index needs 64-bit masks, one bit for each byte of a block.
+ */
+#ifdef HAVE_U64
+#define STRUCTURAL_INDEX
+
+/* The number of bytes indexed at a time, which must be a multiple of 64. */
+#define STRUCTURAL_WINDOW 4096
+
+/*
+ * The structural index of a buffer: the positions of the characters that
+ * begin each token, found 64 bytes at a time without parsing. These are the
+ * operators []{}:, outside of strings, the opening quotes of strings, and the
+ * first character of numbers and literals. Anything else outside of strings
+ * between them is whitespace, or the rest of a token. The positions are found
+ * a window at a time, so the memory used does not depend on the input.
+ */
+typedef struct {
+    /* The buffer, and how much of it has been indexed. */
+    const char *start;
+    const char *indexed;
+    const char *end;
+    /* The start of the last window indexed. */
+    const char *window;
+    /* The positions in the last window indexed, and the next one to use. */
+    const char **positions;
+    size_t count;
+    size_t next;
+    /* The state carried from one block to the next. */
+    U64 prev_escaped;
+    U64 prev_in_string;
+    U64 prev_scalar;
+} StructuralIndex;
+#endif
+
+/* A key in the table of interned keys. */
+typedef struct {
+    char *chars;
+    size_t length;
+} InternedKey;
+
+/* An unfinished array or object. */
+typedef struct {
+    /*
+     * The stack index of the container, or the position of the word starting
+     * it on a tape, or where the active paths of its children start when
+     * selecting.
+     */
+    size_t index;
+    /* The offset of its children's pending strings. */
+    size_t chars_start;
+    /* The number of its children so far, for parsers that count them. */
+    size_t count;
+    CJ_BOOL object;
+} Frame;
+
+/* A built array or object being walked, and the position of its next child. */
+typedef struct {
+    const CJValue *value;
+    size_t next;
+    /* The copy being made of it, when copying it. */
+    CJValue *copy;
+    /* The position of the word starting it, when putting it on a tape. */
+    size_t start;
+} Walk;
+
 /* The parser structure. */
 typedef struct {
-    /* The number of bytes remaining in the buffer. */
-    size_t remaining;
-    /* A pointer to the current character in the buffer, or NULL on EOF. */
-    const char *buf_ptr;
+    /*
+     * The current character and the end of the buffer. The buffer is refilled
+     * as soon as it is used up, so they are only equal at EOF.
+     */
+    const char *cur;
+    const char *end;
     /* The interfaces for reading and allocating. */
     CJAllocator *allocator;
+    /* The reader, or NULL if it is exhausted or the input is one buffer. */
     CJReader *reader;
-    /* The depth of the parser. */
-    int depth;
+    /* True if the input is one buffer that stays valid after parsing. */
+    CJ_BOOL contiguous;
+    /*
+     * True if strings are decoded in place in the input, and where the next
+     * decoded character of the current string goes if so.
+     */
+    CJ_BOOL in_situ;
+    char *in_situ_dst;
+    /* The allocator used for the scratch buffers. */
+    CJAllocator *scratch_allocator;
+    /* The stack of values belonging to unfinished arrays and objects. */
+    CJValue *stack;
+    size_t stack_len;
+    size_t stack_cap;
+    /* The stack of unfinished arrays and objects, innermost last. */
+    Frame *frames;
+    size_t frames_len;
+    size_t frames_cap;
+    /* The stack of built arrays and objects being walked, innermost last. */
+    Walk *walks;
+    size_t walks_len;
+    size_t walks_cap;
+    /*
+     * The buffer that strings and numbers are built in. Short strings belonging
+     * to unfinished arrays and objects stay here until they are packed into
+     * the allocation of their container.
+     */
+    char *chars;
+    size_t chars_len;
+    size_t chars_cap;
+    /* The open-addressed table of interned keys, with a power of two size. */
+    InternedKey *interned;
+    size_t interned_len;
+    size_t interned_cap;
+    /* The flags passed to cj_parse_ex. */
+    unsigned flags;
+    /* The handler and its context, when parsing into events. */
+    const CJHandler *handler;
+    void *ctx;
+    /* The depth of the parser, and the depth at which it gives up. */
+    size_t depth;
+    size_t max_depth;
+#ifdef CJ_STATS
+    /* The statistics of the current parse, or NULL if not counting. */
+    CJParseStats *stats;
+    /* The start of the current buffer, and the bytes of input before it. */
+    const char *buffer_start;
+    size_t buffer_offset;
+#endif
+#ifdef STRUCTURAL_INDEX
+    /* The structural index of the input, if it is walked instead of skipping
+     * whitespace. */
+    StructuralIndex *structurals;
+#endif
     /* Error handling structures. */
     jmp_buf buf;
     CJParseResult result;
 } Parser;
 
+#ifdef CJ_STATS
+/* Add to a statistic, if they are being counted. */
+#define STAT_ADD(p, field, n)\
+    do { if ((p)->stats != NULL) (p)->stats->field += (n); } while (0)
+#else
+#define STAT_ADD(p, field, n) do {} while (0)
+#endif
+
 #ifdef CJ_DEFAULT_ALLOCATOR
 static void *default_allocate(CJAllocator *allocator, void *ptr, size_t size) {
     (void) allocator;
@@ -76,676 +351,8744 @@ static void *default_allocate(CJAllocator *allocator, void *ptr, size_t size) {
 static CJAllocator default_allocator = { default_allocate };
 #endif
 
-#ifdef CJ_FILE_READER
-static const char *file_reader_callback(CJReader *reader, size_t *size) {
-    CJFileReader *file_reader = cj_container_of(reader, CJFileReader, reader);
-    *size = fread(
-        file_reader->buffer,
-        1,
-        file_reader->buffer_size,
-        file_reader->file
-    );
-    if (*size == 0) {
-        *size = !feof(file_reader->file);
-        return NULL;
-    }
-    return file_reader->buffer;
+/* A type with the strictest alignment required by cj's data structures. */
+typedef union {
+    long l;
+    double d;
+    void *p;
+    size_t s;
+} MaxAlign;
+
+/* Round a size up to a multiple of the alignment of MaxAlign. */
+#define ALIGN_UP(n)\
+    (((n) + sizeof(MaxAlign) - 1) / sizeof(MaxAlign) * sizeof(MaxAlign))
+
+#if defined(CJ_ARENA) || defined(CJ_POOL)
+/* A chunk of memory owned by an arena or pool. Its data follows the header. */
+struct CJArenaChunk {
+    /* The previously allocated chunk. */
+    struct CJArenaChunk *prev;
+    /* The number of bytes of data in this chunk. */
+    size_t size;
+    /* The number of bytes of data that have been handed out. */
+    size_t used;
+};
+
+/* The sizes of the headers for chunks and allocations. */
+#define CHUNK_HEADER_SIZE ALIGN_UP(sizeof(struct CJArenaChunk))
+#define ALLOC_HEADER_SIZE ALIGN_UP(sizeof(size_t))
+
+static char *chunk_data(struct CJArenaChunk *chunk) {
+    return (char*) chunk + CHUNK_HEADER_SIZE;
 }
 
-void cj_init_file_reader(
-    CJFileReader *file_reader,
-    FILE *file,
-    char *buffer,
-    size_t buffer_size
-) {
-    file_reader->file = file;
-    file_reader->buffer = buffer;
-    file_reader->buffer_size = buffer_size;
-    file_reader->reader.read = file_reader_callback;
+/*
+ * Each allocation is preceded by a header holding its rounded-up size in an
+ * arena, or its size class in a pool.
+ */
+static size_t *alloc_header(void *ptr) {
+    return (size_t*) (void*) ((char*) ptr - ALLOC_HEADER_SIZE);
 }
 #endif
 
-#ifdef CJ_STRING_READER
-static const char *string_reader_callback(CJReader *reader, size_t *size) {
-    CJStringReader *string_reader =
-        cj_container_of(reader, CJStringReader, reader);
-    if (string_reader->string == NULL) {
-        *size = 0;
-        return NULL;
-    } else {
-        const char *result = string_reader->string;
-        *size = string_reader->length;
-        string_reader->string = NULL;
-        return result;
+#ifdef CJ_ARENA
+
+/* Check if ptr is the most recent allocation in the arena. */
+static CJ_BOOL arena_is_last(CJArena *arena, void *ptr) {
+    struct CJArenaChunk *chunk = arena->chunk;
+    return (char*) ptr + *alloc_header(ptr)
+        == chunk_data(chunk) + chunk->used;
+}
+
+static CJ_BOOL arena_new_chunk(CJArena *arena, size_t min_size) {
+    struct CJArenaChunk *chunk;
+    size_t size = arena->chunk_size;
+    if (size < min_size) size = min_size;
+    if (size > SIZE_MAX - CHUNK_HEADER_SIZE) return CJ_FALSE;
+    chunk = arena->backing->allocate(arena->backing, NULL,
+        CHUNK_HEADER_SIZE + size);
+    if (chunk == NULL) return CJ_FALSE;
+    chunk->prev = arena->chunk;
+    chunk->size = size;
+    chunk->used = 0;
+    arena->chunk = chunk;
+    /* grow geometrically so that large documents need few chunks */
+    if (arena->chunk_size <= SIZE_MAX / 2) arena->chunk_size *= 2;
+    return CJ_TRUE;
+}
+
+static void *arena_alloc(CJArena *arena, size_t size) {
+    size_t *header;
+    size_t needed;
+    if (size > SIZE_MAX - ALLOC_HEADER_SIZE - sizeof(MaxAlign)) return NULL;
+    size = ALIGN_UP(size);
+    needed = ALLOC_HEADER_SIZE + size;
+    if (arena->chunk == NULL
+            || arena->chunk->size - arena->chunk->used < needed) {
+        if (!arena_new_chunk(arena, needed)) return NULL;
     }
+    header = (size_t*) (void*) (chunk_data(arena->chunk) + arena->chunk->used);
+    *header = size;
+    arena->chunk->used += needed;
+    return (char*) header + ALLOC_HEADER_SIZE;
 }
 
-void cj_init_string_reader(
-    CJStringReader *string_reader,
-    const char *string,
-    size_t length
-) {
-    string_reader->string = string;
-    string_reader->length = length;
-    string_reader->reader.read = string_reader_callback;
+static void *arena_allocate(CJAllocator *allocator, void *ptr, size_t size) {
+    CJArena *arena = cj_container_of(allocator, CJArena, allocator);
+    size_t old_size;
+    void *result;
+    if (ptr == NULL) return arena_alloc(arena, size);
+    old_size = *alloc_header(ptr);
+    if (size == 0) {
+        /* only the most recent allocation can be given back */
+        if (arena_is_last(arena, ptr)) {
+            arena->chunk->used -= ALLOC_HEADER_SIZE + old_size;
+        }
+        return NULL;
+    }
+    if (size > SIZE_MAX - sizeof(MaxAlign)) return NULL;
+    if (arena_is_last(arena, ptr)) {
+        /* resize in place if there's room */
+        size_t rest = arena->chunk->size - arena->chunk->used + old_size;
+        if (ALIGN_UP(size) <= rest) {
+            arena->chunk->used += ALIGN_UP(size);
+            arena->chunk->used -= old_size;
+            *alloc_header(ptr) = ALIGN_UP(size);
+            return ptr;
+        }
+    } else if (size <= old_size) {
+        /* shrinking elsewhere in the arena leaves the allocation as is */
+        return ptr;
+    }
+    result = arena_alloc(arena, size);
+    if (result == NULL) return NULL;
+    memcpy(result, ptr, old_size < size ? old_size : size);
+    return result;
 }
+
+void cj_arena_init(CJArena *arena, CJAllocator *backing, size_t chunk_size) {
+#ifdef CJ_DEFAULT_ALLOCATOR
+    if (backing == NULL) backing = &default_allocator;
 #endif
+    if (chunk_size == 0) chunk_size = CJ_ARENA_CHUNK_SIZE;
+    arena->allocator.allocate = arena_allocate;
+    arena->backing = backing;
+    arena->chunk = NULL;
+    arena->chunk_size = chunk_size;
+}
 
-/* Global buffer for parser initial state. */
-static const char initial_buffer[1] = { ' ' };
+/* Free all chunks older than the given chunk. */
+static void arena_free_chunks(CJArena *arena, struct CJArenaChunk *chunk) {
+    while (chunk != NULL) {
+        struct CJArenaChunk *prev = chunk->prev;
+        arena->backing->allocate(arena->backing, chunk, 0);
+        chunk = prev;
+    }
+}
 
-#if defined(__STDC_VERSION__)
-    #if __STDC_VERSION__ >= 201112L
-        #define ERROR_DECL static _Noreturn void error
-    #endif
-#elif defined(__clang__) || defined(__GNUC__)
-    #if __has_attribute(__noreturn__)
-        #define ERROR_DECL __attribute__((__noreturn__)) static void error
-    #endif
-#elif defined(_MSC_VER)
-    #define ERROR_DECL __declspec(noreturn) static void error
-#endif
+void cj_arena_reset(CJArena *arena) {
+    /* the most recent chunk is the largest, so keep it around */
+    if (arena->chunk != NULL) {
+        arena_free_chunks(arena, arena->chunk->prev);
+        arena->chunk->prev = NULL;
+        arena->chunk->used = 0;
+    }
+}
 
-#ifdef ERROR_DECL
-#define UNREACHABLE do {} while (0)
-#else
-#define UNREACHABLE do { return 0; } while (0)
-#define ERROR_DECL static void error
+void cj_arena_release(CJArena *arena) {
+    arena_free_chunks(arena, arena->chunk);
+    arena->chunk = NULL;
+}
 #endif
 
-ERROR_DECL(Parser *p, CJParseResult result) {
-    p->result = result;
-    longjmp(p->buf, 1);
+#if defined(THREADS_POSIX) || defined(THREADS_WINDOWS)
+#define HAVE_THREADS
+
+/* A thin layer over the threads of the system. */
+#ifdef THREADS_POSIX
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+#define THREAD_ENTRY(name) static void *name(void *arg)
+#define THREAD_EXIT return NULL
+typedef void *(*ThreadEntry)(void *arg);
+
+static CJ_BOOL start_thread(Thread *thread, ThreadEntry entry, void *arg) {
+    return pthread_create(thread, NULL, entry, arg) == 0;
 }
 
-static void *alloc(Parser *p, void *ptr, size_t size) {
-    void *result = p->allocator->allocate(p->allocator, ptr, size);
-    /* throw on failure */
-    if (result == NULL) error(p, CJ_SYNTAX_ERROR);
-    return result;
+static void join_thread(Thread thread) {
+    pthread_join(thread, NULL);
 }
 
-static void dealloc(CJAllocator *allocator, void *ptr) {
-    /* avoid the allocator interpreting this as an allocation */
-    if (ptr == NULL) return;
-    allocator->allocate(allocator, ptr, 0);
+static CJ_BOOL init_mutex(Mutex *mutex) {
+    return pthread_mutex_init(mutex, NULL) == 0;
 }
 
-static CJ_BOOL at_eof(const Parser *p) {
-    return p->buf_ptr == NULL;
+static void destroy_mutex(Mutex *mutex) {
+    pthread_mutex_destroy(mutex);
 }
 
-static void advance(Parser *p) {
-    if (at_eof(p)) return;
-    if (--p->remaining == 0) {
-        p->buf_ptr = p->reader->read(p->reader, &p->remaining);
-        if (p->buf_ptr == NULL && p->remaining != 0) {
-            error(p, CJ_READ_ERROR);
-        }
-    } else {
-        ++p->buf_ptr;
-    }
+static void lock_mutex(Mutex *mutex) {
+    pthread_mutex_lock(mutex);
 }
 
-static char take_unchecked(Parser *p) {
-    char result = *p->buf_ptr;
-    advance(p);
-    return result;
+static void unlock_mutex(Mutex *mutex) {
+    pthread_mutex_unlock(mutex);
 }
 
-static char take(Parser *p) {
-    if (at_eof(p)) error(p, CJ_SYNTAX_ERROR);
-    return take_unchecked(p);
+static CJ_BOOL init_condition(Condition *condition) {
+    return pthread_cond_init(condition, NULL) == 0;
 }
 
-static void skip_ws(Parser *p) {
-    while (p->buf_ptr != NULL) {
-        switch (*p->buf_ptr) {
-            case ' ': case '\n': case '\r': case '\t':
-                advance(p);
-                break;
-            default:
-                return;
-        }
-    }
+static void destroy_condition(Condition *condition) {
+    pthread_cond_destroy(condition);
 }
 
-static CJ_BOOL check(Parser *p, char c) {
-    return p->buf_ptr != NULL && *p->buf_ptr == c;
+static void wait_condition(Condition *condition, Mutex *mutex) {
+    pthread_cond_wait(condition, mutex);
 }
 
-static CJ_BOOL eat(Parser *p, char c) {
-    if (check(p, c)) {
-        advance(p);
-        return CJ_TRUE;
-    }
-    return CJ_FALSE;
+static void broadcast_condition(Condition *condition) {
+    pthread_cond_broadcast(condition);
 }
 
-static void require(Parser *p, char c) {
-    if (!check(p, c)) error(p, CJ_SYNTAX_ERROR);
-    advance(p);
+static unsigned count_processors(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 0) return (unsigned) count;
+#endif
+    return 1;
 }
 
-/* starting capacity for strings, arrays, and objects */
-#define INITIAL_CAPACITY 8
+/* Pin a thread to a processor, where the system supports it. */
+static CJ_BOOL pin_thread(Thread thread, unsigned processor) {
+#if defined(__linux__) && defined(CPU_SET)
+    cpu_set_t set;
+    if (processor >= CPU_SETSIZE) return CJ_FALSE;
+    CPU_ZERO(&set);
+    CPU_SET(processor, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+#else
+    (void) thread;
+    (void) processor;
+    return CJ_TRUE;
+#endif
+}
+#else
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Condition;
+#define THREAD_ENTRY(name) static DWORD WINAPI name(LPVOID arg)
+#define THREAD_EXIT return 0
+typedef LPTHREAD_START_ROUTINE ThreadEntry;
 
-/* A generic container. */
-typedef struct {
-    size_t cap;
-    struct {
-        size_t len;
-        void *ptr;
-    } *slice;
-} GenericContainer;
-
-/* Initialize the container. */
-static void container_init(
-    Parser *p,
-    GenericContainer *container,
-    void *loc,
-    size_t child_size
-) {
-    container->slice = loc;
-    /* empty length and NULL pointer, in case of allocation error */
-    container->slice->len = 0;
-    container->slice->ptr = NULL;
-    /* then try to allocate */
-    container->slice->ptr = alloc(p, NULL, INITIAL_CAPACITY * child_size);
-    container->cap = INITIAL_CAPACITY;
+static CJ_BOOL start_thread(Thread *thread, ThreadEntry entry, void *arg) {
+    *thread = CreateThread(NULL, 0, entry, arg, 0, NULL);
+    return *thread != NULL;
 }
 
-/* Add an element to the container. */
-static void *container_add_one(
-    Parser *p,
-    GenericContainer *container,
-    size_t child_size
-) {
-    if (container->cap == container->slice->len) {
-        /* guard against overflow */
-        if (container->cap > SIZE_MAX / (child_size * 2)) {
-            error(p, CJ_OUT_OF_MEMORY);
-        }
-        /* double in size for container growth */
-        container->slice->ptr = alloc(p, container->slice->ptr,
-            container->cap * child_size * 2);
-        container->cap *= 2;
-    }
-    return (char*) container->slice->ptr + container->slice->len++ * child_size;
+static void join_thread(Thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
 }
 
-/* Shrink the data to fit. */
-static void container_shrink(
-    Parser *p,
-    GenericContainer *container,
-    size_t child_size
-) {
-    if (container->slice->len == 0) {\
-        /* if empty, then use NULL for the data */
-        dealloc(p->allocator, container->slice->ptr);
-        container->slice->ptr = NULL;
-    } else {\
-        container->slice->ptr = alloc(p, container->slice->ptr,
-            container->slice->len * child_size);
-    }
+static CJ_BOOL init_mutex(Mutex *mutex) {
+    InitializeCriticalSection(mutex);
+    return CJ_TRUE;
 }
 
-/*
- * A generic container generator for use with cj's container types.
- */
-#define DEFINE_CONTAINER(ContainerName, func_name, ChildType, ArrayType)\
-typedef struct {\
-    size_t cap;\
-    ArrayType *slice;\
-} ContainerName;\
-\
-static void func_name##_init(\
-    Parser *p,\
-    ContainerName *container,\
-    ArrayType *loc\
-) {\
-    container_init(p, (void*) container, loc, sizeof(ChildType));\
-}\
-\
-static ChildType *func_name##_add_one(Parser *p, ContainerName *container) {\
-    return container_add_one(p, (void*) container, sizeof(ChildType));\
-}\
-\
-static void func_name##_shrink(Parser *p, ContainerName *container) {\
-    container_shrink(p, (void*) container, sizeof(ChildType));\
+static void destroy_mutex(Mutex *mutex) {
+    DeleteCriticalSection(mutex);
 }
 
-/* Definitions of container wrappers for all of cj's container types. */
+static void lock_mutex(Mutex *mutex) {
+    EnterCriticalSection(mutex);
+}
 
-DEFINE_CONTAINER(String, string, char, CJString)
-DEFINE_CONTAINER(Array, array, CJValue, CJArray)
-DEFINE_CONTAINER(Object, object, CJObjectMember, CJObject)
+static void unlock_mutex(Mutex *mutex) {
+    LeaveCriticalSection(mutex);
+}
 
-static void push_char(Parser *p, String *string, char c) {
-    *string_add_one(p, string) = c;
+static CJ_BOOL init_condition(Condition *condition) {
+    InitializeConditionVariable(condition);
+    return CJ_TRUE;
 }
 
-static void push_codepoint_unchecked(
-    Parser *p,
-    String *string,
-    Codepoint codepoint
-) {
-    if (codepoint < 0x80) {
-        push_char(p, string, codepoint);
-    } else {
-        if (codepoint < 0x800) {
-            push_char(p, string, 0xC0 | (codepoint >> 6));
-        } else {
-            if (codepoint < 0x10000) {
-                push_char(p, string, 0xE0 | (codepoint >> 12));
-            } else {
-                push_char(p, string, 0xF0 | (codepoint >> 18));
-                push_char(p, string, 0x80 | ((codepoint >> 12) & 0x3F));
-            }
-            push_char(p, string, 0x80 | ((codepoint >> 6) & 0x3F));
-        }
-        push_char(p, string, 0x80 | (codepoint & 0x3F));
-    }
+static void destroy_condition(Condition *condition) {
+    (void) condition;
 }
 
-static Codepoint hex_digit(Parser *p) {
-    char c = take(p);
-    if (c >= '0' && c <= '9') return c - '0';
-    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
-    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
-    error(p, CJ_SYNTAX_ERROR);
-    UNREACHABLE;
+static void wait_condition(Condition *condition, Mutex *mutex) {
+    SleepConditionVariableCS(condition, mutex, INFINITE);
 }
 
-static void push_codepoint(Parser *p, String *string, Codepoint codepoint) {
-    if (codepoint > 0x10FFFF) {
-        error(p, CJ_SYNTAX_ERROR);
-    }
-    push_codepoint_unchecked(p, string, codepoint);
+static void broadcast_condition(Condition *condition) {
+    WakeAllConditionVariable(condition);
 }
 
-static char read_escaped_codepoint(Parser *p) {
-    char c = take(p);
-    switch (c) {
-        case '"': case '\\': case '/': return c;
-        case 'b': return '\b';
-        case 'f': return '\f';
-        case 'n': return '\n';
-        case 'r': return '\r';
-        case 't': return '\t';
-        default:
-            error(p, CJ_SYNTAX_ERROR);
-            UNREACHABLE;
-    }
+static unsigned count_processors(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
 }
 
-static void utf8_check_cont(Parser *p, Codepoint *codepoint) {
-    char c;
-    if (at_eof(p)) error(p, CJ_SYNTAX_ERROR);
-    c = *p->buf_ptr;
-    if (((c & 0x80) == 0) || (c & 0x40)) error(p, CJ_SYNTAX_ERROR);
+/* Pin a thread to a processor in its processor group. */
+static CJ_BOOL pin_thread(Thread thread, unsigned processor) {
+    if (processor >= sizeof(DWORD_PTR) * CHAR_BIT) return CJ_FALSE;
+    return SetThreadAffinityMask(thread, (DWORD_PTR) 1 << processor) != 0;
+}
+#endif
+#endif
+
+#ifdef CJ_POOL
+/*
+ * Allocations up to POOL_FINE_MAX bytes are rounded up to a multiple of the
+ * alignment, which fits any number of values or members exactly. Above that,
+ * each doubling of the size is split into four classes, up to POOL_MAX bytes.
+ */
+#define POOL_FINE_MAX 256
+#define POOL_FINE_CLASSES (POOL_FINE_MAX / sizeof(MaxAlign))
+#define POOL_DOUBLINGS 6
+#define POOL_MAX (POOL_FINE_MAX << POOL_DOUBLINGS)
+#define POOL_CLASSES (POOL_FINE_CLASSES + 4 * POOL_DOUBLINGS)
+
+/* The class of an allocation that was too large for the pool. */
+#define POOL_LARGE POOL_CLASSES
+
+/* Large allocations are linked together so that the pool can free them. Their
+ * links come before their headers. */
+typedef struct LargeLink {
+    struct LargeLink *prev;
+    struct LargeLink *next;
+} LargeLink;
+
+#define LARGE_LINK_SIZE ALIGN_UP(sizeof(LargeLink))
+
+/* The largest chunk a pool grows to. */
+#define POOL_MAX_CHUNK_SIZE ((size_t) 1 << 20)
+
+/* A cache holds at most this many free allocations of each class, and takes
+ * or gives back this many at a time. */
+#define POOL_CACHE_LIMIT 64
+#define POOL_CACHE_BATCH 16
+
+struct CJPool {
+    CJAllocator allocator;
+    /* The allocator that chunks and large allocations come from. */
+    CJAllocator *backing;
+    /* The most recently allocated chunk, and the size of the next one. */
+    struct CJArenaChunk *chunk;
+    size_t chunk_size;
+    /* The free allocations of each class, each linked to the next through its
+     * first bytes. */
+    void *free[POOL_CLASSES];
+    /* The allocations that were too large for any class. */
+    LargeLink *large;
+    /* The caches of the pool. */
+    CJPoolCache *caches;
+#ifdef HAVE_THREADS
+    /* Held by caches while they use the rest of the pool, and while large
+     * allocations are linked or unlinked. */
+    Mutex mutex;
+#endif
+};
+
+struct CJPoolCache {
+    CJAllocator allocator;
+    CJPool *pool;
+    /* The neighbouring caches of the same pool. */
+    CJPoolCache *prev;
+    CJPoolCache *next;
+    /* The free allocations of each class held by this cache. */
+    void *free[POOL_CLASSES];
+    size_t free_count[POOL_CLASSES];
+};
+
+/* Find the class of an allocation of the given size. */
+static size_t pool_class(size_t size) {
+    size_t base, c;
+    if (size <= POOL_FINE_MAX) {
+        return size == 0 ? 0 : (size - 1) / sizeof(MaxAlign);
+    }
+    for (base = POOL_FINE_MAX, c = POOL_FINE_CLASSES; base < POOL_MAX;
+            base *= 2, c += 4) {
+        if (size <= base * 2) return c + (size - base - 1) / (base / 4);
+    }
+    return POOL_LARGE;
+}
+
+/* Find the size of the allocations of a class. */
+static size_t pool_class_size(size_t c) {
+    size_t base = POOL_FINE_MAX;
+    if (c < POOL_FINE_CLASSES) return (c + 1) * sizeof(MaxAlign);
+    c -= POOL_FINE_CLASSES;
+    base <<= c / 4;
+    return base + (c % 4 + 1) * (base / 4);
+}
+
+static void *free_list_pop(void **list) {
+    void *ptr = *list;
+    if (ptr != NULL) *list = *(void**) ptr;
+    return ptr;
+}
+
+static void free_list_push(void **list, void *ptr) {
+    *(void**) ptr = *list;
+    *list = ptr;
+}
+
+/* Carve a new allocation of a class out of the pool's chunks. */
+static void *pool_carve(CJPool *pool, size_t c) {
+    size_t needed = ALLOC_HEADER_SIZE + pool_class_size(c);
+    size_t *header;
+    if (pool->chunk == NULL || pool->chunk->size - pool->chunk->used < needed) {
+        struct CJArenaChunk *chunk;
+        size_t size = pool->chunk_size;
+        if (size < needed) size = needed;
+        chunk = pool->backing->allocate(pool->backing, NULL,
+            CHUNK_HEADER_SIZE + size);
+        if (chunk == NULL) return NULL;
+        chunk->prev = pool->chunk;
+        chunk->size = size;
+        chunk->used = 0;
+        pool->chunk = chunk;
+        if (pool->chunk_size <= POOL_MAX_CHUNK_SIZE / 2) pool->chunk_size *= 2;
+    }
+    header = (size_t*) (void*) (chunk_data(pool->chunk) + pool->chunk->used);
+    *header = c;
+    pool->chunk->used += needed;
+    return (char*) header + ALLOC_HEADER_SIZE;
+}
+
+/* Get an allocation of a class from the pool itself. */
+static void *pool_take(CJPool *pool, size_t c) {
+    void *ptr = free_list_pop(&pool->free[c]);
+    return ptr != NULL ? ptr : pool_carve(pool, c);
+}
+
+/* Get an allocation of a class through a cache, refilling it if empty. */
+static void *cache_take(CJPoolCache *cache, size_t c) {
+    if (cache->free[c] == NULL) {
+        CJPool *pool = cache->pool;
+        size_t i;
+#ifdef HAVE_THREADS
+        lock_mutex(&pool->mutex);
+#endif
+        for (i = 0; i < POOL_CACHE_BATCH; ++i) {
+            void *ptr = pool_take(pool, c);
+            if (ptr == NULL) break;
+            free_list_push(&cache->free[c], ptr);
+        }
+#ifdef HAVE_THREADS
+        unlock_mutex(&pool->mutex);
+#endif
+        cache->free_count[c] = i;
+        if (i == 0) return NULL;
+    }
+    --cache->free_count[c];
+    return free_list_pop(&cache->free[c]);
+}
+
+/* Give the first count free allocations of a class held by a cache back to its
+ * pool. The pool must be locked. */
+static void cache_give_back(CJPoolCache *cache, size_t c, size_t count) {
+    CJPool *pool = cache->pool;
+    cache->free_count[c] -= count;
+    while (count-- > 0) {
+        free_list_push(&pool->free[c], free_list_pop(&cache->free[c]));
+    }
+}
+
+/* Free an allocation through a cache, giving a batch back if it's full. */
+static void cache_give(CJPoolCache *cache, void *ptr, size_t c) {
+    free_list_push(&cache->free[c], ptr);
+    if (++cache->free_count[c] > POOL_CACHE_LIMIT) {
+#ifdef HAVE_THREADS
+        lock_mutex(&cache->pool->mutex);
+#endif
+        cache_give_back(cache, c, POOL_CACHE_BATCH);
+#ifdef HAVE_THREADS
+        unlock_mutex(&cache->pool->mutex);
+#endif
+    }
+}
+
+static LargeLink *large_link(void *ptr) {
+    return (LargeLink*) (void*) ((char*) ptr - ALLOC_HEADER_SIZE
+        - LARGE_LINK_SIZE);
+}
+
+static void link_large(CJPool *pool, LargeLink *link) {
+    link->prev = NULL;
+    link->next = pool->large;
+    if (pool->large != NULL) pool->large->prev = link;
+    pool->large = link;
+}
+
+static void unlink_large(CJPool *pool, LargeLink *link) {
+    if (link->prev != NULL) {
+        link->prev->next = link->next;
+    } else {
+        pool->large = link->next;
+    }
+    if (link->next != NULL) link->next->prev = link->prev;
+}
+
+/*
+ * Allocate, resize, or free a large allocation with the backing allocator of a
+ * pool, keeping the list of them up to date.
+ */
+static void *pool_large(CJPool *pool, void *ptr, size_t size) {
+    CJAllocator *backing = pool->backing;
+    LargeLink *link = NULL, *new_link = NULL;
+    char *result = NULL;
+    if (size > SIZE_MAX - LARGE_LINK_SIZE - ALLOC_HEADER_SIZE) return NULL;
+#ifdef HAVE_THREADS
+    if (pool->caches != NULL) lock_mutex(&pool->mutex);
+#endif
+    if (ptr != NULL) {
+        link = large_link(ptr);
+        unlink_large(pool, link);
+    }
+    if (size == 0) {
+        backing->allocate(backing, link, 0);
+    } else {
+        new_link = backing->allocate(backing, link,
+            LARGE_LINK_SIZE + ALLOC_HEADER_SIZE + size);
+        if (new_link != NULL) {
+            link_large(pool, new_link);
+            result = (char*) new_link + LARGE_LINK_SIZE + ALLOC_HEADER_SIZE;
+            *alloc_header(result) = POOL_LARGE;
+        } else if (link != NULL) {
+            /* a failed resize leaves the allocation as it was */
+            link_large(pool, link);
+        }
+    }
+#ifdef HAVE_THREADS
+    if (pool->caches != NULL) unlock_mutex(&pool->mutex);
+#endif
+    return result;
+}
+
+/* Allocate, resize, or free through a pool, or a cache if it's not NULL. */
+static void *pool_resize(
+    CJPool *pool,
+    CJPoolCache *cache,
+    void *ptr,
+    size_t size
+) {
+    size_t old_class = POOL_LARGE, new_class;
+    void *result;
+    if (ptr != NULL) {
+        old_class = *alloc_header(ptr);
+        if (size == 0) {
+            if (old_class == POOL_LARGE) {
+                pool_large(pool, ptr, 0);
+            } else if (cache != NULL) {
+                cache_give(cache, ptr, old_class);
+            } else {
+                free_list_push(&pool->free[old_class], ptr);
+            }
+            return NULL;
+        }
+    }
+    new_class = pool_class(size);
+    if (new_class == POOL_LARGE) {
+        /* let the backing allocator resize in place if it can */
+        if (old_class == POOL_LARGE) return pool_large(pool, ptr, size);
+        result = pool_large(pool, NULL, size);
+        if (result == NULL) return NULL;
+    } else {
+        /* a resize within the same class needs no work */
+        if (ptr != NULL && old_class == new_class) return ptr;
+        result = cache != NULL
+            ? cache_take(cache, new_class)
+            : pool_take(pool, new_class);
+        if (result == NULL) return NULL;
+    }
+    if (ptr != NULL) {
+        /* a large allocation is larger than any class */
+        size_t old_size = old_class == POOL_LARGE ? size
+            : pool_class_size(old_class);
+        memcpy(result, ptr, old_size < size ? old_size : size);
+        pool_resize(pool, cache, ptr, 0);
+    }
+    return result;
+}
+
+static void *pool_allocate(CJAllocator *allocator, void *ptr, size_t size) {
+    CJPool *pool = cj_container_of(allocator, CJPool, allocator);
+    return pool_resize(pool, NULL, ptr, size);
+}
+
+#ifdef HAVE_THREADS
+static void *pool_cache_allocate(
+    CJAllocator *allocator,
+    void *ptr,
+    size_t size
+) {
+    CJPoolCache *cache = cj_container_of(allocator, CJPoolCache, allocator);
+    return pool_resize(cache->pool, cache, ptr, size);
+}
+#endif
+
+CJPool *cj_pool_new(CJAllocator *backing, size_t chunk_size) {
+    CJPool *pool;
+    size_t i;
+#ifdef CJ_DEFAULT_ALLOCATOR
+    if (backing == NULL) backing = &default_allocator;
+#endif
+    if (chunk_size == 0) chunk_size = CJ_POOL_CHUNK_SIZE;
+    pool = backing->allocate(backing, NULL, sizeof(CJPool));
+    if (pool == NULL) return NULL;
+#ifdef HAVE_THREADS
+    if (!init_mutex(&pool->mutex)) {
+        backing->allocate(backing, pool, 0);
+        return NULL;
+    }
+#endif
+    pool->allocator.allocate = pool_allocate;
+    pool->backing = backing;
+    pool->chunk = NULL;
+    pool->chunk_size = chunk_size;
+    for (i = 0; i < POOL_CLASSES; ++i) pool->free[i] = NULL;
+    pool->large = NULL;
+    pool->caches = NULL;
+    return pool;
+}
+
+CJAllocator *cj_pool_allocator(CJPool *pool) {
+    return &pool->allocator;
+}
+
+void cj_pool_delete(CJPool *pool) {
+    CJAllocator *backing = pool->backing;
+    struct CJArenaChunk *chunk = pool->chunk;
+    while (pool->large != NULL) {
+        LargeLink *next = pool->large->next;
+        backing->allocate(backing, pool->large, 0);
+        pool->large = next;
+    }
+    while (pool->caches != NULL) {
+        CJPoolCache *next = pool->caches->next;
+        backing->allocate(backing, pool->caches, 0);
+        pool->caches = next;
+    }
+    while (chunk != NULL) {
+        struct CJArenaChunk *prev = chunk->prev;
+        backing->allocate(backing, chunk, 0);
+        chunk = prev;
+    }
+#ifdef HAVE_THREADS
+    destroy_mutex(&pool->mutex);
+#endif
+    backing->allocate(backing, pool, 0);
+}
+
+CJPoolCache *cj_pool_cache_new(CJPool *pool) {
+#ifdef HAVE_THREADS
+    CJPoolCache *cache;
+    size_t i;
+    cache = pool->backing->allocate(pool->backing, NULL, sizeof(CJPoolCache));
+    if (cache == NULL) return NULL;
+    cache->allocator.allocate = pool_cache_allocate;
+    cache->pool = pool;
+    for (i = 0; i < POOL_CLASSES; ++i) {
+        cache->free[i] = NULL;
+        cache->free_count[i] = 0;
+    }
+    cache->prev = NULL;
+    lock_mutex(&pool->mutex);
+    cache->next = pool->caches;
+    if (pool->caches != NULL) pool->caches->prev = cache;
+    pool->caches = cache;
+    unlock_mutex(&pool->mutex);
+    return cache;
+#else
+    /* without threads there is no lock to share the pool under */
+    (void) pool;
+    return NULL;
+#endif
+}
+
+CJAllocator *cj_pool_cache_allocator(CJPoolCache *cache) {
+    return &cache->allocator;
+}
+
+void cj_pool_cache_delete(CJPoolCache *cache) {
+    CJPool *pool = cache->pool;
+    size_t i;
+#ifdef HAVE_THREADS
+    lock_mutex(&pool->mutex);
+#endif
+    for (i = 0; i < POOL_CLASSES; ++i) {
+        cache_give_back(cache, i, cache->free_count[i]);
+    }
+    if (cache->prev != NULL) {
+        cache->prev->next = cache->next;
+    } else {
+        pool->caches = cache->next;
+    }
+    if (cache->next != NULL) cache->next->prev = cache->prev;
+#ifdef HAVE_THREADS
+    unlock_mutex(&pool->mutex);
+#endif
+    pool->backing->allocate(pool->backing, cache, 0);
+}
+#endif
+
+#ifdef CJ_FILE_READER
+static const char *file_reader_callback(CJReader *reader, size_t *size) {
+    CJFileReader *file_reader = cj_container_of(reader, CJFileReader, reader);
+    *size = fread(
+        file_reader->buffer,
+        1,
+        file_reader->buffer_size,
+        file_reader->file
+    );
+    if (*size == 0) {
+        *size = !feof(file_reader->file);
+        return NULL;
+    }
+    return file_reader->buffer;
+}
+
+void cj_init_file_reader(
+    CJFileReader *file_reader,
+    FILE *file,
+    char *buffer,
+    size_t buffer_size
+) {
+    file_reader->file = file;
+    file_reader->buffer = buffer;
+    file_reader->buffer_size = buffer_size;
+    file_reader->reader.read = file_reader_callback;
+}
+#endif
+
+#ifdef CJ_STRING_READER
+static const char *string_reader_callback(CJReader *reader, size_t *size) {
+    CJStringReader *string_reader =
+        cj_container_of(reader, CJStringReader, reader);
+    if (string_reader->string == NULL) {
+        *size = 0;
+        return NULL;
+    } else {
+        const char *result = string_reader->string;
+        *size = string_reader->length;
+        string_reader->string = NULL;
+        return result;
+    }
+}
+
+void cj_init_string_reader(
+    CJStringReader *string_reader,
+    const char *string,
+    size_t length
+) {
+    string_reader->string = string;
+    string_reader->length = length;
+    string_reader->reader.read = string_reader_callback;
+}
+#endif
+
+#ifdef CJ_MAPPED_FILE_READER
+static const char *mapped_file_reader_callback(CJReader *reader, size_t *size) {
+    CJMappedFileReader *mapped_file_reader =
+        cj_container_of(reader, CJMappedFileReader, reader);
+    if (mapped_file_reader->consumed || mapped_file_reader->length == 0) {
+        *size = 0;
+        return NULL;
+    }
+    mapped_file_reader->consumed = CJ_TRUE;
+    *size = mapped_file_reader->length;
+    return mapped_file_reader->data;
+}
+
+/* The size of the first allocation when reading a file that isn't mapped. */
+#define INITIAL_FILE_CAPACITY 4096
+
+/* Read the rest of a file into memory, for when it can't be mapped. */
+static CJ_BOOL read_whole_file(
+    CJMappedFileReader *mapped_file_reader,
+    FILE *f
+) {
+    CJAllocator *allocator = mapped_file_reader->allocator;
+    size_t capacity = 0;
+    for (;;) {
+        char *data;
+        size_t new_capacity =
+            capacity == 0 ? INITIAL_FILE_CAPACITY : capacity * 2;
+        if (new_capacity < capacity) return CJ_FALSE;
+        data = allocator->allocate(allocator, mapped_file_reader->data,
+            new_capacity);
+        if (data == NULL) return CJ_FALSE;
+        mapped_file_reader->data = data;
+        capacity = new_capacity;
+        /* fread only comes up short at the end of the file or on an error */
+        mapped_file_reader->length += fread(data + mapped_file_reader->length,
+            1, capacity - mapped_file_reader->length, f);
+        if (mapped_file_reader->length < capacity) return !ferror(f);
+    }
+}
+
+/* Try to map a file, or read it if mapping it fails. */
+static CJ_BOOL map_file(
+    CJMappedFileReader *mapped_file_reader,
+    const char *path
+) {
+#if defined(MAPPING_POSIX)
+    struct stat st;
+    FILE *f;
+    CJ_BOOL result;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return CJ_FALSE;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+            && (off_t) (size_t) st.st_size == st.st_size) {
+        size_t length = (size_t) st.st_size;
+        /* a private mapping can be written to without changing the file */
+        void *data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+            fd, 0);
+        if (data != MAP_FAILED) {
+            /* it's parsed from start to end, so read ahead */
+            posix_madvise(data, length, POSIX_MADV_SEQUENTIAL);
+            posix_madvise(data, length, POSIX_MADV_WILLNEED);
+            close(fd);
+            mapped_file_reader->data = data;
+            mapped_file_reader->length = length;
+            mapped_file_reader->mapped = CJ_TRUE;
+            return CJ_TRUE;
+        }
+    }
+    f = fdopen(fd, "rb");
+    if (f == NULL) {
+        close(fd);
+        return CJ_FALSE;
+    }
+    result = read_whole_file(mapped_file_reader, f);
+    fclose(f);
+    return result;
+#else
+    FILE *f;
+    CJ_BOOL result;
+#if defined(MAPPING_WINDOWS)
+    LARGE_INTEGER size;
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return CJ_FALSE;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0
+            && (LONGLONG) (SIZE_T) size.QuadPart == size.QuadPart) {
+        /* a copy-on-write view can be written to without changing the file */
+        HANDLE mapping =
+            CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if (mapping != NULL) {
+            void *data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0,
+                (SIZE_T) size.QuadPart);
+            /* the view keeps the mapping open */
+            CloseHandle(mapping);
+            if (data != NULL) {
+                CloseHandle(file);
+                mapped_file_reader->data = data;
+                mapped_file_reader->length = (size_t) size.QuadPart;
+                mapped_file_reader->mapped = CJ_TRUE;
+                return CJ_TRUE;
+            }
+        }
+    }
+    CloseHandle(file);
+#endif
+    f = fopen(path, "rb");
+    if (f == NULL) return CJ_FALSE;
+    result = read_whole_file(mapped_file_reader, f);
+    fclose(f);
+    return result;
+#endif
+}
+
+CJ_BOOL cj_open_mapped_file_reader(
+    CJMappedFileReader *mapped_file_reader,
+    const char *path,
+    CJAllocator *allocator
+) {
+#ifdef CJ_DEFAULT_ALLOCATOR
+    if (allocator == NULL) allocator = &default_allocator;
+#endif
+    mapped_file_reader->data = NULL;
+    mapped_file_reader->length = 0;
+    mapped_file_reader->allocator = allocator;
+    mapped_file_reader->mapped = CJ_FALSE;
+    mapped_file_reader->consumed = CJ_FALSE;
+    mapped_file_reader->reader.read = mapped_file_reader_callback;
+    if (map_file(mapped_file_reader, path)) return CJ_TRUE;
+    /* free what was read before the failure */
+    if (mapped_file_reader->data != NULL) {
+        allocator->allocate(allocator, mapped_file_reader->data, 0);
+        mapped_file_reader->data = NULL;
+    }
+    return CJ_FALSE;
+}
+
+void cj_close_mapped_file_reader(CJMappedFileReader *mapped_file_reader) {
+    if (mapped_file_reader->mapped) {
+#if defined(MAPPING_POSIX)
+        munmap(mapped_file_reader->data, mapped_file_reader->length);
+#elif defined(MAPPING_WINDOWS)
+        UnmapViewOfFile(mapped_file_reader->data);
+#endif
+    } else if (mapped_file_reader->data != NULL) {
+        mapped_file_reader->allocator->allocate(mapped_file_reader->allocator,
+            mapped_file_reader->data, 0);
+    }
+    mapped_file_reader->data = NULL;
+    mapped_file_reader->length = 0;
+}
+#endif
+
+#ifdef CJ_READ_AHEAD_READER
+struct CJReadAheadReader {
+    CJReader reader;
+    /* The reader being read ahead of, and the rest of its last buffer. */
+    CJReader *source;
+    const char *pending;
+    size_t pending_length;
+    /* The allocator of this reader. */
+    CJAllocator *allocator;
+    /* The ring of buffers, and how many bytes were read into each. */
+    char *buffers;
+    size_t *lengths;
+    size_t buffer_size;
+    size_t buffer_count;
+    /* The next buffer to read, and the number of buffers after it that are
+     * filled and waiting to be read. */
+    size_t next;
+    size_t filled;
+    /* True if the buffer before the next one was returned and is in use. */
+    CJ_BOOL holding;
+    /* True once the source has ended, and if it ended with an error. */
+    CJ_BOOL ended;
+    CJ_BOOL failed;
+#ifdef HAVE_THREADS
+    /* True if the reader is being deleted, so the thread should stop. */
+    CJ_BOOL stopping;
+    /* The thread that fills the buffers, and what it is synchronized with. */
+    Thread thread;
+    Mutex mutex;
+    Condition condition;
+#endif
+};
+
+/*
+ * Fill a buffer from the source, stopping early only if the source ends.
+ * Return the length, and set ended and failed if the source ended.
+ */
+static size_t fill_read_ahead_buffer(
+    CJReadAheadReader *r,
+    char *buffer,
+    CJ_BOOL *ended,
+    CJ_BOOL *failed
+) {
+    size_t length = 0;
+    while (length < r->buffer_size) {
+        size_t n = r->buffer_size - length;
+        if (r->pending_length == 0) {
+            size_t size;
+            const char *chunk = r->source->read(r->source, &size);
+            if (chunk == NULL) {
+                *ended = CJ_TRUE;
+                *failed = size != 0;
+                break;
+            }
+            r->pending = chunk;
+            r->pending_length = size;
+        }
+        if (n > r->pending_length) n = r->pending_length;
+        memcpy(buffer + length, r->pending, n);
+        length += n;
+        r->pending += n;
+        r->pending_length -= n;
+    }
+    return length;
+}
+
+#ifdef HAVE_THREADS
+/* Fill buffers whenever one is free, until the source ends. */
+THREAD_ENTRY(read_ahead_thread) {
+    CJReadAheadReader *r = arg;
+    CJ_BOOL ended = CJ_FALSE;
+    CJ_BOOL failed = CJ_FALSE;
+    lock_mutex(&r->mutex);
+    while (!ended) {
+        size_t index, length;
+        while (!r->stopping
+                && r->filled + r->holding == r->buffer_count) {
+            wait_condition(&r->condition, &r->mutex);
+        }
+        if (r->stopping) break;
+        index = (r->next + r->filled) % r->buffer_count;
+        /* the buffer is not touched by the reader until it is filled */
+        unlock_mutex(&r->mutex);
+        length = fill_read_ahead_buffer(r,
+            r->buffers + index * r->buffer_size, &ended, &failed);
+        lock_mutex(&r->mutex);
+        r->lengths[index] = length;
+        if (length != 0) ++r->filled;
+        r->ended = ended;
+        r->failed = failed;
+        broadcast_condition(&r->condition);
+    }
+    unlock_mutex(&r->mutex);
+    THREAD_EXIT;
+}
+#endif
+
+static const char *read_ahead_reader_callback(CJReader *reader, size_t *size) {
+    CJReadAheadReader *r = cj_container_of(reader, CJReadAheadReader, reader);
+    const char *buffer;
+#ifdef HAVE_THREADS
+    lock_mutex(&r->mutex);
+    /* the last buffer is used up, so it can be filled again */
+    if (r->holding) {
+        r->holding = CJ_FALSE;
+        broadcast_condition(&r->condition);
+    }
+    while (r->filled == 0 && !r->ended) {
+        wait_condition(&r->condition, &r->mutex);
+    }
+    if (r->filled == 0) {
+        unlock_mutex(&r->mutex);
+        *size = r->failed;
+        return NULL;
+    }
+    buffer = r->buffers + r->next * r->buffer_size;
+    *size = r->lengths[r->next];
+    r->next = (r->next + 1) % r->buffer_count;
+    --r->filled;
+    r->holding = CJ_TRUE;
+    unlock_mutex(&r->mutex);
+#else
+    /* without threads, read ahead only as far as one buffer */
+    if (r->ended) {
+        *size = r->failed;
+        return NULL;
+    }
+    buffer = r->buffers;
+    *size = fill_read_ahead_buffer(r, r->buffers, &r->ended, &r->failed);
+    if (*size == 0) {
+        *size = r->failed;
+        return NULL;
+    }
+#endif
+    return buffer;
+}
+
+CJReadAheadReader *cj_read_ahead_new(
+    CJAllocator *allocator,
+    CJReader *source,
+    size_t buffer_size,
+    size_t buffer_count
+) {
+    CJReadAheadReader *r;
+#ifdef CJ_DEFAULT_ALLOCATOR
+    if (allocator == NULL) allocator = &default_allocator;
+#endif
+    if (buffer_size == 0) buffer_size = CJ_READ_AHEAD_BUFFER_SIZE;
+    if (buffer_count < 2) buffer_count = 2;
+    if (buffer_size > SIZE_MAX / buffer_count
+            || buffer_count > SIZE_MAX / sizeof(size_t)) {
+        return NULL;
+    }
+    r = allocator->allocate(allocator, NULL, sizeof(CJReadAheadReader));
+    if (r == NULL) return NULL;
+    r->reader.read = read_ahead_reader_callback;
+    r->source = source;
+    r->pending = NULL;
+    r->pending_length = 0;
+    r->allocator = allocator;
+    r->buffer_size = buffer_size;
+    r->buffer_count = buffer_count;
+    r->next = 0;
+    r->filled = 0;
+    r->holding = CJ_FALSE;
+    r->ended = CJ_FALSE;
+    r->failed = CJ_FALSE;
+    r->buffers = allocator->allocate(allocator, NULL,
+        buffer_size * buffer_count);
+    r->lengths = allocator->allocate(allocator, NULL,
+        buffer_count * sizeof(size_t));
+    if (r->buffers == NULL || r->lengths == NULL) goto fail;
+#ifdef HAVE_THREADS
+    r->stopping = CJ_FALSE;
+    if (!init_mutex(&r->mutex)) goto fail;
+    if (!init_condition(&r->condition)) {
+        destroy_mutex(&r->mutex);
+        goto fail;
+    }
+    if (!start_thread(&r->thread, read_ahead_thread, r)) {
+        destroy_condition(&r->condition);
+        destroy_mutex(&r->mutex);
+        goto fail;
+    }
+#endif
+    return r;
+fail:
+    if (r->buffers != NULL) allocator->allocate(allocator, r->buffers, 0);
+    if (r->lengths != NULL) allocator->allocate(allocator, r->lengths, 0);
+    allocator->allocate(allocator, r, 0);
+    return NULL;
+}
+
+CJReader *cj_read_ahead_reader(CJReadAheadReader *read_ahead_reader) {
+    return &read_ahead_reader->reader;
+}
+
+void cj_read_ahead_delete(CJReadAheadReader *read_ahead_reader) {
+    CJAllocator *allocator = read_ahead_reader->allocator;
+#ifdef HAVE_THREADS
+    lock_mutex(&read_ahead_reader->mutex);
+    read_ahead_reader->stopping = CJ_TRUE;
+    broadcast_condition(&read_ahead_reader->condition);
+    unlock_mutex(&read_ahead_reader->mutex);
+    join_thread(read_ahead_reader->thread);
+    destroy_condition(&read_ahead_reader->condition);
+    destroy_mutex(&read_ahead_reader->mutex);
+#endif
+    allocator->allocate(allocator, read_ahead_reader->buffers, 0);
+    allocator->allocate(allocator, read_ahead_reader->lengths, 0);
+    allocator->allocate(allocator, read_ahead_reader, 0);
+}
+#endif
+
+#ifdef CJ_FILE_WRITER
+static char *file_writer_callback(
+    CJWriter *writer,
+    size_t length,
+    size_t *size
+) {
+    CJFileWriter *file_writer = cj_container_of(writer, CJFileWriter, writer);
+    if (fwrite(file_writer->buffer, 1, length, file_writer->file) != length) {
+        return NULL;
+    }
+    if (size != NULL) *size = file_writer->buffer_size;
+    return file_writer->buffer;
+}
+
+void cj_init_file_writer(
+    CJFileWriter *file_writer,
+    FILE *file,
+    char *buffer,
+    size_t buffer_size
+) {
+    file_writer->file = file;
+    file_writer->buffer = buffer;
+    file_writer->buffer_size = buffer_size;
+    file_writer->writer.write = file_writer_callback;
+}
+#endif
+
+#ifdef CJ_BUFFER_WRITER
+/* The size of the first allocation of a buffer writer. */
+#define INITIAL_BUFFER_CAPACITY 256
+
+static char *buffer_writer_callback(
+    CJWriter *writer,
+    size_t length,
+    size_t *size
+) {
+    CJBufferWriter *buffer_writer =
+        cj_container_of(writer, CJBufferWriter, writer);
+    buffer_writer->length += length;
+    /* grow when full, leaving room for the null terminator at the end */
+    if (buffer_writer->length == buffer_writer->capacity) {
+        size_t capacity = buffer_writer->capacity == 0
+            ? INITIAL_BUFFER_CAPACITY : buffer_writer->capacity * 2;
+        char *data;
+        if (capacity < buffer_writer->capacity) return NULL;
+        data = buffer_writer->allocator->allocate(buffer_writer->allocator,
+            buffer_writer->data, capacity);
+        if (data == NULL) return NULL;
+        buffer_writer->data = data;
+        buffer_writer->capacity = capacity;
+    }
+    if (size == NULL) {
+        buffer_writer->data[buffer_writer->length] = '\0';
+        return buffer_writer->data;
+    }
+    *size = buffer_writer->capacity - buffer_writer->length;
+    return buffer_writer->data + buffer_writer->length;
+}
+
+void cj_init_buffer_writer(
+    CJBufferWriter *buffer_writer,
+    CJAllocator *allocator
+) {
+#ifdef CJ_DEFAULT_ALLOCATOR
+    if (allocator == NULL) allocator = &default_allocator;
+#endif
+    buffer_writer->allocator = allocator;
+    buffer_writer->data = NULL;
+    buffer_writer->length = 0;
+    buffer_writer->capacity = 0;
+    buffer_writer->writer.write = buffer_writer_callback;
+}
+#endif
+
+#if defined(__STDC_VERSION__)
+    #if __STDC_VERSION__ >= 201112L
+        #define ERROR_DECL static _Noreturn void error
+    #endif
+#elif defined(__clang__) || defined(__GNUC__)
+    #if __has_attribute(__noreturn__)
+        #define ERROR_DECL __attribute__((__noreturn__)) static void error
+    #endif
+#elif defined(_MSC_VER)
+    #define ERROR_DECL __declspec(noreturn) static void error
+#endif
+
+#ifdef ERROR_DECL
+#define UNREACHABLE do {} while (0)
+#else
+#define UNREACHABLE do { return 0; } while (0)
+#define ERROR_DECL static void error
+#endif
+
+ERROR_DECL(Parser *p, CJParseResult result) {
+    p->result = result;
+    longjmp(p->buf, 1);
+}
+
+static void *alloc(Parser *p, void *ptr, size_t size) {
+    void *result = p->allocator->allocate(p->allocator, ptr, size);
+    /* throw on failure */
+    if (result == NULL) error(p, CJ_OUT_OF_MEMORY);
+    return result;
+}
+
+static void dealloc(CJAllocator *allocator, void *ptr) {
+    /* avoid the allocator interpreting this as an allocation */
+    if (ptr == NULL) return;
+    allocator->allocate(allocator, ptr, 0);
+}
+
+static CJ_BOOL at_eof(const Parser *p) {
+    return p->cur == p->end;
+}
+
+/* Get the next buffer from the reader, if there is one. */
+static void refill(Parser *p) {
+    while (p->reader != NULL) {
+        size_t size;
+        const char *buf = p->reader->read(p->reader, &size);
+        STAT_ADD(p, reads, 1);
+        if (buf == NULL) {
+            if (size != 0) error(p, CJ_READ_ERROR);
+            /* don't read past EOF */
+            p->reader = NULL;
+        } else if (size != 0) {
+#ifdef CJ_STATS
+            if (p->stats != NULL) {
+                p->stats->bytes_read += size;
+                p->buffer_offset += p->end - p->buffer_start;
+                p->buffer_start = buf;
+            }
+#endif
+            p->cur = buf;
+            p->end = buf + size;
+        } else {
+            /* an empty buffer, so try again */
+            continue;
+        }
+        return;
+    }
+}
+
+/* Move to the next character. Must not be called at EOF. */
+static void advance(Parser *p) {
+    if (++p->cur == p->end) refill(p);
+}
+
+static char take_unchecked(Parser *p) {
+    char result = *p->cur;
+    advance(p);
+    return result;
+}
+
+static char take(Parser *p) {
+    if (at_eof(p)) error(p, CJ_SYNTAX_ERROR);
+    return take_unchecked(p);
+}
+
+static CJ_BOOL is_ws(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+/* Skip whitespace, using vector or word operations for long runs. */
+static const char *skip_ws_run(const char *cur, const char *end) {
+    /* most runs are empty or a single space, so check one character first */
+    if (cur == end || !is_ws(*cur)) return cur;
+    ++cur;
+#if defined(SIMD_AVX2)
+    {
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i carriage = _mm256_set1_epi8('\r');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        while (end - cur >= 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) (const void*) cur);
+            __m256i ws = _mm256_or_si256(
+                _mm256_or_si256(
+                    _mm256_cmpeq_epi8(v, space),
+                    _mm256_cmpeq_epi8(v, newline)),
+                _mm256_or_si256(
+                    _mm256_cmpeq_epi8(v, carriage),
+                    _mm256_cmpeq_epi8(v, tab)));
+            unsigned mask = ~(unsigned) _mm256_movemask_epi8(ws);
+            if (mask != 0) return cur + FIRST_SET_BIT(mask);
+            cur += 32;
+        }
+    }
+#endif
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+    {
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i carriage = _mm_set1_epi8('\r');
+        const __m128i tab = _mm_set1_epi8('\t');
+        while (end - cur >= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*) (const void*) cur);
+            __m128i ws = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_cmpeq_epi8(v, space),
+                    _mm_cmpeq_epi8(v, newline)),
+                _mm_or_si128(
+                    _mm_cmpeq_epi8(v, carriage),
+                    _mm_cmpeq_epi8(v, tab)));
+            unsigned mask = ~(unsigned) _mm_movemask_epi8(ws) & 0xFFFF;
+            if (mask != 0) {
+#ifdef FIRST_SET_BIT
+                return cur + FIRST_SET_BIT(mask);
+#else
+                break;
+#endif
+            }
+            cur += 16;
+        }
+    }
+#elif defined(SIMD_NEON)
+    {
+        const uint8x16_t space = vdupq_n_u8(' ');
+        const uint8x16_t newline = vdupq_n_u8('\n');
+        const uint8x16_t carriage = vdupq_n_u8('\r');
+        const uint8x16_t tab = vdupq_n_u8('\t');
+        while (end - cur >= 16) {
+            uint8x16_t v = vld1q_u8((const uint8_t*) cur);
+            uint8x16_t ws = vorrq_u8(
+                vorrq_u8(vceqq_u8(v, space), vceqq_u8(v, newline)),
+                vorrq_u8(vceqq_u8(v, carriage), vceqq_u8(v, tab)));
+            /* find the exact position below */
+            if (vminvq_u8(ws) == 0) break;
+            cur += 16;
+        }
+    }
+#else
+    while ((size_t) (end - cur) >= sizeof(Word)) {
+        Word w = load_word(cur);
+        Word ws = WORD_EQ_BYTES(w, ' ') | WORD_EQ_BYTES(w, '\n')
+            | WORD_EQ_BYTES(w, '\r') | WORD_EQ_BYTES(w, '\t');
+        /* find the exact position below */
+        if (ws != WORD_REPEAT(0x80)) break;
+        cur += sizeof(Word);
+    }
+#endif
+    while (cur != end && is_ws(*cur)) ++cur;
+    return cur;
+}
+
+#ifdef STRUCTURAL_INDEX
+/* The bytes of a block of 64 that are each kind of character. */
+typedef struct {
+    U64 backslash;
+    U64 quote;
+    U64 ws;
+    U64 op;
+} BlockMasks;
+
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+/* The characters matching a byte, anywhere in the block. */
+#define BLOCK_EQ(v, c) _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#define BLOCK_MASK(m) ((U64) (unsigned) _mm_movemask_epi8(m) & 0xFFFF)
+#elif defined(SIMD_NEON)
+/* Gather the high bit of each byte into a mask, like _mm_movemask_epi8. */
+static U64 neon_movemask(uint8x16_t v) {
+    static const unsigned char bits[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+    };
+    uint8x16_t t = vandq_u8(v, vld1q_u8(bits));
+    t = vpaddq_u8(t, t);
+    t = vpaddq_u8(t, t);
+    t = vpaddq_u8(t, t);
+    return vgetq_lane_u16(vreinterpretq_u16_u8(t), 0);
+}
+#endif
+
+/*
+ * Classify the characters of a block. Besides []{}:, the operators include
+ * only the characters that are the same as [ or ] after setting bit 5.
+ */
+static void classify_block(const char *block, BlockMasks *m) {
+    int i;
+    m->backslash = m->quote = m->ws = m->op = 0;
+#if defined(SIMD_AVX2)
+    for (i = 0; i < 64; i += 32) {
+        __m256i v =
+            _mm256_loadu_si256((const __m256i*) (const void*) (block + i));
+        __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i ws = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+                _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+        m->backslash |= (U64) (unsigned) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << i;
+        m->quote |= (U64) (unsigned) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << i;
+        m->ws |= (U64) (unsigned) _mm256_movemask_epi8(ws) << i;
+        m->op |= (U64) (unsigned) _mm256_movemask_epi8(op) << i;
+    }
+#elif defined(SIMD_SSE2)
+    for (i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (const void*) (block + i));
+        __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(BLOCK_EQ(v, ' '), BLOCK_EQ(v, '\n')),
+            _mm_or_si128(BLOCK_EQ(v, '\r'), BLOCK_EQ(v, '\t')));
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(BLOCK_EQ(folded, '{'), BLOCK_EQ(folded, '}')),
+            _mm_or_si128(BLOCK_EQ(v, ':'), BLOCK_EQ(v, ',')));
+        m->backslash |= BLOCK_MASK(BLOCK_EQ(v, '\\')) << i;
+        m->quote |= BLOCK_MASK(BLOCK_EQ(v, '"')) << i;
+        m->ws |= BLOCK_MASK(ws) << i;
+        m->op |= BLOCK_MASK(op) << i;
+    }
+#elif defined(SIMD_NEON)
+    for (i = 0; i < 64; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*) block + i);
+        uint8x16_t folded = vorrq_u8(v, vdupq_n_u8(0x20));
+        uint8x16_t ws = vorrq_u8(
+            vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')),
+                vceqq_u8(v, vdupq_n_u8('\n'))),
+            vorrq_u8(vceqq_u8(v, vdupq_n_u8('\r')),
+                vceqq_u8(v, vdupq_n_u8('\t'))));
+        uint8x16_t op = vorrq_u8(
+            vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')),
+                vceqq_u8(folded, vdupq_n_u8('}'))),
+            vorrq_u8(vceqq_u8(v, vdupq_n_u8(':')),
+                vceqq_u8(v, vdupq_n_u8(','))));
+        m->backslash |= neon_movemask(vceqq_u8(v, vdupq_n_u8('\\'))) << i;
+        m->quote |= neon_movemask(vceqq_u8(v, vdupq_n_u8('"'))) << i;
+        m->ws |= neon_movemask(ws) << i;
+        m->op |= neon_movemask(op) << i;
+    }
+#else
+    for (i = 0; i < 64; ++i) {
+        U64 bit = (U64) 1 << i;
+        switch (block[i]) {
+            case '\\': m->backslash |= bit; break;
+            case '"': m->quote |= bit; break;
+            case ' ': case '\n': case '\r': case '\t': m->ws |= bit; break;
+            case '[': case ']': case '{': case '}': case ':': case ',':
+                m->op |= bit;
+                break;
+            default:
+                break;
+        }
+    }
+#endif
+}
+
+/* Each bit is the parity of the set bits at or below it. */
+static U64 prefix_xor(U64 x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/* The characters of a block that are escaped by a backslash. */
+static U64 find_escaped(StructuralIndex *si, U64 backslash) {
+    const U64 even_bits = U64_C(0x55555555, 0x55555555);
+    U64 follows_escape, odd_starts, even_starts;
+    /* a backslash escaped from the last block can't escape anything */
+    backslash &= ~si->prev_escaped;
+    follows_escape = backslash << 1 | si->prev_escaped;
+    /*
+     * Adding the start of a run of backslashes to the run carries out of the
+     * end of it, which has the parity of its length once the runs starting on
+     * odd and even bits are told apart.
+     */
+    odd_starts = backslash & ~even_bits & ~follows_escape;
+    even_starts = odd_starts + backslash;
+    si->prev_escaped = even_starts < backslash;
+    return (even_bits ^ (even_starts << 1)) & follows_escape;
+}
+
+/* Find the positions of the tokens in a block starting at the given place. */
+static void index_block(
+    StructuralIndex *si,
+    const char *block,
+    const char *at
+) {
+    BlockMasks m;
+    U64 in_string, tail, scalar, follows_scalar, starts;
+    classify_block(block, &m);
+    m.quote &= ~find_escaped(si, m.backslash);
+    /* the opening quotes are in strings, while the closing ones are not */
+    in_string = prefix_xor(m.quote) ^ si->prev_in_string;
+    si->prev_in_string = (U64) 0 - (in_string >> 63);
+    tail = in_string ^ m.quote;
+    /* numbers and literals start after anything other than part of one */
+    scalar = ~(m.op | m.ws);
+    follows_scalar = (scalar & ~m.quote) << 1 | si->prev_scalar;
+    si->prev_scalar = (scalar & ~m.quote) >> 63;
+    starts = (m.op | (scalar & ~follows_scalar)) & ~tail;
+    if (starts != 0) {
+        const char **out = si->positions + si->count;
+        do {
+            *out++ = at + FIRST_SET_BIT64(starts);
+            starts &= starts - 1;
+        } while (starts != 0);
+        si->count = out - si->positions;
+    }
+}
+
+/* Index the next window of the buffer, replacing the positions of the last. */
+static void index_window(StructuralIndex *si) {
+    size_t i, length = si->end - si->indexed;
+    si->window = si->indexed;
+    si->count = 0;
+    si->next = 0;
+    if (length > STRUCTURAL_WINDOW) length = STRUCTURAL_WINDOW;
+    for (i = 0; i + 64 <= length; i += 64) {
+        index_block(si, si->indexed + i, si->indexed + i);
+    }
+    if (i != length) {
+        /* whitespace doesn't start anything, so pad the last block with it */
+        char block[64];
+        memset(block, ' ', sizeof(block));
+        memcpy(block, si->indexed + i, length - i);
+        index_block(si, block, si->indexed + i);
+    }
+    si->indexed += length;
+}
+
+/* Set up the index of a buffer, with nothing indexed yet. */
+static void init_structural_index(
+    StructuralIndex *si,
+    const char *start,
+    const char *end,
+    const char **positions
+) {
+    si->start = start;
+    si->indexed = start;
+    si->end = end;
+    si->window = start;
+    si->positions = positions;
+    si->count = 0;
+    si->next = 0;
+    si->prev_escaped = 0;
+    si->prev_in_string = 0;
+    si->prev_scalar = 0;
+}
+
+/* Find the first token at or after a position, or the end of the buffer. */
+static const char *next_structural(StructuralIndex *si, const char *cur) {
+    for (;;) {
+        while (si->next != si->count && si->positions[si->next] < cur) {
+            ++si->next;
+        }
+        if (si->next != si->count) return si->positions[si->next];
+        if (si->indexed == si->end) return si->end;
+        index_window(si);
+    }
+}
+
+/*
+ * Skip whitespace using the index. Whitespace outside of strings is always
+ * followed by whitespace or the start of a token, so if the parser is at any
+ * whitespace, the next token is where it stops.
+ */
+static void skip_indexed(Parser *p) {
+    if (!at_eof(p) && is_ws(*p->cur)) {
+        p->cur = next_structural(p->structurals, p->cur);
+    }
+}
+#endif
+
+static void skip_ws(Parser *p) {
+#ifdef STRUCTURAL_INDEX
+    if (p->structurals != NULL) {
+        skip_indexed(p);
+        return;
+    }
+#endif
+    for (;;) {
+        p->cur = skip_ws_run(p->cur, p->end);
+        if (!at_eof(p) || p->reader == NULL) return;
+        /* ran out of buffer, so get more */
+        refill(p);
+    }
+}
+
+static CJ_BOOL check(Parser *p, char c) {
+    return p->cur != p->end && *p->cur == c;
+}
+
+static CJ_BOOL eat(Parser *p, char c) {
+    if (check(p, c)) {
+        advance(p);
+        return CJ_TRUE;
+    }
+    return CJ_FALSE;
+}
+
+static void require(Parser *p, char c) {
+    if (!check(p, c)) error(p, CJ_SYNTAX_ERROR);
+    advance(p);
+}
+
+/* starting capacities for the parser's scratch buffers */
+#define INITIAL_STACK_CAPACITY 16
+#define INITIAL_CHARS_CAPACITY 64
+
+/*
+ * The string used for the empty strings made by cj, which are not allocated.
+ * Any other string is freed by cj_free, whatever its length.
+ */
+static char empty_string[1] = { '\0' };
+
+/* Grow a scratch buffer so that it has room for at least one more element. */
+static void *grow_scratch(
+    Parser *p,
+    void *ptr,
+    size_t *cap,
+    size_t initial_cap,
+    size_t child_size
+) {
+    size_t new_cap = *cap == 0 ? initial_cap : *cap * 2;
+    /* guard against overflow */
+    if (new_cap < *cap || new_cap > SIZE_MAX / child_size) {
+        error(p, CJ_OUT_OF_MEMORY);
+    }
+    ptr = p->scratch_allocator->allocate(p->scratch_allocator, ptr,
+        new_cap * child_size);
+    if (ptr == NULL) error(p, CJ_OUT_OF_MEMORY);
+    STAT_ADD(p, scratch_growths, 1);
+    *cap = new_cap;
+    return ptr;
+}
+
+/*
+ * Push a null value onto the value stack and return its index. Values on the
+ * stack are always valid, so that they can be freed if an error occurs.
+ */
+static size_t push_value(Parser *p) {
+    if (p->stack_len == p->stack_cap) {
+        p->stack = grow_scratch(p, p->stack, &p->stack_cap,
+            INITIAL_STACK_CAPACITY, sizeof(CJValue));
+    }
+    p->stack[p->stack_len].type = CJ_NULL;
+    p->stack[p->stack_len].flags = 0;
+    return p->stack_len++;
+}
+
+static void push_char(Parser *p, char c) {
+    if (p->chars_len == p->chars_cap) {
+        p->chars = grow_scratch(p, p->chars, &p->chars_cap,
+            INITIAL_CHARS_CAPACITY, 1);
+    }
+    p->chars[p->chars_len++] = c;
+}
+
+/* Append a run of characters to the character buffer. */
+static void push_chars(Parser *p, const char *chars, size_t length) {
+    while (p->chars_cap - p->chars_len < length) {
+        p->chars = grow_scratch(p, p->chars, &p->chars_cap,
+            INITIAL_CHARS_CAPACITY, 1);
+    }
+    memcpy(p->chars + p->chars_len, chars, length);
+    p->chars_len += length;
+}
+
+/*
+ * Copy the string at the given offset of the character buffer out to an
+ * exact-size allocation, and pop it.
+ */
+static void finish_string(Parser *p, CJString *str, size_t start) {
+    size_t length = p->chars_len - start;
+    if (length == 0) {
+        str->chars = empty_string;
+    } else {
+        str->chars = alloc(p, NULL, length + 1);
+        memcpy(str->chars, p->chars + start, length);
+        str->chars[length] = '\0';
+    }
+    str->length = length;
+    p->chars_len = start;
+}
+
+/*
+ * Strings in arrays and objects up to this long are packed into the allocation
+ * of their container instead of being allocated separately.
+ */
+#define PACKED_STRING_MAX 15
+
+/*
+ * Leave a short string at the given offset of the character buffer to be
+ * packed into its container. Until then, it is borrowed with no characters.
+ */
+static void pend_string(Parser *p, CJValue *value, size_t start) {
+    value->flags = CJ_VALUE_BORROWED;
+    value->as.string.chars = NULL;
+    value->as.string.length = p->chars_len - start;
+    push_char(p, '\0');
+}
+
+/* Check if a value is a string waiting to be packed into its container. */
+static CJ_BOOL is_pending(const CJValue *value) {
+    return value->type == CJ_STRING && value->as.string.chars == NULL;
+}
+
+/*
+ * Copy the pending strings of a container's children to the given location,
+ * and pop them from the character buffer. Each container's pending strings are
+ * in the same order as the children they belong to.
+ */
+static void pack_strings(Parser *p, size_t start, char *packed) {
+    if (p->chars_len == start) return;
+    memcpy(packed, p->chars + start, p->chars_len - start);
+    p->chars_len = start;
+}
+
+/* The FNV-1a hash of a key. */
+static size_t hash_key(const char *key, size_t length) {
+    unsigned long hash = 2166136261UL;
+    size_t i;
+    for (i = 0; i < length; ++i) {
+        hash ^= (unsigned char) key[i];
+        hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return hash;
+}
+
+/* Get the reference count in front of an interned key. */
+static size_t *key_refs(const char *chars) {
+    return (size_t*) (void*) chars - 1;
+}
+
+/* Grow the table of interned keys, reinserting the keys in it. */
+static void grow_interned(Parser *p) {
+    size_t i, cap = p->interned_cap == 0 ? 64 : p->interned_cap * 2;
+    InternedKey *table;
+    if (cap > SIZE_MAX / sizeof(InternedKey)) error(p, CJ_OUT_OF_MEMORY);
+    table = p->scratch_allocator->allocate(p->scratch_allocator, NULL,
+        cap * sizeof(InternedKey));
+    if (table == NULL) error(p, CJ_OUT_OF_MEMORY);
+    for (i = 0; i < cap; ++i) table[i].chars = NULL;
+    for (i = 0; i < p->interned_cap; ++i) {
+        const InternedKey *key = &p->interned[i];
+        if (key->chars != NULL) {
+            size_t slot = hash_key(key->chars, key->length) & (cap - 1);
+            while (table[slot].chars != NULL) slot = (slot + 1) & (cap - 1);
+            table[slot] = *key;
+        }
+    }
+    dealloc(p->scratch_allocator, p->interned);
+    p->interned = table;
+    p->interned_cap = cap;
+}
+
+/*
+ * Replace the key at the given offset of the character buffer with a shared,
+ * reference counted copy of it, and pop it.
+ */
+static void intern_key(Parser *p, CJValue *value, size_t start) {
+    const char *chars = p->chars + start;
+    size_t length = p->chars_len - start;
+    size_t slot;
+    size_t *refs;
+    /* keep the table at most half full */
+    if (p->interned_len >= p->interned_cap / 2) grow_interned(p);
+    slot = hash_key(chars, length) & (p->interned_cap - 1);
+    for (; p->interned[slot].chars != NULL;
+            slot = (slot + 1) & (p->interned_cap - 1)) {
+        const InternedKey *key = &p->interned[slot];
+        if (key->length == length && memcmp(key->chars, chars, length) == 0) {
+            ++*key_refs(key->chars);
+            value->as.string.chars = key->chars;
+            value->as.string.length = length;
+            value->flags = CJ_VALUE_SHARED;
+            p->chars_len = start;
+            return;
+        }
+    }
+    if (length > SIZE_MAX - sizeof(size_t) - 1) error(p, CJ_OUT_OF_MEMORY);
+    refs = alloc(p, NULL, sizeof(size_t) + length + 1);
+    *refs = 1;
+    value->as.string.chars = (char*) (refs + 1);
+    memcpy(value->as.string.chars, chars, length);
+    value->as.string.chars[length] = '\0';
+    value->as.string.length = length;
+    value->flags = CJ_VALUE_SHARED;
+    p->interned[slot].chars = value->as.string.chars;
+    p->interned[slot].length = length;
+    ++p->interned_len;
+    p->chars_len = start;
+}
+
+/*
+ * Append decoded characters to the current string. When decoding in place, the
+ * decoded string is never longer than its escaped form, so the characters
+ * never overtake the input.
+ */
+static void push_string_chars(Parser *p, const char *chars, size_t length) {
+    STAT_ADD(p, string_bytes, length);
+    if (p->in_situ) {
+        /* when only validating, the characters are not kept anywhere */
+        if (p->in_situ_dst == NULL) return;
+        if (p->in_situ_dst != chars) memmove(p->in_situ_dst, chars, length);
+        p->in_situ_dst += length;
+    } else {
+        push_chars(p, chars, length);
+    }
+}
+
+static void push_codepoint_unchecked(Parser *p, Codepoint codepoint) {
+    char buf[4];
+    size_t length;
+    if (codepoint < 0x80) {
+        buf[0] = codepoint;
+        length = 1;
+    } else if (codepoint < 0x800) {
+        buf[0] = 0xC0 | (codepoint >> 6);
+        buf[1] = 0x80 | (codepoint & 0x3F);
+        length = 2;
+    } else if (codepoint < 0x10000) {
+        buf[0] = 0xE0 | (codepoint >> 12);
+        buf[1] = 0x80 | ((codepoint >> 6) & 0x3F);
+        buf[2] = 0x80 | (codepoint & 0x3F);
+        length = 3;
+    } else {
+        buf[0] = 0xF0 | (codepoint >> 18);
+        buf[1] = 0x80 | ((codepoint >> 12) & 0x3F);
+        buf[2] = 0x80 | ((codepoint >> 6) & 0x3F);
+        buf[3] = 0x80 | (codepoint & 0x3F);
+        length = 4;
+    }
+    push_string_chars(p, buf, length);
+}
+
+/* Get the value of a hex digit. */
+static Codepoint hex_value(Parser *p, char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    error(p, CJ_SYNTAX_ERROR);
+    UNREACHABLE;
+}
+
+static Codepoint hex_digit(Parser *p) {
+    return hex_value(p, take(p));
+}
+
+static void push_codepoint(Parser *p, Codepoint codepoint) {
+    if (codepoint > 0x10FFFF) {
+        error(p, CJ_SYNTAX_ERROR);
+    }
+    push_codepoint_unchecked(p, codepoint);
+}
+
+/* Get the character that an escape stands for, given the one after the '\\'. */
+static char escaped_char(Parser *p, char c) {
+    switch (c) {
+        case '"': case '\\': case '/': return c;
+        case 'b': return '\b';
+        case 'f': return '\f';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        default:
+            error(p, CJ_SYNTAX_ERROR);
+            UNREACHABLE;
+    }
+}
+
+static char read_escaped_codepoint(Parser *p) {
+    return escaped_char(p, take(p));
+}
+
+static void utf8_check_cont(Parser *p, Codepoint *codepoint) {
+    char c;
+    if (at_eof(p)) error(p, CJ_SYNTAX_ERROR);
+    c = *p->cur;
+    if (((c & 0x80) == 0) || (c & 0x40)) error(p, CJ_SYNTAX_ERROR);
     *codepoint <<= 6;
     *codepoint |= c & 0x3F;
     advance(p);
 }
 
-static Codepoint overlong_check(
-    Parser *p,
-    Codepoint codepoint,
-    Codepoint mask,
-    Codepoint min
-) {
-    codepoint &= mask;
-    if (codepoint <= min) error(p, CJ_SYNTAX_ERROR);
-    return codepoint;
+static Codepoint overlong_check(
+    Parser *p,
+    Codepoint codepoint,
+    Codepoint mask,
+    Codepoint min
+) {
+    codepoint &= mask;
+    if (codepoint <= min) error(p, CJ_SYNTAX_ERROR);
+    return codepoint;
+}
+
+static Codepoint read_utf8_codepoint(Parser *p) {
+    Codepoint codepoint;
+    char b = take(p);
+    if ((b & (1 << 7)) == 0) {
+        if (b < ' ') error(p, CJ_SYNTAX_ERROR);
+        return b;
+    }
+    if ((b & (1 << 6)) == 0) error(p, CJ_SYNTAX_ERROR);
+    codepoint = b & 0x7F;
+    utf8_check_cont(p, &codepoint);
+    if ((b & (1 << 5)) == 0) {
+        return overlong_check(p, codepoint, 0x7FF, 0x7F);
+    }
+    utf8_check_cont(p, &codepoint);
+    if ((b & (1 << 4)) == 0) {
+        return overlong_check(p, codepoint, 0xFFFF, 0x7FF);
+    }
+    utf8_check_cont(p, &codepoint);
+    if ((b & (1 << 3)) == 0) {
+        return overlong_check(p, codepoint, 0x1FFFFF, 0xFFFF);
+    }
+    /* too many bytes! */
+    error(p, CJ_SYNTAX_ERROR);
+}
+
+/*
+ * Push a UTF-16 code unit from an escape, combining surrogate pairs. A high
+ * half is kept in pending until the next character is known.
+ */
+static void push_utf16_unit(Parser *p, Codepoint current, Codepoint *pending) {
+    /* if it's a surrogate half... */
+    if ((current >> 11) == 0x1B) {
+        /* low or high? */
+        if (current & 0x400) {
+            if (*pending != -1) {
+                /* if pending high half, combine them */
+                Codepoint high = ((*pending & 0x3FF) << 10) + 0x10000;
+                push_codepoint(p, high | (current & 0x3FF));
+            } else {
+                /* print current */
+                push_codepoint(p, current);
+            }
+            /* nothing pending anymore */
+            *pending = -1;
+        } else {
+            /* print pending */
+            if (*pending != -1) push_codepoint(p, *pending);
+            /* store high half in pending */
+            *pending = current;
+        }
+    } else {
+        /* print pending */
+        if (*pending != -1) push_codepoint(p, *pending);
+        /* not a surrogate half, so print as is */
+        push_codepoint(p, current);
+        /* nothing pending anymore */
+        *pending = -1;
+    }
+}
+
+static void utf16_escape(Parser *p, Codepoint *pending) {
+    /* read four hex digits */
+    Codepoint current
+        = (hex_digit(p) << 12)
+        | (hex_digit(p) << 8)
+        | (hex_digit(p) << 4)
+        | hex_digit(p);
+    push_utf16_unit(p, current, pending);
+}
+
+/*
+ * Skip printable ASCII other than quotes and backslashes, using vector or word
+ * operations to check many characters at once.
+ */
+static const char *skip_plain_ascii(const char *cur, const char *end) {
+#if defined(SIMD_AVX2)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i space = _mm256_set1_epi8(' ');
+    while (end - cur >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (const void*) cur);
+        /* bytes below space as signed are control characters or not ASCII */
+        __m256i special = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(v, quote),
+                _mm256_cmpeq_epi8(v, backslash)),
+            _mm256_cmpgt_epi8(space, v));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(special);
+        if (mask != 0) return cur + FIRST_SET_BIT(mask);
+        cur += 32;
+    }
+#endif
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+    {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i space = _mm_set1_epi8(' ');
+        while (end - cur >= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*) (const void*) cur);
+            /* bytes below space as signed are control or non-ASCII bytes */
+            __m128i special = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_cmpeq_epi8(v, quote),
+                    _mm_cmpeq_epi8(v, backslash)),
+                _mm_cmplt_epi8(v, space));
+            unsigned mask = (unsigned) _mm_movemask_epi8(special);
+            if (mask != 0) {
+#ifdef FIRST_SET_BIT
+                return cur + FIRST_SET_BIT(mask);
+#else
+                break;
+#endif
+            }
+            cur += 16;
+        }
+    }
+#elif defined(SIMD_NEON)
+    {
+        const uint8x16_t quote = vdupq_n_u8('"');
+        const uint8x16_t backslash = vdupq_n_u8('\\');
+        const uint8x16_t space = vdupq_n_u8(' ');
+        const uint8x16_t high = vdupq_n_u8(0x80);
+        while (end - cur >= 16) {
+            uint8x16_t v = vld1q_u8((const uint8_t*) cur);
+            uint8x16_t special = vorrq_u8(
+                vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)),
+                vorrq_u8(vcltq_u8(v, space), vcgeq_u8(v, high)));
+            /* find the exact position below */
+            if (vmaxvq_u8(special) != 0) break;
+            cur += 16;
+        }
+    }
+#else
+    while ((size_t) (end - cur) >= sizeof(Word)) {
+        Word w = load_word(cur);
+        /* find the exact position below */
+        if ((WORD_HAS_LESS(w, ' ') | (w & WORD_REPEAT(0x80))
+                | WORD_HAS_BYTE(w, '"') | WORD_HAS_BYTE(w, '\\')) != 0) {
+            break;
+        }
+        cur += sizeof(Word);
+    }
+#endif
+    while (cur != end) {
+        unsigned char c = *cur;
+        if (c < ' ' || c >= 0x80 || c == '"' || c == '\\') break;
+        ++cur;
+    }
+    return cur;
+}
+
+/*
+ * Get the length of the valid multi-byte UTF-8 sequence at cur, or 0 if it is
+ * invalid or extends past the end of the buffer. This accepts exactly what
+ * read_utf8_codepoint and push_codepoint accept.
+ */
+static size_t utf8_sequence_length(const char *cur, const char *end) {
+    const unsigned char *u = (const unsigned char*) cur;
+    size_t available = end - cur;
+    if (u[0] < 0xC2) {
+        /* continuation bytes and overlong two-byte sequences */
+        return 0;
+    } else if (u[0] < 0xE0) {
+        if (available < 2 || (u[1] & 0xC0) != 0x80) return 0;
+        return 2;
+    } else if (u[0] < 0xF0) {
+        if (available < 3 || (u[1] & 0xC0) != 0x80 || (u[2] & 0xC0) != 0x80) {
+            return 0;
+        }
+        /* overlong */
+        if (u[0] == 0xE0 && u[1] < 0xA0) return 0;
+        return 3;
+    } else if (u[0] < 0xF5) {
+        if (available < 4 || (u[1] & 0xC0) != 0x80 || (u[2] & 0xC0) != 0x80
+                || (u[3] & 0xC0) != 0x80) {
+            return 0;
+        }
+        /* overlong, or above U+10FFFF */
+        if (u[0] == 0xF0 && u[1] < 0x90) return 0;
+        if (u[0] == 0xF4 && u[1] >= 0x90) return 0;
+        return 4;
+    }
+    return 0;
+}
+
+/*
+ * Find the end of a run of characters that can be copied into a string as is:
+ * that is, printable ASCII other than quotes and backslashes, and valid UTF-8.
+ */
+static const char *scan_string_run(const char *cur, const char *end) {
+    for (;;) {
+        unsigned char c;
+        cur = skip_plain_ascii(cur, end);
+        /* text that isn't ASCII tends to stay that way, so stay here for it */
+        while (cur != end && (unsigned char) *cur >= 0x80) {
+            /* leave anything invalid or incomplete for the slow path */
+            size_t length = utf8_sequence_length(cur, end);
+            if (length == 0) return cur;
+            cur += length;
+        }
+        if (cur == end) return cur;
+        c = *cur;
+        if (c < ' ' || c == '"' || c == '\\') return cur;
+    }
+}
+
+/* Parse a string into the character buffer, or in place. */
+static void parse_string(Parser *p) {
+    Codepoint pending = -1;
+    for (;;) {
+        Codepoint codepoint;
+        const char *run = scan_string_run(p->cur, p->end);
+        if (run != p->cur) {
+            if (pending != -1) {
+                push_codepoint(p, pending);
+                pending = -1;
+            }
+            push_string_chars(p, p->cur, run - p->cur);
+            p->cur = run;
+            if (at_eof(p)) refill(p);
+            continue;
+        }
+        if (eat(p, '"')) break;
+        if (eat(p, '\\')) {
+            STAT_ADD(p, escapes, 1);
+            if (eat(p, 'u')) {
+                utf16_escape(p, &pending);
+                continue;
+            }
+            codepoint = read_escaped_codepoint(p);
+        } else {
+            codepoint = read_utf8_codepoint(p);
+        }
+        if (pending != -1) {
+            push_codepoint(p, pending);
+            pending = -1;
+        }
+        push_codepoint(p, codepoint);
+    }
+    if (pending != -1) push_codepoint(p, pending);
+}
+
+/*
+ * Store the string at the given offset of the character buffer in the value at
+ * the given stack index, which is an object key if key is set.
+ */
+static void finish_string_value(
+    Parser *p,
+    size_t index,
+    CJ_BOOL key,
+    size_t start
+) {
+    CJValue *value = &p->stack[index];
+    size_t length = p->chars_len - start;
+    if (length == 0) {
+        finish_string(p, &value->as.string, start);
+    } else if (key && (p->flags & CJ_PARSE_INTERN_KEYS)) {
+        intern_key(p, value, start);
+    } else if (index != 0 && length <= PACKED_STRING_MAX) {
+        /* strings in the root value's children have a container */
+        pend_string(p, value, start);
+    } else {
+        finish_string(p, &value->as.string, start);
+    }
+    value->type = CJ_STRING;
+}
+
+/*
+ * Parse a string value into the value at the given stack index, which is an
+ * object key if key is set.
+ */
+static void parse_string_value(Parser *p, size_t index, CJ_BOOL key) {
+    CJValue *value;
+    if (p->in_situ) {
+        /* the input is known to be mutable */
+        char *start = (char*) p->cur;
+        p->in_situ_dst = start;
+        parse_string(p);
+        /* the closing quote is at or after the end of the decoded string */
+        *p->in_situ_dst = '\0';
+        value = &p->stack[index];
+        value->flags = CJ_VALUE_BORROWED;
+        value->as.string.chars = start;
+        value->as.string.length = p->in_situ_dst - start;
+        value->type = CJ_STRING;
+    } else {
+        size_t start = p->chars_len;
+        parse_string(p);
+        finish_string_value(p, index, key, start);
+    }
+}
+
+/*
+ * Arrays and objects are built on the value stack, with their elements (or
+ * keys and values, in pairs) pushed above the slot for the container itself.
+ * Once the container is finished, its children are copied to an exact-size
+ * allocation and popped, so the stack is shared by all levels of nesting.
+ */
+
+/* Open an array or object at the given stack index. */
+static void push_frame(Parser *p, size_t index, CJ_BOOL object) {
+    Frame *frame;
+    if (p->frames_len == p->frames_cap) {
+        p->frames = grow_scratch(p, p->frames, &p->frames_cap,
+            INITIAL_STACK_CAPACITY, sizeof(Frame));
+    }
+    frame = &p->frames[p->frames_len++];
+    frame->index = index;
+    frame->chars_start = p->chars_len;
+    frame->count = 0;
+    frame->object = object;
+}
+
+/*
+ * Start walking the children of a built array or object, and return its walk,
+ * which is only valid until the next one is pushed.
+ */
+static Walk *push_walk(Parser *p, const CJValue *value) {
+    Walk *walk;
+    if (p->walks_len == p->walks_cap) {
+        p->walks = grow_scratch(p, p->walks, &p->walks_cap,
+            INITIAL_STACK_CAPACITY, sizeof(Walk));
+    }
+    walk = &p->walks[p->walks_len++];
+    walk->value = value;
+    walk->next = 0;
+    walk->copy = NULL;
+    walk->start = 0;
+    return walk;
+}
+
+/*
+ * Copy the elements above the given stack index out to the array there, along
+ * with their pending strings, which start at the given offset.
+ */
+static void finish_array(Parser *p, size_t index, size_t chars_start) {
+    size_t i, length;
+    CJValue *elements = NULL;
+    length = p->stack_len - index - 1;
+    if (length != 0) {
+        char *packed;
+        elements = alloc(p, NULL,
+            length * sizeof(CJValue) + (p->chars_len - chars_start));
+        memcpy(elements, &p->stack[index + 1], length * sizeof(CJValue));
+        p->stack_len = index + 1;
+        /* the pending strings go after the elements */
+        packed = (char*) (elements + length);
+        for (i = 0; i < length; ++i) {
+            if (is_pending(&elements[i])) {
+                elements[i].as.string.chars = packed;
+                packed += elements[i].as.string.length + 1;
+            }
+        }
+        pack_strings(p, chars_start, (char*) (elements + length));
+    }
+    p->stack[index].as.array.length = length;
+    p->stack[index].as.array.elements = elements;
+    p->stack[index].type = CJ_ARRAY;
+}
+
+/*
+ * Objects with at least this many members get a hash index after their members
+ * when it is asked for, so that cj_object_get doesn't need to scan them.
+ */
+#define INDEX_MIN_MEMBERS 16
+
+/*
+ * The hash index of an object. It is followed by mask + 1 slots, which each
+ * hold one more than the position of a member, or 0 if empty. Members are
+ * inserted in order with linear probing, so duplicate keys are found in order.
+ */
+typedef struct {
+    size_t mask;
+} ObjectIndex;
+
+/* Get the number of slots for an object index, or 0 if it can't have one. */
+static size_t index_slots(size_t length) {
+    size_t slots = INDEX_MIN_MEMBERS;
+    if (length < INDEX_MIN_MEMBERS || length >= UINT_MAX) return 0;
+    /* keep the table at most half full */
+    while (slots / 2 < length) {
+        if (slots > SIZE_MAX / 2) return 0;
+        slots *= 2;
+    }
+    return slots;
+}
+
+/* Get the size of an object index, or 0 if it can't have one. */
+static size_t index_size(size_t length) {
+    size_t slots = index_slots(length);
+    size_t members_size = length * sizeof(CJObjectMember);
+    if (slots == 0) return 0;
+    if (slots > (SIZE_MAX - members_size - sizeof(ObjectIndex))
+            / sizeof(unsigned)) {
+        return 0;
+    }
+    return sizeof(ObjectIndex) + slots * sizeof(unsigned);
+}
+
+static ObjectIndex *object_index(const CJObject *object) {
+    return (ObjectIndex*) (void*) (object->members + object->length);
+}
+
+static unsigned *index_slot_array(ObjectIndex *index) {
+    return (unsigned*) (void*) (index + 1);
+}
+
+/* Fill in the hash index of an object that has room for one. */
+static void build_index(CJObject *object) {
+    ObjectIndex *index = object_index(object);
+    unsigned *slots = index_slot_array(index);
+    size_t i;
+    memset(slots, 0, (index->mask + 1) * sizeof(unsigned));
+    for (i = 0; i < object->length; ++i) {
+        const CJString *key = &object->members[i].key;
+        size_t slot = hash_key(key->chars, key->length) & index->mask;
+        while (slots[slot] != 0) slot = (slot + 1) & index->mask;
+        slots[slot] = i + 1;
+    }
+}
+
+/* Check whether two members of an object have the same key. */
+static CJ_BOOL has_duplicate_keys(const CJValue *object) {
+    const CJObject *obj = &object->as.object;
+    size_t i, j;
+    if (object->flags & CJ_VALUE_INDEXED) {
+        ObjectIndex *index = object_index(obj);
+        const unsigned *slots = index_slot_array(index);
+        /* the first member found with each key must be that member */
+        for (i = 0; i < obj->length; ++i) {
+            const CJString *key = &obj->members[i].key;
+            j = hash_key(key->chars, key->length) & index->mask;
+            for (;; j = (j + 1) & index->mask) {
+                const CJString *other = &obj->members[slots[j] - 1].key;
+                if (other->length == key->length
+                        && memcmp(other->chars, key->chars, key->length) == 0) {
+                    break;
+                }
+            }
+            if (slots[j] - 1 != i) return CJ_TRUE;
+        }
+        return CJ_FALSE;
+    }
+    for (i = 1; i < obj->length; ++i) {
+        const CJString *key = &obj->members[i].key;
+        for (j = 0; j < i; ++j) {
+            const CJString *other = &obj->members[j].key;
+            if (other->length == key->length
+                    && memcmp(other->chars, key->chars, key->length) == 0) {
+                return CJ_TRUE;
+            }
+        }
+    }
+    return CJ_FALSE;
+}
+
+/*
+ * Copy the keys and values above the given stack index out to the object
+ * there, along with their pending strings, which start at the given offset.
+ */
+static void finish_object(Parser *p, size_t index, size_t chars_start) {
+    size_t i, length;
+    CJObjectMember *members = NULL;
+    length = (p->stack_len - index - 1) / 2;
+    if (length != 0) {
+        const CJValue *pairs = &p->stack[index + 1];
+        /* the index is also used to find duplicate keys */
+        size_t extra = (p->flags
+            & (CJ_PARSE_INDEX_OBJECTS | CJ_PARSE_REJECT_DUPLICATES))
+            ? index_size(length) : 0;
+        size_t size = length * sizeof(CJObjectMember) + extra;
+        char *packed;
+        if (p->chars_len - chars_start > SIZE_MAX - size) {
+            error(p, CJ_OUT_OF_MEMORY);
+        }
+        members = alloc(p, NULL, size + (p->chars_len - chars_start));
+        /* the pending strings go after the members and the index */
+        packed = (char*) members + size;
+        for (i = 0; i < length; ++i) {
+            CJObjectMember *member = &members[i];
+            member->key = pairs[2 * i].as.string;
+            member->value = pairs[2 * i + 1];
+            if (is_pending(&pairs[2 * i])) {
+                member->key.chars = packed;
+                packed += member->key.length + 1;
+            }
+            if (is_pending(&member->value)) {
+                member->value.as.string.chars = packed;
+                packed += member->value.as.string.length + 1;
+            }
+            if (pairs[2 * i].flags & CJ_VALUE_BORROWED) {
+                member->value.flags |= CJ_VALUE_BORROWED_KEY;
+            } else if (pairs[2 * i].flags & CJ_VALUE_SHARED) {
+                member->value.flags |= CJ_VALUE_SHARED_KEY;
+            }
+        }
+        p->stack_len = index + 1;
+        pack_strings(p, chars_start, (char*) members + size);
+        if (extra != 0) {
+            ObjectIndex *object_index = (ObjectIndex*) (void*)
+                (members + length);
+            object_index->mask = index_slots(length) - 1;
+            p->stack[index].flags |= CJ_VALUE_INDEXED;
+        }
+    }
+    p->stack[index].as.object.length = length;
+    p->stack[index].as.object.members = members;
+    p->stack[index].type = CJ_OBJECT;
+    /* the index is built now, as searches must not modify the object */
+    if (p->stack[index].flags & CJ_VALUE_INDEXED) {
+        build_index(&p->stack[index].as.object);
+    }
+    /* the object is on the stack, so it is freed along with the rest */
+    if ((p->flags & CJ_PARSE_REJECT_DUPLICATES)
+            && has_duplicate_keys(&p->stack[index])) {
+        error(p, CJ_DUPLICATE_KEY);
+    }
+}
+
+static CJ_BOOL is_digit(Parser *p) {
+    if (at_eof(p)) return CJ_FALSE;
+    return *p->cur >= '0' && *p->cur <= '9';
+}
+
+/* Take a character of a number, copying it to the character buffer if asked. */
+static void take_number_char(Parser *p, CJ_BOOL copy) {
+    char c = take_unchecked(p);
+    if (copy) push_char(p, c);
+}
+
+static void require_digits(Parser *p, CJ_BOOL copy) {
+    if (!is_digit(p)) error(p, CJ_SYNTAX_ERROR);
+    do {
+        /* copy the digits in this buffer all at once */
+        const char *cur = p->cur;
+        while (cur != p->end && *cur >= '0' && *cur <= '9') ++cur;
+        if (copy) push_chars(p, p->cur, cur - p->cur);
+        p->cur = cur;
+        if (!at_eof(p)) break;
+        refill(p);
+    } while (is_digit(p));
+}
+
+/*
+ * Check the syntax of a number without converting it, copying its text to the
+ * character buffer if asked.
+ */
+static void scan_number_text(Parser *p, CJ_BOOL copy) {
+    /* negative sign */
+    if (check(p, '-')) take_number_char(p, copy);
+    /* integer part */
+    if (check(p, '0')) {
+        take_number_char(p, copy);
+    } else {
+        require_digits(p, copy);
+    }
+    /* fraction part */
+    if (check(p, '.')) {
+        take_number_char(p, copy);
+        require_digits(p, copy);
+    }
+    /* exponent part */
+    if (check(p, 'e') || check(p, 'E')) {
+        take_number_char(p, copy);
+        if (check(p, '-') || check(p, '+')) {
+            take_number_char(p, copy);
+        }
+        require_digits(p, copy);
+    }
+}
+
+#ifdef FAST_NUMBERS
+/*
+ * Numbers are converted straight from the input. The first 19 significant
+ * digits are accumulated in a 64-bit integer, and then converted using one of
+ * these methods, from fastest to slowest:
+ *
+ * - If the integer and the power of ten are both exactly representable as a
+ *   double, a single multiplication or division is exact.
+ * - Otherwise, the Eisel-Lemire algorithm multiplies by a 128-bit
+ *   approximation of the power of five, which is enough to round correctly in
+ *   all but a few cases that it can detect.
+ * - If that fails, or there are too many digits to decide how to round, the
+ *   digits are written out in a small local buffer for strtod.
+ */
+
+/* The number of significant digits that fit in the integer. */
+#define MANTISSA_DIGITS 19
+
+/*
+ * The maximum number of significant digits that affect the conversion. Beyond
+ * this, it only matters if there are any nonzero digits.
+ */
+#define NUMBER_MAX_DIGITS 768
+
+/* The limit for exponents and digit counts, beyond which they saturate. */
+#define EXPONENT_LIMIT (LONG_MAX / 4)
+
+/* The bits of a double. */
+#define DOUBLE_MANTISSA_BITS 52
+#define DOUBLE_INFINITE_POWER 0x7FF
+
+/* A decimal number being converted. */
+typedef struct {
+    /* The first MANTISSA_DIGITS significant digits. */
+    U64 mantissa;
+    /* The number of significant digits. */
+    long digits;
+    /* The decimal exponent of the last significant digit. */
+    long exponent;
+    /* True if any digit not in the mantissa is nonzero. */
+    CJ_BOOL inexact;
+    /* True if any digit not in the mantissa or extra digits is nonzero. */
+    CJ_BOOL lost;
+    /* The significant digits after those in the mantissa. */
+    size_t extra_len;
+    char extra[NUMBER_MAX_DIGITS - MANTISSA_DIGITS];
+} Decimal;
+
+static void add_extra_digit(Decimal *d, int digit) {
+    if (d->extra_len < sizeof(d->extra)) {
+        d->extra[d->extra_len++] = '0' + digit;
+    } else if (digit != 0) {
+        d->lost = CJ_TRUE;
+    }
+    if (digit != 0) d->inexact = CJ_TRUE;
+    if (d->digits < EXPONENT_LIMIT) ++d->digits;
+}
+
+/* Scan a run of digits, which is after the decimal point if fraction is set. */
+static void scan_digits(Parser *p, Decimal *d, CJ_BOOL fraction) {
+    if (!is_digit(p)) error(p, CJ_SYNTAX_ERROR);
+    for (;;) {
+        const char *cur = p->cur;
+        while (cur != p->end && *cur >= '0' && *cur <= '9') {
+            int digit = *cur++ - '0';
+            if (d->digits >= MANTISSA_DIGITS) {
+                add_extra_digit(d, digit);
+            } else if (d->digits != 0 || digit != 0) {
+                /* leading zeros in the fraction are not significant */
+                d->mantissa = d->mantissa * 10 + digit;
+                ++d->digits;
+            }
+            if (fraction && d->exponent > -EXPONENT_LIMIT) --d->exponent;
+        }
+        p->cur = cur;
+        if (!at_eof(p)) return;
+        refill(p);
+        if (!is_digit(p)) return;
+    }
+}
+
+/* The result of multiplying two 64-bit integers. */
+typedef struct {
+    U64 high;
+    U64 low;
+} U128;
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 Wide;
+#endif
+
+static U128 full_multiply(U64 a, U64 b) {
+    U128 result;
+#ifdef __SIZEOF_INT128__
+    Wide product = (Wide) a * b;
+    result.high = (U64) (product >> 64);
+    result.low = (U64) product;
+#else
+    const U64 mask = 0xFFFFFFFF;
+    U64 lo_lo = (a & mask) * (b & mask);
+    U64 hi_lo = (a >> 32) * (b & mask);
+    U64 lo_hi = (a & mask) * (b >> 32);
+    U64 hi_hi = (a >> 32) * (b >> 32);
+    U64 cross = (lo_lo >> 32) + (hi_lo & mask) + lo_hi;
+    result.high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    result.low = (cross << 32) | (lo_lo & mask);
+#endif
+    return result;
+}
+
+static int leading_zeros(U64 x) {
+    int n = 0;
+    int shift;
+    for (shift = 32; shift != 0; shift /= 2) {
+        if ((x >> (64 - shift)) == 0) {
+            n += shift;
+            x <<= shift;
+        }
+    }
+    return n;
+}
+
+/* An approximation of floor(log2(5^q)) + 63, for -342 <= q <= 308. */
+static long power_of_two(long q) {
+    long x = 217706L * q;
+    /* floor division, without relying on shifting negative numbers */
+    return (x >= 0 ? x / 65536 : -((65535 - x) / 65536)) + 63;
+}
+
+/* The range of powers of ten that don't always round to zero or infinity. */
+#define SMALLEST_POWER_OF_TEN (-342)
+#define LARGEST_POWER_OF_TEN 308
+/* The largest power of ten needed to format a double. */
+#define LARGEST_FORMATTED_POWER 324
+
+#define POW5(a, b, c, d) { U64_C(a, b), U64_C(c, d) }
+
+/*
+ * 128-bit approximations of the powers of five from SMALLEST_POWER_OF_TEN to
+ * LARGEST_FORMATTED_POWER, normalized so that the highest bit is set. They are
+ * truncated, except from 5^-27 to 5^-1, which are rounded up.
+ */
+static const U128 powers_of_five[] = {
+    POW5(0xeef453d6, 0x923bd65a, 0x113faa29, 0x06a13b3f),
+    POW5(0x9558b466, 0x1b6565f8, 0x4ac7ca59, 0xa424c507),
+    POW5(0xbaaee17f, 0xa23ebf76, 0x5d79bcf0, 0x0d2df649),
+    POW5(0xe95a99df, 0x8ace6f53, 0xf4d82c2c, 0x107973dc),
+    POW5(0x91d8a02b, 0xb6c10594, 0x79071b9b, 0x8a4be869),
+    POW5(0xb64ec836, 0xa47146f9, 0x9748e282, 0x6cdee284),
+    POW5(0xe3e27a44, 0x4d8d98b7, 0xfd1b1b23, 0x08169b25),
+    POW5(0x8e6d8c6a, 0xb0787f72, 0xfe30f0f5, 0xe50e20f7),
+    POW5(0xb208ef85, 0x5c969f4f, 0xbdbd2d33, 0x5e51a935),
+    POW5(0xde8b2b66, 0xb3bc4723, 0xad2c7880, 0x35e61382),
+    POW5(0x8b16fb20, 0x3055ac76, 0x4c3bcb50, 0x21afcc31),
+    POW5(0xaddcb9e8, 0x3c6b1793, 0xdf4abe24, 0x2a1bbf3d),
+    POW5(0xd953e862, 0x4b85dd78, 0xd71d6dad, 0x34a2af0d),
+    POW5(0x87d4713d, 0x6f33aa6b, 0x8672648c, 0x40e5ad68),
+    POW5(0xa9c98d8c, 0xcb009506, 0x680efdaf, 0x511f18c2),
+    POW5(0xd43bf0ef, 0xfdc0ba48, 0x0212bd1b, 0x2566def2),
+    POW5(0x84a57695, 0xfe98746d, 0x014bb630, 0xf7604b57),
+    POW5(0xa5ced43b, 0x7e3e9188, 0x419ea3bd, 0x35385e2d),
+    POW5(0xcf42894a, 0x5dce35ea, 0x52064cac, 0x828675b9),
+    POW5(0x818995ce, 0x7aa0e1b2, 0x7343efeb, 0xd1940993),
+    POW5(0xa1ebfb42, 0x19491a1f, 0x1014ebe6, 0xc5f90bf8),
+    POW5(0xca66fa12, 0x9f9b60a6, 0xd41a26e0, 0x77774ef6),
+    POW5(0xfd00b897, 0x478238d0, 0x8920b098, 0x955522b4),
+    POW5(0x9e20735e, 0x8cb16382, 0x55b46e5f, 0x5d5535b0),
+    POW5(0xc5a89036, 0x2fddbc62, 0xeb2189f7, 0x34aa831d),
+    POW5(0xf712b443, 0xbbd52b7b, 0xa5e9ec75, 0x01d523e4),
+    POW5(0x9a6bb0aa, 0x55653b2d, 0x47b233c9, 0x2125366e),
+    POW5(0xc1069cd4, 0xeabe89f8, 0x999ec0bb, 0x696e840a),
+    POW5(0xf148440a, 0x256e2c76, 0xc00670ea, 0x43ca250d),
+    POW5(0x96cd2a86, 0x5764dbca, 0x38040692, 0x6a5e5728),
+    POW5(0xbc807527, 0xed3e12bc, 0xc6050837, 0x04f5ecf2),
+    POW5(0xeba09271, 0xe88d976b, 0xf7864a44, 0xc633682e),
+    POW5(0x93445b87, 0x31587ea3, 0x7ab3ee6a, 0xfbe0211d),
+    POW5(0xb8157268, 0xfdae9e4c, 0x5960ea05, 0xbad82964),
+    POW5(0xe61acf03, 0x3d1a45df, 0x6fb92487, 0x298e33bd),
+    POW5(0x8fd0c162, 0x06306bab, 0xa5d3b6d4, 0x79f8e056),
+    POW5(0xb3c4f1ba, 0x87bc8696, 0x8f48a489, 0x9877186c),
+    POW5(0xe0b62e29, 0x29aba83c, 0x331acdab, 0xfe94de87),
+    POW5(0x8c71dcd9, 0xba0b4925, 0x9ff0c08b, 0x7f1d0b14),
+    POW5(0xaf8e5410, 0x288e1b6f, 0x07ecf0ae, 0x5ee44dd9),
+    POW5(0xdb71e914, 0x32b1a24a, 0xc9e82cd9, 0xf69d6150),
+    POW5(0x892731ac, 0x9faf056e, 0xbe311c08, 0x3a225cd2),
+    POW5(0xab70fe17, 0xc79ac6ca, 0x6dbd630a, 0x48aaf406),
+    POW5(0xd64d3d9d, 0xb981787d, 0x092cbbcc, 0xdad5b108),
+    POW5(0x85f04682, 0x93f0eb4e, 0x25bbf560, 0x08c58ea5),
+    POW5(0xa76c5823, 0x38ed2621, 0xaf2af2b8, 0x0af6f24e),
+    POW5(0xd1476e2c, 0x07286faa, 0x1af5af66, 0x0db4aee1),
+    POW5(0x82cca4db, 0x847945ca, 0x50d98d9f, 0xc890ed4d),
+    POW5(0xa37fce12, 0x6597973c, 0xe50ff107, 0xbab528a0),
+    POW5(0xcc5fc196, 0xfefd7d0c, 0x1e53ed49, 0xa96272c8),
+    POW5(0xff77b1fc, 0xbebcdc4f, 0x25e8e89c, 0x13bb0f7a),
+    POW5(0x9faacf3d, 0xf73609b1, 0x77b19161, 0x8c54e9ac),
+    POW5(0xc795830d, 0x75038c1d, 0xd59df5b9, 0xef6a2417),
+    POW5(0xf97ae3d0, 0xd2446f25, 0x4b057328, 0x6b44ad1d),
+    POW5(0x9becce62, 0x836ac577, 0x4ee367f9, 0x430aec32),
+    POW5(0xc2e801fb, 0x244576d5, 0x229c41f7, 0x93cda73f),
+    POW5(0xf3a20279, 0xed56d48a, 0x6b435275, 0x78c1110f),
+    POW5(0x9845418c, 0x345644d6, 0x830a1389, 0x6b78aaa9),
+    POW5(0xbe5691ef, 0x416bd60c, 0x23cc986b, 0xc656d553),
+    POW5(0xedec366b, 0x11c6cb8f, 0x2cbfbe86, 0xb7ec8aa8),
+    POW5(0x94b3a202, 0xeb1c3f39, 0x7bf7d714, 0x32f3d6a9),
+    POW5(0xb9e08a83, 0xa5e34f07, 0xdaf5ccd9, 0x3fb0cc53),
+    POW5(0xe858ad24, 0x8f5c22c9, 0xd1b3400f, 0x8f9cff68),
+    POW5(0x91376c36, 0xd99995be, 0x23100809, 0xb9c21fa1),
+    POW5(0xb5854744, 0x8ffffb2d, 0xabd40a0c, 0x2832a78a),
+    POW5(0xe2e69915, 0xb3fff9f9, 0x16c90c8f, 0x323f516c),
+    POW5(0x8dd01fad, 0x907ffc3b, 0xae3da7d9, 0x7f6792e3),
+    POW5(0xb1442798, 0xf49ffb4a, 0x99cd11cf, 0xdf41779c),
+    POW5(0xdd95317f, 0x31c7fa1d, 0x40405643, 0xd711d583),
+    POW5(0x8a7d3eef, 0x7f1cfc52, 0x482835ea, 0x666b2572),
+    POW5(0xad1c8eab, 0x5ee43b66, 0xda324365, 0x0005eecf),
+    POW5(0xd863b256, 0x369d4a40, 0x90bed43e, 0x40076a82),
+    POW5(0x873e4f75, 0xe2224e68, 0x5a7744a6, 0xe804a291),
+    POW5(0xa90de353, 0x5aaae202, 0x711515d0, 0xa205cb36),
+    POW5(0xd3515c28, 0x31559a83, 0x0d5a5b44, 0xca873e03),
+    POW5(0x8412d999, 0x1ed58091, 0xe858790a, 0xfe9486c2),
+    POW5(0xa5178fff, 0x668ae0b6, 0x626e974d, 0xbe39a872),
+    POW5(0xce5d73ff, 0x402d98e3, 0xfb0a3d21, 0x2dc8128f),
+    POW5(0x80fa687f, 0x881c7f8e, 0x7ce66634, 0xbc9d0b99),
+    POW5(0xa139029f, 0x6a239f72, 0x1c1fffc1, 0xebc44e80),
+    POW5(0xc9874347, 0x44ac874e, 0xa327ffb2, 0x66b56220),
+    POW5(0xfbe91419, 0x15d7a922, 0x4bf1ff9f, 0x0062baa8),
+    POW5(0x9d71ac8f, 0xada6c9b5, 0x6f773fc3, 0x603db4a9),
+    POW5(0xc4ce17b3, 0x99107c22, 0xcb550fb4, 0x384d21d3),
+    POW5(0xf6019da0, 0x7f549b2b, 0x7e2a53a1, 0x46606a48),
+    POW5(0x99c10284, 0x4f94e0fb, 0x2eda7444, 0xcbfc426d),
+    POW5(0xc0314325, 0x637a1939, 0xfa911155, 0xfefb5308),
+    POW5(0xf03d93ee, 0xbc589f88, 0x793555ab, 0x7eba27ca),
+    POW5(0x96267c75, 0x35b763b5, 0x4bc1558b, 0x2f3458de),
+    POW5(0xbbb01b92, 0x83253ca2, 0x9eb1aaed, 0xfb016f16),
+    POW5(0xea9c2277, 0x23ee8bcb, 0x465e15a9, 0x79c1cadc),
+    POW5(0x92a1958a, 0x7675175f, 0x0bfacd89, 0xec191ec9),
+    POW5(0xb749faed, 0x14125d36, 0xcef980ec, 0x671f667b),
+    POW5(0xe51c79a8, 0x5916f484, 0x82b7e127, 0x80e7401a),
+    POW5(0x8f31cc09, 0x37ae58d2, 0xd1b2ecb8, 0xb0908810),
+    POW5(0xb2fe3f0b, 0x8599ef07, 0x861fa7e6, 0xdcb4aa15),
+    POW5(0xdfbdcece, 0x67006ac9, 0x67a791e0, 0x93e1d49a),
+    POW5(0x8bd6a141, 0x006042bd, 0xe0c8bb2c, 0x5c6d24e0),
+    POW5(0xaecc4991, 0x4078536d, 0x58fae9f7, 0x73886e18),
+    POW5(0xda7f5bf5, 0x90966848, 0xaf39a475, 0x506a899e),
+    POW5(0x888f9979, 0x7a5e012d, 0x6d8406c9, 0x52429603),
+    POW5(0xaab37fd7, 0xd8f58178, 0xc8e5087b, 0xa6d33b83),
+    POW5(0xd5605fcd, 0xcf32e1d6, 0xfb1e4a9a, 0x90880a64),
+    POW5(0x855c3be0, 0xa17fcd26, 0x5cf2eea0, 0x9a55067f),
+    POW5(0xa6b34ad8, 0xc9dfc06f, 0xf42faa48, 0xc0ea481e),
+    POW5(0xd0601d8e, 0xfc57b08b, 0xf13b94da, 0xf124da26),
+    POW5(0x823c1279, 0x5db6ce57, 0x76c53d08, 0xd6b70858),
+    POW5(0xa2cb1717, 0xb52481ed, 0x54768c4b, 0x0c64ca6e),
+    POW5(0xcb7ddcdd, 0xa26da268, 0xa9942f5d, 0xcf7dfd09),
+    POW5(0xfe5d5415, 0x0b090b02, 0xd3f93b35, 0x435d7c4c),
+    POW5(0x9efa548d, 0x26e5a6e1, 0xc47bc501, 0x4a1a6daf),
+    POW5(0xc6b8e9b0, 0x709f109a, 0x359ab641, 0x9ca1091b),
+    POW5(0xf867241c, 0x8cc6d4c0, 0xc30163d2, 0x03c94b62),
+    POW5(0x9b407691, 0xd7fc44f8, 0x79e0de63, 0x425dcf1d),
+    POW5(0xc2109436, 0x4dfb5636, 0x985915fc, 0x12f542e4),
+    POW5(0xf294b943, 0xe17a2bc4, 0x3e6f5b7b, 0x17b2939d),
+    POW5(0x979cf3ca, 0x6cec5b5a, 0xa705992c, 0xeecf9c42),
+    POW5(0xbd8430bd, 0x08277231, 0x50c6ff78, 0x2a838353),
+    POW5(0xece53cec, 0x4a314ebd, 0xa4f8bf56, 0x35246428),
+    POW5(0x940f4613, 0xae5ed136, 0x871b7795, 0xe136be99),
+    POW5(0xb9131798, 0x99f68584, 0x28e2557b, 0x59846e3f),
+    POW5(0xe757dd7e, 0xc07426e5, 0x331aeada, 0x2fe589cf),
+    POW5(0x9096ea6f, 0x3848984f, 0x3ff0d2c8, 0x5def7621),
+    POW5(0xb4bca50b, 0x065abe63, 0x0fed077a, 0x756b53a9),
+    POW5(0xe1ebce4d, 0xc7f16dfb, 0xd3e84959, 0x12c62894),
+    POW5(0x8d3360f0, 0x9cf6e4bd, 0x64712dd7, 0xabbbd95c),
+    POW5(0xb080392c, 0xc4349dec, 0xbd8d794d, 0x96aacfb3),
+    POW5(0xdca04777, 0xf541c567, 0xecf0d7a0, 0xfc5583a0),
+    POW5(0x89e42caa, 0xf9491b60, 0xf41686c4, 0x9db57244),
+    POW5(0xac5d37d5, 0xb79b6239, 0x311c2875, 0xc522ced5),
+    POW5(0xd77485cb, 0x25823ac7, 0x7d633293, 0x366b828b),
+    POW5(0x86a8d39e, 0xf77164bc, 0xae5dff9c, 0x02033197),
+    POW5(0xa8530886, 0xb54dbdeb, 0xd9f57f83, 0x0283fdfc),
+    POW5(0xd267caa8, 0x62a12d66, 0xd072df63, 0xc324fd7b),
+    POW5(0x8380dea9, 0x3da4bc60, 0x4247cb9e, 0x59f71e6d),
+    POW5(0xa4611653, 0x8d0deb78, 0x52d9be85, 0xf074e608),
+    POW5(0xcd795be8, 0x70516656, 0x67902e27, 0x6c921f8b),
+    POW5(0x806bd971, 0x4632dff6, 0x00ba1cd8, 0xa3db53b6),
+    POW5(0xa086cfcd, 0x97bf97f3, 0x80e8a40e, 0xccd228a4),
+    POW5(0xc8a883c0, 0xfdaf7df0, 0x6122cd12, 0x8006b2cd),
+    POW5(0xfad2a4b1, 0x3d1b5d6c, 0x796b8057, 0x20085f81),
+    POW5(0x9cc3a6ee, 0xc6311a63, 0xcbe33036, 0x74053bb0),
+    POW5(0xc3f490aa, 0x77bd60fc, 0xbedbfc44, 0x11068a9c),
+    POW5(0xf4f1b4d5, 0x15acb93b, 0xee92fb55, 0x15482d44),
+    POW5(0x99171105, 0x2d8bf3c5, 0x751bdd15, 0x2d4d1c4a),
+    POW5(0xbf5cd546, 0x78eef0b6, 0xd262d45a, 0x78a0635d),
+    POW5(0xef340a98, 0x172aace4, 0x86fb8971, 0x16c87c34),
+    POW5(0x9580869f, 0x0e7aac0e, 0xd45d35e6, 0xae3d4da0),
+    POW5(0xbae0a846, 0xd2195712, 0x89748360, 0x59cca109),
+    POW5(0xe998d258, 0x869facd7, 0x2bd1a438, 0x703fc94b),
+    POW5(0x91ff8377, 0x5423cc06, 0x7b6306a3, 0x4627ddcf),
+    POW5(0xb67f6455, 0x292cbf08, 0x1a3bc84c, 0x17b1d542),
+    POW5(0xe41f3d6a, 0x7377eeca, 0x20caba5f, 0x1d9e4a93),
+    POW5(0x8e938662, 0x882af53e, 0x547eb47b, 0x7282ee9c),
+    POW5(0xb23867fb, 0x2a35b28d, 0xe99e619a, 0x4f23aa43),
+    POW5(0xdec681f9, 0xf4c31f31, 0x6405fa00, 0xe2ec94d4),
+    POW5(0x8b3c113c, 0x38f9f37e, 0xde83bc40, 0x8dd3dd04),
+    POW5(0xae0b158b, 0x4738705e, 0x9624ab50, 0xb148d445),
+    POW5(0xd98ddaee, 0x19068c76, 0x3badd624, 0xdd9b0957),
+    POW5(0x87f8a8d4, 0xcfa417c9, 0xe54ca5d7, 0x0a80e5d6),
+    POW5(0xa9f6d30a, 0x038d1dbc, 0x5e9fcf4c, 0xcd211f4c),
+    POW5(0xd47487cc, 0x8470652b, 0x7647c320, 0x0069671f),
+    POW5(0x84c8d4df, 0xd2c63f3b, 0x29ecd9f4, 0x0041e073),
+    POW5(0xa5fb0a17, 0xc777cf09, 0xf4681071, 0x00525890),
+    POW5(0xcf79cc9d, 0xb955c2cc, 0x7182148d, 0x4066eeb4),
+    POW5(0x81ac1fe2, 0x93d599bf, 0xc6f14cd8, 0x48405530),
+    POW5(0xa21727db, 0x38cb002f, 0xb8ada00e, 0x5a506a7c),
+    POW5(0xca9cf1d2, 0x06fdc03b, 0xa6d90811, 0xf0e4851c),
+    POW5(0xfd442e46, 0x88bd304a, 0x908f4a16, 0x6d1da663),
+    POW5(0x9e4a9cec, 0x15763e2e, 0x9a598e4e, 0x043287fe),
+    POW5(0xc5dd4427, 0x1ad3cdba, 0x40eff1e1, 0x853f29fd),
+    POW5(0xf7549530, 0xe188c128, 0xd12bee59, 0xe68ef47c),
+    POW5(0x9a94dd3e, 0x8cf578b9, 0x82bb74f8, 0x301958ce),
+    POW5(0xc13a148e, 0x3032d6e7, 0xe36a5236, 0x3c1faf01),
+    POW5(0xf18899b1, 0xbc3f8ca1, 0xdc44e6c3, 0xcb279ac1),
+    POW5(0x96f5600f, 0x15a7b7e5, 0x29ab103a, 0x5ef8c0b9),
+    POW5(0xbcb2b812, 0xdb11a5de, 0x7415d448, 0xf6b6f0e7),
+    POW5(0xebdf6617, 0x91d60f56, 0x111b495b, 0x3464ad21),
+    POW5(0x936b9fce, 0xbb25c995, 0xcab10dd9, 0x00beec34),
+    POW5(0xb84687c2, 0x69ef3bfb, 0x3d5d514f, 0x40eea742),
+    POW5(0xe65829b3, 0x046b0afa, 0x0cb4a5a3, 0x112a5112),
+    POW5(0x8ff71a0f, 0xe2c2e6dc, 0x47f0e785, 0xeaba72ab),
+    POW5(0xb3f4e093, 0xdb73a093, 0x59ed2167, 0x65690f56),
+    POW5(0xe0f218b8, 0xd25088b8, 0x306869c1, 0x3ec3532c),
+    POW5(0x8c974f73, 0x83725573, 0x1e414218, 0xc73a13fb),
+    POW5(0xafbd2350, 0x644eeacf, 0xe5d1929e, 0xf90898fa),
+    POW5(0xdbac6c24, 0x7d62a583, 0xdf45f746, 0xb74abf39),
+    POW5(0x894bc396, 0xce5da772, 0x6b8bba8c, 0x328eb783),
+    POW5(0xab9eb47c, 0x81f5114f, 0x066ea92f, 0x3f326564),
+    POW5(0xd686619b, 0xa27255a2, 0xc80a537b, 0x0efefebd),
+    POW5(0x8613fd01, 0x45877585, 0xbd06742c, 0xe95f5f36),
+    POW5(0xa798fc41, 0x96e952e7, 0x2c481138, 0x23b73704),
+    POW5(0xd17f3b51, 0xfca3a7a0, 0xf75a1586, 0x2ca504c5),
+    POW5(0x82ef8513, 0x3de648c4, 0x9a984d73, 0xdbe722fb),
+    POW5(0xa3ab6658, 0x0d5fdaf5, 0xc13e60d0, 0xd2e0ebba),
+    POW5(0xcc963fee, 0x10b7d1b3, 0x318df905, 0x079926a8),
+    POW5(0xffbbcfe9, 0x94e5c61f, 0xfdf17746, 0x497f7052),
+    POW5(0x9fd561f1, 0xfd0f9bd3, 0xfeb6ea8b, 0xedefa633),
+    POW5(0xc7caba6e, 0x7c5382c8, 0xfe64a52e, 0xe96b8fc0),
+    POW5(0xf9bd690a, 0x1b68637b, 0x3dfdce7a, 0xa3c673b0),
+    POW5(0x9c1661a6, 0x51213e2d, 0x06bea10c, 0xa65c084e),
+    POW5(0xc31bfa0f, 0xe5698db8, 0x486e494f, 0xcff30a62),
+    POW5(0xf3e2f893, 0xdec3f126, 0x5a89dba3, 0xc3efccfa),
+    POW5(0x986ddb5c, 0x6b3a76b7, 0xf8962946, 0x5a75e01c),
+    POW5(0xbe895233, 0x86091465, 0xf6bbb397, 0xf1135823),
+    POW5(0xee2ba6c0, 0x678b597f, 0x746aa07d, 0xed582e2c),
+    POW5(0x94db4838, 0x40b717ef, 0xa8c2a44e, 0xb4571cdc),
+    POW5(0xba121a46, 0x50e4ddeb, 0x92f34d62, 0x616ce413),
+    POW5(0xe896a0d7, 0xe51e1566, 0x77b020ba, 0xf9c81d17),
+    POW5(0x915e2486, 0xef32cd60, 0x0ace1474, 0xdc1d122e),
+    POW5(0xb5b5ada8, 0xaaff80b8, 0x0d819992, 0x132456ba),
+    POW5(0xe3231912, 0xd5bf60e6, 0x10e1fff6, 0x97ed6c69),
+    POW5(0x8df5efab, 0xc5979c8f, 0xca8d3ffa, 0x1ef463c1),
+    POW5(0xb1736b96, 0xb6fd83b3, 0xbd308ff8, 0xa6b17cb2),
+    POW5(0xddd0467c, 0x64bce4a0, 0xac7cb3f6, 0xd05ddbde),
+    POW5(0x8aa22c0d, 0xbef60ee4, 0x6bcdf07a, 0x423aa96b),
+    POW5(0xad4ab711, 0x2eb3929d, 0x86c16c98, 0xd2c953c6),
+    POW5(0xd89d64d5, 0x7a607744, 0xe871c7bf, 0x077ba8b7),
+    POW5(0x87625f05, 0x6c7c4a8b, 0x11471cd7, 0x64ad4972),
+    POW5(0xa93af6c6, 0xc79b5d2d, 0xd598e40d, 0x3dd89bcf),
+    POW5(0xd389b478, 0x79823479, 0x4aff1d10, 0x8d4ec2c3),
+    POW5(0x843610cb, 0x4bf160cb, 0xcedf722a, 0x585139ba),
+    POW5(0xa54394fe, 0x1eedb8fe, 0xc2974eb4, 0xee658828),
+    POW5(0xce947a3d, 0xa6a9273e, 0x733d2262, 0x29feea32),
+    POW5(0x811ccc66, 0x8829b887, 0x0806357d, 0x5a3f525f),
+    POW5(0xa163ff80, 0x2a3426a8, 0xca07c2dc, 0xb0cf26f7),
+    POW5(0xc9bcff60, 0x34c13052, 0xfc89b393, 0xdd02f0b5),
+    POW5(0xfc2c3f38, 0x41f17c67, 0xbbac2078, 0xd443ace2),
+    POW5(0x9d9ba783, 0x2936edc0, 0xd54b944b, 0x84aa4c0d),
+    POW5(0xc5029163, 0xf384a931, 0x0a9e795e, 0x65d4df11),
+    POW5(0xf64335bc, 0xf065d37d, 0x4d4617b5, 0xff4a16d5),
+    POW5(0x99ea0196, 0x163fa42e, 0x504bced1, 0xbf8e4e45),
+    POW5(0xc06481fb, 0x9bcf8d39, 0xe45ec286, 0x2f71e1d6),
+    POW5(0xf07da27a, 0x82c37088, 0x5d767327, 0xbb4e5a4c),
+    POW5(0x964e858c, 0x91ba2655, 0x3a6a07f8, 0xd510f86f),
+    POW5(0xbbe226ef, 0xb628afea, 0x890489f7, 0x0a55368b),
+    POW5(0xeadab0ab, 0xa3b2dbe5, 0x2b45ac74, 0xccea842e),
+    POW5(0x92c8ae6b, 0x464fc96f, 0x3b0b8bc9, 0x0012929d),
+    POW5(0xb77ada06, 0x17e3bbcb, 0x09ce6ebb, 0x40173744),
+    POW5(0xe5599087, 0x9ddcaabd, 0xcc420a6a, 0x101d0515),
+    POW5(0x8f57fa54, 0xc2a9eab6, 0x9fa94682, 0x4a12232d),
+    POW5(0xb32df8e9, 0xf3546564, 0x47939822, 0xdc96abf9),
+    POW5(0xdff97724, 0x70297ebd, 0x59787e2b, 0x93bc56f7),
+    POW5(0x8bfbea76, 0xc619ef36, 0x57eb4edb, 0x3c55b65a),
+    POW5(0xaefae514, 0x77a06b03, 0xede62292, 0x0b6b23f1),
+    POW5(0xdab99e59, 0x958885c4, 0xe95fab36, 0x8e45eced),
+    POW5(0x88b402f7, 0xfd75539b, 0x11dbcb02, 0x18ebb414),
+    POW5(0xaae103b5, 0xfcd2a881, 0xd652bdc2, 0x9f26a119),
+    POW5(0xd59944a3, 0x7c0752a2, 0x4be76d33, 0x46f0495f),
+    POW5(0x857fcae6, 0x2d8493a5, 0x6f70a440, 0x0c562ddb),
+    POW5(0xa6dfbd9f, 0xb8e5b88e, 0xcb4ccd50, 0x0f6bb952),
+    POW5(0xd097ad07, 0xa71f26b2, 0x7e2000a4, 0x1346a7a7),
+    POW5(0x825ecc24, 0xc873782f, 0x8ed40066, 0x8c0c28c8),
+    POW5(0xa2f67f2d, 0xfa90563b, 0x72890080, 0x2f0f32fa),
+    POW5(0xcbb41ef9, 0x79346bca, 0x4f2b40a0, 0x3ad2ffb9),
+    POW5(0xfea126b7, 0xd78186bc, 0xe2f610c8, 0x4987bfa8),
+    POW5(0x9f24b832, 0xe6b0f436, 0x0dd9ca7d, 0x2df4d7c9),
+    POW5(0xc6ede63f, 0xa05d3143, 0x91503d1c, 0x79720dbb),
+    POW5(0xf8a95fcf, 0x88747d94, 0x75a44c63, 0x97ce912a),
+    POW5(0x9b69dbe1, 0xb548ce7c, 0xc986afbe, 0x3ee11aba),
+    POW5(0xc24452da, 0x229b021b, 0xfbe85bad, 0xce996168),
+    POW5(0xf2d56790, 0xab41c2a2, 0xfae27299, 0x423fb9c3),
+    POW5(0x97c560ba, 0x6b0919a5, 0xdccd879f, 0xc967d41a),
+    POW5(0xbdb6b8e9, 0x05cb600f, 0x5400e987, 0xbbc1c920),
+    POW5(0xed246723, 0x473e3813, 0x290123e9, 0xaab23b68),
+    POW5(0x9436c076, 0x0c86e30b, 0xf9a0b672, 0x0aaf6521),
+    POW5(0xb9447093, 0x8fa89bce, 0xf808e40e, 0x8d5b3e69),
+    POW5(0xe7958cb8, 0x7392c2c2, 0xb60b1d12, 0x30b20e04),
+    POW5(0x90bd77f3, 0x483bb9b9, 0xb1c6f22b, 0x5e6f48c2),
+    POW5(0xb4ecd5f0, 0x1a4aa828, 0x1e38aeb6, 0x360b1af3),
+    POW5(0xe2280b6c, 0x20dd5232, 0x25c6da63, 0xc38de1b0),
+    POW5(0x8d590723, 0x948a535f, 0x579c487e, 0x5a38ad0e),
+    POW5(0xb0af48ec, 0x79ace837, 0x2d835a9d, 0xf0c6d851),
+    POW5(0xdcdb1b27, 0x98182244, 0xf8e43145, 0x6cf88e65),
+    POW5(0x8a08f0f8, 0xbf0f156b, 0x1b8e9ecb, 0x641b58ff),
+    POW5(0xac8b2d36, 0xeed2dac5, 0xe272467e, 0x3d222f3f),
+    POW5(0xd7adf884, 0xaa879177, 0x5b0ed81d, 0xcc6abb0f),
+    POW5(0x86ccbb52, 0xea94baea, 0x98e94712, 0x9fc2b4e9),
+    POW5(0xa87fea27, 0xa539e9a5, 0x3f2398d7, 0x47b36224),
+    POW5(0xd29fe4b1, 0x8e88640e, 0x8eec7f0d, 0x19a03aad),
+    POW5(0x83a3eeee, 0xf9153e89, 0x1953cf68, 0x300424ac),
+    POW5(0xa48ceaaa, 0xb75a8e2b, 0x5fa8c342, 0x3c052dd7),
+    POW5(0xcdb02555, 0x653131b6, 0x3792f412, 0xcb06794d),
+    POW5(0x808e1755, 0x5f3ebf11, 0xe2bbd88b, 0xbee40bd0),
+    POW5(0xa0b19d2a, 0xb70e6ed6, 0x5b6aceae, 0xae9d0ec4),
+    POW5(0xc8de0475, 0x64d20a8b, 0xf245825a, 0x5a445275),
+    POW5(0xfb158592, 0xbe068d2e, 0xeed6e2f0, 0xf0d56712),
+    POW5(0x9ced737b, 0xb6c4183d, 0x55464dd6, 0x9685606b),
+    POW5(0xc428d05a, 0xa4751e4c, 0xaa97e14c, 0x3c26b886),
+    POW5(0xf5330471, 0x4d9265df, 0xd53dd99f, 0x4b3066a8),
+    POW5(0x993fe2c6, 0xd07b7fab, 0xe546a803, 0x8efe4029),
+    POW5(0xbf8fdb78, 0x849a5f96, 0xde985204, 0x72bdd033),
+    POW5(0xef73d256, 0xa5c0f77c, 0x963e6685, 0x8f6d4440),
+    POW5(0x95a86376, 0x27989aad, 0xdde70013, 0x79a44aa8),
+    POW5(0xbb127c53, 0xb17ec159, 0x5560c018, 0x580d5d52),
+    POW5(0xe9d71b68, 0x9dde71af, 0xaab8f01e, 0x6e10b4a6),
+    POW5(0x92267121, 0x62ab070d, 0xcab39613, 0x04ca70e8),
+    POW5(0xb6b00d69, 0xbb55c8d1, 0x3d607b97, 0xc5fd0d22),
+    POW5(0xe45c10c4, 0x2a2b3b05, 0x8cb89a7d, 0xb77c506a),
+    POW5(0x8eb98a7a, 0x9a5b04e3, 0x77f3608e, 0x92adb242),
+    POW5(0xb267ed19, 0x40f1c61c, 0x55f038b2, 0x37591ed3),
+    POW5(0xdf01e85f, 0x912e37a3, 0x6b6c46de, 0xc52f6688),
+    POW5(0x8b61313b, 0xbabce2c6, 0x2323ac4b, 0x3b3da015),
+    POW5(0xae397d8a, 0xa96c1b77, 0xabec975e, 0x0a0d081a),
+    POW5(0xd9c7dced, 0x53c72255, 0x96e7bd35, 0x8c904a21),
+    POW5(0x881cea14, 0x545c7575, 0x7e50d641, 0x77da2e54),
+    POW5(0xaa242499, 0x697392d2, 0xdde50bd1, 0xd5d0b9e9),
+    POW5(0xd4ad2dbf, 0xc3d07787, 0x955e4ec6, 0x4b44e864),
+    POW5(0x84ec3c97, 0xda624ab4, 0xbd5af13b, 0xef0b113e),
+    POW5(0xa6274bbd, 0xd0fadd61, 0xecb1ad8a, 0xeacdd58e),
+    POW5(0xcfb11ead, 0x453994ba, 0x67de18ed, 0xa5814af2),
+    POW5(0x81ceb32c, 0x4b43fcf4, 0x80eacf94, 0x8770ced7),
+    POW5(0xa2425ff7, 0x5e14fc31, 0xa1258379, 0xa94d028d),
+    POW5(0xcad2f7f5, 0x359a3b3e, 0x096ee458, 0x13a04330),
+    POW5(0xfd87b5f2, 0x8300ca0d, 0x8bca9d6e, 0x188853fc),
+    POW5(0x9e74d1b7, 0x91e07e48, 0x775ea264, 0xcf55347e),
+    POW5(0xc6120625, 0x76589dda, 0x95364afe, 0x032a819e),
+    POW5(0xf79687ae, 0xd3eec551, 0x3a83ddbd, 0x83f52205),
+    POW5(0x9abe14cd, 0x44753b52, 0xc4926a96, 0x72793543),
+    POW5(0xc16d9a00, 0x95928a27, 0x75b7053c, 0x0f178294),
+    POW5(0xf1c90080, 0xbaf72cb1, 0x5324c68b, 0x12dd6339),
+    POW5(0x971da050, 0x74da7bee, 0xd3f6fc16, 0xebca5e04),
+    POW5(0xbce50864, 0x92111aea, 0x88f4bb1c, 0xa6bcf585),
+    POW5(0xec1e4a7d, 0xb69561a5, 0x2b31e9e3, 0xd06c32e6),
+    POW5(0x9392ee8e, 0x921d5d07, 0x3aff322e, 0x62439fd0),
+    POW5(0xb877aa32, 0x36a4b449, 0x09befeb9, 0xfad487c3),
+    POW5(0xe69594be, 0xc44de15b, 0x4c2ebe68, 0x7989a9b4),
+    POW5(0x901d7cf7, 0x3ab0acd9, 0x0f9d3701, 0x4bf60a11),
+    POW5(0xb424dc35, 0x095cd80f, 0x538484c1, 0x9ef38c95),
+    POW5(0xe12e1342, 0x4bb40e13, 0x2865a5f2, 0x06b06fba),
+    POW5(0x8cbccc09, 0x6f5088cb, 0xf93f87b7, 0x442e45d4),
+    POW5(0xafebff0b, 0xcb24aafe, 0xf78f69a5, 0x1539d749),
+    POW5(0xdbe6fece, 0xbdedd5be, 0xb573440e, 0x5a884d1c),
+    POW5(0x89705f41, 0x36b4a597, 0x31680a88, 0xf8953031),
+    POW5(0xabcc7711, 0x8461cefc, 0xfdc20d2b, 0x36ba7c3e),
+    POW5(0xd6bf94d5, 0xe57a42bc, 0x3d329076, 0x04691b4d),
+    POW5(0x8637bd05, 0xaf6c69b5, 0xa63f9a49, 0xc2c1b110),
+    POW5(0xa7c5ac47, 0x1b478423, 0x0fcf80dc, 0x33721d54),
+    POW5(0xd1b71758, 0xe219652b, 0xd3c36113, 0x404ea4a9),
+    POW5(0x83126e97, 0x8d4fdf3b, 0x645a1cac, 0x083126ea),
+    POW5(0xa3d70a3d, 0x70a3d70a, 0x3d70a3d7, 0x0a3d70a4),
+    POW5(0xcccccccc, 0xcccccccc, 0xcccccccc, 0xcccccccd),
+    POW5(0x80000000, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0xa0000000, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0xc8000000, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0xfa000000, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0x9c400000, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0xc3500000, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0xf4240000, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0x98968000, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0xbebc2000, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0xee6b2800, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0x9502f900, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0xba43b740, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0xe8d4a510, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0x9184e72a, 0x00000000, 0x00000000, 0x00000000),
+    POW5(0xb5e620f4, 0x80000000, 0x00000000, 0x00000000),
+    POW5(0xe35fa931, 0xa0000000, 0x00000000, 0x00000000),
+    POW5(0x8e1bc9bf, 0x04000000, 0x00000000, 0x00000000),
+    POW5(0xb1a2bc2e, 0xc5000000, 0x00000000, 0x00000000),
+    POW5(0xde0b6b3a, 0x76400000, 0x00000000, 0x00000000),
+    POW5(0x8ac72304, 0x89e80000, 0x00000000, 0x00000000),
+    POW5(0xad78ebc5, 0xac620000, 0x00000000, 0x00000000),
+    POW5(0xd8d726b7, 0x177a8000, 0x00000000, 0x00000000),
+    POW5(0x87867832, 0x6eac9000, 0x00000000, 0x00000000),
+    POW5(0xa968163f, 0x0a57b400, 0x00000000, 0x00000000),
+    POW5(0xd3c21bce, 0xcceda100, 0x00000000, 0x00000000),
+    POW5(0x84595161, 0x401484a0, 0x00000000, 0x00000000),
+    POW5(0xa56fa5b9, 0x9019a5c8, 0x00000000, 0x00000000),
+    POW5(0xcecb8f27, 0xf4200f3a, 0x00000000, 0x00000000),
+    POW5(0x813f3978, 0xf8940984, 0x40000000, 0x00000000),
+    POW5(0xa18f07d7, 0x36b90be5, 0x50000000, 0x00000000),
+    POW5(0xc9f2c9cd, 0x04674ede, 0xa4000000, 0x00000000),
+    POW5(0xfc6f7c40, 0x45812296, 0x4d000000, 0x00000000),
+    POW5(0x9dc5ada8, 0x2b70b59d, 0xf0200000, 0x00000000),
+    POW5(0xc5371912, 0x364ce305, 0x6c280000, 0x00000000),
+    POW5(0xf684df56, 0xc3e01bc6, 0xc7320000, 0x00000000),
+    POW5(0x9a130b96, 0x3a6c115c, 0x3c7f4000, 0x00000000),
+    POW5(0xc097ce7b, 0xc90715b3, 0x4b9f1000, 0x00000000),
+    POW5(0xf0bdc21a, 0xbb48db20, 0x1e86d400, 0x00000000),
+    POW5(0x96769950, 0xb50d88f4, 0x13144480, 0x00000000),
+    POW5(0xbc143fa4, 0xe250eb31, 0x17d955a0, 0x00000000),
+    POW5(0xeb194f8e, 0x1ae525fd, 0x5dcfab08, 0x00000000),
+    POW5(0x92efd1b8, 0xd0cf37be, 0x5aa1cae5, 0x00000000),
+    POW5(0xb7abc627, 0x050305ad, 0xf14a3d9e, 0x40000000),
+    POW5(0xe596b7b0, 0xc643c719, 0x6d9ccd05, 0xd0000000),
+    POW5(0x8f7e32ce, 0x7bea5c6f, 0xe4820023, 0xa2000000),
+    POW5(0xb35dbf82, 0x1ae4f38b, 0xdda2802c, 0x8a800000),
+    POW5(0xe0352f62, 0xa19e306e, 0xd50b2037, 0xad200000),
+    POW5(0x8c213d9d, 0xa502de45, 0x4526f422, 0xcc340000),
+    POW5(0xaf298d05, 0x0e4395d6, 0x9670b12b, 0x7f410000),
+    POW5(0xdaf3f046, 0x51d47b4c, 0x3c0cdd76, 0x5f114000),
+    POW5(0x88d8762b, 0xf324cd0f, 0xa5880a69, 0xfb6ac800),
+    POW5(0xab0e93b6, 0xefee0053, 0x8eea0d04, 0x7a457a00),
+    POW5(0xd5d238a4, 0xabe98068, 0x72a49045, 0x98d6d880),
+    POW5(0x85a36366, 0xeb71f041, 0x47a6da2b, 0x7f864750),
+    POW5(0xa70c3c40, 0xa64e6c51, 0x999090b6, 0x5f67d924),
+    POW5(0xd0cf4b50, 0xcfe20765, 0xfff4b4e3, 0xf741cf6d),
+    POW5(0x82818f12, 0x81ed449f, 0xbff8f10e, 0x7a8921a4),
+    POW5(0xa321f2d7, 0x226895c7, 0xaff72d52, 0x192b6a0d),
+    POW5(0xcbea6f8c, 0xeb02bb39, 0x9bf4f8a6, 0x9f764490),
+    POW5(0xfee50b70, 0x25c36a08, 0x02f236d0, 0x4753d5b4),
+    POW5(0x9f4f2726, 0x179a2245, 0x01d76242, 0x2c946590),
+    POW5(0xc722f0ef, 0x9d80aad6, 0x424d3ad2, 0xb7b97ef5),
+    POW5(0xf8ebad2b, 0x84e0d58b, 0xd2e08987, 0x65a7deb2),
+    POW5(0x9b934c3b, 0x330c8577, 0x63cc55f4, 0x9f88eb2f),
+    POW5(0xc2781f49, 0xffcfa6d5, 0x3cbf6b71, 0xc76b25fb),
+    POW5(0xf316271c, 0x7fc3908a, 0x8bef464e, 0x3945ef7a),
+    POW5(0x97edd871, 0xcfda3a56, 0x97758bf0, 0xe3cbb5ac),
+    POW5(0xbde94e8e, 0x43d0c8ec, 0x3d52eeed, 0x1cbea317),
+    POW5(0xed63a231, 0xd4c4fb27, 0x4ca7aaa8, 0x63ee4bdd),
+    POW5(0x945e455f, 0x24fb1cf8, 0x8fe8caa9, 0x3e74ef6a),
+    POW5(0xb975d6b6, 0xee39e436, 0xb3e2fd53, 0x8e122b44),
+    POW5(0xe7d34c64, 0xa9c85d44, 0x60dbbca8, 0x7196b616),
+    POW5(0x90e40fbe, 0xea1d3a4a, 0xbc8955e9, 0x46fe31cd),
+    POW5(0xb51d13ae, 0xa4a488dd, 0x6babab63, 0x98bdbe41),
+    POW5(0xe264589a, 0x4dcdab14, 0xc696963c, 0x7eed2dd1),
+    POW5(0x8d7eb760, 0x70a08aec, 0xfc1e1de5, 0xcf543ca2),
+    POW5(0xb0de6538, 0x8cc8ada8, 0x3b25a55f, 0x43294bcb),
+    POW5(0xdd15fe86, 0xaffad912, 0x49ef0eb7, 0x13f39ebe),
+    POW5(0x8a2dbf14, 0x2dfcc7ab, 0x6e356932, 0x6c784337),
+    POW5(0xacb92ed9, 0x397bf996, 0x49c2c37f, 0x07965404),
+    POW5(0xd7e77a8f, 0x87daf7fb, 0xdc33745e, 0xc97be906),
+    POW5(0x86f0ac99, 0xb4e8dafd, 0x69a028bb, 0x3ded71a3),
+    POW5(0xa8acd7c0, 0x222311bc, 0xc40832ea, 0x0d68ce0c),
+    POW5(0xd2d80db0, 0x2aabd62b, 0xf50a3fa4, 0x90c30190),
+    POW5(0x83c7088e, 0x1aab65db, 0x792667c6, 0xda79e0fa),
+    POW5(0xa4b8cab1, 0xa1563f52, 0x577001b8, 0x91185938),
+    POW5(0xcde6fd5e, 0x09abcf26, 0xed4c0226, 0xb55e6f86),
+    POW5(0x80b05e5a, 0xc60b6178, 0x544f8158, 0x315b05b4),
+    POW5(0xa0dc75f1, 0x778e39d6, 0x696361ae, 0x3db1c721),
+    POW5(0xc913936d, 0xd571c84c, 0x03bc3a19, 0xcd1e38e9),
+    POW5(0xfb587849, 0x4ace3a5f, 0x04ab48a0, 0x4065c723),
+    POW5(0x9d174b2d, 0xcec0e47b, 0x62eb0d64, 0x283f9c76),
+    POW5(0xc45d1df9, 0x42711d9a, 0x3ba5d0bd, 0x324f8394),
+    POW5(0xf5746577, 0x930d6500, 0xca8f44ec, 0x7ee36479),
+    POW5(0x9968bf6a, 0xbbe85f20, 0x7e998b13, 0xcf4e1ecb),
+    POW5(0xbfc2ef45, 0x6ae276e8, 0x9e3fedd8, 0xc321a67e),
+    POW5(0xefb3ab16, 0xc59b14a2, 0xc5cfe94e, 0xf3ea101e),
+    POW5(0x95d04aee, 0x3b80ece5, 0xbba1f1d1, 0x58724a12),
+    POW5(0xbb445da9, 0xca61281f, 0x2a8a6e45, 0xae8edc97),
+    POW5(0xea157514, 0x3cf97226, 0xf52d09d7, 0x1a3293bd),
+    POW5(0x924d692c, 0xa61be758, 0x593c2626, 0x705f9c56),
+    POW5(0xb6e0c377, 0xcfa2e12e, 0x6f8b2fb0, 0x0c77836c),
+    POW5(0xe498f455, 0xc38b997a, 0x0b6dfb9c, 0x0f956447),
+    POW5(0x8edf98b5, 0x9a373fec, 0x4724bd41, 0x89bd5eac),
+    POW5(0xb2977ee3, 0x00c50fe7, 0x58edec91, 0xec2cb657),
+    POW5(0xdf3d5e9b, 0xc0f653e1, 0x2f2967b6, 0x6737e3ed),
+    POW5(0x8b865b21, 0x5899f46c, 0xbd79e0d2, 0x0082ee74),
+    POW5(0xae67f1e9, 0xaec07187, 0xecd85906, 0x80a3aa11),
+    POW5(0xda01ee64, 0x1a708de9, 0xe80e6f48, 0x20cc9495),
+    POW5(0x884134fe, 0x908658b2, 0x3109058d, 0x147fdcdd),
+    POW5(0xaa51823e, 0x34a7eede, 0xbd4b46f0, 0x599fd415),
+    POW5(0xd4e5e2cd, 0xc1d1ea96, 0x6c9e18ac, 0x7007c91a),
+    POW5(0x850fadc0, 0x9923329e, 0x03e2cf6b, 0xc604ddb0),
+    POW5(0xa6539930, 0xbf6bff45, 0x84db8346, 0xb786151c),
+    POW5(0xcfe87f7c, 0xef46ff16, 0xe6126418, 0x65679a63),
+    POW5(0x81f14fae, 0x158c5f6e, 0x4fcb7e8f, 0x3f60c07e),
+    POW5(0xa26da399, 0x9aef7749, 0xe3be5e33, 0x0f38f09d),
+    POW5(0xcb090c80, 0x01ab551c, 0x5cadf5bf, 0xd3072cc5),
+    POW5(0xfdcb4fa0, 0x02162a63, 0x73d9732f, 0xc7c8f7f6),
+    POW5(0x9e9f11c4, 0x014dda7e, 0x2867e7fd, 0xdcdd9afa),
+    POW5(0xc646d635, 0x01a1511d, 0xb281e1fd, 0x541501b8),
+    POW5(0xf7d88bc2, 0x4209a565, 0x1f225a7c, 0xa91a4226),
+    POW5(0x9ae75759, 0x6946075f, 0x3375788d, 0xe9b06958),
+    POW5(0xc1a12d2f, 0xc3978937, 0x0052d6b1, 0x641c83ae),
+    POW5(0xf209787b, 0xb47d6b84, 0xc0678c5d, 0xbd23a49a),
+    POW5(0x9745eb4d, 0x50ce6332, 0xf840b7ba, 0x963646e0),
+    POW5(0xbd176620, 0xa501fbff, 0xb650e5a9, 0x3bc3d898),
+    POW5(0xec5d3fa8, 0xce427aff, 0xa3e51f13, 0x8ab4cebe),
+    POW5(0x93ba47c9, 0x80e98cdf, 0xc66f336c, 0x36b10137),
+    POW5(0xb8a8d9bb, 0xe123f017, 0xb80b0047, 0x445d4184),
+    POW5(0xe6d3102a, 0xd96cec1d, 0xa60dc059, 0x157491e5),
+    POW5(0x9043ea1a, 0xc7e41392, 0x87c89837, 0xad68db2f),
+    POW5(0xb454e4a1, 0x79dd1877, 0x29babe45, 0x98c311fb),
+    POW5(0xe16a1dc9, 0xd8545e94, 0xf4296dd6, 0xfef3d67a),
+    POW5(0x8ce2529e, 0x2734bb1d, 0x1899e4a6, 0x5f58660c),
+    POW5(0xb01ae745, 0xb101e9e4, 0x5ec05dcf, 0xf72e7f8f),
+    POW5(0xdc21a117, 0x1d42645d, 0x76707543, 0xf4fa1f73),
+    POW5(0x899504ae, 0x72497eba, 0x6a06494a, 0x791c53a8),
+    POW5(0xabfa45da, 0x0edbde69, 0x0487db9d, 0x17636892),
+    POW5(0xd6f8d750, 0x9292d603, 0x45a9d284, 0x5d3c42b6),
+    POW5(0x865b8692, 0x5b9bc5c2, 0x0b8a2392, 0xba45a9b2),
+    POW5(0xa7f26836, 0xf282b732, 0x8e6cac77, 0x68d7141e),
+    POW5(0xd1ef0244, 0xaf2364ff, 0x3207d795, 0x430cd926),
+    POW5(0x8335616a, 0xed761f1f, 0x7f44e6bd, 0x49e807b8),
+    POW5(0xa402b9c5, 0xa8d3a6e7, 0x5f16206c, 0x9c6209a6),
+    POW5(0xcd036837, 0x130890a1, 0x36dba887, 0xc37a8c0f),
+    POW5(0x80222122, 0x6be55a64, 0xc2494954, 0xda2c9789),
+    POW5(0xa02aa96b, 0x06deb0fd, 0xf2db9baa, 0x10b7bd6c),
+    POW5(0xc83553c5, 0xc8965d3d, 0x6f928294, 0x94e5acc7),
+    POW5(0xfa42a8b7, 0x3abbf48c, 0xcb772339, 0xba1f17f9),
+    POW5(0x9c69a972, 0x84b578d7, 0xff2a7604, 0x14536efb),
+    POW5(0xc38413cf, 0x25e2d70d, 0xfef51385, 0x19684aba),
+    POW5(0xf46518c2, 0xef5b8cd1, 0x7eb25866, 0x5fc25d69),
+    POW5(0x98bf2f79, 0xd5993802, 0xef2f773f, 0xfbd97a61),
+    POW5(0xbeeefb58, 0x4aff8603, 0xaafb550f, 0xfacfd8fa),
+    POW5(0xeeaaba2e, 0x5dbf6784, 0x95ba2a53, 0xf983cf38),
+    POW5(0x952ab45c, 0xfa97a0b2, 0xdd945a74, 0x7bf26183),
+    POW5(0xba756174, 0x393d88df, 0x94f97111, 0x9aeef9e4),
+    POW5(0xe912b9d1, 0x478ceb17, 0x7a37cd56, 0x01aab85d),
+    POW5(0x91abb422, 0xccb812ee, 0xac62e055, 0xc10ab33a),
+    POW5(0xb616a12b, 0x7fe617aa, 0x577b986b, 0x314d6009),
+    POW5(0xe39c4976, 0x5fdf9d94, 0xed5a7e85, 0xfda0b80b),
+    POW5(0x8e41ade9, 0xfbebc27d, 0x14588f13, 0xbe847307),
+    POW5(0xb1d21964, 0x7ae6b31c, 0x596eb2d8, 0xae258fc8),
+    POW5(0xde469fbd, 0x99a05fe3, 0x6fca5f8e, 0xd9aef3bb),
+    POW5(0x8aec23d6, 0x80043bee, 0x25de7bb9, 0x480d5854),
+    POW5(0xada72ccc, 0x20054ae9, 0xaf561aa7, 0x9a10ae6a),
+    POW5(0xd910f7ff, 0x28069da4, 0x1b2ba151, 0x8094da04),
+    POW5(0x87aa9aff, 0x79042286, 0x90fb44d2, 0xf05d0842),
+    POW5(0xa99541bf, 0x57452b28, 0x353a1607, 0xac744a53),
+    POW5(0xd3fa922f, 0x2d1675f2, 0x42889b89, 0x97915ce8),
+    POW5(0x847c9b5d, 0x7c2e09b7, 0x69956135, 0xfebada11),
+    POW5(0xa59bc234, 0xdb398c25, 0x43fab983, 0x7e699095),
+    POW5(0xcf02b2c2, 0x1207ef2e, 0x94f967e4, 0x5e03f4bb),
+    POW5(0x8161afb9, 0x4b44f57d, 0x1d1be0ee, 0xbac278f5),
+    POW5(0xa1ba1ba7, 0x9e1632dc, 0x6462d92a, 0x69731732),
+    POW5(0xca28a291, 0x859bbf93, 0x7d7b8f75, 0x03cfdcfe),
+    POW5(0xfcb2cb35, 0xe702af78, 0x5cda7352, 0x44c3d43e),
+    POW5(0x9defbf01, 0xb061adab, 0x3a088813, 0x6afa64a7),
+    POW5(0xc56baec2, 0x1c7a1916, 0x088aaa18, 0x45b8fdd0),
+    POW5(0xf6c69a72, 0xa3989f5b, 0x8aad549e, 0x57273d45),
+    POW5(0x9a3c2087, 0xa63f6399, 0x36ac54e2, 0xf678864b),
+    POW5(0xc0cb28a9, 0x8fcf3c7f, 0x84576a1b, 0xb416a7dd),
+    POW5(0xf0fdf2d3, 0xf3c30b9f, 0x656d44a2, 0xa11c51d5),
+    POW5(0x969eb7c4, 0x7859e743, 0x9f644ae5, 0xa4b1b325),
+    POW5(0xbc4665b5, 0x96706114, 0x873d5d9f, 0x0dde1fee),
+    POW5(0xeb57ff22, 0xfc0c7959, 0xa90cb506, 0xd155a7ea),
+    POW5(0x9316ff75, 0xdd87cbd8, 0x09a7f124, 0x42d588f2),
+    POW5(0xb7dcbf53, 0x54e9bece, 0x0c11ed6d, 0x538aeb2f),
+    POW5(0xe5d3ef28, 0x2a242e81, 0x8f1668c8, 0xa86da5fa),
+    POW5(0x8fa47579, 0x1a569d10, 0xf96e017d, 0x694487bc),
+    POW5(0xb38d92d7, 0x60ec4455, 0x37c981dc, 0xc395a9ac),
+    POW5(0xe070f78d, 0x3927556a, 0x85bbe253, 0xf47b1417),
+    POW5(0x8c469ab8, 0x43b89562, 0x93956d74, 0x78ccec8e),
+    POW5(0xaf584166, 0x54a6babb, 0x387ac8d1, 0x970027b2),
+    POW5(0xdb2e51bf, 0xe9d0696a, 0x06997b05, 0xfcc0319e),
+    POW5(0x88fcf317, 0xf22241e2, 0x441fece3, 0xbdf81f03),
+    POW5(0xab3c2fdd, 0xeeaad25a, 0xd527e81c, 0xad7626c3),
+    POW5(0xd60b3bd5, 0x6a5586f1, 0x8a71e223, 0xd8d3b074),
+    POW5(0x85c70565, 0x62757456, 0xf6872d56, 0x67844e49),
+    POW5(0xa738c6be, 0xbb12d16c, 0xb428f8ac, 0x016561db),
+    POW5(0xd106f86e, 0x69d785c7, 0xe13336d7, 0x01beba52),
+    POW5(0x82a45b45, 0x0226b39c, 0xecc00246, 0x61173473),
+    POW5(0xa34d7216, 0x42b06084, 0x27f002d7, 0xf95d0190),
+    POW5(0xcc20ce9b, 0xd35c78a5, 0x31ec038d, 0xf7b441f4),
+    POW5(0xff290242, 0xc83396ce, 0x7e670471, 0x75a15271),
+    POW5(0x9f79a169, 0xbd203e41, 0x0f0062c6, 0xe984d386),
+    POW5(0xc75809c4, 0x2c684dd1, 0x52c07b78, 0xa3e60868),
+    POW5(0xf92e0c35, 0x37826145, 0xa7709a56, 0xccdf8a82),
+    POW5(0x9bbcc7a1, 0x42b17ccb, 0x88a66076, 0x400bb691),
+    POW5(0xc2abf989, 0x935ddbfe, 0x6acff893, 0xd00ea435),
+    POW5(0xf356f7eb, 0xf83552fe, 0x0583f6b8, 0xc4124d43),
+    POW5(0x98165af3, 0x7b2153de, 0xc3727a33, 0x7a8b704a),
+    POW5(0xbe1bf1b0, 0x59e9a8d6, 0x744f18c0, 0x592e4c5c),
+    POW5(0xeda2ee1c, 0x7064130c, 0x1162def0, 0x6f79df73),
+    POW5(0x9485d4d1, 0xc63e8be7, 0x8addcb56, 0x45ac2ba8),
+    POW5(0xb9a74a06, 0x37ce2ee1, 0x6d953e2b, 0xd7173692),
+    POW5(0xe8111c87, 0xc5c1ba99, 0xc8fa8db6, 0xccdd0437),
+    POW5(0x910ab1d4, 0xdb9914a0, 0x1d9c9892, 0x400a22a2),
+    POW5(0xb54d5e4a, 0x127f59c8, 0x2503beb6, 0xd00cab4b),
+    POW5(0xe2a0b5dc, 0x971f303a, 0x2e44ae64, 0x840fd61d),
+    POW5(0x8da471a9, 0xde737e24, 0x5ceaecfe, 0xd289e5d2),
+    POW5(0xb10d8e14, 0x56105dad, 0x7425a83e, 0x872c5f47),
+    POW5(0xdd50f199, 0x6b947518, 0xd12f124e, 0x28f77719),
+    POW5(0x8a5296ff, 0xe33cc92f, 0x82bd6b70, 0xd99aaa6f),
+    POW5(0xace73cbf, 0xdc0bfb7b, 0x636cc64d, 0x1001550b),
+    POW5(0xd8210bef, 0xd30efa5a, 0x3c47f7e0, 0x5401aa4e),
+    POW5(0x8714a775, 0xe3e95c78, 0x65acfaec, 0x34810a71),
+    POW5(0xa8d9d153, 0x5ce3b396, 0x7f1839a7, 0x41a14d0d),
+    POW5(0xd31045a8, 0x341ca07c, 0x1ede4811, 0x1209a050),
+    POW5(0x83ea2b89, 0x2091e44d, 0x934aed0a, 0xab460432),
+    POW5(0xa4e4b66b, 0x68b65d60, 0xf81da84d, 0x5617853f),
+    POW5(0xce1de406, 0x42e3f4b9, 0x36251260, 0xab9d668e),
+    POW5(0x80d2ae83, 0xe9ce78f3, 0xc1d72b7c, 0x6b426019),
+    POW5(0xa1075a24, 0xe4421730, 0xb24cf65b, 0x8612f81f),
+    POW5(0xc94930ae, 0x1d529cfc, 0xdee033f2, 0x6797b627),
+    POW5(0xfb9b7cd9, 0xa4a7443c, 0x169840ef, 0x017da3b1),
+    POW5(0x9d412e08, 0x06e88aa5, 0x8e1f2895, 0x60ee864e),
+    POW5(0xc491798a, 0x08a2ad4e, 0xf1a6f2ba, 0xb92a27e2),
+    POW5(0xf5b5d7ec, 0x8acb58a2, 0xae10af69, 0x6774b1db),
+    POW5(0x9991a6f3, 0xd6bf1765, 0xacca6da1, 0xe0a8ef29),
+    POW5(0xbff610b0, 0xcc6edd3f, 0x17fd090a, 0x58d32af3),
+    POW5(0xeff394dc, 0xff8a948e, 0xddfc4b4c, 0xef07f5b0),
+    POW5(0x95f83d0a, 0x1fb69cd9, 0x4abdaf10, 0x1564f98e),
+    POW5(0xbb764c4c, 0xa7a4440f, 0x9d6d1ad4, 0x1abe37f1),
+    POW5(0xea53df5f, 0xd18d5513, 0x84c86189, 0x216dc5ed),
+    POW5(0x92746b9b, 0xe2f8552c, 0x32fd3cf5, 0xb4e49bb4),
+    POW5(0xb7118682, 0xdbb66a77, 0x3fbc8c33, 0x221dc2a1),
+    POW5(0xe4d5e823, 0x92a40515, 0x0fabaf3f, 0xeaa5334a),
+    POW5(0x8f05b116, 0x3ba6832d, 0x29cb4d87, 0xf2a7400e),
+    POW5(0xb2c71d5b, 0xca9023f8, 0x743e20e9, 0xef511012),
+    POW5(0xdf78e4b2, 0xbd342cf6, 0x914da924, 0x6b255416),
+    POW5(0x8bab8eef, 0xb6409c1a, 0x1ad089b6, 0xc2f7548e),
+    POW5(0xae9672ab, 0xa3d0c320, 0xa184ac24, 0x73b529b1),
+    POW5(0xda3c0f56, 0x8cc4f3e8, 0xc9e5d72d, 0x90a2741e),
+    POW5(0x88658996, 0x17fb1871, 0x7e2fa67c, 0x7a658892),
+    POW5(0xaa7eebfb, 0x9df9de8d, 0xddbb901b, 0x98feeab7),
+    POW5(0xd51ea6fa, 0x85785631, 0x552a7422, 0x7f3ea565),
+    POW5(0x8533285c, 0x936b35de, 0xd53a8895, 0x8f87275f),
+    POW5(0xa67ff273, 0xb8460356, 0x8a892aba, 0xf368f137),
+    POW5(0xd01fef10, 0xa657842c, 0x2d2b7569, 0xb0432d85),
+    POW5(0x8213f56a, 0x67f6b29b, 0x9c3b2962, 0x0e29fc73),
+    POW5(0xa298f2c5, 0x01f45f42, 0x8349f3ba, 0x91b47b8f),
+    POW5(0xcb3f2f76, 0x42717713, 0x241c70a9, 0x36219a73),
+    POW5(0xfe0efb53, 0xd30dd4d7, 0xed238cd3, 0x83aa0110),
+    POW5(0x9ec95d14, 0x63e8a506, 0xf4363804, 0x324a40aa),
+    POW5(0xc67bb459, 0x7ce2ce48, 0xb143c605, 0x3edcd0d5),
+    POW5(0xf81aa16f, 0xdc1b81da, 0xdd94b786, 0x8e94050a),
+    POW5(0x9b10a4e5, 0xe9913128, 0xca7cf2b4, 0x191c8326),
+    POW5(0xc1d4ce1f, 0x63f57d72, 0xfd1c2f61, 0x1f63a3f0),
+    POW5(0xf24a01a7, 0x3cf2dccf, 0xbc633b39, 0x673c8cec),
+    POW5(0x976e4108, 0x8617ca01, 0xd5be0503, 0xe085d813),
+    POW5(0xbd49d14a, 0xa79dbc82, 0x4b2d8644, 0xd8a74e18),
+    POW5(0xec9c459d, 0x51852ba2, 0xddf8e7d6, 0x0ed1219e),
+    POW5(0x93e1ab82, 0x52f33b45, 0xcabb90e5, 0xc942b503),
+    POW5(0xb8da1662, 0xe7b00a17, 0x3d6a751f, 0x3b936243),
+    POW5(0xe7109bfb, 0xa19c0c9d, 0x0cc51267, 0x0a783ad4),
+    POW5(0x906a617d, 0x450187e2, 0x27fb2b80, 0x668b24c5),
+    POW5(0xb484f9dc, 0x9641e9da, 0xb1f9f660, 0x802dedf6),
+    POW5(0xe1a63853, 0xbbd26451, 0x5e7873f8, 0xa0396973),
+    POW5(0x8d07e334, 0x55637eb2, 0xdb0b487b, 0x6423e1e8),
+    POW5(0xb049dc01, 0x6abc5e5f, 0x91ce1a9a, 0x3d2cda62),
+    POW5(0xdc5c5301, 0xc56b75f7, 0x7641a140, 0xcc7810fb),
+    POW5(0x89b9b3e1, 0x1b6329ba, 0xa9e904c8, 0x7fcb0a9d),
+    POW5(0xac2820d9, 0x623bf429, 0x546345fa, 0x9fbdcd44),
+    POW5(0xd732290f, 0xbacaf133, 0xa97c1779, 0x47ad4095),
+    POW5(0x867f59a9, 0xd4bed6c0, 0x49ed8eab, 0xcccc485d),
+    POW5(0xa81f3014, 0x49ee8c70, 0x5c68f256, 0xbfff5a74),
+    POW5(0xd226fc19, 0x5c6a2f8c, 0x73832eec, 0x6fff3111),
+    POW5(0x83585d8f, 0xd9c25db7, 0xc831fd53, 0xc5ff7eab),
+    POW5(0xa42e74f3, 0xd032f525, 0xba3e7ca8, 0xb77f5e55),
+    POW5(0xcd3a1230, 0xc43fb26f, 0x28ce1bd2, 0xe55f35eb),
+    POW5(0x80444b5e, 0x7aa7cf85, 0x7980d163, 0xcf5b81b3),
+    POW5(0xa0555e36, 0x1951c366, 0xd7e105bc, 0xc332621f),
+    POW5(0xc86ab5c3, 0x9fa63440, 0x8dd9472b, 0xf3fefaa7),
+    POW5(0xfa856334, 0x878fc150, 0xb14f98f6, 0xf0feb951),
+    POW5(0x9c935e00, 0xd4b9d8d2, 0x6ed1bf9a, 0x569f33d3),
+    POW5(0xc3b83581, 0x09e84f07, 0x0a862f80, 0xec4700c8),
+    POW5(0xf4a642e1, 0x4c6262c8, 0xcd27bb61, 0x2758c0fa),
+    POW5(0x98e7e9cc, 0xcfbd7dbd, 0x8038d51c, 0xb897789c),
+    POW5(0xbf21e440, 0x03acdd2c, 0xe0470a63, 0xe6bd56c3),
+    POW5(0xeeea5d50, 0x04981478, 0x1858ccfc, 0xe06cac74),
+    POW5(0x95527a52, 0x02df0ccb, 0x0f37801e, 0x0c43ebc8),
+    POW5(0xbaa718e6, 0x8396cffd, 0xd3056025, 0x8f54e6ba),
+    POW5(0xe950df20, 0x247c83fd, 0x47c6b82e, 0xf32a2069),
+    POW5(0x91d28b74, 0x16cdd27e, 0x4cdc331d, 0x57fa5441),
+    POW5(0xb6472e51, 0x1c81471d, 0xe0133fe4, 0xadf8e952),
+    POW5(0xe3d8f9e5, 0x63a198e5, 0x58180fdd, 0xd97723a6),
+    POW5(0x8e679c2f, 0x5e44ff8f, 0x570f09ea, 0xa7ea7648),
+    /* the rest are only used to format the smallest subnormals */
+    POW5(0xb201833b, 0x35d63f73, 0x2cd2cc65, 0x51e513da),
+    POW5(0xde81e40a, 0x034bcf4f, 0xf8077f7e, 0xa65e58d1),
+    POW5(0x8b112e86, 0x420f6191, 0xfb04afaf, 0x27faf782),
+    POW5(0xadd57a27, 0xd29339f6, 0x79c5db9a, 0xf1f9b563),
+    POW5(0xd94ad8b1, 0xc7380874, 0x18375281, 0xae7822bc),
+    POW5(0x87cec76f, 0x1c830548, 0x8f229391, 0x0d0b15b5),
+    POW5(0xa9c2794a, 0xe3a3c69a, 0xb2eb3875, 0x504ddb22),
+    POW5(0xd433179d, 0x9c8cb841, 0x5fa60692, 0xa46151eb),
+    POW5(0x849feec2, 0x81d7f328, 0xdbc7c41b, 0xa6bcd333),
+    POW5(0xa5c7ea73, 0x224deff3, 0x12b9b522, 0x906c0800),
+    POW5(0xcf39e50f, 0xeae16bef, 0xd768226b, 0x34870a00),
+    POW5(0x81842f29, 0xf2cce375, 0xe6a11583, 0x00d46640),
+    POW5(0xa1e53af4, 0x6f801c53, 0x60495ae3, 0xc1097fd0),
+    POW5(0xca5e89b1, 0x8b602368, 0x385bb19c, 0xb14bdfc4),
+    POW5(0xfcf62c1d, 0xee382c42, 0x46729e03, 0xdd9ed7b5),
+    POW5(0x9e19db92, 0xb4e31ba9, 0x6c07a2c2, 0x6a8346d1)
+};
+
+/*
+ * Find the bits of m * 10^q, rounded to the nearest double, using the
+ * Eisel-Lemire algorithm. Return CJ_FALSE if the result can't be determined.
+ */
+static CJ_BOOL eisel_lemire(U64 m, long q, U64 *bits) {
+    U128 product;
+    U64 mantissa;
+    long power2;
+    int lz, upperbit, shift;
+    if (m == 0 || q < SMALLEST_POWER_OF_TEN) {
+        *bits = 0;
+        return CJ_TRUE;
+    }
+    if (q > LARGEST_POWER_OF_TEN) {
+        *bits = (U64) DOUBLE_INFINITE_POWER << DOUBLE_MANTISSA_BITS;
+        return CJ_TRUE;
+    }
+    lz = leading_zeros(m);
+    m <<= lz;
+    product = full_multiply(m, powers_of_five[q - SMALLEST_POWER_OF_TEN].high);
+    /* if the rounding might be affected by the lower bits, compute them */
+    if ((product.high & 0x1FF) == 0x1FF) {
+        U128 second =
+            full_multiply(m, powers_of_five[q - SMALLEST_POWER_OF_TEN].low);
+        product.low += second.high;
+        if (second.high > product.low) ++product.high;
+        /* still ambiguous outside of the range where the product is exact */
+        if (product.low == ~(U64) 0 && (q < -27 || q > 55)) return CJ_FALSE;
+    }
+    upperbit = (int) (product.high >> 63);
+    shift = upperbit + 64 - DOUBLE_MANTISSA_BITS - 3;
+    mantissa = product.high >> shift;
+    power2 = power_of_two(q) + upperbit - lz + 1023;
+    if (power2 <= 0) {
+        /* subnormal */
+        if (-power2 + 1 >= 64) {
+            *bits = 0;
+            return CJ_TRUE;
+        }
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        /* rounding up may have made it normal, which sets the exponent bit */
+        *bits = mantissa;
+        return CJ_TRUE;
+    }
+    /* exactly halfway between two doubles, so round to even */
+    if (product.low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1
+            && (mantissa << shift) == product.high) {
+        mantissa &= ~(U64) 1;
+    }
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (U64) 2 << DOUBLE_MANTISSA_BITS) {
+        mantissa = (U64) 1 << DOUBLE_MANTISSA_BITS;
+        ++power2;
+    }
+    mantissa &= ~((U64) 1 << DOUBLE_MANTISSA_BITS);
+    if (power2 >= DOUBLE_INFINITE_POWER) {
+        power2 = DOUBLE_INFINITE_POWER;
+        mantissa = 0;
+    }
+    *bits = mantissa | ((U64) power2 << DOUBLE_MANTISSA_BITS);
+    return CJ_TRUE;
+}
+
+/*
+ * Excess precision would round twice, so exact multiplication is only used if
+ * doubles are evaluated as doubles.
+ */
+#if !defined(__FLT_EVAL_METHOD__) || __FLT_EVAL_METHOD__ == 0
+#define EXACT_MULTIPLY
+
+/* The powers of ten that are exactly representable as doubles. */
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#endif
+
+/*
+ * Write out the digits of the decimal for strtod. The conversion is counted in
+ * the statistics of the parser, if there is one.
+ */
+static double decimal_strtod(Parser *p, const Decimal *d, long exponent) {
+    /* digits, a nonzero digit for lost digits, and the exponent */
+    char buf[NUMBER_MAX_DIGITS + 3 + sizeof(long) * CHAR_BIT];
+    long written = d->digits < MANTISSA_DIGITS ? d->digits : MANTISSA_DIGITS;
+    U64 mantissa = d->mantissa;
+    long i;
+#ifdef CJ_STATS
+    if (p != NULL) STAT_ADD(p, slow_numbers, 1);
+#else
+    (void) p;
+#endif
+    for (i = written; i > 0; --i) {
+        buf[i - 1] = '0' + (int) (mantissa % 10);
+        mantissa /= 10;
+    }
+    memcpy(buf + written, d->extra, d->extra_len);
+    written += d->extra_len;
+    /* the exponent is relative to the last significant digit */
+    exponent += d->digits - written;
+    if (d->lost) {
+        /* make sure that the lost digits round the right way */
+        buf[written++] = '1';
+        --exponent;
+    }
+    /* no decimal point is needed, so the locale can't interfere */
+    sprintf(buf + written, "e%ld", exponent);
+    return strtod(buf, NULL);
+}
+
+/*
+ * Convert a decimal to a double, where exponent is the decimal exponent of its
+ * last significant digit. The parser is NULL if converting a lazy number.
+ */
+static double decimal_to_double(Parser *p, const Decimal *d, long exponent) {
+    U64 bits;
+    double result;
+    /* the exponent of the last digit in the mantissa */
+    long q = exponent;
+    if (d->digits > MANTISSA_DIGITS) q += d->digits - MANTISSA_DIGITS;
+    if (!d->inexact) {
+#ifdef EXACT_MULTIPLY
+        if (d->mantissa <= (U64) 1 << 53 && q >= -22 && q <= 22) {
+            result = (double) d->mantissa;
+            if (q < 0) return result / exact_powers_of_ten[-q];
+            return result * exact_powers_of_ten[q];
+        }
+#endif
+        if (!eisel_lemire(d->mantissa, q, &bits)) {
+            return decimal_strtod(p, d, exponent);
+        }
+    } else {
+        /*
+         * The real value is between the mantissa and the next integer, so if
+         * both round to the same double, that's the answer.
+         */
+        U64 upper;
+        if (!eisel_lemire(d->mantissa, q, &bits)
+                || !eisel_lemire(d->mantissa + 1, q, &upper)
+                || bits != upper) {
+            return decimal_strtod(p, d, exponent);
+        }
+    }
+    memcpy(&result, &bits, sizeof(double));
+    return result;
+}
+
+/* Scan a number into a decimal, returning true if it is negative. */
+static CJ_BOOL scan_decimal(Parser *p, Decimal *d) {
+    CJ_BOOL negative = eat(p, '-');
+    d->mantissa = 0;
+    d->digits = 0;
+    d->exponent = 0;
+    d->inexact = CJ_FALSE;
+    d->lost = CJ_FALSE;
+    d->extra_len = 0;
+    /* integer part */
+    if (!eat(p, '0')) scan_digits(p, d, CJ_FALSE);
+    /* fraction part */
+    if (eat(p, '.')) scan_digits(p, d, CJ_TRUE);
+    /* exponent part */
+    if (eat(p, 'e') || eat(p, 'E')) {
+        long exponent = 0;
+        CJ_BOOL negative_exponent = CJ_FALSE;
+        if (!eat(p, '+')) negative_exponent = eat(p, '-');
+        if (!is_digit(p)) error(p, CJ_SYNTAX_ERROR);
+        do {
+            if (exponent < EXPONENT_LIMIT / 10) {
+                exponent = exponent * 10 + (*p->cur - '0');
+            }
+            advance(p);
+        } while (is_digit(p));
+        d->exponent += negative_exponent ? -exponent : exponent;
+    }
+    return negative;
+}
+
+static double scan_number(Parser *p) {
+    Decimal d;
+    CJ_BOOL negative = scan_decimal(p, &d);
+    return negative
+        ? -decimal_to_double(p, &d, d.exponent)
+        : decimal_to_double(p, &d, d.exponent);
+}
+
+/*
+ * Copy the text of a number at the given offset of the character buffer to the
+ * value at the given stack index, without converting it, and pop it.
+ */
+static void keep_number_text(Parser *p, size_t index, size_t start) {
+    CJValue *value;
+    char *chars = alloc(p, NULL, p->chars_len - start);
+    memcpy(chars, p->chars + start, p->chars_len - start);
+    value = &p->stack[index];
+    value->flags = CJ_VALUE_RAW_NUMBER;
+    value->as.raw.chars = chars;
+    value->as.raw.length = p->chars_len - start;
+    value->type = CJ_NUMBER;
+    p->chars_len = start;
+}
+
+/*
+ * Keep the text of a number instead of converting it. If the input stays
+ * valid, the value points into it; otherwise, the text is copied.
+ */
+static void parse_raw_number(Parser *p, size_t index) {
+    if (p->contiguous) {
+        const char *start = p->cur;
+        CJValue *value;
+        scan_number_text(p, CJ_FALSE);
+        value = &p->stack[index];
+        value->flags = CJ_VALUE_RAW_NUMBER | CJ_VALUE_BORROWED;
+        value->as.raw.chars = start;
+        value->as.raw.length = p->cur - start;
+        value->type = CJ_NUMBER;
+    } else {
+        size_t start = p->chars_len;
+        scan_number_text(p, CJ_TRUE);
+        keep_number_text(p, index, start);
+    }
+}
+
+/*
+ * Scan the text of a raw number into a decimal. Returns false if the text is
+ * not a valid number.
+ */
+static CJ_BOOL raw_to_decimal(
+    const CJRawNumber *raw,
+    Decimal *d,
+    CJ_BOOL *negative
+) {
+    Parser p;
+    p.cur = raw->chars;
+    p.end = raw->chars + raw->length;
+    p.reader = NULL;
+    if (setjmp(p.buf)) return CJ_FALSE;
+    *negative = scan_decimal(&p, d);
+    return at_eof(&p);
+}
+
+#ifdef CJ_INT64
+/* Convert a decimal to an integer if it is one, and it fits. */
+static CJ_BOOL decimal_to_int64(
+    const Decimal *d,
+    CJ_BOOL negative,
+    CJInt64 *out
+) {
+    U64 magnitude = d->mantissa;
+    U64 limit = ((U64) 1 << 63) - (negative ? 0 : 1);
+    /* the exponent of the last digit in the mantissa */
+    long q = d->exponent;
+    if (d->digits > MANTISSA_DIGITS) q += d->digits - MANTISSA_DIGITS;
+    if (magnitude == 0) {
+        *out = 0;
+        return CJ_TRUE;
+    }
+    /* a nonzero digit past the mantissa is either a fraction or too big */
+    if (d->inexact) return CJ_FALSE;
+    for (; q < 0; ++q) {
+        if (magnitude % 10 != 0) return CJ_FALSE;
+        magnitude /= 10;
+    }
+    for (; q > 0; --q) {
+        if (magnitude > limit / 10) return CJ_FALSE;
+        magnitude *= 10;
+    }
+    if (magnitude > limit) return CJ_FALSE;
+    /* negate without overflowing on the most negative integer */
+    *out = negative ? -(CJInt64) (magnitude - 1) - 1 : (CJInt64) magnitude;
+    return CJ_TRUE;
+}
+#endif
+#else
+static double scan_number(Parser *p) {
+    /*
+     * Without a 64-bit integer type, we read the number into the character
+     * buffer and use strtod on it.
+     */
+    double number;
+    size_t start = p->chars_len;
+    STAT_ADD(p, slow_numbers, 1);
+    scan_number_text(p, CJ_TRUE);
+    /* parse number */
+    /* TODO - how should huge numbers (that parse to infinity) be handled? */
+    push_char(p, '\0');
+    number = strtod(p->chars + start, NULL);
+    p->chars_len = start;
+    return number;
+}
+#endif
+
+static void parse_number(Parser *p, size_t index) {
+    double number;
+#ifdef FAST_NUMBERS
+    if (p->flags & CJ_PARSE_LAZY_NUMBERS) {
+        parse_raw_number(p, index);
+        return;
+    }
+#endif
+    number = scan_number(p);
+    p->stack[index].type = CJ_NUMBER;
+    p->stack[index].as.number = number;
+}
+
+#ifdef FAST_NUMBERS
+/* Convert the text of a number to a double. */
+static double raw_to_double(const CJRawNumber *raw) {
+    Decimal d;
+    CJ_BOOL negative;
+    double number;
+    if (!raw_to_decimal(raw, &d, &negative)) return 0.0;
+    number = decimal_to_double(NULL, &d, d.exponent);
+    return negative ? -number : number;
+}
+#endif
+
+/*
+ * Convert the text of a number at the given offset of the character buffer to
+ * the value at the given stack index, and pop it.
+ */
+static void finish_number_text(Parser *p, size_t index, size_t start) {
+    CJValue *value;
+#ifdef FAST_NUMBERS
+    CJRawNumber raw;
+    if (p->flags & CJ_PARSE_LAZY_NUMBERS) {
+        keep_number_text(p, index, start);
+        return;
+    }
+    raw.chars = p->chars + start;
+    raw.length = p->chars_len - start;
+    value = &p->stack[index];
+    value->as.number = raw_to_double(&raw);
+#else
+    push_char(p, '\0');
+    value = &p->stack[index];
+    value->as.number = strtod(p->chars + start, NULL);
+#endif
+    value->type = CJ_NUMBER;
+    p->chars_len = start;
+}
+
+double cj_number_to_double(const CJValue *value) {
+#ifdef FAST_NUMBERS
+    if (value->flags & CJ_VALUE_RAW_NUMBER) {
+        return raw_to_double(&value->as.raw);
+    }
+#endif
+    return value->as.number;
+}
+
+#ifdef CJ_INT64
+CJ_BOOL cj_number_to_int64(const CJValue *value, CJInt64 *out) {
+    double number;
+    CJInt64 integer;
+#ifdef FAST_NUMBERS
+    if (value->flags & CJ_VALUE_RAW_NUMBER) {
+        /* read exactly from the text, like cj_cursor_get_int64 */
+        Decimal d;
+        CJ_BOOL negative;
+        if (!raw_to_decimal(&value->as.raw, &d, &negative)) return CJ_FALSE;
+        return decimal_to_int64(&d, negative, out);
+    }
+#endif
+    /* without exact decimals, lazy numbers can only go through a double */
+    number = cj_number_to_double(value);
+    /* the range check also rejects NaN */
+    if (!(number >= -9223372036854775808.0 && number < 9223372036854775808.0)) {
+        return CJ_FALSE;
+    }
+    integer = (CJInt64) number;
+    if ((double) integer != number) return CJ_FALSE;
+    *out = integer;
+    return CJ_TRUE;
+}
+#endif
+
+/* Parse the key of an object member, along with the colon after it. */
+static void parse_key(Parser *p) {
+    require(p, '"');
+    parse_string_value(p, push_value(p), CJ_TRUE);
+    skip_ws(p);
+    require(p, ':');
+    skip_ws(p);
+}
+
+/*
+ * Parse a value and push it onto the value stack. Whitespace around the value
+ * is left for the caller to skip, so that it is only skipped once. Instead of
+ * recursing into arrays and objects, they are opened on the stack of frames,
+ * so that the depth is only limited by memory.
+ */
+static void parse(Parser *p) {
+    /* the frames below are the caller's */
+    size_t base = p->frames_len;
+    for (;;) {
+        size_t index = push_value(p);
+        CJValue *value;
+        /* check depth */
+        if (++p->depth == p->max_depth) {
+            error(p, CJ_TOO_MUCH_NESTING);
+        }
+#ifdef CJ_STATS
+        if (p->stats != NULL && p->depth > p->stats->max_depth) {
+            p->stats->max_depth = p->depth;
+        }
+#endif
+        if (check(p, '-') || is_digit(p)) {
+            parse_number(p, index);
+        } else {
+            /* only literals use this, as containers may move the stack */
+            value = &p->stack[index];
+            switch (take(p)) {
+                case 't':
+                    require(p, 'r');
+                    require(p, 'u');
+                    require(p, 'e');
+                    value->type = CJ_BOOLEAN;
+                    value->as.boolean = CJ_TRUE;
+                    break;
+                case 'f':
+                    require(p, 'a');
+                    require(p, 'l');
+                    require(p, 's');
+                    require(p, 'e');
+                    value->type = CJ_BOOLEAN;
+                    value->as.boolean = CJ_FALSE;
+                    break;
+                case 'n':
+                    require(p, 'u');
+                    require(p, 'l');
+                    require(p, 'l');
+                    break;
+                case '"':
+                    parse_string_value(p, index, CJ_FALSE);
+                    break;
+                case '[':
+                    skip_ws(p);
+                    if (eat(p, ']')) {
+                        finish_array(p, index, p->chars_len);
+                        break;
+                    }
+                    /* go on to the first element */
+                    push_frame(p, index, CJ_FALSE);
+                    continue;
+                case '{':
+                    skip_ws(p);
+                    if (eat(p, '}')) {
+                        finish_object(p, index, p->chars_len);
+                        break;
+                    }
+                    /* go on to the value of the first member */
+                    push_frame(p, index, CJ_TRUE);
+                    parse_key(p);
+                    continue;
+                default:
+                    error(p, CJ_SYNTAX_ERROR);
+            }
+        }
+        --p->depth;
+        /* close the containers that the value was the last child of */
+        for (;;) {
+            const Frame *frame;
+            if (p->frames_len == base) return;
+            frame = &p->frames[p->frames_len - 1];
+            skip_ws(p);
+            if (eat(p, ',')) {
+                skip_ws(p);
+                if (frame->object) parse_key(p);
+                break;
+            }
+            require(p, frame->object ? '}' : ']');
+            --p->frames_len;
+            if (frame->object) {
+                finish_object(p, frame->index, frame->chars_start);
+            } else {
+                finish_array(p, frame->index, frame->chars_start);
+            }
+            --p->depth;
+        }
+    }
+}
+
+static CJ_BOOL key_equals(
+    const CJString *key,
+    const char *chars,
+    size_t length
+) {
+    return key->length == length && memcmp(key->chars, chars, length) == 0;
+}
+
+/* Find a member of an object, or the last one with the key if last is set. */
+static const CJValue *object_find(
+    const CJValue *object,
+    const char *key,
+    size_t length,
+    CJ_BOOL last
+) {
+    const CJObject *obj;
+    const CJValue *found = NULL;
+    size_t i;
+    if (object->type != CJ_OBJECT) return NULL;
+    obj = &object->as.object;
+    if (object->flags & CJ_VALUE_INDEXED) {
+        ObjectIndex *index = object_index(obj);
+        const unsigned *slots = index_slot_array(index);
+        /* all members with the key are found before an empty slot */
+        for (i = hash_key(key, length) & index->mask; slots[i] != 0;
+                i = (i + 1) & index->mask) {
+            const CJObjectMember *member = &obj->members[slots[i] - 1];
+            if (key_equals(&member->key, key, length)) {
+                found = &member->value;
+                if (!last) break;
+            }
+        }
+    } else if (last) {
+        for (i = obj->length; i > 0; --i) {
+            if (key_equals(&obj->members[i - 1].key, key, length)) {
+                return &obj->members[i - 1].value;
+            }
+        }
+    } else {
+        for (i = 0; i < obj->length; ++i) {
+            if (key_equals(&obj->members[i].key, key, length)) {
+                return &obj->members[i].value;
+            }
+        }
+    }
+    return found;
+}
+
+const CJValue *cj_object_get(
+    const CJValue *object,
+    const char *key,
+    size_t length
+) {
+    return object_find(object, key, length, CJ_FALSE);
+}
+
+const CJValue *cj_object_get_last(
+    const CJValue *object,
+    const char *key,
+    size_t length
+) {
+    return object_find(object, key, length, CJ_TRUE);
+}
+
+CJParseResult cj_parse(CJAllocator *allocator, CJReader *reader, CJValue *out) {
+    return cj_parse_ex(allocator, reader, out, 0);
+}
+
+/* Free the values left on the stack and the parser's scratch buffers. */
+static void free_scratch(Parser *p, CJ_BOOL free_values) {
+    size_t i;
+    if (free_values) {
+        for (i = 0; i < p->stack_len; ++i) {
+            cj_free(p->allocator, &p->stack[i]);
+        }
+    }
+    dealloc(p->scratch_allocator, p->stack);
+    dealloc(p->scratch_allocator, p->frames);
+    dealloc(p->scratch_allocator, p->walks);
+    dealloc(p->scratch_allocator, p->chars);
+    dealloc(p->scratch_allocator, p->interned);
+#ifdef STRUCTURAL_INDEX
+    if (p->structurals != NULL) {
+        dealloc(p->scratch_allocator, (void*) p->structurals->positions);
+    }
+#endif
+}
+
+#ifdef CJ_STATS
+/* An allocator that counts the calls to another in a parser's statistics. */
+typedef struct {
+    CJAllocator allocator;
+    CJAllocator *inner;
+    CJParseStats *stats;
+} CountingAllocator;
+
+static void *counting_allocate(CJAllocator *allocator, void *ptr, size_t size) {
+    CountingAllocator *counting =
+        cj_container_of(allocator, CountingAllocator, allocator);
+    CJParseStats *stats = counting->stats;
+    if (size == 0) {
+        ++stats->frees;
+    } else {
+        if (ptr == NULL) {
+            ++stats->allocations;
+        } else {
+            ++stats->reallocations;
+        }
+        stats->bytes_allocated += size;
+    }
+    return counting->inner->allocate(counting->inner, ptr, size);
+}
+
+/* The allocators of a parser while its statistics are counted. */
+typedef struct {
+    CountingAllocator allocator;
+    CountingAllocator scratch_allocator;
+} StatsAllocators;
+
+static void init_counting_allocator(
+    CountingAllocator *counting,
+    CJAllocator *inner,
+    CJParseStats *stats
+) {
+    counting->allocator.allocate = counting_allocate;
+    counting->inner = inner;
+    counting->stats = stats;
+}
+
+/*
+ * Start counting the statistics of a parser that has its input, if asked to.
+ * Its allocators are wrapped in counting ones until end_stats.
+ */
+static void begin_stats(Parser *p, StatsAllocators *sa) {
+    CJParseStats *stats = p->stats;
+    if (stats == NULL) return;
+    memset(stats, 0, sizeof(CJParseStats));
+    /* input in one buffer is all read at once, without the reader */
+    stats->bytes_read = p->end - p->cur;
+    p->buffer_start = p->cur;
+    p->buffer_offset = 0;
+    init_counting_allocator(&sa->allocator, p->allocator, stats);
+    init_counting_allocator(&sa->scratch_allocator, p->scratch_allocator,
+        stats);
+    /* the allocators are compared to tell if scratch memory is separate */
+    if (p->scratch_allocator == p->allocator) {
+        p->scratch_allocator = &sa->allocator.allocator;
+    } else {
+        p->scratch_allocator = &sa->scratch_allocator.allocator;
+    }
+    p->allocator = &sa->allocator.allocator;
+}
+
+/* Finish counting the statistics of a parser, and unwrap its allocators. */
+static void end_stats(Parser *p, StatsAllocators *sa) {
+    CJParseStats *stats = p->stats;
+    if (stats == NULL) return;
+    p->allocator = sa->allocator.inner;
+    p->scratch_allocator = sa->scratch_allocator.inner;
+    stats->bytes_consumed = p->buffer_offset + (p->cur - p->buffer_start);
+    if (p->result != CJ_SUCCESS) stats->error_offset = stats->bytes_consumed;
+}
+#endif
+
+/* Initialize a parser with no input. */
+static void init_parser(Parser *p, CJAllocator *allocator, unsigned flags) {
+#ifdef CJ_DEFAULT_ALLOCATOR
+    if (allocator == NULL) allocator = &default_allocator;
+#endif
+    p->cur = NULL;
+    p->end = NULL;
+    p->reader = NULL;
+    p->contiguous = CJ_FALSE;
+    p->in_situ = CJ_FALSE;
+    p->in_situ_dst = NULL;
+    p->allocator = allocator;
+    p->scratch_allocator = allocator;
+#ifdef CJ_ARENA
+    /* keep the scratch buffers from filling up an arena */
+    if (allocator->allocate == arena_allocate) {
+        CJArena *arena = cj_container_of(allocator, CJArena, allocator);
+        p->scratch_allocator = arena->backing;
+    }
+#endif
+    p->flags = flags;
+    p->handler = NULL;
+    p->ctx = NULL;
+    p->depth = 0;
+    p->max_depth = CJ_MAX_DEPTH;
+#ifdef CJ_STATS
+    p->stats = NULL;
+#endif
+#ifdef STRUCTURAL_INDEX
+    p->structurals = NULL;
+#endif
+    p->stack = NULL;
+    p->stack_len = 0;
+    p->stack_cap = 0;
+    p->frames = NULL;
+    p->frames_len = 0;
+    p->frames_cap = 0;
+    p->walks = NULL;
+    p->walks_len = 0;
+    p->walks_cap = 0;
+    p->chars = NULL;
+    p->chars_len = 0;
+    p->chars_cap = 0;
+    p->interned = NULL;
+    p->interned_len = 0;
+    p->interned_cap = 0;
+    p->result = CJ_SUCCESS;
+}
+
+/* Parse the root value, and the whitespace around it, into out. */
+static void parse_root(Parser *p, CJValue *out) {
+    /* get the first buffer if we need it */
+    if (at_eof(p)) refill(p);
+    skip_ws(p);
+    parse(p);
+    skip_ws(p);
+    /* we should be at EOF, otherwise we consider it a syntax error */
+    if (!at_eof(p)) error(p, CJ_SYNTAX_ERROR);
+    *out = p->stack[0];
+}
+
+/* Parse the root value with an initialized parser. */
+static CJParseResult run_parser(Parser *p, CJValue *out) {
+#ifdef CJ_STATS
+    StatsAllocators sa;
+#endif
+#ifdef STRUCTURAL_INDEX
+    StructuralIndex structurals;
+    /* strings decoded in place could be mistaken for structure */
+    if ((p->flags & CJ_PARSE_TWO_STAGE) && p->contiguous && !p->in_situ) {
+        init_structural_index(&structurals, p->cur, p->end, NULL);
+        p->structurals = &structurals;
+    }
+#endif
+#ifdef CJ_STATS
+    begin_stats(p, &sa);
+#endif
+    if (setjmp(p->buf)) {
+        /* an error occurred, so free memory unless the arena will */
+        free_scratch(p, !(p->flags & CJ_PARSE_ARENA));
+        out->type = CJ_NULL;
+    } else {
+#ifdef STRUCTURAL_INDEX
+        if (p->structurals != NULL) {
+            p->structurals->positions = p->scratch_allocator->allocate(
+                p->scratch_allocator, NULL,
+                STRUCTURAL_WINDOW * sizeof(const char*));
+            if (p->structurals->positions == NULL) {
+                error(p, CJ_OUT_OF_MEMORY);
+            }
+        }
+#endif
+        parse_root(p, out);
+        free_scratch(p, CJ_FALSE);
+    }
+#ifdef CJ_STATS
+    end_stats(p, &sa);
+#endif
+    return p->result;
+}
+
+/* Give a parser its input from a reader. */
+static void set_reader(Parser *p, CJReader *reader) {
+#ifdef CJ_STRING_READER
+    if (reader->read == string_reader_callback) {
+        /* the whole input is available, so parse it as one buffer */
+        CJStringReader *string_reader =
+            cj_container_of(reader, CJStringReader, reader);
+        if (string_reader->string != NULL) {
+            p->cur = string_reader->string;
+            p->end = p->cur + string_reader->length;
+            p->contiguous = CJ_TRUE;
+            string_reader->string = NULL;
+        }
+        return;
+    }
+#endif
+#ifdef CJ_MAPPED_FILE_READER
+    if (reader->read == mapped_file_reader_callback) {
+        /* the file stays available, just like a string */
+        CJMappedFileReader *mapped_file_reader =
+            cj_container_of(reader, CJMappedFileReader, reader);
+        if (!mapped_file_reader->consumed) {
+            p->cur = mapped_file_reader->data;
+            p->end = p->cur + mapped_file_reader->length;
+            p->contiguous = CJ_TRUE;
+            mapped_file_reader->consumed = CJ_TRUE;
+        }
+        return;
+    }
+#endif
+    p->reader = reader;
+}
+
+CJParseResult cj_parse_ex(
+    CJAllocator *allocator,
+    CJReader *reader,
+    CJValue *out,
+    unsigned flags
+) {
+    /* create a parser */
+    Parser p;
+    init_parser(&p, allocator, flags);
+    set_reader(&p, reader);
+    return run_parser(&p, out);
+}
+
+void cj_init_parse_options(CJParseOptions *options) {
+    options->flags = 0;
+    options->max_depth = CJ_MAX_DEPTH;
+    options->stats = NULL;
+}
+
+/* Initialize a parser with the given options, or the defaults if NULL. */
+static void init_parser_options(
+    Parser *p,
+    CJAllocator *allocator,
+    const CJParseOptions *options
+) {
+    init_parser(p, allocator, options == NULL ? 0 : options->flags);
+    if (options != NULL) {
+        p->max_depth = options->max_depth;
+#ifdef CJ_STATS
+        p->stats = options->stats;
+#endif
+    }
+}
+
+CJParseResult cj_parse_with_options(
+    CJAllocator *allocator,
+    CJReader *reader,
+    CJValue *out,
+    const CJParseOptions *options
+) {
+    Parser p;
+    init_parser_options(&p, allocator, options);
+    set_reader(&p, reader);
+    return run_parser(&p, out);
+}
+
+CJParseResult cj_parse_buffer(
+    CJAllocator *allocator,
+    const char *data,
+    size_t length,
+    CJValue *out
+) {
+    return cj_parse_buffer_ex(allocator, data, length, out, 0);
+}
+
+CJParseResult cj_parse_buffer_ex(
+    CJAllocator *allocator,
+    const char *data,
+    size_t length,
+    CJValue *out,
+    unsigned flags
+) {
+    Parser p;
+    init_parser(&p, allocator, flags);
+    p.cur = data;
+    p.end = data + length;
+    p.contiguous = CJ_TRUE;
+    return run_parser(&p, out);
+}
+
+CJParseResult cj_parse_insitu(
+    CJAllocator *allocator,
+    char *data,
+    size_t length,
+    CJValue *out
+) {
+    return cj_parse_insitu_ex(allocator, data, length, out, 0);
+}
+
+CJParseResult cj_parse_insitu_ex(
+    CJAllocator *allocator,
+    char *data,
+    size_t length,
+    CJValue *out,
+    unsigned flags
+) {
+    Parser p;
+    init_parser(&p, allocator, flags);
+    p.cur = data;
+    p.end = data + length;
+    p.contiguous = CJ_TRUE;
+    p.in_situ = CJ_TRUE;
+    return run_parser(&p, out);
+}
+
+#ifdef HAVE_THREADS
+/*
+ * A parallel parse splits the elements of a root array into one range per
+ * thread. Each range is parsed by its own parser, leaving the elements and
+ * their pending strings on its stack, and the ranges are then copied into the
+ * root array in order, just as finish_array would have done.
+ */
+
+/* When choosing the number of threads, give each at least this much input. */
+#define PARALLEL_MIN_RANGE 65536
+
+typedef struct {
+    /* the parser of the range, whose input is the range */
+    Parser p;
+    Thread thread;
+    CJ_BOOL started;
+} ParallelRange;
+
+/*
+ * Find where to split the elements of a root array into up to count ranges of
+ * about the same size, and store the commas between them in cuts. Return the
+ * number of ranges, along with where the first starts and the last ends, or 0
+ * if the input doesn't look like an array. Only strings and nesting are
+ * tracked, so the ranges may still be invalid.
+ */
+static size_t find_ranges(
+    const char *data,
+    size_t length,
+    size_t count,
+    const char **cuts,
+    const char **first,
+    const char **last
+) {
+    const char *cur = data, *end = data + length, *start;
+    size_t depth = 0, ranges = 1;
+    cur = skip_ws_run(cur, end);
+    if (cur == end || *cur != '[') return 0;
+    start = *first = ++cur;
+    while (cur != end) {
+        switch (*cur++) {
+            case '"':
+                for (;;) {
+                    cur = skip_plain_ascii(cur, end);
+                    if (cur == end) return 0;
+                    if (*cur == '"') break;
+                    /* skip the escaped character along with the backslash */
+                    if (*cur++ == '\\' && cur != end) ++cur;
+                }
+                ++cur;
+                break;
+            case '[':
+            case '{':
+                ++depth;
+                break;
+            case ']':
+            case '}':
+                if (depth == 0) {
+                    /* only a bracket closes the root array */
+                    if (cur[-1] != ']') return 0;
+                    *last = cur - 1;
+                    cur = skip_ws_run(cur, end);
+                    return cur == end ? ranges : 0;
+                }
+                --depth;
+                break;
+            case ',':
+                if (depth == 0 && ranges < count
+                        && (size_t) (cur - start) >= length / count * ranges) {
+                    cuts[ranges++ - 1] = cur - 1;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return 0;
+}
+
+/* Parse the comma-separated elements of a range onto the parser's stack. */
+static void parse_range(ParallelRange *range) {
+    Parser *p = &range->p;
+    if (setjmp(p->buf)) return;
+    /* the elements are inside the root array */
+    p->depth = 1;
+    for (;;) {
+        skip_ws(p);
+        parse(p);
+        skip_ws(p);
+        if (at_eof(p)) break;
+        require(p, ',');
+    }
+}
+
+THREAD_ENTRY(parse_range_thread) {
+    parse_range(arg);
+    THREAD_EXIT;
+}
+
+/* Copy the elements of every range into the root array. */
+static CJ_BOOL join_ranges(
+    CJAllocator *allocator,
+    ParallelRange *ranges,
+    size_t count,
+    CJValue *out
+) {
+    size_t i, j, length = 0, chars = 0;
+    CJValue *elements, *element;
+    char *packed;
+    for (i = 0; i < count; ++i) {
+        length += ranges[i].p.stack_len;
+        chars += ranges[i].p.chars_len;
+    }
+    if (length > (SIZE_MAX - chars) / sizeof(CJValue)) return CJ_FALSE;
+    elements = allocator->allocate(allocator, NULL,
+        length * sizeof(CJValue) + chars);
+    if (elements == NULL) return CJ_FALSE;
+    element = elements;
+    packed = (char*) (elements + length);
+    for (i = 0; i < count; ++i) {
+        Parser *p = &ranges[i].p;
+        memcpy(element, p->stack, p->stack_len * sizeof(CJValue));
+        if (p->chars_len != 0) {
+            memcpy(packed, p->chars, p->chars_len);
+            for (j = 0; j < p->stack_len; ++j) {
+                if (is_pending(&element[j])) {
+                    element[j].as.string.chars = packed;
+                    packed += element[j].as.string.length + 1;
+                }
+            }
+        }
+        element += p->stack_len;
+    }
+    out->type = CJ_ARRAY;
+    out->flags = 0;
+    out->as.array.length = length;
+    out->as.array.elements = elements;
+    return CJ_TRUE;
+}
+
+/*
+ * Try to parse a root array in parallel, returning CJ_FALSE if it should be
+ * parsed normally instead, either because it can't be split or because of an
+ * error, which the normal parser reports just as it always would.
+ */
+static CJ_BOOL parse_parallel(
+    CJAllocator *allocator,
+    const char *data,
+    size_t length,
+    CJValue *out,
+    unsigned flags,
+    size_t count
+) {
+    const char **cuts, *first, *last;
+    ParallelRange *ranges;
+    CJ_BOOL success = CJ_TRUE;
+    size_t i;
+    if (count > SIZE_MAX / sizeof(ParallelRange)) return CJ_FALSE;
+    cuts = allocator->allocate(allocator, NULL, count * sizeof(const char*));
+    if (cuts == NULL) return CJ_FALSE;
+    count = find_ranges(data, length, count, cuts, &first, &last);
+    if (count < 2) {
+        allocator->allocate(allocator, (void*) cuts, 0);
+        return CJ_FALSE;
+    }
+    ranges = allocator->allocate(allocator, NULL,
+        count * sizeof(ParallelRange));
+    if (ranges == NULL) {
+        allocator->allocate(allocator, (void*) cuts, 0);
+        return CJ_FALSE;
+    }
+    for (i = 0; i < count; ++i) {
+        Parser *p = &ranges[i].p;
+        init_parser(p, allocator, flags);
+        p->cur = i == 0 ? first : cuts[i - 1] + 1;
+        p->end = i == count - 1 ? last : cuts[i];
+        p->contiguous = CJ_TRUE;
+    }
+    allocator->allocate(allocator, (void*) cuts, 0);
+    /* this thread parses the first range, and starts threads for the rest */
+    for (i = 1; i < count; ++i) {
+        ranges[i].started =
+            start_thread(&ranges[i].thread, parse_range_thread, &ranges[i]);
+    }
+    parse_range(&ranges[0]);
+    for (i = 1; i < count; ++i) {
+        if (ranges[i].started) {
+            join_thread(ranges[i].thread);
+        } else {
+            parse_range(&ranges[i]);
+        }
+    }
+    for (i = 0; i < count; ++i) {
+        if (ranges[i].p.result != CJ_SUCCESS) success = CJ_FALSE;
+    }
+    if (success) success = join_ranges(allocator, ranges, count, out);
+    for (i = 0; i < count; ++i) {
+        free_scratch(&ranges[i].p, !success && !(flags & CJ_PARSE_ARENA));
+    }
+    allocator->allocate(allocator, ranges, 0);
+    return success;
+}
+#endif
+
+CJParseResult cj_parse_parallel(
+    CJAllocator *allocator,
+    const char *data,
+    size_t length,
+    CJValue *out,
+    unsigned flags,
+    unsigned thread_count
+) {
+#ifdef HAVE_THREADS
+    CJAllocator *shared = allocator;
+#ifdef CJ_DEFAULT_ALLOCATOR
+    if (shared == NULL) shared = &default_allocator;
+#endif
+    if (thread_count == 0) {
+        thread_count = count_processors();
+        if (thread_count > length / PARALLEL_MIN_RANGE) {
+            thread_count = (unsigned) (length / PARALLEL_MIN_RANGE);
+        }
+    }
+#ifdef CJ_ARENA
+    /* an arena can't be shared between threads */
+    if (shared->allocate == arena_allocate) thread_count = 1;
+#endif
+#ifdef CJ_POOL
+    /* neither can a pool or one of its caches */
+    if (shared->allocate == pool_allocate
+            || shared->allocate == pool_cache_allocate) {
+        thread_count = 1;
+    }
+#endif
+    /* each range would intern its keys separately */
+    if (flags & CJ_PARSE_INTERN_KEYS) thread_count = 1;
+    if (thread_count > 1
+            && parse_parallel(shared, data, length, out, flags, thread_count)) {
+        return CJ_SUCCESS;
+    }
+#else
+    (void) thread_count;
+#endif
+    return cj_parse_buffer_ex(allocator, data, length, out, flags);
+}
+
+/*
+ * A stream parses one value after another from the same reader, keeping its
+ * scratch buffers between them.
+ */
+struct CJStream {
+    Parser p;
+};
+
+/* Tables of interned keys up to this many slots are kept between values. */
+#define INTERNED_KEEP_SLOTS 1024
+
+/* Get ready to parse another value, keeping the scratch buffers. */
+static void reset_scratch(Parser *p) {
+    p->stack_len = 0;
+    p->frames_len = 0;
+    p->walks_len = 0;
+    p->chars_len = 0;
+    p->depth = 0;
+    /* the interned keys belong to the last value, so forget them */
+    if (p->interned_cap > INTERNED_KEEP_SLOTS) {
+        dealloc(p->scratch_allocator, p->interned);
+        p->interned = NULL;
+        p->interned_cap = 0;
+    } else if (p->interned_len != 0) {
+        size_t i;
+        for (i = 0; i < p->interned_cap; ++i) p->interned[i].chars = NULL;
+    }
+    p->interned_len = 0;
+}
+
+/* Give a parser that is kept between inputs its next input. */
+static void restart_parser(Parser *p, CJReader *reader) {
+    p->cur = NULL;
+    p->end = NULL;
+    p->reader = NULL;
+    p->contiguous = CJ_FALSE;
+    p->in_situ = CJ_FALSE;
+    p->result = CJ_SUCCESS;
+    set_reader(p, reader);
+}
+
+CJStream *cj_stream_new(
+    CJAllocator *allocator,
+    CJReader *reader,
+    unsigned flags
+) {
+    Parser p;
+    CJStream *stream;
+    init_parser(&p, allocator, flags);
+    set_reader(&p, reader);
+    /* keep the stream out of an arena, like the scratch buffers */
+    stream = p.scratch_allocator->allocate(p.scratch_allocator, NULL,
+        sizeof(CJStream));
+    if (stream == NULL) return NULL;
+    stream->p = p;
+    return stream;
+}
+
+CJParseResult cj_parse_next(CJStream *stream, CJValue *out) {
+    Parser *p = &stream->p;
+    out->type = CJ_NULL;
+    out->flags = 0;
+    /* the stream can't go on after an error or its end */
+    if (p->result != CJ_SUCCESS) return p->result;
+    if (setjmp(p->buf)) {
+        /* an error occurred, so free memory unless the arena will */
+        if (!(p->flags & CJ_PARSE_ARENA)) {
+            size_t i;
+            for (i = 0; i < p->stack_len; ++i) {
+                cj_free(p->allocator, &p->stack[i]);
+            }
+        }
+        reset_scratch(p);
+        return p->result;
+    }
+    /* get the first buffer if we need it */
+    if (at_eof(p)) refill(p);
+    skip_ws(p);
+    if (at_eof(p)) {
+        p->result = CJ_END_OF_STREAM;
+        return p->result;
+    }
+    parse(p);
+    /* values must be separated by whitespace */
+    if (!at_eof(p) && !is_ws(*p->cur)) error(p, CJ_SYNTAX_ERROR);
+    *out = p->stack[0];
+    reset_scratch(p);
+    return CJ_SUCCESS;
+}
+
+void cj_stream_delete(CJStream *stream) {
+    CJAllocator *scratch_allocator = stream->p.scratch_allocator;
+    /* no values are left on the stack between calls */
+    free_scratch(&stream->p, CJ_FALSE);
+    dealloc(scratch_allocator, stream);
+}
+
+/*
+ * A parser that is kept between inputs, so that its scratch buffers are only
+ * allocated for the first few.
+ */
+struct CJParser {
+    Parser p;
+#ifdef STRUCTURAL_INDEX
+    StructuralIndex structurals;
+    /* The positions of the structural index, once allocated. */
+    const char **positions;
+#endif
+};
+
+CJParser *cj_parser_new(
+    CJAllocator *allocator,
+    const CJParseOptions *options
+) {
+    Parser p;
+    CJParser *parser;
+    init_parser_options(&p, allocator, options);
+    /* keep the parser out of an arena, like the scratch buffers */
+    parser = p.scratch_allocator->allocate(p.scratch_allocator, NULL,
+        sizeof(CJParser));
+    if (parser == NULL) return NULL;
+    parser->p = p;
+#ifdef STRUCTURAL_INDEX
+    parser->positions = NULL;
+#endif
+    return parser;
+}
+
+CJParseResult cj_parser_parse(
+    CJParser *parser,
+    CJReader *reader,
+    CJValue *out
+) {
+    Parser *p = &parser->p;
+#ifdef CJ_STATS
+    StatsAllocators sa;
+#endif
+    restart_parser(p, reader);
+#ifdef STRUCTURAL_INDEX
+    p->structurals = NULL;
+#endif
+#ifdef CJ_STATS
+    begin_stats(p, &sa);
+#endif
+    if (setjmp(p->buf)) {
+        /* an error occurred, so free memory unless the arena will */
+        if (!(p->flags & CJ_PARSE_ARENA)) {
+            size_t i;
+            for (i = 0; i < p->stack_len; ++i) {
+                cj_free(p->allocator, &p->stack[i]);
+            }
+        }
+        out->type = CJ_NULL;
+        out->flags = 0;
+    } else {
+#ifdef STRUCTURAL_INDEX
+        if ((p->flags & CJ_PARSE_TWO_STAGE) && p->contiguous) {
+            /* the index is allocated once, for the first input in memory */
+            if (parser->positions == NULL) {
+                parser->positions = p->scratch_allocator->allocate(
+                    p->scratch_allocator, NULL,
+                    STRUCTURAL_WINDOW * sizeof(const char*));
+                if (parser->positions == NULL) error(p, CJ_OUT_OF_MEMORY);
+            }
+            init_structural_index(&parser->structurals, p->cur, p->end,
+                parser->positions);
+            p->structurals = &parser->structurals;
+        }
+#endif
+        parse_root(p, out);
+    }
+    reset_scratch(p);
+#ifdef CJ_STATS
+    end_stats(p, &sa);
+#endif
+    return p->result;
+}
+
+void cj_parser_delete(CJParser *parser) {
+    CJAllocator *scratch_allocator = parser->p.scratch_allocator;
+#ifdef STRUCTURAL_INDEX
+    parser->p.structurals = NULL;
+    dealloc(scratch_allocator, (void*) parser->positions);
+#endif
+    /* no values are left on the stack between calls */
+    free_scratch(&parser->p, CJ_FALSE);
+    dealloc(scratch_allocator, parser);
+}
+
+/*
+ * A batch parser has one worker per thread, each with its own parser. A batch
+ * is split into one range of inputs per worker, which takes a few at a time
+ * from the front of its range. A worker that runs out takes the back half of
+ * what is left of another's range, and stops once every range is empty.
+ */
+
+/* A worker takes at most this many inputs from its range at a time. */
+#define BATCH_MAX_TAKE 32
+
+typedef struct {
+    struct CJBatchParser *batch;
+    CJParser *parser;
+#ifdef CJ_ARENA
+    CJArena arena;
+#endif
+#ifdef CJ_POOL
+    CJPoolCache *cache;
+#endif
+#ifdef HAVE_THREADS
+    Thread thread;
+    /* Held while the range is changed, by this worker or another. */
+    Mutex mutex;
+    /* The inputs of the range that are left. */
+    size_t next;
+    size_t end;
+    /* The number of the last batch the worker started. */
+    unsigned long batch_number;
+#endif
+} BatchWorker;
+
+struct CJBatchParser {
+    CJAllocator *allocator;
+    BatchWorker *workers;
+    unsigned count;
+    /* True if the workers allocate from their arenas. */
+    CJ_BOOL arenas;
+    /* The batch being parsed. */
+    const CJBatchInput *inputs;
+    CJValue *outs;
+    CJParseResult *results;
+#ifdef HAVE_THREADS
+    /* Held while a batch starts and finishes. */
+    Mutex mutex;
+    /* Broadcast when a batch starts, or the workers should stop. */
+    Condition started;
+    /* Broadcast when the last worker finishes a batch. */
+    Condition finished;
+    unsigned long batch_number;
+    /* The number of workers that haven't finished the batch. */
+    unsigned running;
+    CJ_BOOL stopping;
+    /* The number of workers whose threads have been started. */
+    unsigned started_count;
+#endif
+    /* The number of workers that have been set up. */
+    unsigned ready_count;
+};
+
+void cj_init_batch_options(CJBatchOptions *options) {
+    options->parse_options = NULL;
+    options->thread_count = 0;
+    options->processors = NULL;
+#ifdef CJ_ARENA
+    options->arenas = CJ_FALSE;
+#endif
+#ifdef CJ_POOL
+    options->pool = NULL;
+#endif
+}
+
+/* Parse one input of the batch. */
+static void batch_parse(BatchWorker *w, size_t index) {
+    CJBatchParser *batch = w->batch;
+    CJStringReader string_reader;
+    cj_init_string_reader(&string_reader, batch->inputs[index].data,
+        batch->inputs[index].length);
+    batch->results[index] = cj_parser_parse(w->parser, &string_reader.reader,
+        &batch->outs[index]);
+}
+
+#ifdef HAVE_THREADS
+/*
+ * Take some inputs from the front of a worker's range, storing the first and
+ * returning how many. A quarter of the range is taken, so that enough is left
+ * to be shared out at the end of a batch.
+ */
+static size_t batch_take(BatchWorker *w, size_t *first) {
+    size_t taken;
+    lock_mutex(&w->mutex);
+    taken = (w->end - w->next + 3) / 4;
+    if (taken > BATCH_MAX_TAKE) taken = BATCH_MAX_TAKE;
+    *first = w->next;
+    w->next += taken;
+    unlock_mutex(&w->mutex);
+    return taken;
+}
+
+/*
+ * Take the back half of what is left of another worker's range, starting with
+ * the next worker, and return CJ_FALSE if every range is empty.
+ */
+static CJ_BOOL batch_steal(BatchWorker *w) {
+    CJBatchParser *batch = w->batch;
+    unsigned index = (unsigned) (w - batch->workers), i;
+    for (i = 1; i < batch->count; ++i) {
+        BatchWorker *victim = &batch->workers[(index + i) % batch->count];
+        size_t first, end;
+        lock_mutex(&victim->mutex);
+        end = victim->end;
+        first = end - (end - victim->next + 1) / 2;
+        victim->end = first;
+        unlock_mutex(&victim->mutex);
+        if (first != end) {
+            lock_mutex(&w->mutex);
+            w->next = first;
+            w->end = end;
+            unlock_mutex(&w->mutex);
+            return CJ_TRUE;
+        }
+    }
+    return CJ_FALSE;
+}
+
+/* Parse inputs until there are none left in any range. */
+static void batch_work(BatchWorker *w) {
+    size_t first, taken;
+    do {
+        while ((taken = batch_take(w, &first)) != 0) {
+            size_t end = first + taken;
+            for (; first < end; ++first) batch_parse(w, first);
+        }
+    } while (batch_steal(w));
+}
+
+THREAD_ENTRY(batch_thread) {
+    BatchWorker *w = arg;
+    CJBatchParser *batch = w->batch;
+    lock_mutex(&batch->mutex);
+    for (;;) {
+        while (w->batch_number == batch->batch_number && !batch->stopping) {
+            wait_condition(&batch->started, &batch->mutex);
+        }
+        if (batch->stopping) break;
+        w->batch_number = batch->batch_number;
+        unlock_mutex(&batch->mutex);
+        batch_work(w);
+        lock_mutex(&batch->mutex);
+        if (--batch->running == 0) broadcast_condition(&batch->finished);
+    }
+    unlock_mutex(&batch->mutex);
+    THREAD_EXIT;
+}
+#endif
+
+/* Set up a worker, and return CJ_FALSE if it fails, leaving nothing behind. */
+static CJ_BOOL setup_worker(
+    CJBatchParser *batch,
+    BatchWorker *w,
+    const CJBatchOptions *options,
+    const CJParseOptions *parse_options
+) {
+    CJAllocator *allocator = batch->allocator;
+    w->batch = batch;
+#ifdef CJ_ARENA
+    cj_arena_init(&w->arena, batch->allocator, 0);
+    if (batch->arenas) allocator = &w->arena.allocator;
+#endif
+#ifdef CJ_POOL
+    w->cache = NULL;
+    if (!batch->arenas && options->pool != NULL) {
+#ifdef HAVE_THREADS
+        w->cache = cj_pool_cache_new(options->pool);
+        if (w->cache == NULL) return CJ_FALSE;
+        allocator = cj_pool_cache_allocator(w->cache);
+#else
+        /* every worker runs on the calling thread, so none need a cache */
+        allocator = cj_pool_allocator(options->pool);
+#endif
+    }
+#else
+    (void) options;
+#endif
+    w->parser = cj_parser_new(allocator, parse_options);
+#ifdef HAVE_THREADS
+    w->next = 0;
+    w->end = 0;
+    w->batch_number = 0;
+    if (w->parser != NULL && init_mutex(&w->mutex)) return CJ_TRUE;
+    if (w->parser != NULL) cj_parser_delete(w->parser);
+#else
+    if (w->parser != NULL) return CJ_TRUE;
+#endif
+#ifdef CJ_POOL
+    if (w->cache != NULL) cj_pool_cache_delete(w->cache);
+#endif
+    return CJ_FALSE;
+}
+
+static void teardown_worker(BatchWorker *w) {
+#ifdef HAVE_THREADS
+    destroy_mutex(&w->mutex);
+#endif
+    cj_parser_delete(w->parser);
+#ifdef CJ_ARENA
+    cj_arena_release(&w->arena);
+#endif
+#ifdef CJ_POOL
+    if (w->cache != NULL) cj_pool_cache_delete(w->cache);
+#endif
+}
+
+CJBatchParser *cj_batch_parser_new(
+    CJAllocator *allocator,
+    const CJBatchOptions *options
+) {
+    CJBatchOptions default_options;
+    CJParseOptions parse_options;
+    CJBatchParser *batch;
+    unsigned count = 1;
+#ifdef CJ_DEFAULT_ALLOCATOR
+    if (allocator == NULL) allocator = &default_allocator;
+#endif
+    if (options == NULL) {
+        cj_init_batch_options(&default_options);
+        options = &default_options;
+    }
+    if (options->parse_options != NULL) {
+        parse_options = *options->parse_options;
+    } else {
+        cj_init_parse_options(&parse_options);
+    }
+    /* every thread would store its statistics in the same place */
+    parse_options.stats = NULL;
+#ifdef HAVE_THREADS
+    count = options->thread_count;
+    if (count == 0) count = count_processors();
+#endif
+    batch = allocator->allocate(allocator, NULL, sizeof(CJBatchParser));
+    if (batch == NULL) return NULL;
+    batch->allocator = allocator;
+    batch->count = count;
+    batch->arenas = CJ_FALSE;
+#ifdef CJ_ARENA
+    batch->arenas = options->arenas;
+    if (batch->arenas) parse_options.flags |= CJ_PARSE_ARENA;
+#endif
+    batch->inputs = NULL;
+    batch->outs = NULL;
+    batch->results = NULL;
+    batch->ready_count = 0;
+    batch->workers = allocator->allocate(allocator, NULL,
+        count * sizeof(BatchWorker));
+    if (batch->workers == NULL) {
+        allocator->allocate(allocator, batch, 0);
+        return NULL;
+    }
+#ifdef HAVE_THREADS
+    batch->batch_number = 0;
+    batch->running = 0;
+    batch->stopping = CJ_FALSE;
+    batch->started_count = 0;
+    if (!init_mutex(&batch->mutex)) goto fail;
+    if (!init_condition(&batch->started)) {
+        destroy_mutex(&batch->mutex);
+        goto fail;
+    }
+    if (!init_condition(&batch->finished)) {
+        destroy_condition(&batch->started);
+        destroy_mutex(&batch->mutex);
+        goto fail;
+    }
+#endif
+    for (; batch->ready_count < count; ++batch->ready_count) {
+        if (!setup_worker(batch, &batch->workers[batch->ready_count], options,
+                &parse_options)) {
+            cj_batch_parser_delete(batch);
+            return NULL;
+        }
+    }
+#ifdef HAVE_THREADS
+    for (; batch->started_count < count; ++batch->started_count) {
+        BatchWorker *w = &batch->workers[batch->started_count];
+        if (!start_thread(&w->thread, batch_thread, w)) {
+            cj_batch_parser_delete(batch);
+            return NULL;
+        }
+        if (options->processors != NULL
+                && !pin_thread(w->thread,
+                    options->processors[batch->started_count])) {
+            /* the thread has to be stopped along with the others */
+            ++batch->started_count;
+            cj_batch_parser_delete(batch);
+            return NULL;
+        }
+    }
+#endif
+    return batch;
+#ifdef HAVE_THREADS
+fail:
+    allocator->allocate(allocator, batch->workers, 0);
+    allocator->allocate(allocator, batch, 0);
+    return NULL;
+#endif
+}
+
+CJ_BOOL cj_parse_batch(
+    CJBatchParser *parser,
+    const CJBatchInput *inputs,
+    size_t count,
+    CJValue *outs,
+    CJParseResult *results
+) {
+    size_t i;
+#ifdef HAVE_THREADS
+    size_t share = count / parser->count, extra = count % parser->count;
+    size_t next = 0;
+#endif
+#ifdef CJ_ARENA
+    /* the values of the last batch go all at once */
+    if (parser->arenas) {
+        for (i = 0; i < parser->count; ++i) {
+            cj_arena_reset(&parser->workers[i].arena);
+        }
+    }
+#endif
+    if (count == 0) return CJ_TRUE;
+    parser->inputs = inputs;
+    parser->outs = outs;
+    parser->results = results;
+#ifdef HAVE_THREADS
+    lock_mutex(&parser->mutex);
+    /* the workers are waiting, so their ranges can be set without locks */
+    for (i = 0; i < parser->count; ++i) {
+        BatchWorker *w = &parser->workers[i];
+        w->next = next;
+        next += i < extra ? share + 1 : share;
+        w->end = next;
+    }
+    ++parser->batch_number;
+    parser->running = parser->count;
+    broadcast_condition(&parser->started);
+    while (parser->running != 0) {
+        wait_condition(&parser->finished, &parser->mutex);
+    }
+    unlock_mutex(&parser->mutex);
+#else
+    for (i = 0; i < count; ++i) batch_parse(&parser->workers[0], i);
+#endif
+    for (i = 0; i < count; ++i) {
+        if (results[i] != CJ_SUCCESS) return CJ_FALSE;
+    }
+    return CJ_TRUE;
+}
+
+void cj_batch_parser_delete(CJBatchParser *parser) {
+    CJAllocator *allocator = parser->allocator;
+    unsigned i;
+#ifdef HAVE_THREADS
+    lock_mutex(&parser->mutex);
+    parser->stopping = CJ_TRUE;
+    broadcast_condition(&parser->started);
+    unlock_mutex(&parser->mutex);
+    for (i = 0; i < parser->started_count; ++i) {
+        join_thread(parser->workers[i].thread);
+    }
+    destroy_condition(&parser->finished);
+    destroy_condition(&parser->started);
+    destroy_mutex(&parser->mutex);
+#endif
+    for (i = 0; i < parser->ready_count; ++i) {
+        teardown_worker(&parser->workers[i]);
+    }
+    allocator->allocate(allocator, parser->workers, 0);
+    allocator->allocate(allocator, parser, 0);
+}
+
+/*
+ * Parsing into events uses the same lexer, but calls the handler instead of
+ * pushing values, so only the string being parsed is kept in memory.
+ */
+
+/* Stop parsing if a handler asked to. */
+static void handled(Parser *p, CJ_BOOL keep_going) {
+    if (!keep_going) error(p, CJ_STOPPED);
+}
+
+/* Parse a string and pass it to the key or string handler. */
+static void string_event(
+    Parser *p,
+    CJ_BOOL (*handler)(void *ctx, const char *chars, size_t length)
+) {
+    parse_string(p);
+    push_char(p, '\0');
+    if (handler != NULL) {
+        handled(p, handler(p->ctx, p->chars, p->chars_len - 1));
+    }
+    p->chars_len = 0;
+}
+
+/* Parse the key of a member, passing it to the handler, and the colon after. */
+static void key_event(Parser *p) {
+    require(p, '"');
+    string_event(p, p->handler->key);
+    skip_ws(p);
+    require(p, ':');
+    skip_ws(p);
+}
+
+/* Pass the end of an array or object to the handler. */
+static void end_event(Parser *p, CJ_BOOL object) {
+    const CJHandler *h = p->handler;
+    if (object) {
+        if (h->end_object != NULL) handled(p, h->end_object(p->ctx));
+    } else {
+        if (h->end_array != NULL) handled(p, h->end_array(p->ctx));
+    }
+}
+
+/*
+ * Parse a value, passing it to the handler. Instead of recursing into arrays
+ * and objects, they are opened on the stack of frames.
+ */
+static void parse_events(Parser *p) {
+    const CJHandler *h = p->handler;
+    /* the frames below are the caller's */
+    size_t base = p->frames_len;
+    for (;;) {
+        CJ_BOOL object;
+        char c;
+        /* check depth */
+        if (++p->depth == p->max_depth) {
+            error(p, CJ_TOO_MUCH_NESTING);
+        }
+        if (check(p, '-') || is_digit(p)) {
+            double number = scan_number(p);
+            if (h->number != NULL) handled(p, h->number(p->ctx, number));
+        } else {
+            switch (c = take(p)) {
+                case 't':
+                    require(p, 'r');
+                    require(p, 'u');
+                    require(p, 'e');
+                    if (h->boolean != NULL) {
+                        handled(p, h->boolean(p->ctx, CJ_TRUE));
+                    }
+                    break;
+                case 'f':
+                    require(p, 'a');
+                    require(p, 'l');
+                    require(p, 's');
+                    require(p, 'e');
+                    if (h->boolean != NULL) {
+                        handled(p, h->boolean(p->ctx, CJ_FALSE));
+                    }
+                    break;
+                case 'n':
+                    require(p, 'u');
+                    require(p, 'l');
+                    require(p, 'l');
+                    if (h->null != NULL) handled(p, h->null(p->ctx));
+                    break;
+                case '"':
+                    string_event(p, h->string);
+                    break;
+                case '[':
+                case '{':
+                    object = c == '{';
+                    if (object) {
+                        if (h->start_object != NULL) {
+                            handled(p, h->start_object(p->ctx));
+                        }
+                    } else {
+                        if (h->start_array != NULL) {
+                            handled(p, h->start_array(p->ctx));
+                        }
+                    }
+                    skip_ws(p);
+                    if (eat(p, object ? '}' : ']')) {
+                        end_event(p, object);
+                        break;
+                    }
+                    /* go on to the first child */
+                    push_frame(p, 0, object);
+                    if (object) key_event(p);
+                    continue;
+                default:
+                    error(p, CJ_SYNTAX_ERROR);
+            }
+        }
+        --p->depth;
+        /* close the containers that the value was the last child of */
+        for (;;) {
+            CJ_BOOL last_object;
+            if (p->frames_len == base) return;
+            last_object = p->frames[p->frames_len - 1].object;
+            skip_ws(p);
+            if (eat(p, ',')) {
+                skip_ws(p);
+                if (last_object) key_event(p);
+                break;
+            }
+            require(p, last_object ? '}' : ']');
+            --p->frames_len;
+            end_event(p, last_object);
+            --p->depth;
+        }
+    }
+}
+
+CJParseResult cj_parse_events(
+    CJAllocator *allocator,
+    CJReader *reader,
+    const CJHandler *handler,
+    void *ctx
+) {
+    Parser p;
+    init_parser(&p, allocator, 0);
+    set_reader(&p, reader);
+    p.handler = handler;
+    p.ctx = ctx;
+    if (setjmp(p.buf) == 0) {
+        /* get the first buffer if we need it */
+        if (at_eof(&p)) refill(&p);
+        skip_ws(&p);
+        parse_events(&p);
+        skip_ws(&p);
+        /* we should be at EOF, otherwise we consider it a syntax error */
+        if (!at_eof(&p)) error(&p, CJ_SYNTAX_ERROR);
+    }
+    free_scratch(&p, CJ_FALSE);
+    return p.result;
+}
+
+/*
+ * Validating follows the same grammar as parse, in the same order, so that it
+ * finds the same errors, but keeps nothing. Strings are decoded as if in situ
+ * with nowhere to put them, and the text of numbers is only checked.
+ */
+
+static void *no_allocate(CJAllocator *allocator, void *ptr, size_t size) {
+    (void) allocator;
+    (void) ptr;
+    (void) size;
+    return NULL;
+}
+
+/*
+ * An allocator that has no memory, for parsers that never allocate. Nothing
+ * writes to an allocator, so it can be const.
+ */
+static const CJAllocator no_allocator = { no_allocate };
+
+/* Validate the key of a member and the colon after it. */
+static void validate_key(Parser *p) {
+    require(p, '"');
+    parse_string(p);
+    skip_ws(p);
+    require(p, ':');
+    skip_ws(p);
+}
+
+/*
+ * Validate a value. Instead of recursing into arrays and objects, a bit is kept
+ * for each open one, saying whether it is an object, so that nothing is
+ * allocated and the stack used does not grow with the depth. Validating
+ * parsers never go deeper than CJ_MAX_DEPTH.
+ */
+static void validate_value(Parser *p) {
+    unsigned char objects[(CJ_MAX_DEPTH + CHAR_BIT - 1) / CHAR_BIT];
+    /* the number of open arrays and objects */
+    size_t open = 0;
+    for (;;) {
+        CJ_BOOL object;
+        char c;
+        /* check depth */
+        if (++p->depth == p->max_depth) {
+            error(p, CJ_TOO_MUCH_NESTING);
+        }
+        if (check(p, '-') || is_digit(p)) {
+            scan_number_text(p, CJ_FALSE);
+        } else {
+            switch (c = take(p)) {
+                case 't':
+                    require(p, 'r');
+                    require(p, 'u');
+                    require(p, 'e');
+                    break;
+                case 'f':
+                    require(p, 'a');
+                    require(p, 'l');
+                    require(p, 's');
+                    require(p, 'e');
+                    break;
+                case 'n':
+                    require(p, 'u');
+                    require(p, 'l');
+                    require(p, 'l');
+                    break;
+                case '"':
+                    parse_string(p);
+                    break;
+                case '[':
+                case '{':
+                    object = c == '{';
+                    skip_ws(p);
+                    if (eat(p, object ? '}' : ']')) break;
+                    if (open == CJ_MAX_DEPTH) error(p, CJ_TOO_MUCH_NESTING);
+                    if (object) {
+                        objects[open / CHAR_BIT] |= 1 << open % CHAR_BIT;
+                        validate_key(p);
+                    } else {
+                        objects[open / CHAR_BIT] &= ~(1 << open % CHAR_BIT);
+                    }
+                    ++open;
+                    /* go on to the first child */
+                    continue;
+                default:
+                    error(p, CJ_SYNTAX_ERROR);
+            }
+        }
+        --p->depth;
+        /* close the containers that the value was the last child of */
+        for (;;) {
+            size_t top = open - 1;
+            if (open == 0) return;
+            object = objects[top / CHAR_BIT] >> top % CHAR_BIT & 1;
+            skip_ws(p);
+            if (eat(p, ',')) {
+                skip_ws(p);
+                if (object) validate_key(p);
+                break;
+            }
+            require(p, object ? '}' : ']');
+            --open;
+            --p->depth;
+        }
+    }
+}
+
+/* Validate the root value with a parser that has its input. */
+static CJParseResult run_validation(Parser *p) {
+    p->in_situ = CJ_TRUE;
+    p->in_situ_dst = NULL;
+    if (setjmp(p->buf)) return p->result;
+    if (at_eof(p)) refill(p);
+    skip_ws(p);
+    validate_value(p);
+    skip_ws(p);
+    if (!at_eof(p)) error(p, CJ_SYNTAX_ERROR);
+    return CJ_SUCCESS;
+}
+
+CJParseResult cj_validate(CJReader *reader) {
+    Parser p;
+    init_parser(&p, (CJAllocator*) &no_allocator, 0);
+    set_reader(&p, reader);
+    return run_validation(&p);
+}
+
+CJParseResult cj_validate_buffer(const char *data, size_t length) {
+    Parser p;
+    init_parser(&p, (CJAllocator*) &no_allocator, 0);
+    p.cur = data;
+    p.end = data + length;
+    p.contiguous = CJ_TRUE;
+    return run_validation(&p);
+}
+
+/* A segment of a path that names no array index. */
+#define SELECT_NO_INDEX ((size_t) -1)
+
+/*
+ * A segment of a compiled path. It matches members with its key, elements at
+ * its index if the key is one, or every child if it is a wildcard.
+ */
+typedef struct {
+    const char *key;
+    size_t length;
+    size_t index;
+    CJ_BOOL wildcard;
+} Segment;
+
+/* A compiled path, and the values it has matched in the current input. */
+typedef struct {
+    Segment *segments;
+    size_t length;
+    CJValue *matches;
+    size_t matches_len;
+    size_t matches_cap;
+} SelectPath;
+
+/*
+ * A selector is allocated along with its paths, their segments, and then the
+ * unescaped characters of their keys.
+ */
+struct CJSelector {
+    Parser p;
+    SelectPath *paths;
+    size_t count;
+    /*
+     * The paths that have matched each level of the value being selected from
+     * so far, with each level's paths above those of its parent.
+     */
+    size_t *active;
+    size_t active_len;
+    size_t active_cap;
+};
+
+/* Check a JSON Pointer, and count its segments and unescaped characters. */
+static CJ_BOOL measure_pointer(
+    const char *pointer,
+    size_t *segments,
+    size_t *chars
+) {
+    if (*pointer != '\0' && *pointer != '/') return CJ_FALSE;
+    for (; *pointer != '\0'; ++pointer) {
+        if (*pointer == '/') {
+            ++*segments;
+        } else {
+            /* only ~0 and ~1 are escapes */
+            if (*pointer == '~') {
+                ++pointer;
+                if (*pointer != '0' && *pointer != '1') return CJ_FALSE;
+            }
+            ++*chars;
+        }
+    }
+    return CJ_TRUE;
+}
+
+/* Get the array index that a key names, or SELECT_NO_INDEX if none. */
+static size_t segment_index(const char *key, size_t length) {
+    size_t i, index = 0;
+    /* indices have no leading zeros */
+    if (length == 0 || (key[0] == '0' && length > 1)) return SELECT_NO_INDEX;
+    for (i = 0; i < length; ++i) {
+        size_t digit;
+        if (key[i] < '0' || key[i] > '9') return SELECT_NO_INDEX;
+        digit = key[i] - '0';
+        if (index > (SELECT_NO_INDEX - 1 - digit) / 10) return SELECT_NO_INDEX;
+        index = index * 10 + digit;
+    }
+    return index;
+}
+
+/*
+ * Unescape the segment of a checked pointer that starts at the given position
+ * into the given characters, and return the position after it.
+ */
+static const char *fill_segment(
+    const char *pointer,
+    Segment *segment,
+    char *chars
+) {
+    size_t length = 0;
+    segment->key = chars;
+    for (; *pointer != '\0' && *pointer != '/'; ++pointer) {
+        char c = *pointer;
+        if (c == '~') c = *++pointer == '0' ? '~' : '/';
+        chars[length++] = c;
+    }
+    segment->length = length;
+    segment->index = segment_index(chars, length);
+    segment->wildcard = length == 1 && chars[0] == '*';
+    return pointer;
+}
+
+CJSelector *cj_selector_new(
+    CJAllocator *allocator,
+    const char *const *pointers,
+    size_t count,
+    unsigned flags
+) {
+    Parser p;
+    CJSelector *selector;
+    Segment *segment;
+    char *chars;
+    size_t i, size, segments = 0, length = 0;
+    for (i = 0; i < count; ++i) {
+        if (!measure_pointer(pointers[i], &segments, &length)) return NULL;
+    }
+    init_parser(&p, allocator, flags);
+    /* guard against overflow */
+    if (count > (SIZE_MAX - sizeof(CJSelector)) / sizeof(SelectPath)) {
+        return NULL;
+    }
+    size = sizeof(CJSelector) + count * sizeof(SelectPath);
+    if (segments > (SIZE_MAX - size) / sizeof(Segment)) return NULL;
+    size += segments * sizeof(Segment);
+    if (length > SIZE_MAX - size) return NULL;
+    /* keep the selector out of an arena, like the scratch buffers */
+    selector = p.scratch_allocator->allocate(p.scratch_allocator, NULL,
+        size + length);
+    if (selector == NULL) return NULL;
+    selector->p = p;
+    selector->paths = (SelectPath*) (void*) (selector + 1);
+    selector->count = count;
+    selector->active = NULL;
+    selector->active_len = 0;
+    selector->active_cap = 0;
+    segment = (Segment*) (void*) (selector->paths + count);
+    chars = (char*) (segment + segments);
+    for (i = 0; i < count; ++i) {
+        SelectPath *path = &selector->paths[i];
+        const char *pointer = pointers[i];
+        path->segments = segment;
+        path->length = 0;
+        path->matches = NULL;
+        path->matches_len = 0;
+        path->matches_cap = 0;
+        while (*pointer == '/') {
+            pointer = fill_segment(pointer + 1, segment, chars);
+            chars += segment->length;
+            ++segment;
+            ++path->length;
+        }
+    }
+    return selector;
+}
+
+/* Add a path to the paths that matched the next level. */
+static void push_active(CJSelector *selector, size_t path) {
+    if (selector->active_len == selector->active_cap) {
+        selector->active = grow_scratch(&selector->p, selector->active,
+            &selector->active_cap, INITIAL_STACK_CAPACITY, sizeof(size_t));
+    }
+    selector->active[selector->active_len++] = path;
+}
+
+/*
+ * Add a null value to the matches of a path, and return it. Like the value
+ * stack, the matches are always valid, so that they can be freed on error.
+ */
+static CJValue *push_match(Parser *p, SelectPath *path) {
+    CJValue *match;
+    if (path->matches_len == path->matches_cap) {
+        /* most paths match only once */
+        size_t cap = path->matches_cap == 0 ? 1 : path->matches_cap * 2;
+        if (cap < path->matches_cap || cap > SIZE_MAX / sizeof(CJValue)) {
+            error(p, CJ_OUT_OF_MEMORY);
+        }
+        path->matches = alloc(p, path->matches, cap * sizeof(CJValue));
+        path->matches_cap = cap;
+    }
+    match = &path->matches[path->matches_len++];
+    match->type = CJ_NULL;
+    match->flags = 0;
+    return match;
+}
+
+/* Copy a string to an allocation of its own. */
+static void copy_string(Parser *p, CJString *to, const CJString *from) {
+    if (from->length == 0) {
+        to->chars = empty_string;
+    } else {
+        to->chars = alloc(p, NULL, from->length + 1);
+        memcpy(to->chars, from->chars, from->length + 1);
+    }
+    to->length = from->length;
+}
+
+/*
+ * Copy a value for another path that matched it, into a null value. Strings
+ * that were packed into their containers get allocations of their own, and
+ * objects have no room for an index. The copy is valid at every step, so that
+ * it can be freed if an error occurs. Arrays and objects are walked on the
+ * stack of walks instead of recursing into them.
+ */
+static void copy_value(Parser *p, CJValue *to, const CJValue *from) {
+    /* the walks below are the caller's */
+    size_t base = p->walks_len, i, length;
+    for (;;) {
+        /* the flags of a member's key are up to the caller */
+        unsigned flags = from->flags
+            & ~(CJ_VALUE_BORROWED_KEY | CJ_VALUE_SHARED_KEY);
+        Walk *walk;
+        switch (from->type) {
+            case CJ_NUMBER:
+                if ((flags & (CJ_VALUE_RAW_NUMBER | CJ_VALUE_BORROWED))
+                        == CJ_VALUE_RAW_NUMBER) {
+                    char *chars = alloc(p, NULL, from->as.raw.length);
+                    memcpy(chars, from->as.raw.chars, from->as.raw.length);
+                    to->as.raw.chars = chars;
+                    to->as.raw.length = from->as.raw.length;
+                } else {
+                    to->as = from->as;
+                }
+                break;
+            case CJ_STRING:
+                if (flags & CJ_VALUE_SHARED) {
+                    ++*key_refs(from->as.string.chars);
+                    to->as.string = from->as.string;
+                } else {
+                    flags &= ~CJ_VALUE_BORROWED;
+                    copy_string(p, &to->as.string, &from->as.string);
+                }
+                break;
+            case CJ_ARRAY:
+                length = from->as.array.length;
+                to->as.array.elements = length == 0 ? NULL
+                    : alloc(p, NULL, length * sizeof(CJValue));
+                to->as.array.length = 0;
+                to->type = CJ_ARRAY;
+                flags = 0;
+                if (length != 0) push_walk(p, from)->copy = to;
+                break;
+            case CJ_OBJECT:
+                length = from->as.object.length;
+                to->as.object.members = length == 0 ? NULL
+                    : alloc(p, NULL, length * sizeof(CJObjectMember));
+                to->as.object.length = 0;
+                to->type = CJ_OBJECT;
+                flags = 0;
+                if (length != 0) push_walk(p, from)->copy = to;
+                break;
+            default:
+                to->as = from->as;
+                break;
+        }
+        /* a member's value may already have the flag of a shared key */
+        to->flags |= flags;
+        to->type = from->type;
+        /* go on to the next child, leaving the containers that have no more */
+        for (;;) {
+            if (p->walks_len == base) return;
+            walk = &p->walks[p->walks_len - 1];
+            length = walk->value->type == CJ_ARRAY
+                ? walk->value->as.array.length : walk->value->as.object.length;
+            if (walk->next < length) break;
+            --p->walks_len;
+        }
+        i = walk->next++;
+        if (walk->value->type == CJ_ARRAY) {
+            to = &walk->copy->as.array.elements[i];
+            to->type = CJ_NULL;
+            to->flags = 0;
+            walk->copy->as.array.length = i + 1;
+            from = &walk->value->as.array.elements[i];
+        } else {
+            CJObjectMember *member = &walk->copy->as.object.members[i];
+            const CJObjectMember *other = &walk->value->as.object.members[i];
+            member->key.chars = empty_string;
+            member->key.length = 0;
+            member->value.type = CJ_NULL;
+            member->value.flags = 0;
+            walk->copy->as.object.length = i + 1;
+            if (other->value.flags & CJ_VALUE_SHARED_KEY) {
+                ++*key_refs(other->key.chars);
+                member->key = other->key;
+                member->value.flags = CJ_VALUE_SHARED_KEY;
+            } else {
+                copy_string(p, &member->key, &other->key);
+            }
+            to = &member->value;
+            from = &other->value;
+        }
+    }
+}
+
+/*
+ * Copy the values below a built value that a path matches, given how many of
+ * the path's segments the value has matched. The containers that the path
+ * goes into are walked on the stack of walks, one for each segment.
+ */
+static void find_matches(
+    Parser *p,
+    SelectPath *path,
+    const CJValue *value,
+    size_t depth
+) {
+    /* the walks below are the caller's, and the first one matched depth */
+    size_t base = p->walks_len, start = depth, i, length;
+    for (;;) {
+        if (depth == path->length) {
+            copy_value(p, push_match(p, path), value);
+        } else if (value->type == CJ_ARRAY || value->type == CJ_OBJECT) {
+            push_walk(p, value);
+        }
+        /* go on to the next child that matches, leaving the containers that
+         * have no more */
+        for (;;) {
+            Walk *walk;
+            const Segment *segment;
+            if (p->walks_len == base) return;
+            walk = &p->walks[p->walks_len - 1];
+            depth = start + (p->walks_len - 1 - base);
+            segment = &path->segments[depth];
+            i = walk->next;
+            if (walk->value->type == CJ_ARRAY) {
+                const CJArray *array = &walk->value->as.array;
+                if (!segment->wildcard) {
+                    i = segment->index >= i ? segment->index : array->length;
+                }
+                if (i < array->length) {
+                    value = &array->elements[i];
+                    break;
+                }
+            } else {
+                const CJObject *object = &walk->value->as.object;
+                length = object->length;
+                for (; i < length; ++i) {
+                    if (segment->wildcard || key_equals(
+                            &object->members[i].key, segment->key,
+                            segment->length)) {
+                        break;
+                    }
+                }
+                if (i < length) {
+                    value = &object->members[i].value;
+                    break;
+                }
+            }
+            --p->walks_len;
+        }
+        p->walks[p->walks_len - 1].next = i + 1;
+        ++depth;
+    }
+}
+
+/* Skip a value that no path matches, without building any of it. */
+static void skip_value(Parser *p) {
+    p->in_situ = CJ_TRUE;
+    validate_value(p);
+    p->in_situ = CJ_FALSE;
+}
+
+/*
+ * Build a value that the given path matches in full, and hand copies of it, or
+ * of its children, to the other paths that matched it so far.
+ */
+static void select_whole(CJSelector *selector, size_t first, size_t found) {
+    Parser *p = &selector->p;
+    size_t i, depth = p->depth;
+    CJValue *match;
+    /* nothing else is on the stack while selecting */
+    parse(p);
+    match = push_match(p, &selector->paths[found]);
+    *match = p->stack[0];
+    p->stack_len = 0;
+    for (i = first; i < selector->active_len; ++i) {
+        if (selector->active[i] != found) {
+            find_matches(p, &selector->paths[selector->active[i]], match,
+                depth);
+        }
+    }
+}
+
+/*
+ * Match the paths of the array or object on top of the frames, which start at
+ * the given position of the active paths, against its next child, parsing the
+ * child's key if it has one. Return where the paths that matched start.
+ */
+static size_t select_child(CJSelector *selector, size_t first) {
+    Parser *p = &selector->p;
+    const Frame *frame = &p->frames[p->frames_len - 1];
+    /* the paths matched one segment for each level above the child */
+    size_t i, last = frame->index, depth = p->depth - 1;
+    if (frame->object) {
+        /* the key is only needed until the paths are matched against it */
+        size_t start = p->chars_len, length;
+        require(p, '"');
+        parse_string(p);
+        length = p->chars_len - start;
+        for (i = first; i < last; ++i) {
+            size_t path = selector->active[i];
+            const Segment *segment = &selector->paths[path].segments[depth];
+            if (segment->wildcard || (segment->length == length
+                    && (length == 0
+                    || memcmp(segment->key, p->chars + start, length) == 0))) {
+                push_active(selector, path);
+            }
+        }
+        p->chars_len = start;
+        skip_ws(p);
+        require(p, ':');
+        skip_ws(p);
+    } else {
+        for (i = first; i < last; ++i) {
+            size_t path = selector->active[i];
+            const Segment *segment = &selector->paths[path].segments[depth];
+            if (segment->wildcard || segment->index == frame->count) {
+                push_active(selector, path);
+            }
+        }
+    }
+    return last;
+}
+
+/*
+ * Select from the value at the input, which the active paths from the given
+ * position have matched so far. As they have matched one segment for each
+ * level of nesting, the depth of the parser is how many they have matched.
+ * Instead of recursing into arrays and objects, they are opened on the stack
+ * of frames, each with where the active paths of its children start.
+ */
+static void select_value(CJSelector *selector, size_t first) {
+    Parser *p = &selector->p;
+    /* the frames below are the caller's, and first is for the outermost */
+    size_t base = p->frames_len, outer = first;
+    for (;;) {
+        size_t i;
+        if (first == selector->active_len) {
+            skip_value(p);
+        } else {
+            for (i = first; i < selector->active_len; ++i) {
+                if (selector->paths[selector->active[i]].length == p->depth) {
+                    break;
+                }
+            }
+            if (i < selector->active_len) {
+                select_whole(selector, first, selector->active[i]);
+            } else if (check(p, '[') || check(p, '{')) {
+                /* a path with more segments can only match inside one */
+                CJ_BOOL object;
+                if (++p->depth == p->max_depth) {
+                    error(p, CJ_TOO_MUCH_NESTING);
+                }
+                object = take(p) == '{';
+                skip_ws(p);
+                if (!eat(p, object ? '}' : ']')) {
+                    /* go on to the first child */
+                    push_frame(p, selector->active_len, object);
+                    first = select_child(selector, first);
+                    continue;
+                }
+                --p->depth;
+            } else {
+                skip_value(p);
+            }
+        }
+        /* close the containers that the value was the last child of */
+        for (;;) {
+            Frame *top;
+            if (p->frames_len == base) return;
+            top = &p->frames[p->frames_len - 1];
+            /* the paths that matched the child are done with it */
+            selector->active_len = top->index;
+            ++top->count;
+            skip_ws(p);
+            if (eat(p, ',')) {
+                skip_ws(p);
+                /* the container's own paths start where its parent's end */
+                first = select_child(selector,
+                    p->frames_len - 1 == base ? outer : top[-1].index);
+                break;
+            }
+            require(p, top->object ? '}' : ']');
+            --p->frames_len;
+            --p->depth;
+        }
+    }
+}
+
+CJParseResult cj_parse_select(
+    CJSelector *selector,
+    CJReader *reader,
+    CJValue *outs
+) {
+    Parser *p = &selector->p;
+    size_t i, j;
+    restart_parser(p, reader);
+    selector->active_len = 0;
+    if (setjmp(p->buf)) {
+        /* an error occurred, so free memory unless the arena will */
+        for (i = 0; i < selector->count; ++i) {
+            SelectPath *path = &selector->paths[i];
+            if (!(p->flags & CJ_PARSE_ARENA)) {
+                for (j = 0; j < path->matches_len; ++j) {
+                    cj_free(p->allocator, &path->matches[j]);
+                }
+                dealloc(p->allocator, path->matches);
+            }
+            path->matches = NULL;
+            path->matches_len = 0;
+            path->matches_cap = 0;
+            outs[i].type = CJ_NULL;
+            outs[i].flags = 0;
+        }
+        if (!(p->flags & CJ_PARSE_ARENA)) {
+            for (i = 0; i < p->stack_len; ++i) {
+                cj_free(p->allocator, &p->stack[i]);
+            }
+        }
+        reset_scratch(p);
+        return p->result;
+    }
+    /* get the first buffer if we need it */
+    if (at_eof(p)) refill(p);
+    for (i = 0; i < selector->count; ++i) push_active(selector, i);
+    skip_ws(p);
+    select_value(selector, 0);
+    skip_ws(p);
+    if (!at_eof(p)) error(p, CJ_SYNTAX_ERROR);
+    for (i = 0; i < selector->count; ++i) {
+        SelectPath *path = &selector->paths[i];
+        outs[i].type = CJ_ARRAY;
+        outs[i].flags = 0;
+        outs[i].as.array.elements = path->matches;
+        outs[i].as.array.length = path->matches_len;
+        path->matches = NULL;
+        path->matches_len = 0;
+        path->matches_cap = 0;
+    }
+    reset_scratch(p);
+    return CJ_SUCCESS;
+}
+
+void cj_selector_delete(CJSelector *selector) {
+    CJAllocator *scratch_allocator = selector->p.scratch_allocator;
+    /* no values are left on the stack between calls */
+    free_scratch(&selector->p, CJ_FALSE);
+    dealloc(scratch_allocator, selector->active);
+    dealloc(scratch_allocator, selector);
+}
+
+/*
+ * A decoder is allocated along with the compiled form of each struct that it
+ * can decode into, followed by their fields. Members are matched to fields by
+ * a binary search of the keys, without building the rest of the value.
+ */
+
+struct DecodeStruct;
+
+/* A field of a compiled struct. */
+typedef struct {
+    const CJField *field;
+    size_t length;
+    /* The compiled struct of a CJ_FIELD_STRUCT field. */
+    const struct DecodeStruct *nested;
+} DecodeField;
+
+typedef struct DecodeStruct {
+    const CJStructDesc *desc;
+    /* The fields, sorted by the length and then the bytes of their keys. */
+    DecodeField *fields;
+} DecodeStruct;
+
+struct CJDecoder {
+    Parser p;
+    /* The compiled structs, starting with the root. */
+    DecodeStruct *structs;
+    size_t count;
+};
+
+/* Order keys by their length, and then by their bytes. */
+static int compare_keys(
+    const char *a,
+    size_t a_length,
+    const char *b,
+    size_t b_length
+) {
+    if (a_length != b_length) return a_length < b_length ? -1 : 1;
+    return memcmp(a, b, a_length);
+}
+
+static int compare_decode_fields(const void *a, const void *b) {
+    const DecodeField *x = a, *y = b;
+    return compare_keys(x->field->name, x->length, y->field->name, y->length);
+}
+
+/* Get the size of a field's C type, or 0 if it is invalid. */
+static size_t field_size(const CJField *field) {
+    switch (field->type) {
+        case CJ_FIELD_BOOLEAN: return sizeof(CJ_BOOL);
+        case CJ_FIELD_DOUBLE: return sizeof(double);
+        case CJ_FIELD_INT: return sizeof(int);
+#ifdef CJ_INT64
+        case CJ_FIELD_INT64: return sizeof(CJInt64);
+#endif
+        case CJ_FIELD_STRING: return sizeof(char*);
+        case CJ_FIELD_STRUCT:
+            return field->desc == NULL ? 0 : field->desc->size;
+        default: return 0;
+    }
+}
+
+/* Get the position of a description in a list, or the length if it's absent. */
+static size_t find_desc(
+    const CJStructDesc *const *descs,
+    size_t count,
+    const CJStructDesc *desc
+) {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+        if (descs[i] == desc) break;
+    }
+    return i;
+}
+
+/*
+ * List every description reachable from the root once, with the root first,
+ * in an allocation from the given allocator. Returns the number listed, or 0
+ * if a field is invalid or out of memory.
+ */
+static size_t collect_descs(
+    CJAllocator *allocator,
+    const CJStructDesc *root,
+    const CJStructDesc ***out
+) {
+    const CJStructDesc **descs;
+    size_t i, j, count = 1, cap = 4;
+    descs = allocator->allocate(allocator, NULL, cap * sizeof(*descs));
+    if (descs == NULL) return 0;
+    descs[0] = root;
+    for (i = 0; i < count; ++i) {
+        for (j = 0; j < descs[i]->count; ++j) {
+            const CJField *field = &descs[i]->fields[j];
+            if (field->name == NULL || field_size(field) == 0) {
+                dealloc(allocator, (void*) descs);
+                return 0;
+            }
+            if (field->type != CJ_FIELD_STRUCT
+                    || find_desc(descs, count, field->desc) != count) {
+                continue;
+            }
+            if (count == cap) {
+                const CJStructDesc **new_descs = allocator->allocate(allocator,
+                    (void*) descs, 2 * cap * sizeof(*descs));
+                if (new_descs == NULL) {
+                    dealloc(allocator, (void*) descs);
+                    return 0;
+                }
+                descs = new_descs;
+                cap *= 2;
+            }
+            descs[count++] = field->desc;
+        }
+    }
+    *out = descs;
+    return count;
+}
+
+CJDecoder *cj_decoder_new(CJAllocator *allocator, const CJStructDesc *desc) {
+    Parser p;
+    CJDecoder *decoder = NULL;
+    const CJStructDesc **descs;
+    DecodeField *fields;
+    size_t i, j, count, size, total = 0;
+    init_parser(&p, allocator, 0);
+    count = collect_descs(p.scratch_allocator, desc, &descs);
+    if (count == 0) return NULL;
+    for (i = 0; i < count; ++i) {
+        /* guard against overflow */
+        if (descs[i]->count > SIZE_MAX / sizeof(DecodeField) - total) {
+            goto done;
+        }
+        total += descs[i]->count;
+    }
+    size = sizeof(CJDecoder) + count * sizeof(DecodeStruct);
+    if (total > (SIZE_MAX - size) / sizeof(DecodeField)) goto done;
+    /* keep the decoder out of an arena, like the scratch buffers */
+    decoder = p.scratch_allocator->allocate(p.scratch_allocator, NULL,
+        size + total * sizeof(DecodeField));
+    if (decoder == NULL) goto done;
+    decoder->p = p;
+    decoder->structs = (DecodeStruct*) (void*) (decoder + 1);
+    decoder->count = count;
+    fields = (DecodeField*) (void*) (decoder->structs + count);
+    for (i = 0; i < count; ++i) {
+        DecodeStruct *s = &decoder->structs[i];
+        s->desc = descs[i];
+        s->fields = fields;
+        for (j = 0; j < descs[i]->count; ++j) {
+            const CJField *field = &descs[i]->fields[j];
+            fields[j].field = field;
+            fields[j].length = strlen(field->name);
+            fields[j].nested = field->type == CJ_FIELD_STRUCT
+                ? &decoder->structs[find_desc(descs, count, field->desc)]
+                : NULL;
+        }
+        qsort(fields, descs[i]->count, sizeof(DecodeField),
+            compare_decode_fields);
+        /* a key could only ever match one of its fields */
+        for (j = 1; j < descs[i]->count; ++j) {
+            if (compare_decode_fields(&fields[j - 1], &fields[j]) == 0) {
+                dealloc(p.scratch_allocator, decoder);
+                decoder = NULL;
+                goto done;
+            }
+        }
+        fields += descs[i]->count;
+    }
+done:
+    dealloc(p.scratch_allocator, (void*) descs);
+    return decoder;
+}
+
+/* Find the field of a compiled struct that a key belongs to, if any. */
+static const DecodeField *find_field(
+    const DecodeStruct *s,
+    const char *key,
+    size_t length
+) {
+    size_t low = 0, high = s->desc->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const DecodeField *f = &s->fields[mid];
+        int order = compare_keys(key, length, f->field->name, f->length);
+        if (order == 0) return f;
+        if (order < 0) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+static void free_decoded_struct(
+    CJAllocator *allocator,
+    const DecodeStruct *s,
+    char *base
+);
+
+/* Free what a single element of a field's type at the given place owns. */
+static void free_decoded_element(
+    CJAllocator *allocator,
+    const DecodeField *f,
+    char *at
+) {
+    if (f->field->type == CJ_FIELD_STRING) {
+        char **string = (char**) (void*) at;
+        dealloc(allocator, *string);
+        *string = NULL;
+    } else if (f->field->type == CJ_FIELD_STRUCT) {
+        free_decoded_struct(allocator, f->nested, at);
+    }
+}
+
+/* Free what a field of the struct at the given place owns. */
+static void free_decoded_field(
+    CJAllocator *allocator,
+    const DecodeField *f,
+    char *base
+) {
+    const CJField *field = f->field;
+    if (field->array) {
+        char **elements = (char**) (void*) (base + field->offset);
+        size_t *count = (size_t*) (void*) (base + field->count_offset);
+        size_t i, size = field_size(field);
+        if (*elements != NULL) {
+            for (i = 0; i < *count; ++i) {
+                free_decoded_element(allocator, f, *elements + i * size);
+            }
+            dealloc(allocator, *elements);
+        }
+        *elements = NULL;
+        *count = 0;
+    } else {
+        free_decoded_element(allocator, f, base + field->offset);
+    }
+}
+
+static void free_decoded_struct(
+    CJAllocator *allocator,
+    const DecodeStruct *s,
+    char *base
+) {
+    size_t i;
+    for (i = 0; i < s->desc->count; ++i) {
+        free_decoded_field(allocator, &s->fields[i], base);
+    }
+}
+
+/*
+ * Note that a value didn't fit its field. Decoding goes on, so that the input
+ * is checked in full, and then fails with CJ_TYPE_MISMATCH if it was valid.
+ */
+static void mismatched(Parser *p) {
+    if (p->result == CJ_SUCCESS) p->result = CJ_TYPE_MISMATCH;
+}
+
+/* Skip a value of the wrong type for its field. */
+static void mismatch(Parser *p) {
+    skip_value(p);
+    mismatched(p);
+}
+
+/* Check if the current value is a number. */
+static CJ_BOOL at_number(Parser *p) {
+    return check(p, '-') || is_digit(p);
+}
+
+static void require_null(Parser *p) {
+    require(p, 'n');
+    require(p, 'u');
+    require(p, 'l');
+    require(p, 'l');
+}
+
+static void decode_struct(Parser *p, const DecodeStruct *s, char *base);
+
+/*
+ * Decode a value into a single element of a field's type at the given place.
+ * Returns false, without taking any of the value, if it is of the wrong type.
+ */
+static CJ_BOOL decode_typed(Parser *p, const DecodeField *f, char *at) {
+    switch (f->field->type) {
+        case CJ_FIELD_BOOLEAN:
+            if (eat(p, 't')) {
+                require(p, 'r');
+                require(p, 'u');
+                require(p, 'e');
+                *(CJ_BOOL*) (void*) at = CJ_TRUE;
+                return CJ_TRUE;
+            }
+            if (eat(p, 'f')) {
+                require(p, 'a');
+                require(p, 'l');
+                require(p, 's');
+                require(p, 'e');
+                *(CJ_BOOL*) (void*) at = CJ_FALSE;
+                return CJ_TRUE;
+            }
+            return CJ_FALSE;
+        case CJ_FIELD_DOUBLE:
+            if (!at_number(p)) return CJ_FALSE;
+            *(double*) (void*) at = scan_number(p);
+            return CJ_TRUE;
+        case CJ_FIELD_INT: {
+            double number;
+            if (!at_number(p)) return CJ_FALSE;
+            number = scan_number(p);
+            /* the range check also rejects NaN */
+            if (number >= INT_MIN && number <= INT_MAX
+                    && (double) (int) number == number) {
+                *(int*) (void*) at = (int) number;
+            } else {
+                mismatched(p);
+            }
+            return CJ_TRUE;
+        }
+#ifdef CJ_INT64
+        case CJ_FIELD_INT64: {
+            CJInt64 integer;
+            CJ_BOOL fits;
+#ifdef FAST_NUMBERS
+            Decimal d;
+            CJ_BOOL negative;
+            if (!at_number(p)) return CJ_FALSE;
+            negative = scan_decimal(p, &d);
+            fits = decimal_to_int64(&d, negative, &integer);
+#else
+            CJValue number;
+            if (!at_number(p)) return CJ_FALSE;
+            number.type = CJ_NUMBER;
+            number.flags = 0;
+            number.as.number = scan_number(p);
+            fits = cj_number_to_int64(&number, &integer);
+#endif
+            if (fits) {
+                *(CJInt64*) (void*) at = integer;
+            } else {
+                mismatched(p);
+            }
+            return CJ_TRUE;
+        }
+#endif
+        case CJ_FIELD_STRING: {
+            char **string = (char**) (void*) at;
+            char *chars = NULL;
+            if (eat(p, '"')) {
+                size_t start = p->chars_len, length;
+                parse_string(p);
+                length = p->chars_len - start;
+                chars = alloc(p, NULL, length + 1);
+                memcpy(chars, p->chars + start, length);
+                chars[length] = '\0';
+                p->chars_len = start;
+            } else if (check(p, 'n')) {
+                require_null(p);
+            } else {
+                return CJ_FALSE;
+            }
+            dealloc(p->allocator, *string);
+            *string = chars;
+            return CJ_TRUE;
+        }
+        case CJ_FIELD_STRUCT:
+            if (!check(p, '{')) return CJ_FALSE;
+            decode_struct(p, f->nested, at);
+            return CJ_TRUE;
+        default:
+            /* the decoder only has valid fields */
+            return CJ_FALSE;
+    }
+}
+
+/* Decode a value into a single element, skipping it if it doesn't fit. */
+static void decode_element(Parser *p, const DecodeField *f, char *at) {
+    CJ_BOOL fits;
+    /* check depth */
+    if (++p->depth == p->max_depth) {
+        error(p, CJ_TOO_MUCH_NESTING);
+    }
+    fits = decode_typed(p, f, at);
+    --p->depth;
+    if (!fits) mismatch(p);
+}
+
+/* Decode an array, or null, into an array field of the struct at base. */
+static void decode_array(Parser *p, const DecodeField *f, char *base) {
+    const CJField *field = f->field;
+    char **elements = (char**) (void*) (base + field->offset);
+    size_t *count = (size_t*) (void*) (base + field->count_offset);
+    size_t size = field_size(field), cap = 0;
+    if (!check(p, 'n') && !check(p, '[')) {
+        mismatch(p);
+        return;
+    }
+    /* check depth */
+    if (++p->depth == p->max_depth) {
+        error(p, CJ_TOO_MUCH_NESTING);
+    }
+    free_decoded_field(p->allocator, f, base);
+    if (check(p, 'n')) {
+        require_null(p);
+    } else {
+        require(p, '[');
+        skip_ws(p);
+        if (!eat(p, ']')) {
+            for (;;) {
+                char *element;
+                if (*count == cap) {
+                    size_t new_cap = cap == 0 ? 4 : cap * 2;
+                    /* guard against overflow */
+                    if (new_cap < cap || new_cap > SIZE_MAX / size) {
+                        error(p, CJ_OUT_OF_MEMORY);
+                    }
+                    *elements = alloc(p, *elements, new_cap * size);
+                    cap = new_cap;
+                }
+                /* the element is counted first, so it is freed on error */
+                element = *elements + *count * size;
+                memset(element, 0, size);
+                ++*count;
+                decode_element(p, f, element);
+                skip_ws(p);
+                if (!eat(p, ',')) break;
+                skip_ws(p);
+            }
+            require(p, ']');
+            /* give back the unused capacity */
+            if (*count != cap) *elements = alloc(p, *elements, *count * size);
+        }
+    }
+    --p->depth;
+}
+
+/* Decode the object at the current position into the struct at base. */
+static void decode_struct(Parser *p, const DecodeStruct *s, char *base) {
+    require(p, '{');
+    skip_ws(p);
+    if (eat(p, '}')) return;
+    for (;;) {
+        const DecodeField *f;
+        size_t start = p->chars_len;
+        require(p, '"');
+        parse_string(p);
+        f = find_field(s, p->chars + start, p->chars_len - start);
+        p->chars_len = start;
+        skip_ws(p);
+        require(p, ':');
+        skip_ws(p);
+        if (f == NULL) {
+            skip_value(p);
+        } else if (f->field->array) {
+            decode_array(p, f, base);
+        } else {
+            decode_element(p, f, base + f->field->offset);
+        }
+        skip_ws(p);
+        if (!eat(p, ',')) break;
+        skip_ws(p);
+    }
+    require(p, '}');
+}
+
+CJParseResult cj_decode(CJDecoder *decoder, CJReader *reader, void *dst) {
+    Parser *p = &decoder->p;
+    restart_parser(p, reader);
+    if (setjmp(p->buf)) {
+        reset_scratch(p);
+        return p->result;
+    }
+    /* get the first buffer if we need it */
+    if (at_eof(p)) refill(p);
+    skip_ws(p);
+    if (check(p, '{')) {
+        ++p->depth;
+        decode_struct(p, &decoder->structs[0], dst);
+        --p->depth;
+    } else {
+        mismatch(p);
+    }
+    skip_ws(p);
+    if (!at_eof(p)) error(p, CJ_SYNTAX_ERROR);
+    reset_scratch(p);
+    return p->result;
+}
+
+void cj_decode_free(CJDecoder *decoder, void *dst) {
+    free_decoded_struct(decoder->p.allocator, &decoder->structs[0], dst);
+}
+
+void cj_decoder_delete(CJDecoder *decoder) {
+    CJAllocator *scratch_allocator = decoder->p.scratch_allocator;
+    free_scratch(&decoder->p, CJ_FALSE);
+    dealloc(scratch_allocator, decoder);
+}
+
+/*
+ * A document is read by cursors that each keep their own place, so the parser
+ * only holds a position while a cursor function runs. Skipping a value scans
+ * it for where it ends, which the document remembers for the last scalar read
+ * and the last container moved through, so a value that has just been read is
+ * not scanned again when its container moves past it.
+ */
+
+/* Decoded strings are kept in blocks of at least this many bytes. */
+#define DOC_STRING_BLOCK_SIZE 4096
+
+/* A block of decoded strings, which follow it. */
+typedef struct DocStringBlock {
+    struct DocStringBlock *next;
+    size_t used;
+    size_t size;
+} DocStringBlock;
+
+#define DOC_STRING_BLOCK_HEADER_SIZE ALIGN_UP(sizeof(DocStringBlock))
+
+struct CJDoc {
+    Parser p;
+    /* The input, and the start of its root value. */
+    const char *start;
+    const char *root;
+    /* The blocks of decoded strings, newest first. */
+    DocStringBlock *strings;
+    /* The start and end of the last scalar read. */
+    const char *scalar_start;
+    const char *scalar_end;
+    /*
+     * The start of the last container moved through, and a position inside it
+     * that is resume_depth containers deep, from which scanning finds its end.
+     * If resume_depth is 0, the position is its end.
+     */
+    const char *resume_start;
+    const char *resume_at;
+    size_t resume_depth;
+#ifdef STRUCTURAL_INDEX
+    /* The index used to skip containers, once one has been skipped. */
+    StructuralIndex structurals;
+    const char **positions;
+#endif
+};
+
+/* Scan past the rest of a string, from after its opening quote. */
+static const char *scan_past_string(Parser *p, const char *cur) {
+    for (;;) {
+        cur = skip_plain_ascii(cur, p->end);
+        if (cur == p->end) error(p, CJ_SYNTAX_ERROR);
+        if (*cur == '"') return cur + 1;
+        /* skip the escaped character along with the backslash */
+        if (*cur++ == '\\') {
+            if (cur == p->end) error(p, CJ_SYNTAX_ERROR);
+            ++cur;
+        }
+    }
+}
+
+#ifdef STRUCTURAL_INDEX
+/*
+ * Get the structural index ready to find tokens from a position, or return
+ * CJ_FALSE if it can't, because the position is before its window.
+ */
+static CJ_BOOL seek_structurals(CJDoc *doc, const char *cur) {
+    StructuralIndex *si = &doc->structurals;
+    if (doc->positions == NULL) {
+        /* without memory for the index, scan without it */
+        doc->positions = doc->p.scratch_allocator->allocate(
+            doc->p.scratch_allocator, NULL,
+            STRUCTURAL_WINDOW * sizeof(const char*));
+        if (doc->positions == NULL) return CJ_FALSE;
+        init_structural_index(si, doc->start, doc->p.end, doc->positions);
+    }
+    if (cur < si->window) return CJ_FALSE;
+    /* the positions of the window are in order, so search it again */
+    if (si->next != 0 && si->positions[si->next - 1] >= cur) si->next = 0;
+    return CJ_TRUE;
+}
+#endif
+
+/*
+ * Scan to the end of a value without validating it, tracking only strings and
+ * nesting. Scanning starts at a position inside the value that is the given
+ * number of containers deep, or at its start if 0.
+ */
+static const char *scan_past(CJDoc *doc, const char *cur, size_t depth) {
+    Parser *p = &doc->p;
+    if (depth == 0) {
+        const char *start = cur;
+        switch (*cur) {
+            case '"':
+                return scan_past_string(p, cur + 1);
+            case '[':
+            case '{':
+                ++cur;
+                depth = 1;
+                break;
+            default:
+                /* a number or literal runs until the next delimiter */
+                while (cur != p->end && !is_ws(*cur) && *cur != ','
+                        && *cur != ']' && *cur != '}') {
+                    ++cur;
+                }
+                if (cur == start) error(p, CJ_SYNTAX_ERROR);
+                return cur;
+        }
+    }
+#ifdef STRUCTURAL_INDEX
+    if (seek_structurals(doc, cur)) {
+        for (;;) {
+            cur = next_structural(&doc->structurals, cur);
+            if (cur == p->end) error(p, CJ_SYNTAX_ERROR);
+            switch (*cur++) {
+                case '[':
+                case '{':
+                    ++depth;
+                    break;
+                case ']':
+                case '}':
+                    if (--depth == 0) return cur;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+#endif
+    while (depth != 0) {
+        if (cur == p->end) error(p, CJ_SYNTAX_ERROR);
+        switch (*cur++) {
+            case '"':
+                cur = scan_past_string(p, cur);
+                break;
+            case '[':
+            case '{':
+                ++depth;
+                break;
+            case ']':
+            case '}':
+                --depth;
+                break;
+            default:
+                break;
+        }
+    }
+    return cur;
+}
+
+/* Find the end of a value, using what the document remembers if it can. */
+static const char *find_value_end(CJDoc *doc, const char *start) {
+    if (start == doc->scalar_start) return doc->scalar_end;
+    if (start == doc->resume_start) {
+        return doc->resume_depth == 0
+            ? doc->resume_at
+            : scan_past(doc, doc->resume_at, doc->resume_depth);
+    }
+    return scan_past(doc, start, 0);
+}
+
+/*
+ * Check what comes after the value at the given start, which the parser is at
+ * the end of. Only whitespace may follow the root value.
+ */
+static void end_value(CJDoc *doc, const char *start) {
+    Parser *p = &doc->p;
+    if (start == doc->root) {
+        if (skip_ws_run(p->cur, p->end) != p->end) error(p, CJ_SYNTAX_ERROR);
+    } else if (!at_eof(p) && !is_ws(*p->cur) && *p->cur != ','
+            && *p->cur != ']' && *p->cur != '}') {
+        error(p, CJ_SYNTAX_ERROR);
+    }
+}
+
+/* Finish reading a scalar, and remember where it ends. */
+static void end_scalar(CJDoc *doc, const char *start) {
+    end_value(doc, start);
+    doc->scalar_start = start;
+    doc->scalar_end = doc->p.cur;
+}
+
+/* Remember a position inside a container, from which its end can be found. */
+static void remember_resume(
+    CJDoc *doc,
+    const char *start,
+    const char *at,
+    size_t depth
+) {
+    doc->resume_start = start;
+    doc->resume_at = at;
+    doc->resume_depth = depth;
+}
+
+/* Point a cursor at the value at the parser's position. */
+static void init_cursor(CJCursor *cursor, CJDoc *doc) {
+    Parser *p = &doc->p;
+    if (at_eof(p)) error(p, CJ_SYNTAX_ERROR);
+    switch (*p->cur) {
+        case '"': case '[': case '{': case 't': case 'f': case 'n': case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            break;
+        default:
+            error(p, CJ_SYNTAX_ERROR);
+    }
+    cursor->doc = doc;
+    cursor->start = p->cur;
+    cursor->next = NULL;
+    cursor->child = NULL;
+}
+
+/* Copy a decoded string into the document's blocks, null-terminated. */
+static const char *keep_doc_string(
+    CJDoc *doc,
+    const char *chars,
+    size_t length
+) {
+    Parser *p = &doc->p;
+    DocStringBlock *block = doc->strings;
+    char *kept;
+    if (block == NULL || block->size - block->used <= length) {
+        size_t size = DOC_STRING_BLOCK_SIZE;
+        if (length >= size - DOC_STRING_BLOCK_HEADER_SIZE) {
+            if (length > SIZE_MAX - DOC_STRING_BLOCK_HEADER_SIZE - 1) {
+                error(p, CJ_OUT_OF_MEMORY);
+            }
+            size = DOC_STRING_BLOCK_HEADER_SIZE + length + 1;
+        }
+        block = alloc(p, NULL, size);
+        block->next = doc->strings;
+        block->used = DOC_STRING_BLOCK_HEADER_SIZE;
+        block->size = size;
+        doc->strings = block;
+    }
+    kept = (char*) block + block->used;
+    if (length != 0) memcpy(kept, chars, length);
+    kept[length] = '\0';
+    block->used += length + 1;
+    return kept;
+}
+
+/*
+ * Read the string at the parser's position, pointing into the input if it has
+ * no escapes, or decoding it otherwise.
+ */
+static const char *read_doc_string(CJDoc *doc, size_t *length) {
+    Parser *p = &doc->p;
+    const char *chars = ++p->cur;
+    const char *run = scan_string_run(chars, p->end);
+    if (run != p->end && *run == '"') {
+        *length = run - chars;
+        p->cur = run + 1;
+        return chars;
+    }
+    p->chars_len = 0;
+    parse_string(p);
+    *length = p->chars_len;
+    return keep_doc_string(doc, p->chars, p->chars_len);
+}
+
+/*
+ * Move a container's cursor to its next child, skipping the last one it handed
+ * out, and leave the parser at the child, or at its key in an object. Returns
+ * CJ_FALSE at the end of the container.
+ */
+static CJ_BOOL cursor_advance(CJCursor *cursor, char close) {
+    CJDoc *doc = cursor->doc;
+    Parser *p = &doc->p;
+    CJ_BOOL first = cursor->next == NULL;
+    if (first) {
+        cursor->next = cursor->start + 1;
+    } else if (cursor->child != NULL) {
+        cursor->next = find_value_end(doc, cursor->child);
+        cursor->child = NULL;
+    }
+    p->cur = cursor->next;
+    skip_ws(p);
+    if (eat(p, close)) {
+        end_value(doc, cursor->start);
+        remember_resume(doc, cursor->start, p->cur, 0);
+        /* stay at the end */
+        cursor->next = p->cur - 1;
+        return CJ_FALSE;
+    }
+    if (!first) {
+        require(p, ',');
+        skip_ws(p);
+    }
+    return CJ_TRUE;
+}
+
+/* Hand out the child of a container at the parser's position. */
+static void cursor_child(CJCursor *cursor, CJCursor *out) {
+    CJDoc *doc = cursor->doc;
+    init_cursor(out, doc);
+    cursor->child = out->start;
+    remember_resume(doc, cursor->start, out->start, 1);
+}
+
+/*
+ * Parse the key of the member at the parser's position, leaving the parser at
+ * its value, and return whether it matches.
+ */
+static CJ_BOOL match_key(Parser *p, const char *key, size_t length) {
+    const char *run;
+    CJ_BOOL matches;
+    require(p, '"');
+    run = scan_string_run(p->cur, p->end);
+    if (run != p->end && *run == '"') {
+        matches = (size_t) (run - p->cur) == length
+            && memcmp(p->cur, key, length) == 0;
+        p->cur = run + 1;
+    } else {
+        p->chars_len = 0;
+        parse_string(p);
+        matches = p->chars_len == length
+            && (length == 0 || memcmp(p->chars, key, length) == 0);
+    }
+    skip_ws(p);
+    require(p, ':');
+    skip_ws(p);
+    return matches;
+}
+
+CJDoc *cj_doc_open(CJAllocator *allocator, const char *data, size_t length) {
+    Parser p;
+    CJDoc *doc;
+    init_parser(&p, allocator, 0);
+    p.cur = data;
+    p.end = data + length;
+    p.contiguous = CJ_TRUE;
+    doc = p.scratch_allocator->allocate(p.scratch_allocator, NULL,
+        sizeof(CJDoc));
+    if (doc == NULL) return NULL;
+    doc->p = p;
+    doc->start = data;
+    doc->root = NULL;
+    doc->strings = NULL;
+    doc->scalar_start = NULL;
+    doc->scalar_end = NULL;
+    doc->resume_start = NULL;
+    doc->resume_at = NULL;
+    doc->resume_depth = 0;
+#ifdef STRUCTURAL_INDEX
+    doc->positions = NULL;
+#endif
+    return doc;
+}
+
+CJ_BOOL cj_doc_root(CJDoc *doc, CJCursor *out) {
+    Parser *p = &doc->p;
+    if (p->result != CJ_SUCCESS) return CJ_FALSE;
+    if (setjmp(p->buf)) return CJ_FALSE;
+    p->cur = doc->start;
+    skip_ws(p);
+    init_cursor(out, doc);
+    doc->root = out->start;
+    return CJ_TRUE;
+}
+
+CJParseResult cj_doc_result(const CJDoc *doc) {
+    return doc->p.result;
+}
+
+void cj_doc_close(CJDoc *doc) {
+    CJAllocator *scratch_allocator = doc->p.scratch_allocator;
+    while (doc->strings != NULL) {
+        DocStringBlock *next = doc->strings->next;
+        dealloc(doc->p.allocator, doc->strings);
+        doc->strings = next;
+    }
+#ifdef STRUCTURAL_INDEX
+    dealloc(scratch_allocator, (void*) doc->positions);
+#endif
+    free_scratch(&doc->p, CJ_FALSE);
+    dealloc(scratch_allocator, doc);
+}
+
+CJType cj_cursor_type(const CJCursor *cursor) {
+    switch (*cursor->start) {
+        case '"': return CJ_STRING;
+        case '[': return CJ_ARRAY;
+        case '{': return CJ_OBJECT;
+        case 't': case 'f': return CJ_BOOLEAN;
+        case 'n': return CJ_NULL;
+        default: return CJ_NUMBER;
+    }
+}
+
+CJ_BOOL cj_cursor_next_element(CJCursor *array, CJCursor *out) {
+    Parser *p = &array->doc->p;
+    if (p->result != CJ_SUCCESS || *array->start != '[') return CJ_FALSE;
+    if (setjmp(p->buf)) return CJ_FALSE;
+    if (!cursor_advance(array, ']')) return CJ_FALSE;
+    cursor_child(array, out);
+    return CJ_TRUE;
+}
+
+CJ_BOOL cj_cursor_next_member(
+    CJCursor *object,
+    const char **key,
+    size_t *key_length,
+    CJCursor *out
+) {
+    CJDoc *doc = object->doc;
+    Parser *p = &doc->p;
+    if (p->result != CJ_SUCCESS || *object->start != '{') return CJ_FALSE;
+    if (setjmp(p->buf)) return CJ_FALSE;
+    if (!cursor_advance(object, '}')) return CJ_FALSE;
+    if (!check(p, '"')) error(p, CJ_SYNTAX_ERROR);
+    *key = read_doc_string(doc, key_length);
+    skip_ws(p);
+    require(p, ':');
+    skip_ws(p);
+    cursor_child(object, out);
+    return CJ_TRUE;
+}
+
+/*
+ * Search an object for a member from its cursor's place, wrapping around to
+ * its first member, and leave the cursor at the member if one is found.
+ */
+static CJ_BOOL search_members(
+    CJCursor *object,
+    const char *key,
+    size_t length,
+    CJCursor *out
+) {
+    Parser *p = &object->doc->p;
+    const char *next = object->next;
+    const char *child = object->child;
+    /* the first member looked at, where the search stops once it wraps */
+    const char *mark = NULL;
+    CJ_BOOL wrapped = CJ_FALSE;
+    for (;;) {
+        if (!cursor_advance(object, '}')) {
+            /* starting from the first member, there is nothing to wrap to */
+            if (wrapped || next == NULL) break;
+            if (mark == NULL) mark = p->cur - 1;
+            object->next = NULL;
+            object->child = NULL;
+            wrapped = CJ_TRUE;
+            continue;
+        }
+        if (mark == NULL) {
+            mark = p->cur;
+        } else if (wrapped && p->cur >= mark) {
+            break;
+        }
+        if (match_key(p, key, length)) {
+            cursor_child(object, out);
+            return CJ_TRUE;
+        }
+        if (at_eof(p)) error(p, CJ_SYNTAX_ERROR);
+        object->child = p->cur;
+        remember_resume(object->doc, object->start, p->cur, 1);
+    }
+    object->next = next;
+    object->child = child;
+    return CJ_FALSE;
+}
+
+CJ_BOOL cj_cursor_field(
+    CJCursor *object,
+    const char *key,
+    size_t length,
+    CJCursor *out
+) {
+    Parser *p = &object->doc->p;
+    if (p->result != CJ_SUCCESS || *object->start != '{') return CJ_FALSE;
+    if (setjmp(p->buf)) return CJ_FALSE;
+    return search_members(object, key, length, out);
+}
+
+const char *cj_cursor_get_string(CJCursor *cursor, size_t *length) {
+    CJDoc *doc = cursor->doc;
+    Parser *p = &doc->p;
+    const char *chars;
+    if (p->result != CJ_SUCCESS || *cursor->start != '"') return NULL;
+    if (setjmp(p->buf)) return NULL;
+    p->cur = cursor->start;
+    chars = read_doc_string(doc, length);
+    end_scalar(doc, cursor->start);
+    return chars;
+}
+
+CJ_BOOL cj_cursor_get_double(CJCursor *cursor, double *out) {
+    CJDoc *doc = cursor->doc;
+    Parser *p = &doc->p;
+    if (p->result != CJ_SUCCESS) return CJ_FALSE;
+    if (setjmp(p->buf)) return CJ_FALSE;
+    p->cur = cursor->start;
+    if (!at_number(p)) return CJ_FALSE;
+    *out = scan_number(p);
+    end_scalar(doc, cursor->start);
+    return CJ_TRUE;
+}
+
+#ifdef CJ_INT64
+CJ_BOOL cj_cursor_get_int64(CJCursor *cursor, CJInt64 *out) {
+    CJDoc *doc = cursor->doc;
+    Parser *p = &doc->p;
+    CJ_BOOL fits;
+#ifdef FAST_NUMBERS
+    Decimal d;
+    CJ_BOOL negative;
+#else
+    CJValue number;
+#endif
+    if (p->result != CJ_SUCCESS) return CJ_FALSE;
+    if (setjmp(p->buf)) return CJ_FALSE;
+    p->cur = cursor->start;
+    if (!at_number(p)) return CJ_FALSE;
+#ifdef FAST_NUMBERS
+    negative = scan_decimal(p, &d);
+    fits = decimal_to_int64(&d, negative, out);
+#else
+    number.type = CJ_NUMBER;
+    number.flags = 0;
+    number.as.number = scan_number(p);
+    fits = cj_number_to_int64(&number, out);
+#endif
+    end_scalar(doc, cursor->start);
+    return fits;
+}
+#endif
+
+CJ_BOOL cj_cursor_get_boolean(CJCursor *cursor, CJ_BOOL *out) {
+    CJDoc *doc = cursor->doc;
+    Parser *p = &doc->p;
+    if (p->result != CJ_SUCCESS) return CJ_FALSE;
+    if (setjmp(p->buf)) return CJ_FALSE;
+    p->cur = cursor->start;
+    if (eat(p, 't')) {
+        require(p, 'r');
+        require(p, 'u');
+        require(p, 'e');
+        *out = CJ_TRUE;
+    } else if (eat(p, 'f')) {
+        require(p, 'a');
+        require(p, 'l');
+        require(p, 's');
+        require(p, 'e');
+        *out = CJ_FALSE;
+    } else {
+        return CJ_FALSE;
+    }
+    end_scalar(doc, cursor->start);
+    return CJ_TRUE;
+}
+
+CJ_BOOL cj_cursor_get_null(CJCursor *cursor) {
+    CJDoc *doc = cursor->doc;
+    Parser *p = &doc->p;
+    if (p->result != CJ_SUCCESS || *cursor->start != 'n') return CJ_FALSE;
+    if (setjmp(p->buf)) return CJ_FALSE;
+    p->cur = cursor->start;
+    require_null(p);
+    end_scalar(doc, cursor->start);
+    return CJ_TRUE;
+}
+
+CJParseResult cj_cursor_parse(
+    CJCursor *cursor,
+    CJAllocator *allocator,
+    CJValue *out
+) {
+    CJDoc *doc = cursor->doc;
+    Parser *p = &doc->p;
+    CJParseResult result;
+    out->type = CJ_NULL;
+    out->flags = 0;
+    if (p->result != CJ_SUCCESS) return p->result;
+    if (setjmp(p->buf)) return p->result;
+    p->cur = find_value_end(doc, cursor->start);
+    end_value(doc, cursor->start);
+    result = cj_parse_buffer(allocator, cursor->start,
+        p->cur - cursor->start, out);
+    /* the value has been read, so its errors are the document's */
+    if (result == CJ_SUCCESS) {
+        remember_resume(doc, cursor->start, p->cur, 0);
+    } else if (result != CJ_OUT_OF_MEMORY) {
+        p->result = result;
+    }
+    return result;
+}
+
+#ifdef CJ_INT64
+/*
+ * A tape is built by a parser that appends to its words as it goes. Strings
+ * are built one after another in the character buffer, each after its length,
+ * and the buffer becomes the tape's strings at the end. The words and strings
+ * are built in scratch buffers, and moved to the value's allocator.
+ */
+
+/*
+ * The top byte of a word is its type, with TAPE_END set if it ends an array or
+ * object, or TAPE_INTEGER set if it is a number stored in the word itself.
+ */
+#define TAPE_PAYLOAD_BITS 56
+#define TAPE_END 0x80
+#define TAPE_INTEGER 0x40
+#define TAPE_TYPE_MASK 0x0F
+#define TAPE_PAYLOAD_MASK (((CJUInt64) 1 << TAPE_PAYLOAD_BITS) - 1)
+
+/* Integers of up to this magnitude are stored in the word, as exact doubles. */
+#define TAPE_INTEGER_MAX 9007199254740992.0
+
+/*
+ * The low byte of a string's payload is its length, and the rest its offset,
+ * unless it is too long, in which case its length comes first in the strings.
+ */
+#define TAPE_LONG_STRING 0xFF
+
+#define INITIAL_TAPE_CAPACITY 64
+
+typedef struct {
+    Parser p;
+    CJUInt64 *words;
+    size_t length;
+    size_t capacity;
+} TapeBuilder;
+
+static CJUInt64 tape_word(int tag, size_t payload) {
+    return (CJUInt64) tag << TAPE_PAYLOAD_BITS | (CJUInt64) payload;
+}
+
+static int tape_tag(const CJTape *tape, size_t position) {
+    return (int) (tape->words[position] >> TAPE_PAYLOAD_BITS);
+}
+
+static size_t tape_payload(const CJTape *tape, size_t position) {
+    return (size_t) (tape->words[position] & TAPE_PAYLOAD_MASK);
+}
+
+/* Append a word to the tape, returning its position. */
+static size_t tape_push(TapeBuilder *t, CJUInt64 word) {
+    if (t->length == t->capacity) {
+        t->words = grow_scratch(&t->p, t->words, &t->capacity,
+            INITIAL_TAPE_CAPACITY, sizeof(CJUInt64));
+    }
+    t->words[t->length] = word;
+    return t->length++;
+}
+
+/*
+ * Finish the string that starts at the given offset of the strings, and append
+ * its word.
+ */
+static void tape_end_string(TapeBuilder *t, size_t offset) {
+    Parser *p = &t->p;
+    size_t length = p->chars_len - offset;
+    if (length >= TAPE_LONG_STRING) {
+        /* move the characters along to make room for the length */
+        push_chars(p, (const char*) &length, sizeof(size_t));
+        memmove(p->chars + offset + sizeof(size_t), p->chars + offset, length);
+        memcpy(p->chars + offset, &length, sizeof(size_t));
+        length = TAPE_LONG_STRING;
+    }
+    push_char(p, '\0');
+    tape_push(t, tape_word(CJ_STRING, offset << 8 | length));
+}
+
+/* Parse a string onto the end of the strings, and append its word. */
+static void tape_string(TapeBuilder *t) {
+    size_t offset = t->p.chars_len;
+    parse_string(&t->p);
+    tape_end_string(t, offset);
+}
+
+/*
+ * Append a number, in the word itself if it is an integer that a double holds
+ * exactly, or otherwise in the word after.
+ */
+static void tape_number(TapeBuilder *t, double number) {
+    static const double zero = 0.0;
+    CJUInt64 bits = 0;
+    /* negative zero needs its sign */
+    if (number >= -TAPE_INTEGER_MAX && number <= TAPE_INTEGER_MAX
+            && number == (double) (CJInt64) number
+            && (number != 0.0 || memcmp(&number, &zero, sizeof(double)) == 0)) {
+        /* the payload is the integer in two's complement */
+        bits = (CJUInt64) (CJInt64) number & TAPE_PAYLOAD_MASK;
+        tape_push(t, tape_word(CJ_NUMBER | TAPE_INTEGER, 0) | bits);
+    } else {
+        memcpy(&bits, &number, sizeof(double));
+        tape_push(t, tape_word(CJ_NUMBER, 0));
+        tape_push(t, bits);
+    }
+}
+
+/* Parse the key of a member onto the tape, and the colon after it. */
+static void tape_key(TapeBuilder *t) {
+    Parser *p = &t->p;
+    require(p, '"');
+    tape_string(t);
+    skip_ws(p);
+    require(p, ':');
+    skip_ws(p);
+}
+
+/*
+ * Finish an array or object that starts at the given position. The word
+ * starting it holds the position of the word ending it, which holds the number
+ * of children.
+ */
+static void tape_end_container(
+    TapeBuilder *t,
+    size_t start,
+    CJType type,
+    size_t count
+) {
+    size_t end = tape_push(t, tape_word(type | TAPE_END, count));
+    t->words[start] = tape_word(type, end);
+}
+
+/*
+ * Parse a value onto the tape. Instead of recursing into arrays and objects,
+ * they are opened on the stack of frames, each with the position of the word
+ * starting it.
+ */
+static void tape_value(TapeBuilder *t) {
+    Parser *p = &t->p;
+    /* the frames below are the caller's */
+    size_t base = p->frames_len;
+    for (;;) {
+        CJ_BOOL object;
+        size_t start;
+        char c;
+        /* check depth */
+        if (++p->depth == p->max_depth) {
+            error(p, CJ_TOO_MUCH_NESTING);
+        }
+        if (check(p, '-') || is_digit(p)) {
+            tape_number(t, scan_number(p));
+        } else {
+            switch (c = take(p)) {
+                case 't':
+                    require(p, 'r');
+                    require(p, 'u');
+                    require(p, 'e');
+                    tape_push(t, tape_word(CJ_BOOLEAN, CJ_TRUE));
+                    break;
+                case 'f':
+                    require(p, 'a');
+                    require(p, 'l');
+                    require(p, 's');
+                    require(p, 'e');
+                    tape_push(t, tape_word(CJ_BOOLEAN, CJ_FALSE));
+                    break;
+                case 'n':
+                    require(p, 'u');
+                    require(p, 'l');
+                    require(p, 'l');
+                    tape_push(t, tape_word(CJ_NULL, 0));
+                    break;
+                case '"':
+                    tape_string(t);
+                    break;
+                case '[':
+                case '{':
+                    object = c == '{';
+                    start = tape_push(t, 0);
+                    skip_ws(p);
+                    if (eat(p, object ? '}' : ']')) {
+                        tape_end_container(t, start,
+                            object ? CJ_OBJECT : CJ_ARRAY, 0);
+                        break;
+                    }
+                    /* go on to the first child */
+                    push_frame(p, start, object);
+                    if (object) tape_key(t);
+                    continue;
+                default:
+                    error(p, CJ_SYNTAX_ERROR);
+            }
+        }
+        --p->depth;
+        /* close the containers that the value was the last child of */
+        for (;;) {
+            Frame *frame;
+            if (p->frames_len == base) return;
+            frame = &p->frames[p->frames_len - 1];
+            ++frame->count;
+            skip_ws(p);
+            if (eat(p, ',')) {
+                skip_ws(p);
+                if (frame->object) tape_key(t);
+                break;
+            }
+            require(p, frame->object ? '}' : ']');
+            --p->frames_len;
+            tape_end_container(t, frame->index,
+                frame->object ? CJ_OBJECT : CJ_ARRAY, frame->count);
+            --p->depth;
+        }
+    }
+}
+
+/*
+ * Move a scratch buffer to an exact-size allocation from the value's
+ * allocator, or return NULL if out of memory, leaving it in place.
+ */
+static void *keep_scratch(Parser *p, void *scratch, size_t size) {
+    void *kept;
+    if (p->allocator == p->scratch_allocator) {
+        kept = p->allocator->allocate(p->allocator, scratch, size);
+        /* failing to shrink it is fine */
+        return kept != NULL ? kept : scratch;
+    }
+    kept = p->allocator->allocate(p->allocator, NULL, size);
+    if (kept != NULL) {
+        memcpy(kept, scratch, size);
+        dealloc(p->scratch_allocator, scratch);
+    }
+    return kept;
+}
+
+CJParseResult cj_parse_tape(
+    CJAllocator *allocator,
+    CJReader *reader,
+    CJTape *out
+) {
+    TapeBuilder t;
+    init_parser(&t.p, allocator, 0);
+    set_reader(&t.p, reader);
+    t.words = NULL;
+    t.length = 0;
+    t.capacity = 0;
+    out->words = NULL;
+    out->length = 0;
+    out->strings = NULL;
+    out->strings_length = 0;
+    if (setjmp(t.p.buf)) {
+        dealloc(t.p.scratch_allocator, t.words);
+        free_scratch(&t.p, CJ_FALSE);
+        return t.p.result;
+    }
+    if (at_eof(&t.p)) refill(&t.p);
+    skip_ws(&t.p);
+    tape_value(&t);
+    skip_ws(&t.p);
+    if (!at_eof(&t.p)) error(&t.p, CJ_SYNTAX_ERROR);
+    out->words = keep_scratch(&t.p, t.words, t.length * sizeof(CJUInt64));
+    if (out->words == NULL) error(&t.p, CJ_OUT_OF_MEMORY);
+    t.words = NULL;
+    out->length = t.length;
+    if (t.p.chars_len != 0) {
+        out->strings = keep_scratch(&t.p, t.p.chars, t.p.chars_len);
+        if (out->strings == NULL) {
+            dealloc(t.p.allocator, out->words);
+            out->words = NULL;
+            error(&t.p, CJ_OUT_OF_MEMORY);
+        }
+        t.p.chars = NULL;
+        out->strings_length = t.p.chars_len;
+    }
+    free_scratch(&t.p, CJ_FALSE);
+    return CJ_SUCCESS;
+}
+
+CJType cj_tape_type(const CJTape *tape, size_t position) {
+    return (CJType) (tape_tag(tape, position) & TAPE_TYPE_MASK);
+}
+
+size_t cj_tape_next(const CJTape *tape, size_t position) {
+    switch (tape_tag(tape, position)) {
+        case CJ_NUMBER:
+            return position + 2;
+        case CJ_ARRAY:
+        case CJ_OBJECT:
+            return tape_payload(tape, position) + 1;
+        default:
+            return position + 1;
+    }
+}
+
+size_t cj_tape_first(const CJTape *tape, size_t position) {
+    (void) tape;
+    return position + 1;
+}
+
+size_t cj_tape_length(const CJTape *tape, size_t position) {
+    return tape_payload(tape, tape_payload(tape, position));
+}
+
+CJ_BOOL cj_tape_boolean(const CJTape *tape, size_t position) {
+    return tape_payload(tape, position) != 0;
+}
+
+double cj_tape_number(const CJTape *tape, size_t position) {
+    double number;
+    if (tape_tag(tape, position) & TAPE_INTEGER) {
+        CJUInt64 bits = tape->words[position] & TAPE_PAYLOAD_MASK;
+        /* extend the sign of the payload */
+        if (bits >> (TAPE_PAYLOAD_BITS - 1)) bits |= ~TAPE_PAYLOAD_MASK;
+        return (double) (CJInt64) bits;
+    }
+    memcpy(&number, &tape->words[position + 1], sizeof(double));
+    return number;
+}
+
+const char *cj_tape_string(
+    const CJTape *tape,
+    size_t position,
+    size_t *length
+) {
+    size_t payload = tape_payload(tape, position);
+    const char *chars = tape->strings + (payload >> 8);
+    *length = payload & 0xFF;
+    if (*length == TAPE_LONG_STRING) {
+        memcpy(length, chars, sizeof(size_t));
+        chars += sizeof(size_t);
+    }
+    return chars;
+}
+
+size_t cj_tape_object_get(
+    const CJTape *tape,
+    size_t position,
+    const char *key,
+    size_t length
+) {
+    size_t i, count, member;
+    if (tape_tag(tape, position) != CJ_OBJECT) return 0;
+    count = cj_tape_length(tape, position);
+    member = position + 1;
+    for (i = 0; i < count; ++i) {
+        size_t key_length;
+        const char *chars = cj_tape_string(tape, member, &key_length);
+        /* keys are one word, so the value is right after */
+        if (key_length == length && memcmp(chars, key, length) == 0) {
+            return member + 1;
+        }
+        member = cj_tape_next(tape, member + 1);
+    }
+    return 0;
+}
+
+void cj_tape_free(CJAllocator *allocator, const CJTape *tape) {
+#ifdef CJ_DEFAULT_ALLOCATOR
+    if (allocator == NULL) allocator = &default_allocator;
+#endif
+    dealloc(allocator, tape->words);
+    dealloc(allocator, tape->strings);
+}
+#endif
+
+/*
+ * The push parser keeps its place in the grammar in a state, and its
+ * unfinished arrays and objects in a stack of frames, so that it can stop at
+ * the end of any chunk and pick up again with the next one. Values are built
+ * on the same value stack as the recursive parser.
+ */
+
+/* What the push parser expects next. */
+typedef enum {
+    /* a value */
+    PUSH_VALUE,
+    /* a value, or the end of an empty array */
+    PUSH_FIRST_ELEMENT,
+    /* a key, or the end of an empty object */
+    PUSH_FIRST_MEMBER,
+    /* a key */
+    PUSH_KEY,
+    /* the colon after a key */
+    PUSH_COLON,
+    /* a comma, or the end of the array or object */
+    PUSH_AFTER_VALUE,
+    /* more of a string */
+    PUSH_STRING,
+    /* the character after a backslash */
+    PUSH_ESCAPE,
+    /* the hex digits of a \u escape */
+    PUSH_HEX,
+    /* the continuation bytes of a UTF-8 sequence */
+    PUSH_UTF8,
+    /* more of a number */
+    PUSH_NUMBER,
+    /* the rest of true, false, or null */
+    PUSH_LITERAL,
+    /* nothing but whitespace, after the root value */
+    PUSH_DONE,
+    /* nothing, as an error occurred */
+    PUSH_FAILED
+} PushState;
+
+/* Where the push parser is in a number. */
+typedef enum {
+    /* after the minus sign */
+    NUMBER_SIGN,
+    /* after a leading zero */
+    NUMBER_ZERO,
+    /* in the integer part */
+    NUMBER_INTEGER,
+    /* after the decimal point */
+    NUMBER_POINT,
+    /* in the fraction part */
+    NUMBER_FRACTION,
+    /* after the 'e' */
+    NUMBER_E,
+    /* after the sign of the exponent */
+    NUMBER_EXPONENT_SIGN,
+    /* in the exponent */
+    NUMBER_EXPONENT
+} NumberState;
+
+struct CJPushParser {
+    Parser p;
+    PushState state;
+    /* The stack index of the string or number being parsed. */
+    size_t index;
+    /* The offset of its text in the character buffer. */
+    size_t start;
+    /* True if the string is a key. */
+    CJ_BOOL key;
+    /* The pending high surrogate of a string, or -1. */
+    Codepoint pending;
+    /* The codepoint being decoded from an escape or UTF-8 sequence. */
+    Codepoint codepoint;
+    /* The number of hex digits or continuation bytes still to come. */
+    int remaining;
+    /* The length of the UTF-8 sequence being decoded. */
+    int utf8_length;
+    NumberState number;
+    /* The rest of the literal being matched. */
+    const char *literal;
+};
+
+/* Finish a value, and expect whatever comes after it. */
+static void push_end_value(CJPushParser *pp) {
+    --pp->p.depth;
+    pp->state = pp->p.frames_len == 0 ? PUSH_DONE : PUSH_AFTER_VALUE;
+}
+
+static void push_begin_string(CJPushParser *pp, size_t index, CJ_BOOL key) {
+    pp->index = index;
+    pp->start = pp->p.chars_len;
+    pp->key = key;
+    pp->pending = -1;
+    pp->state = PUSH_STRING;
+}
+
+/* Push the pending high surrogate, as something other than its pair is next. */
+static void push_flush_pending(CJPushParser *pp) {
+    if (pp->pending != -1) {
+        push_codepoint(&pp->p, pp->pending);
+        pp->pending = -1;
+    }
+}
+
+static void push_end_string(CJPushParser *pp) {
+    push_flush_pending(pp);
+    finish_string_value(&pp->p, pp->index, pp->key, pp->start);
+    if (pp->key) {
+        pp->state = PUSH_COLON;
+    } else {
+        push_end_value(pp);
+    }
+}
+
+static void push_string(CJPushParser *pp) {
+    Parser *p = &pp->p;
+    const char *run = scan_string_run(p->cur, p->end);
+    char c;
+    if (run != p->cur) {
+        push_flush_pending(pp);
+        push_chars(p, p->cur, run - p->cur);
+        p->cur = run;
+        return;
+    }
+    c = *p->cur++;
+    if (c == '"') {
+        push_end_string(pp);
+    } else if (c == '\\') {
+        pp->state = PUSH_ESCAPE;
+    } else if ((c & 0x80) == 0) {
+        if (c < ' ') error(p, CJ_SYNTAX_ERROR);
+        push_flush_pending(pp);
+        push_char(p, c);
+    } else {
+        /* a UTF-8 sequence that is split between chunks, or invalid */
+        if ((c & 0x40) == 0) error(p, CJ_SYNTAX_ERROR);
+        if ((c & 0x20) == 0) {
+            pp->utf8_length = 2;
+        } else if ((c & 0x10) == 0) {
+            pp->utf8_length = 3;
+        } else if ((c & 0x08) == 0) {
+            pp->utf8_length = 4;
+        } else {
+            error(p, CJ_SYNTAX_ERROR);
+        }
+        pp->codepoint = c & 0x7F;
+        pp->remaining = pp->utf8_length - 1;
+        pp->state = PUSH_UTF8;
+    }
+}
+
+static void push_utf8(CJPushParser *pp) {
+    Parser *p = &pp->p;
+    char c = *p->cur++;
+    if ((c & 0x80) == 0 || (c & 0x40)) error(p, CJ_SYNTAX_ERROR);
+    pp->codepoint = (pp->codepoint << 6) | (c & 0x3F);
+    if (--pp->remaining == 0) {
+        Codepoint codepoint;
+        if (pp->utf8_length == 2) {
+            codepoint = overlong_check(p, pp->codepoint, 0x7FF, 0x7F);
+        } else if (pp->utf8_length == 3) {
+            codepoint = overlong_check(p, pp->codepoint, 0xFFFF, 0x7FF);
+        } else {
+            codepoint = overlong_check(p, pp->codepoint, 0x1FFFFF, 0xFFFF);
+        }
+        push_flush_pending(pp);
+        push_codepoint(p, codepoint);
+        pp->state = PUSH_STRING;
+    }
+}
+
+static void push_escape(CJPushParser *pp) {
+    Parser *p = &pp->p;
+    char c = *p->cur++;
+    if (c == 'u') {
+        pp->codepoint = 0;
+        pp->remaining = 4;
+        pp->state = PUSH_HEX;
+    } else {
+        c = escaped_char(p, c);
+        push_flush_pending(pp);
+        push_codepoint(p, c);
+        pp->state = PUSH_STRING;
+    }
+}
+
+static void push_hex(CJPushParser *pp) {
+    Parser *p = &pp->p;
+    pp->codepoint = (pp->codepoint << 4) | hex_value(p, *p->cur++);
+    if (--pp->remaining == 0) {
+        push_utf16_unit(p, pp->codepoint, &pp->pending);
+        pp->state = PUSH_STRING;
+    }
+}
+
+/* Finish a number, which must not be missing any digits. */
+static void push_end_number(CJPushParser *pp) {
+    switch (pp->number) {
+        case NUMBER_ZERO: case NUMBER_INTEGER: case NUMBER_FRACTION:
+        case NUMBER_EXPONENT:
+            break;
+        default:
+            error(&pp->p, CJ_SYNTAX_ERROR);
+    }
+    finish_number_text(&pp->p, pp->index, pp->start);
+    push_end_value(pp);
+}
+
+static void push_number(CJPushParser *pp) {
+    Parser *p = &pp->p;
+    while (p->cur != p->end) {
+        char c = *p->cur;
+        CJ_BOOL digit = c >= '0' && c <= '9';
+        switch (pp->number) {
+            case NUMBER_SIGN:
+                if (!digit) error(p, CJ_SYNTAX_ERROR);
+                pp->number = c == '0' ? NUMBER_ZERO : NUMBER_INTEGER;
+                break;
+            case NUMBER_ZERO:
+            case NUMBER_INTEGER:
+                if (digit && pp->number == NUMBER_INTEGER) {
+                    break;
+                } else if (c == '.') {
+                    pp->number = NUMBER_POINT;
+                } else if (c == 'e' || c == 'E') {
+                    pp->number = NUMBER_E;
+                } else {
+                    push_end_number(pp);
+                    return;
+                }
+                break;
+            case NUMBER_POINT:
+                if (!digit) error(p, CJ_SYNTAX_ERROR);
+                pp->number = NUMBER_FRACTION;
+                break;
+            case NUMBER_FRACTION:
+                if (digit) {
+                    break;
+                } else if (c == 'e' || c == 'E') {
+                    pp->number = NUMBER_E;
+                } else {
+                    push_end_number(pp);
+                    return;
+                }
+                break;
+            case NUMBER_E:
+                if (c == '+' || c == '-') {
+                    pp->number = NUMBER_EXPONENT_SIGN;
+                    break;
+                }
+                /* fall through */
+            case NUMBER_EXPONENT_SIGN:
+                if (!digit) error(p, CJ_SYNTAX_ERROR);
+                pp->number = NUMBER_EXPONENT;
+                break;
+            case NUMBER_EXPONENT:
+                if (!digit) {
+                    push_end_number(pp);
+                    return;
+                }
+                break;
+        }
+        push_char(p, c);
+        ++p->cur;
+    }
+}
+
+static void push_close_container(CJPushParser *pp) {
+    Frame *frame = &pp->p.frames[--pp->p.frames_len];
+    if (frame->object) {
+        finish_object(&pp->p, frame->index, frame->chars_start);
+    } else {
+        finish_array(&pp->p, frame->index, frame->chars_start);
+    }
+    push_end_value(pp);
+}
+
+static void push_begin_value(CJPushParser *pp) {
+    Parser *p = &pp->p;
+    char c = *p->cur++;
+    size_t index;
+    /* check depth */
+    if (++p->depth == p->max_depth) {
+        error(p, CJ_TOO_MUCH_NESTING);
+    }
+    index = push_value(p);
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        pp->index = index;
+        pp->start = p->chars_len;
+        pp->number = c == '-' ? NUMBER_SIGN
+            : c == '0' ? NUMBER_ZERO : NUMBER_INTEGER;
+        push_char(p, c);
+        pp->state = PUSH_NUMBER;
+        return;
+    }
+    switch (c) {
+        case 't':
+            p->stack[index].type = CJ_BOOLEAN;
+            p->stack[index].as.boolean = CJ_TRUE;
+            pp->literal = "rue";
+            pp->state = PUSH_LITERAL;
+            break;
+        case 'f':
+            p->stack[index].type = CJ_BOOLEAN;
+            p->stack[index].as.boolean = CJ_FALSE;
+            pp->literal = "alse";
+            pp->state = PUSH_LITERAL;
+            break;
+        case 'n':
+            pp->literal = "ull";
+            pp->state = PUSH_LITERAL;
+            break;
+        case '"':
+            push_begin_string(pp, index, CJ_FALSE);
+            break;
+        case '[':
+            push_frame(p, index, CJ_FALSE);
+            pp->state = PUSH_FIRST_ELEMENT;
+            break;
+        case '{':
+            push_frame(p, index, CJ_TRUE);
+            pp->state = PUSH_FIRST_MEMBER;
+            break;
+        default:
+            error(p, CJ_SYNTAX_ERROR);
+    }
+}
+
+/* Take one step through the grammar. */
+static void push_step(CJPushParser *pp) {
+    Parser *p = &pp->p;
+    char c;
+    switch (pp->state) {
+        case PUSH_STRING:
+            push_string(pp);
+            return;
+        case PUSH_ESCAPE:
+            push_escape(pp);
+            return;
+        case PUSH_HEX:
+            push_hex(pp);
+            return;
+        case PUSH_UTF8:
+            push_utf8(pp);
+            return;
+        case PUSH_NUMBER:
+            push_number(pp);
+            return;
+        case PUSH_LITERAL:
+            if (*p->cur++ != *pp->literal) error(p, CJ_SYNTAX_ERROR);
+            if (*++pp->literal == '\0') push_end_value(pp);
+            return;
+        default:
+            break;
+    }
+    /* everything else may be preceded by whitespace */
+    p->cur = skip_ws_run(p->cur, p->end);
+    if (at_eof(p)) return;
+    c = *p->cur;
+    switch (pp->state) {
+        case PUSH_FIRST_ELEMENT:
+            if (c == ']') {
+                ++p->cur;
+                push_close_container(pp);
+                return;
+            }
+            /* fall through */
+        case PUSH_VALUE:
+            push_begin_value(pp);
+            return;
+        case PUSH_FIRST_MEMBER:
+            if (c == '}') {
+                ++p->cur;
+                push_close_container(pp);
+                return;
+            }
+            /* fall through */
+        case PUSH_KEY:
+            if (c != '"') error(p, CJ_SYNTAX_ERROR);
+            ++p->cur;
+            push_begin_string(pp, push_value(p), CJ_TRUE);
+            return;
+        case PUSH_COLON:
+            if (c != ':') error(p, CJ_SYNTAX_ERROR);
+            ++p->cur;
+            pp->state = PUSH_VALUE;
+            return;
+        case PUSH_AFTER_VALUE:
+            ++p->cur;
+            if (c == ',') {
+                pp->state = p->frames[p->frames_len - 1].object
+                    ? PUSH_KEY : PUSH_VALUE;
+            } else if (c == (p->frames[p->frames_len - 1].object
+                    ? '}' : ']')) {
+                push_close_container(pp);
+            } else {
+                error(p, CJ_SYNTAX_ERROR);
+            }
+            return;
+        default:
+            /* there's something after the root value */
+            error(p, CJ_SYNTAX_ERROR);
+    }
+}
+
+/* Free the values of a failed parse. */
+static void push_fail(CJPushParser *pp) {
+    Parser *p = &pp->p;
+    size_t i;
+    if (!(p->flags & CJ_PARSE_ARENA)) {
+        for (i = 0; i < p->stack_len; ++i) {
+            cj_free(p->allocator, &p->stack[i]);
+        }
+    }
+    p->stack_len = 0;
+    pp->state = PUSH_FAILED;
+}
+
+/* Get ready to parse another value, keeping the scratch buffers. */
+static void push_reset(CJPushParser *pp) {
+    reset_scratch(&pp->p);
+    pp->state = PUSH_VALUE;
+    pp->p.result = CJ_SUCCESS;
+}
+
+CJPushParser *cj_push_new(CJAllocator *allocator, unsigned flags) {
+    Parser p;
+    CJPushParser *pp;
+    init_parser(&p, allocator, flags);
+    /* keep the parser out of an arena, like the scratch buffers */
+    pp = p.scratch_allocator->allocate(p.scratch_allocator, NULL,
+        sizeof(CJPushParser));
+    if (pp == NULL) return NULL;
+    pp->p = p;
+    push_reset(pp);
+    return pp;
+}
+
+CJParseResult cj_push_feed(
+    CJPushParser *parser,
+    const char *data,
+    size_t length
+) {
+    Parser *p = &parser->p;
+    if (parser->state == PUSH_FAILED) return p->result;
+    p->cur = data;
+    p->end = data + length;
+    if (setjmp(p->buf)) {
+        push_fail(parser);
+        return p->result;
+    }
+    while (!at_eof(p)) push_step(parser);
+    return CJ_NEED_MORE;
+}
+
+CJParseResult cj_push_finish(CJPushParser *parser, CJValue *out) {
+    Parser *p = &parser->p;
+    CJParseResult result;
+    out->type = CJ_NULL;
+    out->flags = 0;
+    if (parser->state != PUSH_FAILED) {
+        if (setjmp(p->buf)) {
+            push_fail(parser);
+        } else {
+            /* the end of the input ends a number */
+            if (parser->state == PUSH_NUMBER) push_end_number(parser);
+            if (parser->state != PUSH_DONE) error(p, CJ_SYNTAX_ERROR);
+            *out = p->stack[0];
+        }
+    }
+    result = p->result;
+    push_reset(parser);
+    return result;
+}
+
+void cj_push_delete(CJPushParser *parser) {
+    CJAllocator *scratch_allocator = parser->p.scratch_allocator;
+    free_scratch(&parser->p, !(parser->p.flags & CJ_PARSE_ARENA));
+    dealloc(scratch_allocator, parser);
+}
+
+static void free_string(CJAllocator *allocator, const CJString *string) {
+    /* only cj's own empty strings are not allocated */
+    if (string->chars != empty_string) dealloc(allocator, string->chars);
+}
+
+/* Drop a reference to an interned key, freeing it if it was the last one. */
+static void release_key(CJAllocator *allocator, const CJString *string) {
+    size_t *refs = key_refs(string->chars);
+    if (--*refs == 0) dealloc(allocator, refs);
+}
+
+/* Free the text of a value that is not an array or an object. */
+static void free_scalar(CJAllocator *allocator, const CJValue *value) {
+    if (value->type == CJ_NUMBER) {
+        /* copied number text is allocated, but borrowed text is not */
+        if ((value->flags & (CJ_VALUE_RAW_NUMBER | CJ_VALUE_BORROWED))
+                == CJ_VALUE_RAW_NUMBER) {
+            dealloc(allocator, (char*) value->as.raw.chars);
+        }
+    } else if (value->type == CJ_STRING) {
+        if (value->flags & CJ_VALUE_SHARED) {
+            release_key(allocator, &value->as.string);
+        } else if (!(value->flags & CJ_VALUE_BORROWED)) {
+            free_string(allocator, &value->as.string);
+        }
+    }
+}
+
+/* Get the member that a value belongs to. */
+static CJObjectMember *member_of(CJValue *value) {
+    return cj_container_of(value, CJObjectMember, value);
+}
+
+/*
+ * Values are freed without recursion, and without memory to keep track of the
+ * containers they are in. Children are freed from last to first, and before
+ * going into a child container, the place of its parent is left in the child
+ * itself, which is about to be freed anyway: it takes the type of the parent,
+ * and holds the child that the parent's own place is in, along with its
+ * position among the parent's children.
+ */
+void cj_free(CJAllocator *allocator, const CJValue *value) {
+    /* the children of the container being freed, and how many are left */
+    void *children;
+    size_t left;
+    CJ_BOOL object;
+    /* the child holding the parent's place, or NULL at the top */
+    CJValue *parent = NULL;
+#ifdef CJ_DEFAULT_ALLOCATOR
+    if (allocator == NULL) allocator = &default_allocator;
+#endif
+    if (value->type == CJ_ARRAY) {
+        children = value->as.array.elements;
+        left = value->as.array.length;
+        object = CJ_FALSE;
+    } else if (value->type == CJ_OBJECT) {
+        children = value->as.object.members;
+        left = value->as.object.length;
+        object = CJ_TRUE;
+    } else {
+        free_scalar(allocator, value);
+        return;
+    }
+    for (;;) {
+        CJValue *child;
+        if (left == 0) {
+            dealloc(allocator, children);
+            if (parent == NULL) return;
+            /* go back to the parent, after the child that was just freed */
+            child = parent;
+            object = child->type == CJ_OBJECT;
+            left = child->as.array.length;
+            parent = child->as.array.elements;
+            if (object) {
+                children = member_of(child) - left;
+            } else {
+                children = child - left;
+            }
+            continue;
+        }
+        --left;
+        if (object) {
+            CJObjectMember *member = (CJObjectMember*) children + left;
+            if (member->value.flags & CJ_VALUE_SHARED_KEY) {
+                release_key(allocator, &member->key);
+            } else if (!(member->value.flags & CJ_VALUE_BORROWED_KEY)) {
+                free_string(allocator, &member->key);
+            }
+            child = &member->value;
+        } else {
+            child = (CJValue*) children + left;
+        }
+        if (child->type == CJ_ARRAY || child->type == CJ_OBJECT) {
+            /* go into the child, leaving the parent's place in it */
+            size_t position = left;
+            CJ_BOOL child_object = child->type == CJ_OBJECT;
+            if (child_object) {
+                children = child->as.object.members;
+                left = child->as.object.length;
+            } else {
+                children = child->as.array.elements;
+                left = child->as.array.length;
+            }
+            child->type = object ? CJ_OBJECT : CJ_ARRAY;
+            child->as.array.elements = parent;
+            child->as.array.length = position;
+            parent = child;
+            object = child_object;
+        } else {
+            free_scalar(allocator, child);
+        }
+    }
+}
+
+/*
+ * Values are written into the buffer that the writer last returned, which is
+ * handed back to it once it fills up.
+ */
+typedef struct {
+    CJWriter *writer;
+    /* The start of the buffer, its next unwritten byte, and its end. */
+    char *start;
+    char *cur;
+    char *end;
+    /* The flags passed to cj_write. */
+    unsigned flags;
+    /* The depth of the value being written, for indentation. */
+    int depth;
+    /*
+     * The arrays and objects being written, innermost last, which are kept in
+     * the local array of cj_write until they outgrow it.
+     */
+    const CJValue **open;
+    size_t open_len;
+    size_t open_cap;
+    /* Error handling structure. */
+    jmp_buf buf;
+} Output;
+
+/* The number of arrays and objects that cj_write keeps track of locally. */
+#define OUTPUT_LOCAL_DEPTH 64
+
+/* Write out the filled part of the buffer, and get the next buffer. */
+static void flush_output(Output *o, CJ_BOOL finished) {
+    size_t size;
+    char *buffer = o->writer->write(o->writer, o->cur - o->start,
+        finished ? NULL : &size);
+    if (buffer == NULL) longjmp(o->buf, 1);
+    if (!finished) {
+        o->start = o->cur = buffer;
+        o->end = buffer + size;
+    }
+}
+
+static void output_char(Output *o, char c) {
+    if (o->cur == o->end) flush_output(o, CJ_FALSE);
+    *o->cur++ = c;
+}
+
+static void output_chars(Output *o, const char *chars, size_t length) {
+    size_t space;
+    while (length > (space = o->end - o->cur)) {
+        memcpy(o->cur, chars, space);
+        o->cur += space;
+        chars += space;
+        length -= space;
+        flush_output(o, CJ_FALSE);
+    }
+    memcpy(o->cur, chars, length);
+    o->cur += length;
+}
+
+/* Write the escape for a control character, quote, or backslash. */
+static void output_escape(Output *o, unsigned char c) {
+    static const char hex[] = "0123456789abcdef";
+    char escape[6];
+    escape[0] = '\\';
+    switch (c) {
+        case '"': case '\\': escape[1] = (char) c; break;
+        case '\b': escape[1] = 'b'; break;
+        case '\f': escape[1] = 'f'; break;
+        case '\n': escape[1] = 'n'; break;
+        case '\r': escape[1] = 'r'; break;
+        case '\t': escape[1] = 't'; break;
+        default:
+            escape[1] = 'u';
+            escape[2] = '0';
+            escape[3] = '0';
+            escape[4] = hex[c >> 4];
+            escape[5] = hex[c & 0xF];
+            output_chars(o, escape, 6);
+            return;
+    }
+    output_chars(o, escape, 2);
+}
+
+static void output_string(Output *o, const CJString *str) {
+    const char *cur = str->chars;
+    const char *end = cur + str->length;
+    output_char(o, '"');
+    while (cur != end) {
+        /* copy everything up to the next character that needs escaping */
+        const char *run = skip_plain_ascii(cur, end);
+        while (run != end && (unsigned char) *run >= 0x80) {
+            run = skip_plain_ascii(run + 1, end);
+        }
+        output_chars(o, cur, run - cur);
+        if (run == end) break;
+        output_escape(o, (unsigned char) *run);
+        cur = run + 1;
+    }
+    output_char(o, '"');
+}
+
+/* Enough for a sign, 17 significant digits, and the zeros of 1e-7 or 1e20. */
+#define NUMBER_BUFFER_SIZE 32
+
+#ifdef FAST_NUMBERS
+/*
+ * The shortest decimals are found with the Schubfach algorithm by Raffaello
+ * Giulietti, which finds the decimals in the rounding interval of a double
+ * from 128-bit approximations of powers of ten.
+ */
+
+#define DOUBLE_EXPONENT_BIAS 1075
+#define DOUBLE_MIN_EXPONENT (-1074)
+#define LOW_63_BITS (~(U64) 0 >> 1)
+
+/* floor(x / 2^shift), without relying on shifting negative numbers */
+static long floor_shift(long x, int shift) {
+    long d = 1L << shift;
+    return x >= 0 ? x / d : -((d - 1 - x) / d);
+}
+
+/* floor(log10(2^e)), for -2620 <= e <= 2620 */
+static long floor_log10_pow2(long e) {
+    return floor_shift(e * 315653L, 20);
 }
 
-static Codepoint read_utf8_codepoint(Parser *p) {
-    Codepoint codepoint;
-    char b = take(p);
-    if ((b & (1 << 7)) == 0) {
-        if (b < ' ') error(p, CJ_SYNTAX_ERROR);
-        return b;
+/* floor(log10(3/4 2^e)), for -2936 <= e <= 2936 */
+static long floor_log10_three_quarters_pow2(long e) {
+    return floor_shift(e * 631305L - 261663L, 21);
+}
+
+/* floor(log2(10^e)), for -1233 <= e <= 1233 */
+static long floor_log2_pow10(long e) {
+    return floor_shift(e * 1741647L, 19);
+}
+
+/*
+ * Get the 126-bit approximation of 10^q that is the truncated value plus one,
+ * split into its upper bits and lower 63 bits.
+ */
+static void schubfach_power(long q, U64 *upper, U64 *lower) {
+    U128 power = powers_of_five[q - SMALLEST_POWER_OF_TEN];
+    U64 high, low;
+    /* truncate the powers that are rounded up */
+    if (q >= -27 && q < 0 && power.low-- == 0) --power.high;
+    high = power.high >> 2;
+    low = (power.high << 62) | (power.low >> 2);
+    if (++low == 0) ++high;
+    *upper = (high << 1) | (low >> 63);
+    *lower = low & LOW_63_BITS;
+}
+
+/* Multiply by the power of ten, and round the top 64 bits to odd. */
+static U64 round_to_odd(U64 upper, U64 lower, U64 x) {
+    U64 x1 = full_multiply(lower, x).high;
+    U128 y = full_multiply(upper, x);
+    U64 z = (y.low >> 1) + x1;
+    U64 result = y.high + (z >> 63);
+    return result | (((z & LOW_63_BITS) + LOW_63_BITS) >> 63);
+}
+
+/*
+ * Find the shortest decimal in the rounding interval of c 2^q, preferring the
+ * closest, and store its exponent.
+ */
+static U64 schubfach(long q, U64 c, long *exponent) {
+    U64 odd = c & 1;
+    U64 cb = c << 2;
+    U64 cbr = cb + 2;
+    U64 cbl, upper, lower, vb, vbl, vbr, s, t;
+    long k, h;
+    CJ_BOOL u_in, w_in;
+    if (c != (U64) 1 << DOUBLE_MANTISSA_BITS || q == DOUBLE_MIN_EXPONENT) {
+        /* the doubles on either side are equally far */
+        cbl = cb - 2;
+        k = floor_log10_pow2(q);
+    } else {
+        /* the double below is closer, as the exponent changes */
+        cbl = cb - 1;
+        k = floor_log10_three_quarters_pow2(q);
     }
-    if ((b & (1 << 6)) == 0) error(p, CJ_SYNTAX_ERROR);
-    codepoint = b & 0x7F;
-    utf8_check_cont(p, &codepoint);
-    if ((b & (1 << 5)) == 0) {
-        return overlong_check(p, codepoint, 0x7FF, 0x7F);
+    *exponent = k;
+    h = q + floor_log2_pow10(-k) + 2;
+    schubfach_power(-k, &upper, &lower);
+    vb = round_to_odd(upper, lower, cb << h);
+    vbl = round_to_odd(upper, lower, cbl << h);
+    vbr = round_to_odd(upper, lower, cbr << h);
+    s = vb >> 2;
+    /*
+     * Try one digit less first, using s / 10 = s 2^64 / 10 / 2^64. This also
+     * finds a single digit for the smallest subnormals.
+     */
+    {
+        U64 sp10 = 10 * full_multiply(s, U64_C(0x19999999, 0x999999a0)).high;
+        U64 tp10 = sp10 + 10;
+        CJ_BOOL up_in = vbl + odd <= sp10 << 2;
+        CJ_BOOL wp_in = (tp10 << 2) + odd <= vbr;
+        if (up_in != wp_in) return up_in ? sp10 : tp10;
     }
-    utf8_check_cont(p, &codepoint);
-    if ((b & (1 << 4)) == 0) {
-        return overlong_check(p, codepoint, 0xFFFF, 0x7FF);
+    t = s + 1;
+    u_in = vbl + odd <= s << 2;
+    w_in = (t << 2) + odd <= vbr;
+    if (u_in != w_in) return u_in ? s : t;
+    /* both are in the interval, so pick the closest, or the even one */
+    if (vb < (s + t) << 1 || (vb == (s + t) << 1 && (s & 1) == 0)) return s;
+    return t;
+}
+
+/* The digits of each number below 100. */
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Write out the digits of n, and return how many there are. */
+static int write_digits(U64 n, char *out) {
+    char buf[20];
+    int i = sizeof(buf);
+    while (n >= 100) {
+        i -= 2;
+        memcpy(buf + i, digit_pairs + (n % 100) * 2, 2);
+        n /= 100;
     }
-    utf8_check_cont(p, &codepoint);
-    if ((b & (1 << 3)) == 0) {
-        return overlong_check(p, codepoint, 0x1FFFFF, 0xFFFF);
+    if (n >= 10) {
+        i -= 2;
+        memcpy(buf + i, digit_pairs + n * 2, 2);
+    } else {
+        buf[--i] = (char) ('0' + n);
     }
-    /* too many bytes! */
-    error(p, CJ_SYNTAX_ERROR);
+    memcpy(out, buf + i, sizeof(buf) - i);
+    return (int) sizeof(buf) - i;
 }
 
-static void utf16_escape(Parser *p, String *string, Codepoint *pending) {
-    /* read four hex digits */
-    Codepoint current
-        = (hex_digit(p) << 12)
-        | (hex_digit(p) << 8)
-        | (hex_digit(p) << 4)
-        | hex_digit(p);
-    /* if it's a surrogate half... */
-    if ((current >> 11) == 0x1B) {
-        /* low or high? */
-        if (current & 0x400) {
-            if (*pending != -1) {
-                /* if pending high half, combine them */
-                Codepoint high = ((*pending & 0x3FF) << 10) + 0x10000;
-                push_codepoint(p, string, high | (current & 0x3FF));
-            } else {
-                /* print current */
-                push_codepoint(p, string, current);
-            }
-            /* nothing pending anymore */
-            *pending = -1;
+/*
+ * Find the shortest digits of a finite double that parse back to it, without
+ * the sign, and store the exponent of the first digit. Return the number of
+ * digits, which might include trailing zeros.
+ */
+static int shortest_digits(
+    double number,
+    char *digits,
+    long *exponent,
+    CJ_BOOL *negative
+) {
+    U64 bits, mantissa, c, decimal;
+    long biased, q, e;
+    int count;
+    memcpy(&bits, &number, sizeof(double));
+    *negative = (CJ_BOOL) (bits >> 63);
+    mantissa = bits & (((U64) 1 << DOUBLE_MANTISSA_BITS) - 1);
+    biased = (long) (bits >> DOUBLE_MANTISSA_BITS) & DOUBLE_INFINITE_POWER;
+    if (biased != 0) {
+        c = mantissa | ((U64) 1 << DOUBLE_MANTISSA_BITS);
+        q = biased - DOUBLE_EXPONENT_BIAS;
+        if (q < 0 && q > -DBL_MANT_DIG
+                && (c & (((U64) 1 << -q) - 1)) == 0) {
+            /* a small integer is its own shortest decimal */
+            decimal = c >> -q;
+            e = 0;
         } else {
-            /* print pending */
-            if (*pending != -1) push_codepoint(p, string, *pending);
-            /* store high half in pending */
-            *pending = current;
+            decimal = schubfach(q, c, &e);
         }
+    } else if (mantissa != 0) {
+        decimal = schubfach(DOUBLE_MIN_EXPONENT, mantissa, &e);
     } else {
-        /* print pending */
-        if (*pending != -1) push_codepoint(p, string, *pending);
-        /* not a surrogate half, so print as is */
-        push_codepoint(p, string, current);
-        /* nothing pending anymore */
-        *pending = -1;
+        digits[0] = '0';
+        *exponent = 0;
+        return 1;
+    }
+    count = write_digits(decimal, digits);
+    *exponent = e + count - 1;
+    return count;
+}
+#else
+/*
+ * Find the shortest digits of a finite double that parse back to it, without
+ * the sign, and store the exponent of the first digit. Return the number of
+ * digits, which might include trailing zeros. Without the exact algorithm,
+ * 15, 16, and then 17 digits are tried.
+ */
+static int shortest_digits(
+    double number,
+    char *digits,
+    long *exponent,
+    CJ_BOOL *negative
+) {
+    char buf[NUMBER_BUFFER_SIZE];
+    const char *cur = buf;
+    int precision, count = 0;
+    for (precision = 15;; ++precision) {
+        sprintf(buf, "%.*e", precision - 1, number);
+        if (precision == 17 || strtod(buf, NULL) == number) break;
+    }
+    *negative = *cur == '-';
+    if (*negative) ++cur;
+    for (; *cur != 'e'; ++cur) {
+        if (*cur != '.') digits[count++] = *cur;
     }
+    *exponent = strtol(cur + 1, NULL, 10);
+    return count;
 }
+#endif
 
-static void parse_string(Parser *p, CJString *str) {
-    String string;
-    Codepoint pending = -1;
-    string_init(p, &string, str);
-    while (!eat(p, '"')) {
-        Codepoint codepoint;
-        if (eat(p, '\\')) {
-            if (eat(p, 'u')) {
-                utf16_escape(p, &string, &pending);
-                continue;
-            }
-            codepoint = read_escaped_codepoint(p);
+/* Format a double, and return the length of the text. */
+static size_t format_number(double number, char *out) {
+    char digits[NUMBER_BUFFER_SIZE];
+    char *start = out;
+    long exponent;
+    int count;
+    CJ_BOOL negative;
+    if (number != number) {
+        memcpy(out, "null", 4);
+        return 4;
+    }
+    if (number > DBL_MAX || number < -DBL_MAX) {
+        /* parses back to infinity */
+        if (number < 0) *out++ = '-';
+        memcpy(out, "1e999", 5);
+        return out + 5 - start;
+    }
+    count = shortest_digits(number, digits, &exponent, &negative);
+    while (count > 1 && digits[count - 1] == '0') --count;
+    if (negative) *out++ = '-';
+    if (exponent > -7 && exponent < 21) {
+        if (exponent >= count - 1) {
+            /* an integer */
+            memcpy(out, digits, count);
+            out += count;
+            memset(out, '0', exponent - count + 1);
+            out += exponent - count + 1;
+        } else if (exponent >= 0) {
+            memcpy(out, digits, exponent + 1);
+            out += exponent + 1;
+            *out++ = '.';
+            memcpy(out, digits + exponent + 1, count - exponent - 1);
+            out += count - exponent - 1;
         } else {
-            codepoint = read_utf8_codepoint(p);
+            *out++ = '0';
+            *out++ = '.';
+            memset(out, '0', -exponent - 1);
+            out += -exponent - 1;
+            memcpy(out, digits, count);
+            out += count;
         }
-        if (pending != -1) {
-            push_codepoint(p, &string, pending);
-            pending = -1;
+    } else {
+        /* too large or small, so use an exponent */
+        *out++ = digits[0];
+        if (count > 1) {
+            *out++ = '.';
+            memcpy(out, digits + 1, count - 1);
+            out += count - 1;
         }
-        push_codepoint(p, &string, codepoint);
+        *out++ = 'e';
+        if (exponent < 0) {
+            *out++ = '-';
+            exponent = -exponent;
+        }
+        if (exponent >= 100) *out++ = (char) ('0' + exponent / 100);
+        if (exponent >= 10) *out++ = (char) ('0' + exponent / 10 % 10);
+        *out++ = (char) ('0' + exponent % 10);
     }
-    if (pending != -1) push_codepoint(p, &string, pending);
-    /* add null terminator */
-    push_char(p, &string, '\0');
-    string_shrink(p, &string);
-    /* remove null terminator from length */
-    --str->length;
+    return out - start;
 }
 
-static void parse(Parser *p, CJValue *value);
-
-static void parse_array(Parser *p, CJArray *arr) {
-    Array array;
-    array_init(p, &array, arr);
-    skip_ws(p);
-    if (!check(p, ']')) {
-        do {
-            parse(p, array_add_one(p, &array));
-        } while (eat(p, ','));
+static void output_number(Output *o, const CJValue *value) {
+    char buf[NUMBER_BUFFER_SIZE];
+    if (value->flags & CJ_VALUE_RAW_NUMBER) {
+        /* the text is already valid JSON */
+        output_chars(o, value->as.raw.chars, value->as.raw.length);
+    } else {
+        output_chars(o, buf, format_number(value->as.number, buf));
     }
-    require(p, ']');
-    array_shrink(p, &array);
 }
 
-static void parse_member(Parser *p, CJObjectMember *member) {
-    /* initialize to a valid enough state in case of errors */
-    member->key.chars = NULL;
-    member->value.type = CJ_NULL;
-    skip_ws(p);
-    require(p, '"');
-    parse_string(p, &member->key);
-    skip_ws(p);
-    require(p, ':');
-    parse(p, &member->value);
+/* Start a new line for the next element or member, if pretty printing. */
+static void output_newline(Output *o) {
+    int i;
+    if (!(o->flags & CJ_WRITE_PRETTY)) return;
+    output_char(o, '\n');
+    for (i = 0; i < o->depth; ++i) output_chars(o, "    ", 4);
 }
 
-static void parse_object(Parser *p, CJObject *obj) {
-    Object object;
-    object_init(p, &object, obj);
-    skip_ws(p);
-    if (!check(p, '}')) {
-        do {
-            parse_member(p, object_add_one(p, &object));
-        } while (eat(p, ','));
+/*
+ * Remember an array or object that is being written, moving the ones being
+ * written to the heap if they outgrow the local array.
+ */
+static void push_open(Output *o, const CJValue *container) {
+    if (o->open_len == o->open_cap) {
+#ifdef CJ_DEFAULT_ALLOCATOR
+        size_t cap = o->open_cap * 2;
+        const CJValue **open;
+        if (cap < o->open_cap || cap > SIZE_MAX / sizeof(CJValue*)) {
+            longjmp(o->buf, 1);
+        }
+        open = default_allocator.allocate(&default_allocator,
+            o->open_cap == OUTPUT_LOCAL_DEPTH ? NULL : (void*) o->open,
+            cap * sizeof(CJValue*));
+        if (open == NULL) longjmp(o->buf, 1);
+        if (o->open_cap == OUTPUT_LOCAL_DEPTH) {
+            memcpy(open, o->open, o->open_len * sizeof(CJValue*));
+        }
+        o->open = open;
+        o->open_cap = cap;
+#else
+        /* there is nowhere else to put them */
+        longjmp(o->buf, 1);
+#endif
     }
-    require(p, '}');
-    object_shrink(p, &object);
+    o->open[o->open_len++] = container;
 }
 
-#define NUMBER_BUF_SIZE 32
+/* Free the arrays and objects being written, if they moved to the heap. */
+static void release_open(Output *o) {
+#ifdef CJ_DEFAULT_ALLOCATOR
+    if (o->open_cap != OUTPUT_LOCAL_DEPTH) {
+        dealloc(&default_allocator, (void*) o->open);
+    }
+#else
+    (void) o;
+#endif
+}
 
-typedef struct {
-    /* A pointer to the value in the tree. */
-    CJValue *value;
-    /* A string object to append characters to. */
-    String string;
-    /* A local string for short strings. */
-    CJString local;
-    /* A local buffer for short strings. */
-    char local_buf[NUMBER_BUF_SIZE];
-    /* The length of the local buffer. */
-} NumString;
-
-static void init_num_string(NumString *ns, CJValue *value) {
-    ns->value = value;
-    /* use local buffer until it's too large */
-    ns->string.cap = NUMBER_BUF_SIZE;
-    ns->string.slice = &ns->local;
-    ns->local.chars = ns->local_buf;
-    ns->local.length = 0;
-}
-
-static void push_num_string(Parser *p, NumString *ns, char c) {
-    if (ns->string.slice->length < NUMBER_BUF_SIZE) {
-        /* if we've got space, put it in the local buffer */
-        ns->local_buf[ns->string.slice->length++] = c;
-        return;
+/* Write the key of a member and the colon after it. */
+static void output_key(Output *o, const CJObjectMember *member) {
+    output_string(o, &member->key);
+    output_char(o, ':');
+    if (o->flags & CJ_WRITE_PRETTY) output_char(o, ' ');
+}
+
+/*
+ * Write a value. Instead of recursing into arrays and objects, the ones being
+ * written are kept in a stack, and the position of the child being written in
+ * its parent is worked out from where it is.
+ */
+static void output_value(Output *o, const CJValue *value) {
+    for (;;) {
+        const CJValue *parent;
+        size_t next, length;
+        switch (value->type) {
+            case CJ_NULL:
+                output_chars(o, "null", 4);
+                break;
+            case CJ_BOOLEAN:
+                if (value->as.boolean) {
+                    output_chars(o, "true", 4);
+                } else {
+                    output_chars(o, "false", 5);
+                }
+                break;
+            case CJ_NUMBER:
+                output_number(o, value);
+                break;
+            case CJ_STRING:
+                output_string(o, &value->as.string);
+                break;
+            case CJ_ARRAY:
+                output_char(o, '[');
+                if (value->as.array.length == 0) {
+                    output_char(o, ']');
+                    break;
+                }
+                push_open(o, value);
+                ++o->depth;
+                output_newline(o);
+                /* go on to the first element */
+                value = &value->as.array.elements[0];
+                continue;
+            case CJ_OBJECT:
+                output_char(o, '{');
+                if (value->as.object.length == 0) {
+                    output_char(o, '}');
+                    break;
+                }
+                push_open(o, value);
+                ++o->depth;
+                output_newline(o);
+                /* go on to the value of the first member */
+                output_key(o, &value->as.object.members[0]);
+                value = &value->as.object.members[0].value;
+                continue;
+        }
+        /* close the containers that the value was the last child of */
+        for (;;) {
+            if (o->open_len == 0) return;
+            parent = o->open[o->open_len - 1];
+            if (parent->type == CJ_ARRAY) {
+                next = value - parent->as.array.elements + 1;
+                length = parent->as.array.length;
+            } else {
+                next = member_of((CJValue*) value)
+                    - parent->as.object.members + 1;
+                length = parent->as.object.length;
+            }
+            if (next < length) break;
+            --o->open_len;
+            --o->depth;
+            output_newline(o);
+            output_char(o, parent->type == CJ_ARRAY ? ']' : '}');
+            value = parent;
+        }
+        output_char(o, ',');
+        output_newline(o);
+        if (parent->type == CJ_ARRAY) {
+            value = &parent->as.array.elements[next];
+        } else {
+            output_key(o, &parent->as.object.members[next]);
+            value = &parent->as.object.members[next].value;
+        }
     }
+}
 
-    if (ns->string.slice->length == NUMBER_BUF_SIZE) {
-        /* we need to migrate to an allocation */
-        CJString *cj_string = &ns->value->as.string;
-        /* set value type */
-        ns->value->type = CJ_STRING;
-        /* set to null in case of failure */
-        cj_string->chars = NULL;
-        cj_string->length = 0;
-        /* allocate buffer and initialize length */
-        cj_string->chars = alloc(p, NULL, NUMBER_BUF_SIZE);
-        cj_string->length = NUMBER_BUF_SIZE;
-        /* copy over characters */
-        memcpy(cj_string->chars, ns->local_buf, NUMBER_BUF_SIZE);
-        /* update our string slice */
-        ns->string.slice = cj_string;
+CJ_BOOL cj_write(CJWriter *writer, const CJValue *value, unsigned flags) {
+    const CJValue *local[OUTPUT_LOCAL_DEPTH];
+    Output o;
+    o.writer = writer;
+    o.start = NULL;
+    o.cur = NULL;
+    o.end = NULL;
+    o.flags = flags;
+    o.depth = 0;
+    o.open = local;
+    o.open_len = 0;
+    o.open_cap = OUTPUT_LOCAL_DEPTH;
+    if (setjmp(o.buf)) {
+        release_open(&o);
+        return CJ_FALSE;
     }
+    /* get the first buffer */
+    flush_output(&o, CJ_FALSE);
+    output_value(&o, value);
+    flush_output(&o, CJ_TRUE);
+    release_open(&o);
+    return CJ_TRUE;
+}
+
+#ifdef CJ_INT64
+/*
+ * A snapshot is a header of words, then the words of the tape, then its
+ * strings, padded with zeros to a whole number of words. The words are
+ * written as they are in memory, so they are loaded without being converted,
+ * and the header makes sure that only a machine that would have written the
+ * same bytes loads them.
+ */
+#define SNAPSHOT_MAGIC "CJSNAP\r\n"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER ((CJUInt64) 0x01020304 << 32 | 0x05060708)
 
-    /* push to the allocated string */
-    push_char(p, &ns->string, c);
+/* The words of the header. */
+#define SNAPSHOT_HEADER_MAGIC 0
+#define SNAPSHOT_HEADER_BYTE_ORDER 1
+#define SNAPSHOT_HEADER_VERSION 2
+#define SNAPSHOT_HEADER_SIZE_WIDTH 3
+#define SNAPSHOT_HEADER_WORDS_LENGTH 4
+#define SNAPSHOT_HEADER_STRINGS_LENGTH 5
+#define SNAPSHOT_HEADER_CHECKSUM 6
+#define SNAPSHOT_HEADER_LENGTH 7
+
+/*
+ * Mix words into a checksum. It only has to catch damaged and truncated
+ * files, so it is a multiply and a shift per word, which is much faster than
+ * reading the file in the first place.
+ */
+static CJUInt64 snapshot_checksum(
+    CJUInt64 hash,
+    const CJUInt64 *words,
+    size_t count
+) {
+    const CJUInt64 prime = (CJUInt64) 0x100 << 32 | 0x1B3;
+    size_t i;
+    for (i = 0; i < count; ++i) {
+        hash = (hash ^ words[i]) * prime;
+        hash ^= hash >> 32;
+    }
+    return hash;
 }
 
-static void free_num_string(CJAllocator *allocator, NumString *ns) {
-    if (ns->string.slice != &ns->local) {
-        dealloc(allocator, ns->string.slice->chars);
+/* Get the checksum of a tape, with its strings padded to a whole word. */
+static CJUInt64 tape_checksum(const CJTape *tape) {
+    size_t whole = tape->strings_length / sizeof(CJUInt64);
+    size_t rest = tape->strings_length % sizeof(CJUInt64);
+    CJUInt64 hash = snapshot_checksum(SNAPSHOT_VERSION, tape->words,
+        tape->length);
+    const char *strings = tape->strings;
+    size_t i;
+    /* the strings of a tape in memory may not be aligned */
+    for (i = 0; i < whole; ++i) {
+        CJUInt64 word;
+        memcpy(&word, strings + i * sizeof(CJUInt64), sizeof(CJUInt64));
+        hash = snapshot_checksum(hash, &word, 1);
+    }
+    if (rest != 0) {
+        CJUInt64 word = 0;
+        memcpy(&word, strings + whole * sizeof(CJUInt64), rest);
+        hash = snapshot_checksum(hash, &word, 1);
     }
+    return hash;
 }
 
-static void push_taken(Parser *p, NumString *ns) {
-    push_num_string(p, ns, take_unchecked(p));
+CJ_BOOL cj_save_tape_snapshot(const CJTape *tape, CJWriter *writer) {
+    static const char padding[sizeof(CJUInt64)] = { 0 };
+    CJUInt64 header[SNAPSHOT_HEADER_LENGTH];
+    size_t rest = tape->strings_length % sizeof(CJUInt64);
+    Output o;
+    memcpy(&header[SNAPSHOT_HEADER_MAGIC], SNAPSHOT_MAGIC, sizeof(CJUInt64));
+    header[SNAPSHOT_HEADER_BYTE_ORDER] = SNAPSHOT_BYTE_ORDER;
+    header[SNAPSHOT_HEADER_VERSION] = SNAPSHOT_VERSION;
+    header[SNAPSHOT_HEADER_SIZE_WIDTH] = sizeof(size_t);
+    header[SNAPSHOT_HEADER_WORDS_LENGTH] = tape->length;
+    header[SNAPSHOT_HEADER_STRINGS_LENGTH] = tape->strings_length;
+    header[SNAPSHOT_HEADER_CHECKSUM] = tape_checksum(tape);
+    o.writer = writer;
+    o.start = NULL;
+    o.cur = NULL;
+    o.end = NULL;
+    o.flags = 0;
+    o.depth = 0;
+    o.open = NULL;
+    o.open_len = 0;
+    o.open_cap = 0;
+    if (setjmp(o.buf)) return CJ_FALSE;
+    flush_output(&o, CJ_FALSE);
+    output_chars(&o, (const char*) header, sizeof(header));
+    output_chars(&o, (const char*) tape->words,
+        tape->length * sizeof(CJUInt64));
+    if (tape->strings_length != 0) {
+        output_chars(&o, tape->strings, tape->strings_length);
+    }
+    if (rest != 0) {
+        output_chars(&o, padding, sizeof(CJUInt64) - rest);
+    }
+    flush_output(&o, CJ_TRUE);
+    return CJ_TRUE;
 }
 
-static CJ_BOOL is_digit(Parser *p) {
-    if (at_eof(p)) return CJ_FALSE;
-    return *p->buf_ptr >= '0' && *p->buf_ptr <= '9';
+/* Append a string that is already in memory, like tape_string does. */
+static void tape_chars(TapeBuilder *t, const CJString *string) {
+    size_t offset = t->p.chars_len;
+    if (string->length != 0) {
+        push_chars(&t->p, string->chars, string->length);
+    }
+    tape_end_string(t, offset);
 }
 
-static void require_digits(Parser *p, NumString *ns) {
-    if (!is_digit(p)) error(p, CJ_SYNTAX_ERROR);
-    do {
-        push_taken(p, ns);
-    } while (is_digit(p));
+/*
+ * Append a value, like tape_value does while parsing. Arrays and objects are
+ * walked on the stack of walks instead of recursing into them.
+ */
+static void tape_from_value(TapeBuilder *t, const CJValue *value) {
+    Parser *p = &t->p;
+    for (;;) {
+        Walk *walk;
+        size_t length;
+        switch (value->type) {
+            case CJ_NULL:
+                tape_push(t, tape_word(CJ_NULL, 0));
+                break;
+            case CJ_BOOLEAN:
+                tape_push(t, tape_word(CJ_BOOLEAN,
+                    value->as.boolean ? 1 : 0));
+                break;
+            case CJ_NUMBER:
+                tape_number(t, cj_number_to_double(value));
+                break;
+            case CJ_STRING:
+                tape_chars(t, &value->as.string);
+                break;
+            case CJ_ARRAY:
+            case CJ_OBJECT:
+                push_walk(p, value)->start = tape_push(t, 0);
+                break;
+        }
+        /* go on to the next child, finishing the containers with no more */
+        for (;;) {
+            if (p->walks_len == 0) return;
+            walk = &p->walks[p->walks_len - 1];
+            length = walk->value->type == CJ_ARRAY
+                ? walk->value->as.array.length : walk->value->as.object.length;
+            if (walk->next < length) break;
+            --p->walks_len;
+            tape_end_container(t, walk->start, walk->value->type, length);
+        }
+        if (walk->value->type == CJ_ARRAY) {
+            value = &walk->value->as.array.elements[walk->next++];
+        } else {
+            const CJObjectMember *member =
+                &walk->value->as.object.members[walk->next++];
+            tape_chars(t, &member->key);
+            value = &member->value;
+        }
+    }
 }
 
-static void parse_number(Parser *p, CJValue *value) {
-    /*
-     * To parse a number, we read it into a buffer and use strtod on it. If the
-     * number is too large for the buffer, we allocate a string in the number's
-     * place in the JSON tree, and use that as the buffer. Finally, strtod is
-     * used to find the value of the number, then if needed, the string in the
-     * JSON tree is freed, and last, the number is inserted in the tree.
-     */
-    NumString ns;
-    double number;
-    init_num_string(&ns, value);
-    /* negative sign */
-    if (check(p, '-')) push_taken(p, &ns);
-    /* integer part */
-    if (check(p, '0')) {
-        push_taken(p, &ns);
-    } else {
-        require_digits(p, &ns);
+CJ_BOOL cj_save_snapshot(
+    CJAllocator *allocator,
+    const CJValue *value,
+    CJWriter *writer
+) {
+    TapeBuilder t;
+    CJTape tape;
+    CJ_BOOL result;
+    init_parser(&t.p, allocator, 0);
+    t.words = NULL;
+    t.length = 0;
+    t.capacity = 0;
+    if (setjmp(t.p.buf)) {
+        dealloc(t.p.scratch_allocator, t.words);
+        free_scratch(&t.p, CJ_FALSE);
+        return CJ_FALSE;
     }
-    /* fraction part */
-    if (check(p, '.')) {
-        push_taken(p, &ns);
-        require_digits(p, &ns);
+    tape_from_value(&t, value);
+    tape.words = t.words;
+    tape.length = t.length;
+    tape.strings = t.p.chars;
+    tape.strings_length = t.p.chars_len;
+    result = cj_save_tape_snapshot(&tape, writer);
+    dealloc(t.p.scratch_allocator, t.words);
+    free_scratch(&t.p, CJ_FALSE);
+    return result;
+}
+
+#ifdef CJ_MAPPED_FILE_READER
+/* Check that a string on a tape lies within its strings, ending in a null. */
+static CJ_BOOL check_tape_string(const CJTape *tape, size_t position) {
+    size_t payload = tape_payload(tape, position);
+    size_t offset = payload >> 8, length = payload & 0xFF;
+    if (offset > tape->strings_length) return CJ_FALSE;
+    if (length == TAPE_LONG_STRING) {
+        if (tape->strings_length - offset < sizeof(size_t)) return CJ_FALSE;
+        memcpy(&length, tape->strings + offset, sizeof(size_t));
+        offset += sizeof(size_t);
     }
-    /* exponent part */
-    if (!at_eof(p) && (*p->buf_ptr == 'e' || *p->buf_ptr == 'E')) {
-        push_taken(p, &ns);
-        if (!at_eof(p) && (*p->buf_ptr == '-' || *p->buf_ptr == '+')) {
-            push_taken(p, &ns);
+    return length < tape->strings_length - offset
+        && tape->strings[offset + length] == '\0';
+}
+
+/*
+ * Check that an array or object on a tape ends with the right word where its
+ * starting word says, after exactly the children that its end word counts,
+ * with a string key before each value of an object. The children are skipped
+ * from one to the next, so they must each end before the container does.
+ */
+static CJ_BOOL check_tape_container(const CJTape *tape, size_t position) {
+    int type = tape_tag(tape, position);
+    size_t end = tape_payload(tape, position), child, next, count = 0;
+    if (end <= position || end >= tape->length
+            || tape_tag(tape, end) != (type | TAPE_END)) {
+        return CJ_FALSE;
+    }
+    for (child = position + 1; child != end; child = next) {
+        /* end words only end the containers that point to them */
+        if (tape_tag(tape, child) & TAPE_END) return CJ_FALSE;
+        if (type == CJ_OBJECT && count % 2 == 0
+                && tape_tag(tape, child) != CJ_STRING) {
+            return CJ_FALSE;
         }
-        require_digits(p, &ns);
+        next = cj_tape_next(tape, child);
+        if (next <= child || next > end) return CJ_FALSE;
+        ++count;
     }
-    /* parse number */
-    /* TODO - how should huge numbers (that parse to infinity) be handled? */
-    push_num_string(p, &ns, 0);
-    number = strtod(ns.string.slice->chars, NULL);
-    /* replace string with number */
-    free_num_string(p->allocator, &ns);
-    value->type = CJ_NUMBER;
-    value->as.number = number;
+    if (type == CJ_OBJECT) {
+        if (count % 2 != 0) return CJ_FALSE;
+        count /= 2;
+    }
+    return tape_payload(tape, end) == count;
 }
 
-static void parse(Parser *p, CJValue *value) {
-    /* initialize to a valid state */
-    value->type = CJ_NULL;
-    /* check depth */
-    if (++p->depth == CJ_MAX_DEPTH) {
-        error(p, CJ_TOO_MUCH_NESTING);
+/*
+ * Check every word of a tape, so that no accessor reads outside of it, even if
+ * it was damaged in a way that the checksum misses. The words are checked in
+ * order, which, once the root value is known to take up the whole tape, is the
+ * order of the values and end words that they make up.
+ */
+static CJ_BOOL check_tape(const CJTape *tape) {
+    size_t position = 0;
+    if (tape_tag(tape, 0) & TAPE_END || cj_tape_next(tape, 0) != tape->length) {
+        return CJ_FALSE;
     }
-    skip_ws(p);
-    if (check(p, '-') || is_digit(p)) {
-        parse_number(p, value);
-    } else {
-        switch (take(p)) {
-            case 't':
-                require(p, 'r');
-                require(p, 'u');
-                require(p, 'e');
-                value->type = CJ_BOOLEAN;
-                value->as.boolean = CJ_TRUE;
+    while (position < tape->length) {
+        switch (tape_tag(tape, position)) {
+            case CJ_NULL:
+            case CJ_BOOLEAN:
+            case CJ_NUMBER | TAPE_INTEGER:
+            case CJ_ARRAY | TAPE_END:
+            case CJ_OBJECT | TAPE_END:
                 break;
-            case 'f':
-                require(p, 'a');
-                require(p, 'l');
-                require(p, 's');
-                require(p, 'e');
-                value->type = CJ_BOOLEAN;
-                value->as.boolean = CJ_FALSE;
-                break;
-            case 'n':
-                require(p, 'u');
-                require(p, 'l');
-                require(p, 'l');
+            case CJ_NUMBER:
+                /* the double is in the next word */
+                if (tape->length - position < 2) return CJ_FALSE;
+                ++position;
                 break;
-            case '"':
-                value->type = CJ_STRING;
-                parse_string(p, &value->as.string);
-                break;
-            case '[':
-                value->type = CJ_ARRAY;
-                parse_array(p, &value->as.array);
+            case CJ_STRING:
+                if (!check_tape_string(tape, position)) return CJ_FALSE;
                 break;
-            case '{':
-                value->type = CJ_OBJECT;
-                parse_object(p, &value->as.object);
+            case CJ_ARRAY:
+            case CJ_OBJECT:
+                if (!check_tape_container(tape, position)) return CJ_FALSE;
                 break;
             default:
-                error(p, CJ_SYNTAX_ERROR);
+                return CJ_FALSE;
         }
+        ++position;
     }
-    skip_ws(p);
-    --p->depth;
+    return CJ_TRUE;
 }
 
-CJParseResult cj_parse(CJAllocator *allocator, CJReader *reader, CJValue *out) {
-    /* create a parser */
-    Parser p;
-#ifdef CJ_DEFAULT_ALLOCATOR
-    if (allocator == NULL) allocator = &default_allocator;
-#endif
-    p.buf_ptr = initial_buffer;
-    p.remaining = 1;
-    p.allocator = allocator;
-    p.reader = reader;
-    p.depth = 0;
-    p.result = CJ_SUCCESS;
-    if (setjmp(p.buf)) {
-        /* an error occurred, so free memory */
-        cj_free(p.allocator, out);
-    } else {
-        /* parse root value */
-        parse(&p, out);
-        /* we should be at EOF, otherwise we consider it a syntax error */
-        if (!at_eof(&p)) error(&p, CJ_SYNTAX_ERROR);
+/* Point a tape at the contents of a snapshot, if they are a valid snapshot. */
+static CJ_BOOL open_snapshot(CJTape *tape, char *data, size_t length) {
+    const size_t header_size = SNAPSHOT_HEADER_LENGTH * sizeof(CJUInt64);
+    const CJUInt64 *header = (const CJUInt64*) (void*) data;
+    CJUInt64 words_length, strings_length;
+    size_t rest;
+    if (length < header_size
+            || memcmp(&header[SNAPSHOT_HEADER_MAGIC], SNAPSHOT_MAGIC,
+                sizeof(CJUInt64)) != 0
+            || header[SNAPSHOT_HEADER_BYTE_ORDER] != SNAPSHOT_BYTE_ORDER
+            || header[SNAPSHOT_HEADER_VERSION] != SNAPSHOT_VERSION
+            || header[SNAPSHOT_HEADER_SIZE_WIDTH] != sizeof(size_t)) {
+        return CJ_FALSE;
     }
-    return p.result;
+    /* the lengths must add up to the size of the file exactly */
+    rest = length - header_size;
+    words_length = header[SNAPSHOT_HEADER_WORDS_LENGTH];
+    strings_length = header[SNAPSHOT_HEADER_STRINGS_LENGTH];
+    if (words_length == 0 || words_length > rest / sizeof(CJUInt64)) {
+        return CJ_FALSE;
+    }
+    rest -= (size_t) words_length * sizeof(CJUInt64);
+    if (strings_length > rest || rest - strings_length >= sizeof(CJUInt64)
+            || rest % sizeof(CJUInt64) != 0) {
+        return CJ_FALSE;
+    }
+    tape->words = (CJUInt64*) (void*) (data + header_size);
+    tape->length = (size_t) words_length;
+    tape->strings = strings_length != 0
+        ? (char*) (tape->words + tape->length) : NULL;
+    tape->strings_length = (size_t) strings_length;
+    /* the checksum counts the padding as zeros, so it has to be */
+    for (rest = tape->strings_length; rest % sizeof(CJUInt64) != 0; ++rest) {
+        if (((char*) (tape->words + tape->length))[rest] != 0) return CJ_FALSE;
+    }
+    return tape_checksum(tape) == header[SNAPSHOT_HEADER_CHECKSUM]
+        && check_tape(tape);
 }
 
-void cj_free(CJAllocator *allocator, const CJValue *value) {
-    size_t i;
-#ifdef CJ_DEFAULT_ALLOCATOR
-    if (allocator == NULL) allocator = &default_allocator;
-#endif
-    switch (value->type) {
-        case CJ_STRING:
-            dealloc(allocator, value->as.string.chars);
-            break;
-        case CJ_ARRAY:
-            for (i = 0; i < value->as.array.length; ++i) {
-                cj_free(allocator, &value->as.array.elements[i]);
-            }
-            dealloc(allocator, value->as.array.elements);
-            break;
-        case CJ_OBJECT:
-            for (i = 0; i < value->as.object.length; ++i) {
-                CJObjectMember *member = &value->as.object.members[i];
-                dealloc(allocator, member->key.chars);
-                cj_free(allocator, &member->value);
-            }
-            dealloc(allocator, value->as.object.members);
-            break;
-        default:
-            break;
+CJ_BOOL cj_load_snapshot_mapped(
+    CJSnapshot *snapshot,
+    const char *path,
+    CJAllocator *allocator
+) {
+    CJMappedFileReader *file = &snapshot->file;
+    snapshot->tape.words = NULL;
+    snapshot->tape.length = 0;
+    snapshot->tape.strings = NULL;
+    snapshot->tape.strings_length = 0;
+    if (!cj_open_mapped_file_reader(file, path, allocator)) return CJ_FALSE;
+    if (!open_snapshot(&snapshot->tape, file->data, file->length)) {
+        cj_close_snapshot(snapshot);
+        return CJ_FALSE;
     }
+#if defined(MAPPING_POSIX)
+    /* unlike JSON, the tape is read in any order */
+    if (file->mapped) {
+        posix_madvise(file->data, file->length, POSIX_MADV_NORMAL);
+    }
+#endif
+    return CJ_TRUE;
 }
+
+void cj_close_snapshot(CJSnapshot *snapshot) {
+    cj_close_mapped_file_reader(&snapshot->file);
+    snapshot->tape.words = NULL;
+    snapshot->tape.length = 0;
+    snapshot->tape.strings = NULL;
+    snapshot->tape.strings_length = 0;
+}
+#endif
+#endif
@@ -31,6 +31,11 @@ extern "C" {
 typedef enum { CJ_FALSE, CJ_TRUE } CJ_BOOL;
 
 #include <stddef.h>
+#include <limits.h>
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+#include <stdint.h>
+#endif
 
 /* The maximum depth of a JSON object before it is rejected. */
 #define CJ_MAX_DEPTH 1024
@@ -53,10 +58,96 @@ typedef enum { CJ_FALSE, CJ_TRUE } CJ_BOOL;
  */
 #define CJ_STRING_READER
 
-#ifdef CJ_FILE_READER
+/*
+ * If defined, a built-in reader interface is available that maps a file into
+ * memory on POSIX systems and Windows, or reads all of it otherwise.
+ */
+#define CJ_MAPPED_FILE_READER
+
+/*
+ * If defined, a built-in arena allocator is available that hands out memory
+ * from large chunks and releases it all at once.
+ */
+#define CJ_ARENA
+
+/*
+ * If defined, a built-in pool allocator is available that reuses freed memory
+ * by size class, with optional caches for use from several threads.
+ */
+#define CJ_POOL
+
+/*
+ * If defined, vector instructions (SSE2, AVX2, or NEON) are used to scan the
+ * input when the compiler targets them. Otherwise, the input is scanned a word
+ * at a time.
+ */
+#define CJ_SIMD
+
+/*
+ * If defined, a built-in reader interface is available that reads ahead of
+ * another reader into a ring of buffers.
+ */
+#define CJ_READ_AHEAD_READER
+
+/*
+ * If defined, threads are used on POSIX systems and Windows, and programs
+ * using cj must be linked with the system's thread library, so it is not
+ * defined by default. It changes the following:
+ *
+ * - The read-ahead reader fills its buffers on a background thread. Without
+ *   it, buffers are filled on the calling thread, when it reads, so reading
+ *   does not overlap with parsing.
+ * - cj_parse_parallel parses ranges of the root array on several threads.
+ *   Without it, the array is parsed on the calling thread.
+ * - The batch parser parses inputs on several threads. Without it, every
+ *   input is parsed on the calling thread.
+ * - A pool is locked so that caches on different threads can share it.
+ *   Without it, there is no lock, so cj_pool_cache_new returns NULL.
+ */
+/* #define CJ_THREADS */
+
+/*
+ * If defined, a built-in writer interface is available that can write to a
+ * FILE*.
+ */
+#define CJ_FILE_WRITER
+
+/*
+ * If defined, a built-in writer interface is available that can write to a
+ * growing buffer in memory.
+ */
+#define CJ_BUFFER_WRITER
+
+/*
+ * If defined, parsing with options can count what the parser does in a
+ * CJParseStats. It is not defined by default, as counting costs a little time
+ * even when no statistics are asked for. It only changes cj.c, so code built
+ * with and without it can be linked together.
+ */
+/* #define CJ_STATS */
+
+#if defined(CJ_FILE_READER) || defined(CJ_FILE_WRITER)
 #include <stdio.h>
 #endif
 
+/*
+ * Signed and unsigned 64-bit integer types. CJ_INT64 is defined if there are
+ * any.
+ */
+#if defined(INT64_MAX)
+typedef int64_t CJInt64;
+typedef uint64_t CJUInt64;
+#define CJ_INT64
+#elif (LONG_MAX >> 31 >> 31) >= 1
+typedef long CJInt64;
+typedef unsigned long CJUInt64;
+#define CJ_INT64
+#elif defined(_MSC_VER)
+typedef __int64 CJInt64;
+typedef unsigned __int64 CJUInt64;
+#define CJ_INT64
+#endif
+
 /* The type of a JSON value. */
 typedef enum {
     CJ_NULL,
@@ -69,7 +160,10 @@ typedef enum {
 
 /*
  * A JSON string value. The string is null-terminated, but can contain nulls, so
- * take caution.
+ * take caution. Empty strings made by cj are not allocated, and short strings
+ * in arrays and objects are stored in the same allocation as their container.
+ * A string built by hand is freed by cj_free whatever its length, so even an
+ * empty one must come from the allocator.
  */
 typedef struct {
     size_t length;
@@ -91,15 +185,53 @@ typedef struct {
     struct CJObjectMember *members;
 } CJObject;
 
+/*
+ * The text of a number that has not been converted yet. It is a valid JSON
+ * number, and is not null-terminated.
+ */
+typedef struct {
+    size_t length;
+    const char *chars;
+} CJRawNumber;
+
+/*
+ * Flags describing how a value is stored. cj_free, cj_object_get, and cj_write
+ * trust them, so a value built or changed by hand must set flags to 0, unless
+ * it holds text that one of them describes, such as CJ_VALUE_BORROWED for a
+ * string that must not be freed.
+ *
+ * CJ_VALUE_RAW_NUMBER - The value is a number that has not been converted, so
+ *   as.raw holds its text instead of as.number holding its value. Use
+ *   cj_number_to_double or cj_number_to_int64 to read it.
+ * CJ_VALUE_BORROWED - The text of the value points into the input, and is not
+ *   freed along with the value.
+ * CJ_VALUE_BORROWED_KEY - The value is in an object, and the key of its member
+ *   points into the input.
+ * CJ_VALUE_INDEXED - The value is an object with a hash index after its
+ *   members, which cj_object_get uses to find members. Only the parser sets it.
+ * CJ_VALUE_SHARED - The value is an interned key string, shared by every key
+ *   with the same text, with a reference count in front of its characters.
+ * CJ_VALUE_SHARED_KEY - The value is in an object, and the key of its member
+ *   is interned.
+ */
+#define CJ_VALUE_RAW_NUMBER 0x1
+#define CJ_VALUE_BORROWED 0x2
+#define CJ_VALUE_BORROWED_KEY 0x4
+#define CJ_VALUE_INDEXED 0x8
+#define CJ_VALUE_SHARED 0x10
+#define CJ_VALUE_SHARED_KEY 0x20
+
 /* A JSON value. */
 typedef struct CJValue {
     CJType type;
+    unsigned flags;
     union {
-        CJ_BOOL  boolean;
-        double   number;
-        CJString string;
-        CJArray  array;
-        CJObject object;
+        CJ_BOOL     boolean;
+        double      number;
+        CJRawNumber raw;
+        CJString    string;
+        CJArray     array;
+        CJObject    object;
     } as;
 } CJValue;
 
@@ -122,7 +254,17 @@ typedef enum {
     /* the JSON was nested too deeply */
     CJ_TOO_MUCH_NESTING,
     /* the stream ran into an error */
-    CJ_READ_ERROR
+    CJ_READ_ERROR,
+    /* a handler stopped parsing */
+    CJ_STOPPED,
+    /* the push parser needs more input */
+    CJ_NEED_MORE,
+    /* there are no more values in the stream */
+    CJ_END_OF_STREAM,
+    /* an object had two members with the same key */
+    CJ_DUPLICATE_KEY,
+    /* the JSON was valid, but didn't fit the struct it was decoded into */
+    CJ_TYPE_MISMATCH
 } CJParseResult;
 
 /* The allocator interface. */
@@ -138,6 +280,104 @@ typedef struct CJAllocator {
     void *(*allocate)(struct CJAllocator *allocator, void *ptr, size_t size);
 } CJAllocator;
 
+#ifdef CJ_ARENA
+/* The default size of the first chunk of an arena. */
+#define CJ_ARENA_CHUNK_SIZE 4096
+
+/*
+ * An implementation of the allocator interface that allocates from chunks of
+ * memory obtained from another allocator. Each new chunk is twice as large as
+ * the previous one. Freeing or shrinking an allocation only returns memory to
+ * the arena if it was the most recent allocation; otherwise, the memory is
+ * reclaimed when the arena is reset or released.
+ */
+typedef struct {
+    CJAllocator allocator;
+    /* The allocator that chunks are allocated from. */
+    CJAllocator *backing;
+    /* The most recently allocated chunk. */
+    struct CJArenaChunk *chunk;
+    /* The size of the next chunk to allocate. */
+    size_t chunk_size;
+} CJArena;
+
+/*
+ * Initialize an arena. If backing is NULL, the default allocator is used. If
+ * chunk_size is 0, CJ_ARENA_CHUNK_SIZE is used. No memory is allocated until
+ * the arena is first used.
+ */
+void cj_arena_init(CJArena *arena, CJAllocator *backing, size_t chunk_size);
+
+/*
+ * Free everything allocated from the arena, keeping the most recent chunk for
+ * reuse. Any JSON values allocated from the arena become invalid, and must not
+ * be passed to cj_free.
+ */
+void cj_arena_reset(CJArena *arena);
+
+/* Free everything allocated from the arena, including all of its chunks. */
+void cj_arena_release(CJArena *arena);
+#endif
+
+#ifdef CJ_POOL
+/* The default size of the first chunk of a pool. */
+#define CJ_POOL_CHUNK_SIZE 4096
+
+/*
+ * An implementation of the allocator interface for values that live a long
+ * time and are partly replaced. Small allocations are rounded up to one of a
+ * set of size classes, which include every small multiple of sizeof(CJValue)
+ * and sizeof(CJObjectMember), and are carved from chunks of memory obtained
+ * from another allocator. Freed allocations are kept on a list for their class
+ * and handed out again, so replacing a subtree reuses the memory of the old
+ * one. Large allocations go straight to the other allocator. Chunks are only
+ * returned to it when the pool is deleted.
+ *
+ * The allocator of a pool itself must only be used from one thread at a time.
+ */
+typedef struct CJPool CJPool;
+
+/*
+ * A cache in front of a pool for one thread. A thread allocating through its
+ * own cache only touches the pool, under a lock, to take or give back a batch
+ * of allocations at a time. Memory allocated through one cache may be freed
+ * through another, or after the cache is deleted, through any cache of the
+ * same pool. Caches need that lock, so they are only available with
+ * CJ_THREADS.
+ */
+typedef struct CJPoolCache CJPoolCache;
+
+/*
+ * Create a pool. If backing is NULL, the default allocator is used. If
+ * chunk_size is 0, CJ_POOL_CHUNK_SIZE is used. Returns NULL if out of memory.
+ */
+CJPool *cj_pool_new(CJAllocator *backing, size_t chunk_size);
+
+/* Get the allocator interface of a pool. */
+CJAllocator *cj_pool_allocator(CJPool *pool);
+
+/*
+ * Delete a pool and all of its caches, freeing everything allocated from it.
+ * Any JSON values allocated from the pool become invalid.
+ */
+void cj_pool_delete(CJPool *pool);
+
+/*
+ * Create a cache for a pool. Once any caches exist, the allocator of the pool
+ * itself must not be used. Returns NULL if out of memory. Without CJ_THREADS,
+ * or on a system without threads, there is no lock to share the pool under,
+ * so this always returns NULL, and the pool must only be used through its own
+ * allocator from one thread at a time.
+ */
+CJPoolCache *cj_pool_cache_new(CJPool *pool);
+
+/* Get the allocator interface of a cache. */
+CJAllocator *cj_pool_cache_allocator(CJPoolCache *cache);
+
+/* Delete a cache, giving the allocations it holds back to its pool. */
+void cj_pool_cache_delete(CJPoolCache *cache);
+#endif
+
 /* The reader interface. */
 typedef struct CJReader {
     /*
@@ -183,6 +423,134 @@ void cj_init_string_reader(
 );
 #endif
 
+#ifdef CJ_READ_AHEAD_READER
+/* The default size of each buffer of a read-ahead reader. */
+#define CJ_READ_AHEAD_BUFFER_SIZE 65536
+
+/*
+ * A reader that reads ahead of another reader, the source, so that reading
+ * overlaps with parsing. With CJ_THREADS, a background thread copies from the
+ * source into whichever buffers are free. Without it, a whole buffer is filled
+ * on the calling thread each time one is read, so reading and parsing take
+ * turns instead of overlapping.
+ */
+typedef struct CJReadAheadReader CJReadAheadReader;
+
+/*
+ * Create a read-ahead reader with at least two buffers of the given size. If
+ * buffer_size is 0, CJ_READ_AHEAD_BUFFER_SIZE is used. The source may only be
+ * used by the read-ahead reader until it is deleted. Returns NULL if out of
+ * memory or the thread can't be started.
+ */
+CJReadAheadReader *cj_read_ahead_new(
+    CJAllocator *allocator,
+    CJReader *source,
+    size_t buffer_size,
+    size_t buffer_count
+);
+
+/* Get the reader interface of a read-ahead reader. */
+CJReader *cj_read_ahead_reader(CJReadAheadReader *read_ahead_reader);
+
+/*
+ * Delete a read-ahead reader, waiting for the source to return first if it is
+ * being read from.
+ */
+void cj_read_ahead_delete(CJReadAheadReader *read_ahead_reader);
+#endif
+
+/* The writer interface. */
+typedef struct CJWriter {
+    /*
+     * Write out the first length bytes of the buffer returned by the last call,
+     * of which there are none on the first call.
+     * If size is not NULL, return the buffer to fill next and store its size,
+     * which must be nonzero, in size.
+     * If size is NULL, the output is finished, so return anything but NULL.
+     * On failure, return NULL.
+     */
+    char *(*write)(struct CJWriter *writer, size_t length, size_t *size);
+} CJWriter;
+
+#ifdef CJ_FILE_WRITER
+/* An implementation of the writer interface that writes to a file. */
+typedef struct {
+    CJWriter writer;
+    FILE *file;
+    char *buffer;
+    size_t buffer_size;
+} CJFileWriter;
+
+/* Initialize a file writer. The buffer size must be nonzero. */
+void cj_init_file_writer(
+    CJFileWriter *file_writer,
+    FILE *file,
+    char *buffer,
+    size_t buffer_size
+);
+#endif
+
+#ifdef CJ_BUFFER_WRITER
+/*
+ * An implementation of the writer interface that writes to a buffer, which
+ * grows to fit. Once finished, the output is null-terminated. The buffer
+ * belongs to the caller, who frees it with the allocator, even on failure.
+ */
+typedef struct {
+    CJWriter writer;
+    CJAllocator *allocator;
+    char *data;
+    size_t length;
+    size_t capacity;
+} CJBufferWriter;
+
+/*
+ * Initialize a buffer writer. If allocator is NULL, the default allocator is
+ * used. No memory is allocated until the writer is first used.
+ */
+void cj_init_buffer_writer(
+    CJBufferWriter *buffer_writer,
+    CJAllocator *allocator
+);
+#endif
+
+#ifdef CJ_MAPPED_FILE_READER
+/*
+ * An implementation of the reader interface that gives the parser the whole
+ * file at once, like a string reader. The contents can be modified, such as by
+ * cj_parse_insitu, without changing the file.
+ */
+typedef struct {
+    CJReader reader;
+    /* The contents of the file. */
+    char *data;
+    size_t length;
+    /* The allocator for the contents, if they are not mapped. */
+    CJAllocator *allocator;
+    /* True if the contents are mapped into memory. */
+    CJ_BOOL mapped;
+    /* True once the reader has returned the contents. */
+    CJ_BOOL consumed;
+} CJMappedFileReader;
+
+/*
+ * Open a file for a mapped file reader, returning CJ_FALSE on failure. If the
+ * file can't be mapped, such as if it is a pipe, it is read into memory from
+ * the allocator instead. If allocator is NULL, the default allocator is used.
+ */
+CJ_BOOL cj_open_mapped_file_reader(
+    CJMappedFileReader *mapped_file_reader,
+    const char *path,
+    CJAllocator *allocator
+);
+
+/*
+ * Close the file of a mapped file reader, after which anything pointing into
+ * its contents becomes invalid.
+ */
+void cj_close_mapped_file_reader(CJMappedFileReader *mapped_file_reader);
+#endif
+
 #ifdef offsetof
 /* if offsetof is provided, use it */
 #define cj_offset_of offsetof
@@ -195,12 +563,831 @@ void cj_init_string_reader(
 #define cj_container_of(ptr, type, member)\
     (type*) (void*) ((char*) ptr - cj_offset_of(type, member))
 
+/*
+ * Flags for cj_parse_ex.
+ *
+ * CJ_PARSE_ARENA - The allocator releases all memory at once, such as a
+ *   CJArena. The partially parsed value will not be freed on failure.
+ * CJ_PARSE_LAZY_NUMBERS - Keep the text of numbers and only convert them when
+ *   they are read. When parsing from a buffer, the text points into it, so the
+ *   buffer must outlive the value; otherwise, the text is copied. This has no
+ *   effect if there is no 64-bit integer type or doubles are not IEEE 754.
+ * CJ_PARSE_INDEX_OBJECTS - Build a hash index after the members of each large
+ *   object while parsing, which cj_object_get searches instead of scanning the
+ *   members.
+ * CJ_PARSE_INTERN_KEYS - Keys with the same text share one allocation, so
+ *   equal keys in the same value can be compared by their pointers. Different
+ *   parts of the value must then not be freed by multiple threads at once.
+ *   This has no effect on in-situ parsing.
+ * CJ_PARSE_TWO_STAGE - Find where every token starts before parsing it, a
+ *   block of 64 bytes at a time, so the parser can go from token to token
+ *   instead of looking at each character in between. This has no effect
+ *   unless parsing from a buffer (not in situ) with a 64-bit integer type.
+ * CJ_PARSE_REJECT_DUPLICATES - Fail with CJ_DUPLICATE_KEY if an object has two
+ *   members with the same key. Otherwise, they are all kept, and the first and
+ *   last can be found with cj_object_get and cj_object_get_last. This has no
+ *   effect when not building values, such as when parsing into events.
+ */
+#define CJ_PARSE_ARENA 0x1
+#define CJ_PARSE_LAZY_NUMBERS 0x2
+#define CJ_PARSE_INDEX_OBJECTS 0x4
+#define CJ_PARSE_INTERN_KEYS 0x8
+#define CJ_PARSE_TWO_STAGE 0x10
+#define CJ_PARSE_REJECT_DUPLICATES 0x20
+
 /* Try to parse a JSON value. */
 CJParseResult cj_parse(CJAllocator *allocator, CJReader *reader, CJValue *out);
 
+/* Try to parse a JSON value, using the given flags. */
+CJParseResult cj_parse_ex(
+    CJAllocator *allocator,
+    CJReader *reader,
+    CJValue *out,
+    unsigned flags
+);
+
+/*
+ * Statistics on a parse, for finding out where the time goes. The allocator
+ * counts include the parser's own scratch buffers, and a resize counts its new
+ * size in bytes_allocated. They are only counted if cj is built with CJ_STATS.
+ */
+typedef struct {
+    /* The bytes of input parsed, up to the error if there was one. */
+    size_t bytes_consumed;
+    /* The offset at which an error was found, or 0 if there was none. */
+    size_t error_offset;
+    /* The calls to the reader, and the bytes they returned. */
+    size_t reads;
+    size_t bytes_read;
+    /* The calls to the allocator, by kind, and the bytes asked for. */
+    size_t allocations;
+    size_t reallocations;
+    size_t frees;
+    size_t bytes_allocated;
+    /* The times the parser's scratch buffers grew. */
+    size_t scratch_growths;
+    /* The deepest nesting reached, where the root value is at depth 1. */
+    size_t max_depth;
+    /* The bytes of decoded strings, and the escape sequences in them. */
+    size_t string_bytes;
+    size_t escapes;
+    /* The numbers too long or too precise to convert without strtod. */
+    size_t slow_numbers;
+} CJParseStats;
+
+/*
+ * Options for cj_parse_with_options. They should be set up with
+ * cj_init_parse_options first, so that any options added later get their
+ * defaults.
+ */
+typedef struct {
+    /* The flags for cj_parse_ex. */
+    unsigned flags;
+    /*
+     * The depth at which a value is rejected with CJ_TOO_MUCH_NESTING, which
+     * is CJ_MAX_DEPTH by default. Nested values are parsed and freed without
+     * recursion, so a larger limit only uses more memory while parsing.
+     */
+    size_t max_depth;
+    /*
+     * If not NULL, the statistics of each parse are stored here, replacing
+     * those of the last one. NULL by default. It is ignored, and left alone,
+     * unless cj is built with CJ_STATS, but is always here so that the layout
+     * of the options doesn't depend on how cj was built.
+     */
+    CJParseStats *stats;
+} CJParseOptions;
+
+/* Set parse options to their defaults. */
+void cj_init_parse_options(CJParseOptions *options);
+
+/* Try to parse a JSON value, with the default options if options is NULL. */
+CJParseResult cj_parse_with_options(
+    CJAllocator *allocator,
+    CJReader *reader,
+    CJValue *out,
+    const CJParseOptions *options
+);
+
+/*
+ * A parser that can be used for many inputs, one after another. It keeps the
+ * memory it uses while parsing, so that parsing many small values doesn't
+ * allocate it again for each of them. It can only be used by one thread at a
+ * time.
+ */
+typedef struct CJParser CJParser;
+
+/*
+ * Create a parser with the given options, or the defaults if NULL. Returns
+ * NULL if out of memory.
+ */
+CJParser *cj_parser_new(
+    CJAllocator *allocator,
+    const CJParseOptions *options
+);
+
+/* Try to parse a JSON value with a parser. */
+CJParseResult cj_parser_parse(
+    CJParser *parser,
+    CJReader *reader,
+    CJValue *out
+);
+
+/* Free a parser. The values it parsed are not freed. */
+void cj_parser_delete(CJParser *parser);
+
+/*
+ * Try to parse a JSON value from a buffer in memory. This is faster than using
+ * a reader, as the parser never needs to check for more input. Parsing with a
+ * CJStringReader does the same thing automatically.
+ */
+CJParseResult cj_parse_buffer(
+    CJAllocator *allocator,
+    const char *data,
+    size_t length,
+    CJValue *out
+);
+
+/* Try to parse a JSON value from a buffer in memory, using the given flags. */
+CJParseResult cj_parse_buffer_ex(
+    CJAllocator *allocator,
+    const char *data,
+    size_t length,
+    CJValue *out,
+    unsigned flags
+);
+
+/*
+ * Try to parse a JSON value from a buffer in memory using several threads. If
+ * the value is an array, its elements are split into one range per thread,
+ * which are parsed at the same time and then joined in order. The result is
+ * the same as cj_parse_buffer_ex, including which error is reported, although
+ * an invalid array is parsed a second time to find it. If thread_count is 0,
+ * it is chosen from the number of processors and the length of the input.
+ * The allocator is used from every thread at once, so it must be thread safe.
+ * Only one thread is used with a CJArena, with CJ_PARSE_INTERN_KEYS, or
+ * without CJ_THREADS.
+ */
+CJParseResult cj_parse_parallel(
+    CJAllocator *allocator,
+    const char *data,
+    size_t length,
+    CJValue *out,
+    unsigned flags,
+    unsigned thread_count
+);
+
+/* One input to cj_parse_batch, in memory. */
+typedef struct {
+    const char *data;
+    size_t length;
+} CJBatchInput;
+
+/*
+ * Options for cj_batch_parser_new. They should be set up with
+ * cj_init_batch_options first, so that any options added later get their
+ * defaults.
+ */
+typedef struct {
+    /* The options for parsing each input, or NULL for the defaults. */
+    const CJParseOptions *parse_options;
+    /*
+     * The number of threads, or 0 for one per processor, which is the
+     * default. Without CJ_THREADS, inputs are parsed on the calling thread.
+     */
+    unsigned thread_count;
+    /*
+     * If not NULL, the processor to pin each thread to, with one entry per
+     * thread. Processors are ignored where the system can't pin threads. NULL
+     * by default.
+     */
+    const unsigned *processors;
+#ifdef CJ_ARENA
+    /*
+     * If true, each thread allocates values from its own arena, whose chunks
+     * come from the batch parser's allocator. The values of a batch are then
+     * not freed one by one, but all at once by the next batch or when the
+     * batch parser is deleted. CJ_FALSE by default.
+     */
+    CJ_BOOL arenas;
+#endif
+#ifdef CJ_POOL
+    /*
+     * If not NULL, each thread allocates values through its own cache of this
+     * pool, instead of from the batch parser's allocator. Free them through
+     * any cache of the pool, or by deleting it, which must not happen before
+     * the batch parser is deleted. Without CJ_THREADS, values are allocated
+     * through the pool's own allocator instead, which is then where to free
+     * them. NULL by default.
+     */
+    CJPool *pool;
+#endif
+} CJBatchOptions;
+
+/* Set batch options to their defaults. */
+void cj_init_batch_options(CJBatchOptions *options);
+
+/*
+ * A parser for batches of many small, separate inputs, which spreads them
+ * over a set of threads that are kept between batches. Each thread has its
+ * own parser, so its memory for parsing is kept too. Each thread starts with
+ * an even share of a batch, and threads that run out take half of what is
+ * left of another's share. It can only be used by one thread at a time.
+ */
+typedef struct CJBatchParser CJBatchParser;
+
+/*
+ * Create a batch parser and start its threads, or return NULL if out of
+ * memory or a thread can't be started or pinned. If options is NULL, the
+ * defaults are used. Unless it uses arenas or a pool, values are allocated
+ * from the allocator from every thread at once, so it must be thread safe.
+ * If allocator is NULL, the default allocator is used.
+ */
+CJBatchParser *cj_batch_parser_new(
+    CJAllocator *allocator,
+    const CJBatchOptions *options
+);
+
+/*
+ * Parse a batch of inputs, storing the value and result of each input at the
+ * same index of outs and results. Each value is the same as cj_parse_buffer_ex
+ * would give. Returns CJ_TRUE if every input was parsed successfully.
+ */
+CJ_BOOL cj_parse_batch(
+    CJBatchParser *parser,
+    const CJBatchInput *inputs,
+    size_t count,
+    CJValue *outs,
+    CJParseResult *results
+);
+
+/*
+ * Stop the threads of a batch parser and free it. Values from its arenas
+ * become invalid, while the others are not freed.
+ */
+void cj_batch_parser_delete(CJBatchParser *parser);
+
+/*
+ * A parser for a stream of whitespace-separated JSON values from one reader,
+ * such as newline-delimited JSON.
+ */
+typedef struct CJStream CJStream;
+
+/*
+ * Create a stream that reads values from the reader, using the given flags for
+ * cj_parse_ex. Returns NULL if out of memory.
+ */
+CJStream *cj_stream_new(
+    CJAllocator *allocator,
+    CJReader *reader,
+    unsigned flags
+);
+
+/*
+ * Try to parse the next value of a stream. Returns CJ_END_OF_STREAM if there
+ * are no more. After an error, the rest of the stream can't be parsed, and the
+ * error is returned again.
+ */
+CJParseResult cj_parse_next(CJStream *stream, CJValue *out);
+
+/* Free a stream. The values it parsed are not freed. */
+void cj_stream_delete(CJStream *stream);
+
+/*
+ * The handler interface for parsing into events. Each function is called as
+ * its part of the JSON is parsed, and may be NULL to ignore it. Returning
+ * CJ_FALSE stops parsing with CJ_STOPPED. Keys and strings are only valid
+ * during the call, and are null-terminated, but can contain nulls.
+ */
+typedef struct CJHandler {
+    CJ_BOOL (*start_object)(void *ctx);
+    CJ_BOOL (*end_object)(void *ctx);
+    CJ_BOOL (*start_array)(void *ctx);
+    CJ_BOOL (*end_array)(void *ctx);
+    CJ_BOOL (*key)(void *ctx, const char *chars, size_t length);
+    CJ_BOOL (*string)(void *ctx, const char *chars, size_t length);
+    CJ_BOOL (*number)(void *ctx, double number);
+    CJ_BOOL (*boolean)(void *ctx, CJ_BOOL boolean);
+    CJ_BOOL (*null)(void *ctx);
+} CJHandler;
+
+/*
+ * Parse a JSON value without building it, calling the handler for each part of
+ * it instead. The allocator is only used for the string being parsed. If the
+ * JSON is invalid, the handler may already have been called for part of it.
+ */
+CJParseResult cj_parse_events(
+    CJAllocator *allocator,
+    CJReader *reader,
+    const CJHandler *handler,
+    void *ctx
+);
+
+/*
+ * Check whether the input is valid JSON, without building a value. The rules
+ * and results are the same as cj_parse, except that it never allocates, so it
+ * never runs out of memory.
+ */
+CJParseResult cj_validate(CJReader *reader);
+
+/* Check whether a buffer in memory is valid JSON, without building a value. */
+CJParseResult cj_validate_buffer(const char *data, size_t length);
+
+/*
+ * A set of paths to select from JSON values, compiled once so that it can be
+ * used on many inputs. It can only be used by one thread at a time.
+ */
+typedef struct CJSelector CJSelector;
+
+/*
+ * Compile a selector from JSON Pointers, such as "/users/0/name", using the
+ * given flags for cj_parse_ex. A segment that is just "*" matches every member
+ * or element. Returns NULL if a pointer is invalid or if out of memory.
+ */
+CJSelector *cj_selector_new(
+    CJAllocator *allocator,
+    const char *const *pointers,
+    size_t count,
+    unsigned flags
+);
+
+/*
+ * Parse only the parts of the input that the selector's paths match. Each
+ * element of outs is set to an array of the values that the path with the same
+ * position matched, in the order they appear, which is empty if it matched
+ * none. Everything else is checked as it is skipped, without being built, so
+ * the results are the same as cj_parse_ex.
+ */
+CJParseResult cj_parse_select(
+    CJSelector *selector,
+    CJReader *reader,
+    CJValue *outs
+);
+
+/* Free a selector. The values it selected are not freed. */
+void cj_selector_delete(CJSelector *selector);
+
+/* The C types of fields that JSON can be decoded into. */
+typedef enum {
+    /* A CJ_BOOL, from true or false. */
+    CJ_FIELD_BOOLEAN,
+    /* A double, from any number. */
+    CJ_FIELD_DOUBLE,
+    /* An int, from a number that is an integer in its range. */
+    CJ_FIELD_INT,
+    /*
+     * A CJInt64, from a number that is an integer in its range. Only available
+     * if CJ_INT64 is defined.
+     */
+    CJ_FIELD_INT64,
+    /*
+     * A null-terminated char*, from a string, allocated from the decoder's
+     * allocator. A null sets it to NULL.
+     */
+    CJ_FIELD_STRING,
+    /* A struct embedded in this one, from an object. */
+    CJ_FIELD_STRUCT
+} CJFieldType;
+
+struct CJStructDesc;
+
+/* A description of a field of a struct, and the object member it comes from. */
+typedef struct {
+    /* The key of the member. */
+    const char *name;
+    CJFieldType type;
+    /* The offset of the field in the struct, such as from cj_offset_of. */
+    size_t offset;
+    /* The description of the struct, for CJ_FIELD_STRUCT. */
+    const struct CJStructDesc *desc;
+    /*
+     * If true, the member is an array, and the field is a pointer to its
+     * elements of the given type, allocated from the decoder's allocator. The
+     * number of elements is stored in the size_t at count_offset. A null sets
+     * the pointer to NULL and the count to 0.
+     */
+    CJ_BOOL array;
+    size_t count_offset;
+} CJField;
+
+/* A description of a struct that an object can be decoded into. */
+typedef struct CJStructDesc {
+    /* The size of the struct, for arrays of it. */
+    size_t size;
+    const CJField *fields;
+    size_t count;
+} CJStructDesc;
+
+/*
+ * A decoder that writes objects straight into structs as they are parsed,
+ * without building a value. It can be used on many inputs, one at a time.
+ */
+typedef struct CJDecoder CJDecoder;
+
+/*
+ * Compile a decoder for the given description, and those of any structs in it,
+ * which must outlive the decoder. The keys of each struct are sorted so that
+ * members are matched by binary search. Returns NULL if a description has two
+ * fields with the same name or a field of an unknown type, or if out of memory.
+ */
+CJDecoder *cj_decoder_new(CJAllocator *allocator, const CJStructDesc *desc);
+
+/*
+ * Decode an object into the struct at dst. Members with unknown keys are
+ * checked and skipped without allocating, and fields with no member keep their
+ * values, so they can be given defaults beforehand. If a key is repeated, the
+ * last member wins. String and array fields must be NULL or allocated from the
+ * decoder's allocator, as their old values are freed when replaced. A value of
+ * the wrong type, or a number out of range, fails with CJ_TYPE_MISMATCH once
+ * the rest of the input is found to be valid, so invalid input fails the same
+ * way as with cj_parse. On failure, the struct is left with what was decoded
+ * so far, which can be freed with cj_decode_free.
+ */
+CJParseResult cj_decode(CJDecoder *decoder, CJReader *reader, void *dst);
+
+/*
+ * Free the strings and arrays of a struct decoded by a decoder, and set them to
+ * NULL, with the counts of the arrays set to 0.
+ */
+void cj_decode_free(CJDecoder *decoder, void *dst);
+
+/* Free a decoder. The structs it decoded are not freed. */
+void cj_decoder_delete(CJDecoder *decoder);
+
+/*
+ * A document in memory that is read on demand through cursors, without
+ * parsing it first. Each value is parsed and validated when it is read, and
+ * the values that are skipped over are only scanned for where they end, so
+ * they cost no allocation or conversion, and errors in them may go unnoticed.
+ */
+typedef struct CJDoc CJDoc;
+
+/*
+ * A cursor at a value of a document. An array or object is read forward, one
+ * child at a time, with its cursor keeping its place. Cursors can be copied to
+ * keep more than one place, and each can be read at any time, but reading in
+ * document order scans the input only once. The fields are private.
+ */
+typedef struct {
+    CJDoc *doc;
+    /* The first character of the value. */
+    const char *start;
+    /*
+     * For an array or object, where its next child is looked for, or NULL
+     * before the first, and the last child handed out, which must be skipped
+     * first, or NULL.
+     */
+    const char *next;
+    const char *child;
+} CJCursor;
+
+/*
+ * Open a document, returning NULL if out of memory. The data must outlive the
+ * document, and is not modified. If allocator is NULL, the default allocator
+ * is used for the strings that have to be decoded.
+ */
+CJDoc *cj_doc_open(CJAllocator *allocator, const char *data, size_t length);
+
+/* Get a cursor at the root value of a document. */
+CJ_BOOL cj_doc_root(CJDoc *doc, CJCursor *out);
+
+/*
+ * Get the first error found in a document, or CJ_SUCCESS. After an error, no
+ * cursor of the document can be read. Once the root value has been read to
+ * its end, anything other than whitespace after it is an error.
+ */
+CJParseResult cj_doc_result(const CJDoc *doc);
+
+/*
+ * Close a document, after which the cursors and decoded strings from it become
+ * invalid.
+ */
+void cj_doc_close(CJDoc *doc);
+
+/*
+ * Get the type of the value at a cursor, from its first character. The rest
+ * of the value is only checked when it is read.
+ */
+CJType cj_cursor_type(const CJCursor *cursor);
+
+/*
+ * The functions below return CJ_FALSE, or NULL, if the value is not of the
+ * type asked for, or if the document has an error, which cj_doc_result tells
+ * apart.
+ */
+
+/*
+ * Get a cursor at the next element of an array, returning CJ_FALSE at its end.
+ */
+CJ_BOOL cj_cursor_next_element(CJCursor *array, CJCursor *out);
+
+/*
+ * Get a cursor at the next member of an object, and the characters and length
+ * of its key, as cj_cursor_get_string gives them. Returns CJ_FALSE at its end.
+ */
+CJ_BOOL cj_cursor_next_member(
+    CJCursor *object,
+    const char **key,
+    size_t *key_length,
+    CJCursor *out
+);
+
+/*
+ * Get a cursor at the value of a member of an object with the given key,
+ * returning CJ_FALSE if there is none. Members are searched from the one after
+ * the last member found, wrapping around to the start, so looking them up in
+ * the order they appear scans each only once. The search leaves the object
+ * where it found the member, or where it started if there is none.
+ */
+CJ_BOOL cj_cursor_field(
+    CJCursor *object,
+    const char *key,
+    size_t length,
+    CJCursor *out
+);
+
+/*
+ * Get the characters and length of a string. A string without escapes is
+ * pointed to in the input, so it is not null-terminated. Otherwise, it is
+ * decoded into memory that stays valid until the document is closed.
+ */
+const char *cj_cursor_get_string(CJCursor *cursor, size_t *length);
+
+/* Get the value of a number as a double. */
+CJ_BOOL cj_cursor_get_double(CJCursor *cursor, double *out);
+
+#ifdef CJ_INT64
+/*
+ * Get the value of a number as a 64-bit integer. Numbers that are not integers
+ * that fit are not of this type.
+ */
+CJ_BOOL cj_cursor_get_int64(CJCursor *cursor, CJInt64 *out);
+#endif
+
+/* Get the value of a boolean. */
+CJ_BOOL cj_cursor_get_boolean(CJCursor *cursor, CJ_BOOL *out);
+
+/* Check that a value is null. */
+CJ_BOOL cj_cursor_get_null(CJCursor *cursor);
+
+/*
+ * Parse the whole value at a cursor, like cj_parse_buffer, for when all of it
+ * is needed.
+ */
+CJParseResult cj_cursor_parse(
+    CJCursor *cursor,
+    CJAllocator *allocator,
+    CJValue *out
+);
+
+/*
+ * A parser that is given its input in chunks as it becomes available, rather
+ * than reading it, so that it never has to wait for more.
+ */
+typedef struct CJPushParser CJPushParser;
+
+/*
+ * Create a push parser, using the given flags for cj_parse_ex. Returns NULL if
+ * out of memory.
+ */
+CJPushParser *cj_push_new(CJAllocator *allocator, unsigned flags);
+
+/*
+ * Give the next chunk of input to a push parser, which does not need to keep
+ * it. Returns CJ_NEED_MORE, or the error if the input is invalid.
+ */
+CJParseResult cj_push_feed(
+    CJPushParser *parser,
+    const char *data,
+    size_t length
+);
+
+/*
+ * Tell a push parser that its input is over, and get the value that it parsed.
+ * The parser can then be given the input for another value.
+ */
+CJParseResult cj_push_finish(CJPushParser *parser, CJValue *out);
+
+/* Free a push parser, and any value it was in the middle of parsing. */
+void cj_push_delete(CJPushParser *parser);
+
+#ifdef CJ_INT64
+/*
+ * A JSON value stored as a tape: one array of 64-bit words in document order,
+ * and one buffer of strings. This takes much less memory than a CJValue, and
+ * reading it in order stays within a few cache lines. Values are referred to
+ * by their position in the words, and the root value is at position 0. Each
+ * string and boolean is one word, each number is two, and each array and
+ * object is a word before its children and a word after them. Walk through
+ * the tape with the cj_tape_* functions, as the layout of the words is
+ * private.
+ */
+typedef struct {
+    CJUInt64 *words;
+    size_t length;
+    char *strings;
+    size_t strings_length;
+} CJTape;
+
+/* Try to parse a JSON value into a tape. */
+CJParseResult cj_parse_tape(
+    CJAllocator *allocator,
+    CJReader *reader,
+    CJTape *out
+);
+
+/* Get the type of the value at a position. */
+CJType cj_tape_type(const CJTape *tape, size_t position);
+
+/*
+ * Get the position of the value after the one at a position, skipping its
+ * children in constant time.
+ */
+size_t cj_tape_next(const CJTape *tape, size_t position);
+
+/*
+ * Get the position of the first child of an array or object. The elements of
+ * an array follow one another, while the members of an object are each a key
+ * string followed by a value.
+ */
+size_t cj_tape_first(const CJTape *tape, size_t position);
+
+/* Get the number of elements of an array, or members of an object. */
+size_t cj_tape_length(const CJTape *tape, size_t position);
+
+/* Get the value of a boolean. */
+CJ_BOOL cj_tape_boolean(const CJTape *tape, size_t position);
+
+/* Get the value of a number. */
+double cj_tape_number(const CJTape *tape, size_t position);
+
+/*
+ * Get the characters and length of a string or key. Like CJString, the
+ * characters are null-terminated, but can contain nulls.
+ */
+const char *cj_tape_string(
+    const CJTape *tape,
+    size_t position,
+    size_t *length
+);
+
+/*
+ * Find the position of the value of the first member of an object with the
+ * given key, or return 0 if there is none or the value is not an object. The
+ * members are scanned in order.
+ */
+size_t cj_tape_object_get(
+    const CJTape *tape,
+    size_t position,
+    const char *key,
+    size_t length
+);
+
+/* Free the memory of a tape. */
+void cj_tape_free(CJAllocator *allocator, const CJTape *tape);
+#endif
+
+/*
+ * Try to parse a JSON value from a mutable buffer, decoding strings and keys in
+ * place instead of allocating them. The strings point into the buffer, so it
+ * must outlive the value, and its contents are overwritten.
+ */
+CJParseResult cj_parse_insitu(
+    CJAllocator *allocator,
+    char *data,
+    size_t length,
+    CJValue *out
+);
+
+/* Try to parse a JSON value from a mutable buffer, using the given flags. */
+CJParseResult cj_parse_insitu_ex(
+    CJAllocator *allocator,
+    char *data,
+    size_t length,
+    CJValue *out,
+    unsigned flags
+);
+
+/*
+ * Find the value of the first member of an object with the given key, or
+ * return NULL if there is none or the value is not an object. Objects are
+ * scanned, unless they have a hash index from CJ_PARSE_INDEX_OBJECTS. The
+ * object is never modified, so it can be searched from several threads at once.
+ */
+const CJValue *cj_object_get(
+    const CJValue *object,
+    const char *key,
+    size_t length
+);
+
+/* Like cj_object_get, but finds the last member with the key. */
+const CJValue *cj_object_get_last(
+    const CJValue *object,
+    const char *key,
+    size_t length
+);
+
+/*
+ * Get the value of a number as a double, converting it first if it has not
+ * been converted yet.
+ */
+double cj_number_to_double(const CJValue *value);
+
+#ifdef CJ_INT64
+/*
+ * Get the value of a number as a 64-bit integer. If the number is an integer
+ * that fits, store it in out and return CJ_TRUE. Otherwise, return CJ_FALSE.
+ * Numbers that have not been converted are read exactly from their text, like
+ * cj_cursor_get_int64 and CJ_FIELD_INT64 read them, so 9223372036854775807
+ * fits and -9223372036854775809 does not. Converted numbers can only be read
+ * from their double, so integers beyond 2^53 have already been rounded, and
+ * tiny fractions such as 1e-400 have already become 0.
+ */
+CJ_BOOL cj_number_to_int64(const CJValue *value, CJInt64 *out);
+#endif
+
+/*
+ * Flags for cj_write.
+ *
+ * CJ_WRITE_PRETTY - Put each element and member on its own line, indented by
+ *   four spaces for each level of nesting.
+ */
+#define CJ_WRITE_PRETTY 0x1
+
+/*
+ * Write a JSON value, and return CJ_FALSE if the writer fails. Values nested
+ * more than 64 levels deep are tracked in memory from the default allocator,
+ * so writing them also fails if there is none or it runs out. Numbers are
+ * written with the fewest digits that parse back to the same double, or with
+ * their original text if they are lazy. Without a 64-bit integer type or IEEE
+ * 754 doubles, a few more digits may be used than are needed. Infinities are
+ * written as 1e999 or -1e999, and NaNs as null. Strings are written as they
+ * are, other than their escapes, so they should be valid UTF-8.
+ */
+CJ_BOOL cj_write(CJWriter *writer, const CJValue *value, unsigned flags);
+
 /* Free the memory of a JSON value. */
 void cj_free(CJAllocator *allocator, const CJValue *value);
 
+#ifdef CJ_INT64
+/*
+ * A snapshot is a tape saved in a binary file, which can be loaded again
+ * without being parsed. The file holds the words and strings of the tape as
+ * they are in memory, after a header with the version of the format, the byte
+ * order and size_t width of the machine that saved it, and a checksum. Files
+ * from another version or another kind of machine, or that have been damaged,
+ * fail to load, so the JSON can be parsed instead. A snapshot has no record of
+ * the JSON it was saved from, so check that it is newer than the JSON, such as
+ * by comparing when they were modified, before loading it. Loading checks
+ * every word, so even a file damaged in a way that the checksum misses can't
+ * make the cj_tape_* functions read outside of it.
+ */
+
+/*
+ * Save a value as a snapshot, returning CJ_FALSE if the writer fails or runs
+ * out of memory. The value is converted to a tape in memory from the
+ * allocator first, or the default allocator if it is NULL. As on a tape,
+ * numbers are stored as doubles.
+ */
+CJ_BOOL cj_save_snapshot(
+    CJAllocator *allocator,
+    const CJValue *value,
+    CJWriter *writer
+);
+
+/* Save a tape as a snapshot, returning CJ_FALSE if the writer fails. */
+CJ_BOOL cj_save_tape_snapshot(const CJTape *tape, CJWriter *writer);
+
+#ifdef CJ_MAPPED_FILE_READER
+/* A loaded snapshot. */
+typedef struct {
+    /*
+     * The tape, which points into the file. Read it with the cj_tape_*
+     * functions, but do not free it with cj_tape_free.
+     */
+    CJTape tape;
+    /* The file, which is mapped into memory if possible. */
+    CJMappedFileReader file;
+} CJSnapshot;
+
+/*
+ * Load a snapshot from a file, returning CJ_FALSE if it can't be read or is not
+ * a valid snapshot. The file is mapped into memory, and its checksum and each
+ * of its words checked, without allocating anything for its values. If the file can't be mapped,
+ * it is read into memory from the allocator instead, or the default allocator
+ * if it is NULL.
+ */
+CJ_BOOL cj_load_snapshot_mapped(
+    CJSnapshot *snapshot,
+    const char *path,
+    CJAllocator *allocator
+);
+
+/* Close a snapshot, after which its tape becomes invalid. */
+void cj_close_snapshot(CJSnapshot *snapshot);
+#endif
+#endif
+
 #ifdef __cplusplus
 }
 #endif
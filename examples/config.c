@@ -121,30 +121,24 @@ static CJ_BOOL load_theme(const CJValue *value, Config *out) {
     return CJ_TRUE;
 }
 
-static CJ_BOOL key_eq(const CJString *str, const char *test) {
-    return str->length == strlen(test) && strcmp(str->chars, test) == 0;
+/* Load a property using the given function, if the object has it. */
+static CJ_BOOL load_property(
+    const CJValue *obj,
+    const char *key,
+    CJ_BOOL (*load)(const CJValue *value, Config *out),
+    Config *out
+) {
+    /* like JavaScript, the last duplicate key wins */
+    const CJValue *value = cj_object_get_last(obj, key, strlen(key));
+    return value == NULL || load(value, out);
 }
 
 /* Load the config from its object members. */
-static CJ_BOOL load_config_members(const CJObject *obj, Config *out) {
-    size_t i;
-    for (i = 0; i < obj->length; ++i) {
-        /* get object member */
-        const CJObjectMember *member = &obj->members[i];
-        const CJString *key = &member->key;
-        const CJValue *value = &member->value;
-        /* check key and set appropriate config value based on it */
-        if (key_eq(key, "use_tabs")) {
-            if (!load_use_tabs(value, out)) return CJ_FALSE;
-        } else if (key_eq(key, "indent_width")) {
-            if (!load_indent_width(value, out)) return CJ_FALSE;
-        } else if (key_eq(key, "rulers")) {
-            if (!load_rulers(value, out)) return CJ_FALSE;
-        } else if (key_eq(key, "theme")) {
-            if (!load_theme(value, out)) return CJ_FALSE;
-        }
-    }
-    return CJ_TRUE;
+static CJ_BOOL load_config_members(const CJValue *obj, Config *out) {
+    return load_property(obj, "use_tabs", load_use_tabs, out)
+        && load_property(obj, "indent_width", load_indent_width, out)
+        && load_property(obj, "rulers", load_rulers, out)
+        && load_property(obj, "theme", load_theme, out);
 }
 
 /* Load the config from a JSON value. */
@@ -157,7 +151,7 @@ static CJ_BOOL load_config(const CJValue *in, Config *out) {
         out->rulers[0] = 0;
         memcpy(out->theme, DEFAULT_THEME, strlen(DEFAULT_THEME) + 1);
         if (in->type == CJ_OBJECT) {
-            if (load_config_members(&in->as.object, out)) return CJ_TRUE;
+            if (load_config_members(in, out)) return CJ_TRUE;
         }
     }
     free_config(out);
@@ -178,9 +172,7 @@ static void print_config(const Config *config) {
 }
 
 int main(int argc, char *argv[]) {
-    FILE *f;
-    char buffer[128];
-    CJFileReader file_reader;
+    CJMappedFileReader file_reader;
     CJValue value;
     CJParseResult result;
     Config config;
@@ -190,17 +182,14 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "expected config file name\n");
         return EXIT_FAILURE;
     }
-    f = fopen(argv[1], "r");
-    if (f == NULL) {
+    if (!cj_open_mapped_file_reader(&file_reader, argv[1], NULL)) {
         fprintf(stderr, "failed to open %s: %s\n", argv[1], strerror(errno));
         return EXIT_FAILURE;
     }
-    /* interfaces for building json tree */
-    cj_init_file_reader(&file_reader, f, buffer, sizeof(buffer));
     /* parse json */
     result = cj_parse(NULL, &file_reader.reader, &value);
     /* close input file */
-    fclose(f);
+    cj_close_mapped_file_reader(&file_reader);
     /* handle json parsing error */
     if (result != CJ_SUCCESS) {
         fprintf(stderr, "failed to parse config file\n");
@@ -27,9 +27,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-static void run_benchmark(const char *input, size_t length) {
-    for (int i = 0; i < 10000000; i++) {
+/* Parse the input repeatedly and report how long it took. */
+static void run_benchmark(
+    const char *name,
+    const char *input,
+    size_t length,
+    long iterations
+) {
+    clock_t start = clock();
+    for (long i = 0; i < iterations; i++) {
         CJStringReader string_reader;
         cj_init_string_reader(&string_reader, input, length);
         CJValue value;
@@ -37,9 +45,88 @@ static void run_benchmark(const char *input, size_t length) {
         assert(result == CJ_SUCCESS);
         cj_free(NULL, &value);
     }
+    double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    printf("%-24s %8.1f ns/parse %8.1f MB/s\n", name,
+        seconds * 1e9 / iterations,
+        (double) length * iterations / seconds / 1e6);
 }
 
+/* A cheap random number generator, so that runs are reproducible. */
+static unsigned long next_random(unsigned long *state) {
+    *state = *state * 1103515245 + 12345;
+    return (*state >> 16) & 0x7FFF;
+}
+
+/* The kinds of numbers in the generated arrays. */
+enum { INTEGERS, FLOATS, BIG_EXPONENTS, LONG_MANTISSAS };
+
+/* Write one number of the given kind. */
+static int write_number(char *buf, int kind, unsigned long *state) {
+    unsigned long a = next_random(state) * 32768 + next_random(state);
+    unsigned long b = next_random(state) * 32768 + next_random(state);
+    switch (kind) {
+        case INTEGERS:
+            return sprintf(buf, "%lu", a);
+        case FLOATS:
+            return sprintf(buf, "%lu.%lu", a % 10000, b);
+        case BIG_EXPONENTS:
+            return sprintf(buf, "%lu.%lue%d", a % 10, b,
+                (int) (b % 600) - 300);
+        default:
+            return sprintf(buf, "%lu.%lu%lu%lu", a % 10, a, b, a ^ b);
+    }
+}
+
+/* Benchmark an array of many numbers of the given kind. */
+static void run_array_benchmark(const char *name, int kind) {
+    /* each number is well under 64 characters */
+    const int count = 100000;
+    char *input = malloc((size_t) count * 64 + 2);
+    unsigned long state = 1;
+    size_t length = 0;
+    assert(input != NULL);
+    input[length++] = '[';
+    for (int i = 0; i < count; i++) {
+        if (i > 0) input[length++] = ',';
+        length += write_number(input + length, kind, &state);
+    }
+    input[length++] = ']';
+    run_benchmark(name, input, length, 100);
+    free(input);
+}
+
+/* A scalar benchmark case. */
+typedef struct {
+    const char *name;
+    const char *input;
+} Case;
+
+static const Case cases[] = {
+    { "small integer", "1" },
+    { "large integer", "1234567890123456789" },
+    { "tiny fraction", "0.00000000001" },
+    { "pi", "3.1415926" },
+    { "long mantissa",
+        "1.23456789012345678901234567890123456789012345678901234567891234" },
+    { "huge exponent", "3.456e999" },
+    { "tiny exponent", "3.456e-999" },
+    { "big exponent", "1.7976931348623157e308" },
+    { "negative exponent", "-2.2250738585072014e-308" },
+};
+
 int main(int argc, char *argv[]) {
-    run_benchmark(argv[1], strlen(argv[1]));
+    if (argc > 1) {
+        /* benchmark the given input */
+        run_benchmark(argv[1], argv[1], strlen(argv[1]), 10000000);
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        run_benchmark(cases[i].name, cases[i].input, strlen(cases[i].input),
+            10000000);
+    }
+    run_array_benchmark("array of integers", INTEGERS);
+    run_array_benchmark("array of floats", FLOATS);
+    run_array_benchmark("array of big exponents", BIG_EXPONENTS);
+    run_array_benchmark("array of long mantissas", LONG_MANTISSAS);
     return 0;
 }
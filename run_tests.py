@@ -5,9 +5,35 @@ from pathlib import Path
 from traceback import print_exc
 from typing import Optional
 
-def run_test_program(test_file: Path) -> Optional[bytes]:
+# parsing modes supported by the test program
+MODES = ['default', 'arena', 'stream1', 'buffer', 'string', 'lazy',
+    'lazystream', 'insitu', 'indexed', 'intern', 'events', 'push', 'push1',
+    'next', 'pretty', 'mapped', 'mappedinsitu', 'readahead',
+    'parallel', 'twostage', 'tape', 'snapshot', 'validate', 'select',
+    'deep', 'parser', 'pool', 'stats', 'decode', 'batch', 'cursor']
+
+# modes only supported by the test program built with statistics
+STATS_MODES = {'stats'}
+
+# modes that are tested with the test program built with threads, which the
+# deep mode uses to walk nesting on a small stack, and the pool mode to lock
+# the pool for its caches
+THREAD_MODES = {'readahead', 'parallel', 'batch', 'deep', 'pool'}
+
+# modes whose output only has to mean the same as the default mode's, as they
+# keep the text of numbers or add whitespace
+SAME_VALUE_MODES = {'lazy', 'lazystream', 'pretty'}
+
+def run_test_program(test_file: Path, mode: str) -> Optional[bytes]:
+    if mode in STATS_MODES:
+        program = './test_stats'
+    elif mode in THREAD_MODES:
+        program = './test_threads'
+    else:
+        program = './test'
     try:
-        return subprocess.check_output(['./test', str(test_file)], timeout=5.0)
+        return subprocess.check_output([program, str(test_file), mode],
+            timeout=5.0)
     except subprocess.CalledProcessError as e:
         # signal raised
         if e.returncode < 0:
@@ -15,8 +41,8 @@ def run_test_program(test_file: Path) -> Optional[bytes]:
         # failure occurred
         return None
 
-def run_test(test_file: Path):
-    roundtrip = run_test_program(test_file)
+def run_test(test_file: Path) -> Optional[bytes]:
+    roundtrip = run_test_program(test_file, MODES[0])
 
     match test_file.name[0]:
         case 'y':
@@ -25,15 +51,30 @@ def run_test(test_file: Path):
             assert roundtrip is None
 
     if roundtrip is None:
-        return
+        return None
 
     with test_file.open('rb') as file:
         v = json.load(file, parse_int=float)
 
     assert v == json.loads(roundtrip, parse_int=float)
 
+    return roundtrip
+
+def same_value(output: Optional[bytes], expected: Optional[bytes]) -> bool:
+    if output is None or expected is None:
+        return output == expected
+    return (json.loads(output, parse_int=float)
+        == json.loads(expected, parse_int=float))
+
 # compile test program
 subprocess.check_call(['cc', 'test.c', 'cj.o', '-o', 'test'])
+# statistics are only counted by cj built with them, so they need their own
+# build
+subprocess.check_call(['cc', '-DCJ_STATS', 'test.c', 'cj.c', '-o',
+    'test_stats'])
+# threads are only used by cj built with them, which needs the thread library
+subprocess.check_call(['cc', '-DCJ_THREADS', 'test.c', 'cj.c', '-pthread',
+    '-o', 'test_threads'])
 
 # run tests and then delete test program
 try:
@@ -41,13 +82,26 @@ try:
     test_dir = Path('tests')
     for test_file in test_dir.iterdir():
         try:
-            run_test(test_file)
+            expected = run_test(test_file)
         except:
             print_exc()
             print('FAIL: {}'.format(test_file))
             failures += 1
+            continue
+        # other modes must agree with the default mode, even on i_ tests
+        for mode in MODES[1:]:
+            output = run_test_program(test_file, mode)
+            if mode in SAME_VALUE_MODES:
+                passed = same_value(output, expected)
+            else:
+                passed = output == expected
+            if not passed:
+                print('FAIL ({}): {}'.format(mode, test_file))
+                failures += 1
     if failures != 0:
         print('{} tests failed'.format(failures))
         exit(1)
 finally:
     Path('test').unlink()
+    Path('test_stats').unlink()
+    Path('test_threads').unlink()
@@ -23,88 +23,1725 @@
 
 #include "cj.h"
 
-#include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-static void print_string(const CJString *str) {
-    putchar('"');
-    for (size_t i = 0; i < str->length; i++) {
-        char c = str->chars[i];
-        if ((c >= 0 && c < ' ') || c == '"' || c == '\\') {
-            printf("\\u00%02x", c);
-        } else {
-            putchar(c);
-            // printf("%c", c);
+/* threads with small stacks, to check that nothing recurses deeply */
+#if defined(CJ_THREADS) && (defined(__unix__) || defined(__APPLE__))
+#define SMALL_STACKS
+#include <pthread.h>
+#endif
+
+/* Check that the integer value of a number agrees with its double value. */
+static void check_int64(const CJValue *v, double number) {
+    CJInt64 integer;
+    if (cj_number_to_int64(v, &integer) && (double) integer != number) {
+        abort();
+    }
+}
+
+/*
+ * Check that lazy numbers are converted to integers exactly from their text,
+ * and agree with converted numbers wherever a double holds the integer.
+ */
+static void check_lazy_int64(void) {
+    const char *json = "[9223372036854775807, -9223372036854775808, "
+        "9007199254740993, -9223372036854775809, 9223372036854775808, "
+        "-1e-400, 1.5, 1e400, 42, -1.0e2]";
+    /* how the lazy numbers convert, with 0 where they must not */
+    static const struct {
+        bool fits;
+        CJInt64 integer;
+    } expected[] = {
+        { true, 9223372036854775807 },
+        { true, -9223372036854775807 - 1 },
+        { true, 9007199254740993 },
+        { false, 0 },
+        { false, 0 },
+        { false, 0 },
+        { false, 0 },
+        { false, 0 },
+        { true, 42 },
+        { true, -100 }
+    };
+    CJValue eager, lazy;
+    if (cj_parse_buffer(NULL, json, strlen(json), &eager) != CJ_SUCCESS) {
+        abort();
+    }
+    if (cj_parse_buffer_ex(NULL, json, strlen(json), &lazy,
+            CJ_PARSE_LAZY_NUMBERS) != CJ_SUCCESS) {
+        abort();
+    }
+    for (size_t i = 0; i < lazy.as.array.length; i++) {
+        CJInt64 integer = 1;
+        CJ_BOOL fits =
+            cj_number_to_int64(&lazy.as.array.elements[i], &integer);
+        if (fits != expected[i].fits
+                || (fits && integer != expected[i].integer)) {
+            abort();
+        }
+        /* a double holds the small ones exactly, so they must agree */
+        if (fits && integer > -((CJInt64) 1 << 53)
+                && integer < (CJInt64) 1 << 53) {
+            CJInt64 eager_integer;
+            if (!cj_number_to_int64(&eager.as.array.elements[i],
+                    &eager_integer) || eager_integer != integer) {
+                abort();
+            }
         }
     }
-    putchar('"');
+    cj_free(NULL, &eager);
+    cj_free(NULL, &lazy);
 }
 
-static void write_json(const CJValue *v) {
+/* True if keys are interned, so that equal keys share their characters. */
+static bool interned;
+
+/* True if large objects are parsed with a hash index. */
+static bool indexed;
+
+/* Check that looking up each member of an object finds the right one. */
+static void check_lookup(const CJValue *v) {
+    const CJObject *obj = &v->as.object;
+    /* only objects parsed with an index have one, as lookups don't add it */
+    if ((v->flags & CJ_VALUE_INDEXED) && !indexed) abort();
+    if (indexed && obj->length >= 16 && !(v->flags & CJ_VALUE_INDEXED)) {
+        abort();
+    }
+    for (size_t i = 0; i < obj->length; i++) {
+        const CJString *key = &obj->members[i].key;
+        const CJValue *first = cj_object_get(v, key->chars, key->length);
+        const CJValue *last = cj_object_get_last(v, key->chars, key->length);
+        /* duplicates may be found instead, but only first or last ones */
+        if (first == NULL || last == NULL) abort();
+        if (first > &obj->members[i].value || last < &obj->members[i].value) {
+            abort();
+        }
+        for (size_t j = 0; j < obj->length; j++) {
+            const CJString *other = &obj->members[j].key;
+            if (other->length != key->length
+                    || memcmp(other->chars, key->chars, key->length) != 0) {
+                continue;
+            }
+            if (interned && other->chars != key->chars) abort();
+            if ((j < i && first > &obj->members[j].value)
+                    || (j > i && last < &obj->members[j].value)) {
+                abort();
+            }
+        }
+    }
+    if (cj_object_get(v, "\x01missing", 8) != NULL) abort();
+    if ((v->flags & CJ_VALUE_INDEXED) && !indexed) abort();
+}
+
+/* Check that a number's text converts to the same double as strtod gives. */
+static void check_raw_number(const CJValue *v, double number) {
+    char buf[1024];
+    if (!(v->flags & CJ_VALUE_RAW_NUMBER)) return;
+    if (v->as.raw.length >= sizeof(buf)) return;
+    memcpy(buf, v->as.raw.chars, v->as.raw.length);
+    buf[v->as.raw.length] = '\0';
+    if (strtod(buf, NULL) != number) abort();
+}
+
+/* Check the numbers and objects of a parsed value. */
+static void check_value(const CJValue *v) {
+    double number;
     switch (v->type) {
+        case CJ_NUMBER:
+            number = cj_number_to_double(v);
+            check_int64(v, number);
+            check_raw_number(v, number);
+            break;
+        case CJ_ARRAY:
+            for (size_t i = 0; i < v->as.array.length; i++) {
+                check_value(&v->as.array.elements[i]);
+            }
+            break;
+        case CJ_OBJECT:
+            check_lookup(v);
+            for (size_t i = 0; i < v->as.object.length; i++) {
+                check_value(&v->as.object.members[i].value);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* Write a value to stdout, through a tiny buffer to exercise flushing. */
+static void write_json(const CJValue *v) {
+    char buffer[13];
+    CJFileWriter file_writer;
+    cj_init_file_writer(&file_writer, stdout, buffer, sizeof(buffer));
+    if (!cj_write(&file_writer.writer, v, 0)) abort();
+}
+
+/* Write a value to stdout with indentation, through a buffer in memory. */
+static void write_pretty_json(const CJValue *v) {
+    CJBufferWriter buffer_writer;
+    cj_init_buffer_writer(&buffer_writer, NULL);
+    if (!cj_write(&buffer_writer.writer, v, CJ_WRITE_PRETTY)) abort();
+    if (strlen(buffer_writer.data) != buffer_writer.length) abort();
+    fwrite(buffer_writer.data, 1, buffer_writer.length, stdout);
+    free(buffer_writer.data);
+}
+
+/* The state of printing JSON from events, in the same format as write_json. */
+static struct {
+    /* true if the container at each depth has no children yet */
+    bool first[CJ_MAX_DEPTH + 1];
+    int depth;
+    /* true if a key was just printed, so no comma is needed */
+    bool after_key;
+} printer;
+
+/* Print a comma if the next value is not the first in its container. */
+static void begin_value(void) {
+    if (printer.after_key) {
+        printer.after_key = false;
+    } else {
+        if (!printer.first[printer.depth]) putchar(',');
+        printer.first[printer.depth] = false;
+    }
+}
+
+static CJ_BOOL on_start(char c) {
+    begin_value();
+    putchar(c);
+    printer.first[++printer.depth] = true;
+    return CJ_TRUE;
+}
+
+static CJ_BOOL on_end(char c) {
+    putchar(c);
+    --printer.depth;
+    return CJ_TRUE;
+}
+
+static CJ_BOOL on_start_object(void *ctx) { (void) ctx; return on_start('{'); }
+static CJ_BOOL on_end_object(void *ctx) { (void) ctx; return on_end('}'); }
+static CJ_BOOL on_start_array(void *ctx) { (void) ctx; return on_start('['); }
+static CJ_BOOL on_end_array(void *ctx) { (void) ctx; return on_end(']'); }
+
+static CJ_BOOL on_key(void *ctx, const char *chars, size_t length) {
+    CJValue v = { CJ_STRING, 0, { 0 } };
+    (void) ctx;
+    v.as.string.length = length;
+    v.as.string.chars = (char*) chars;
+    begin_value();
+    write_json(&v);
+    putchar(':');
+    printer.after_key = true;
+    return CJ_TRUE;
+}
+
+static CJ_BOOL on_string(void *ctx, const char *chars, size_t length) {
+    CJValue v = { CJ_STRING, 0, { 0 } };
+    (void) ctx;
+    v.as.string.length = length;
+    v.as.string.chars = (char*) chars;
+    begin_value();
+    write_json(&v);
+    return CJ_TRUE;
+}
+
+static CJ_BOOL on_number(void *ctx, double number) {
+    CJValue v = { CJ_NUMBER, 0, { 0 } };
+    (void) ctx;
+    v.as.number = number;
+    begin_value();
+    write_json(&v);
+    return CJ_TRUE;
+}
+
+static CJ_BOOL on_boolean(void *ctx, CJ_BOOL boolean) {
+    (void) ctx;
+    begin_value();
+    printf("%s", boolean ? "true" : "false");
+    return CJ_TRUE;
+}
+
+static CJ_BOOL on_null(void *ctx) {
+    (void) ctx;
+    begin_value();
+    printf("null");
+    return CJ_TRUE;
+}
+
+static const CJHandler printing_handler = {
+    on_start_object, on_end_object, on_start_array, on_end_array,
+    on_key, on_string, on_number, on_boolean, on_null
+};
+
+/* Copy a string from a tape, allocated as cj_free expects. */
+static void tape_to_string(
+    const CJTape *tape,
+    size_t position,
+    CJString *out
+) {
+    const char *chars = cj_tape_string(tape, position, &out->length);
+    if (chars[out->length] != '\0') abort();
+    /* cj_free frees strings of any length that it didn't make */
+    out->chars = malloc(out->length + 1);
+    if (out->chars == NULL) abort();
+    memcpy(out->chars, chars, out->length + 1);
+}
+
+/* Rebuild a value from a tape, checking that members can be found. */
+static void tape_to_value(const CJTape *tape, size_t position, CJValue *out) {
+    size_t length, child;
+    out->type = cj_tape_type(tape, position);
+    out->flags = 0;
+    switch (out->type) {
         case CJ_NULL:
-            printf("null");
             break;
         case CJ_BOOLEAN:
-            printf("%s", v->as.boolean ? "true" : "false");
+            out->as.boolean = cj_tape_boolean(tape, position);
             break;
         case CJ_NUMBER:
-            /* infinities not yet handled by cj */
-            if (v->as.number == INFINITY) {
-                printf("1e309");
-            } else if (v->as.number == -INFINITY) {
-                printf("-1e309");
-            } else {
-                printf("%.17e", v->as.number);
-            }
+            out->as.number = cj_tape_number(tape, position);
             break;
         case CJ_STRING:
-            print_string(&v->as.string);
+            tape_to_string(tape, position, &out->as.string);
             break;
         case CJ_ARRAY:
-            putchar('[');
-            for (size_t i = 0; i < v->as.array.length; i++) {
-                if (i > 0) putchar(',');
-                write_json(&v->as.array.elements[i]);
+            length = cj_tape_length(tape, position);
+            out->as.array.length = length;
+            out->as.array.elements = NULL;
+            if (length != 0) {
+                out->as.array.elements = malloc(length * sizeof(CJValue));
+                if (out->as.array.elements == NULL) abort();
             }
-            putchar(']');
+            child = cj_tape_first(tape, position);
+            for (size_t i = 0; i < length; i++) {
+                tape_to_value(tape, child, &out->as.array.elements[i]);
+                child = cj_tape_next(tape, child);
+            }
+            if (cj_tape_object_get(tape, position, "", 0) != 0) abort();
             break;
         case CJ_OBJECT:
-            putchar('{');
-            for (size_t i = 0; i < v->as.object.length; i++) {
-                if (i > 0) putchar(',');
-                print_string(&v->as.object.members[i].key);
-                putchar(':');
-                write_json(&v->as.object.members[i].value);
+            length = cj_tape_length(tape, position);
+            out->as.object.length = length;
+            out->as.object.members = NULL;
+            if (length != 0) {
+                out->as.object.members =
+                    malloc(length * sizeof(CJObjectMember));
+                if (out->as.object.members == NULL) abort();
+            }
+            child = cj_tape_first(tape, position);
+            for (size_t i = 0; i < length; i++) {
+                CJObjectMember *member = &out->as.object.members[i];
+                size_t value = cj_tape_next(tape, child), found;
+                tape_to_string(tape, child, &member->key);
+                tape_to_value(tape, value, &member->value);
+                /* the first member with the key comes no later */
+                found = cj_tape_object_get(tape, position, member->key.chars,
+                    member->key.length);
+                if (found == 0 || found > value) abort();
+                child = cj_tape_next(tape, value);
             }
-            putchar('}');
             break;
     }
 }
 
-int main(int argc, char *argv[]) {
-    FILE *f = fopen(argv[1], "r");
-    /* ensure the input file is open */
+/* Parse a tape, and rebuild the value from it. */
+static CJParseResult parse_tape(CJReader *reader, CJValue *value) {
+    CJTape tape;
+    CJParseResult result = cj_parse_tape(NULL, reader, &tape);
+    if (result == CJ_SUCCESS) {
+        tape_to_value(&tape, 0, value);
+        if (cj_tape_next(&tape, 0) != tape.length) abort();
+        cj_tape_free(NULL, &tape);
+    }
+    return result;
+}
+
+/* An arena for the modes that use one. */
+static CJArena arena;
+
+/* The number of allocations made through counting_allocator not yet freed. */
+static size_t live_allocations;
+
+static void *counting_allocate(CJAllocator *allocator, void *ptr, size_t size) {
+    (void) allocator;
+    if (ptr == NULL) ++live_allocations;
+    if (size == 0) --live_allocations;
+    return realloc(ptr, size);
+}
+
+static CJAllocator counting_allocator = { counting_allocate };
+
+/*
+ * Check that a value built by hand, with flags of 0, is freed entirely,
+ * including an empty string and an empty key.
+ */
+static void check_hand_built_value(void) {
+    CJValue value, *elements;
+    CJObjectMember *member;
+    elements = counting_allocate(NULL, NULL, 2 * sizeof(CJValue));
+    elements[0].type = CJ_STRING;
+    elements[0].flags = 0;
+    elements[0].as.string.length = 0;
+    elements[0].as.string.chars = counting_allocate(NULL, NULL, 1);
+    elements[0].as.string.chars[0] = '\0';
+    member = counting_allocate(NULL, NULL, sizeof(CJObjectMember));
+    member->key.length = 0;
+    member->key.chars = counting_allocate(NULL, NULL, 1);
+    member->key.chars[0] = '\0';
+    member->value.type = CJ_NULL;
+    member->value.flags = 0;
+    elements[1].type = CJ_OBJECT;
+    elements[1].flags = 0;
+    elements[1].as.object.length = 1;
+    elements[1].as.object.members = member;
+    value.type = CJ_ARRAY;
+    value.flags = 0;
+    value.as.array.length = 2;
+    value.as.array.elements = elements;
+    if (cj_object_get(&elements[1], "", 0) != &member->value) abort();
+    cj_free(&counting_allocator, &value);
+    if (live_allocations != 0) abort();
+}
+
+/* A pool, and the caches for parsing and freeing in pool mode. */
+static CJPool *pool;
+static CJPoolCache *parse_cache, *free_cache;
+
+/* The live allocations of the pool's backing allocator after the first parse
+ * in pool mode. */
+static size_t pool_allocations;
+
+/* Parse through a cache of a pool twice, checking that the second parse reuses
+ * the memory freed after the first. */
+static CJParseResult parse_pooled(const char *path, FILE *f, CJValue *value) {
+    /* use a tiny chunk size to exercise chunk growth */
+    pool = cj_pool_new(&counting_allocator, 16);
+    if (pool == NULL) abort();
+    parse_cache = cj_pool_cache_new(pool);
+    free_cache = cj_pool_cache_new(pool);
+    if (parse_cache == NULL || free_cache == NULL) abort();
+    CJAllocator *allocator = cj_pool_cache_allocator(parse_cache);
+    char buffer[128];
+    CJFileReader file_reader;
+    cj_init_file_reader(&file_reader, f, buffer, sizeof(buffer));
+    CJParseResult result = cj_parse(allocator, &file_reader.reader, value);
+    if (result != CJ_SUCCESS) {
+        cj_pool_delete(pool);
+        if (live_allocations != 0) abort();
+        return result;
+    }
+    cj_free(allocator, value);
+    pool_allocations = live_allocations;
+    f = freopen(path, "r", f);
+    if (f == NULL) abort();
+    cj_init_file_reader(&file_reader, f, buffer, sizeof(buffer));
+    if (cj_parse(allocator, &file_reader.reader, value) != CJ_SUCCESS) abort();
+    return CJ_SUCCESS;
+}
+
+/* The contents of the file for the modes that read it all at once. */
+static char *contents;
+
+/* The reader for the modes that map the file. */
+static CJMappedFileReader mapped_file_reader;
+
+/* Read the whole file into memory. */
+static size_t read_contents(FILE *f) {
+    size_t length = 0;
+    size_t cap = 128;
+    contents = malloc(cap);
+    if (contents == NULL) abort();
+    for (;;) {
+        length += fread(contents + length, 1, cap - length, f);
+        if (length < cap) break;
+        cap *= 2;
+        contents = realloc(contents, cap);
+        if (contents == NULL) abort();
+    }
+    if (ferror(f)) abort();
+    return length;
+}
+
+/* The file that snapshots are saved to and loaded from. */
+#define SNAPSHOT_PATH "test_snapshot.tmp"
+
+/* Write bytes to the snapshot file. */
+static void write_snapshot_file(const char *data, size_t length) {
+    FILE *f = fopen(SNAPSHOT_PATH, "wb");
     if (f == NULL) abort();
+    if (fwrite(data, 1, length, f) != length) abort();
+    if (fclose(f) != 0) abort();
+}
+
+/* Check that a damaged copy of a snapshot fails to load. */
+static void check_damaged_snapshot(
+    const CJBufferWriter *saved,
+    size_t length,
+    size_t flipped
+) {
+    CJSnapshot snapshot;
+    char *damaged = malloc(saved->length);
+    if (damaged == NULL) abort();
+    memcpy(damaged, saved->data, saved->length);
+    if (flipped < length) damaged[flipped] ^= 0x10;
+    write_snapshot_file(damaged, length);
+    free(damaged);
+    if (cj_load_snapshot_mapped(&snapshot, SNAPSHOT_PATH, NULL)) abort();
+}
+
+/* Check that a tape saved with the right checksum still fails to load. */
+static void check_unloadable_tape(const CJTape *tape) {
+    CJBufferWriter buffer_writer;
+    CJSnapshot snapshot;
+    cj_init_buffer_writer(&buffer_writer, NULL);
+    if (!cj_save_tape_snapshot(tape, &buffer_writer.writer)) abort();
+    write_snapshot_file(buffer_writer.data, buffer_writer.length);
+    free(buffer_writer.data);
+    if (cj_load_snapshot_mapped(&snapshot, SNAPSHOT_PATH, NULL)) abort();
+}
+
+/*
+ * Check that snapshots of tapes whose words point outside of them, or don't
+ * add up, fail to load.
+ */
+static void check_inconsistent_snapshots(void) {
+    const char *json = "[[1],2,\"ab\"]";
+    CJStringReader string_reader;
+    CJTape tape;
+    cj_init_string_reader(&string_reader, json, strlen(json));
+    if (cj_parse_tape(NULL, &string_reader.reader, &tape) != CJ_SUCCESS) {
+        abort();
+    }
+    /* the end of the inner array swapped with the element after it */
+    size_t end = cj_tape_next(&tape, cj_tape_first(&tape, 0)) - 1;
+    CJUInt64 word = tape.words[end];
+    tape.words[end] = tape.words[end + 1];
+    tape.words[end + 1] = word;
+    check_unloadable_tape(&tape);
+    tape.words[end + 1] = tape.words[end];
+    tape.words[end] = word;
+    /* the string pointing past the strings */
+    CJTape no_strings = tape;
+    no_strings.strings = NULL;
+    no_strings.strings_length = 0;
+    check_unloadable_tape(&no_strings);
+    cj_tape_free(NULL, &tape);
+}
+
+/*
+ * Parse the file, save the value as a snapshot, and rebuild it from the loaded
+ * snapshot. The snapshot must match one saved from a tape of the same file,
+ * and fail to load if it is damaged.
+ */
+static CJParseResult snapshot_value(FILE *f, CJValue *value) {
+    char buffer[7];
+    CJFileWriter file_writer;
+    CJBufferWriter tape_writer;
+    CJSnapshot snapshot;
+    CJStringReader string_reader;
+    CJTape tape;
+    CJValue parsed;
+    size_t length = read_contents(f);
+    CJParseResult result = cj_parse_buffer(NULL, contents, length, &parsed);
+    if (result != CJ_SUCCESS) return result;
+    FILE *out = fopen(SNAPSHOT_PATH, "wb");
+    if (out == NULL) abort();
+    cj_init_file_writer(&file_writer, out, buffer, sizeof(buffer));
+    if (!cj_save_snapshot(NULL, &parsed, &file_writer.writer)) abort();
+    if (fclose(out) != 0) abort();
+    cj_free(NULL, &parsed);
+    if (!cj_load_snapshot_mapped(&snapshot, SNAPSHOT_PATH, NULL)) abort();
+    tape_to_value(&snapshot.tape, 0, value);
+    /* a tape parsed straight from the file is saved the same way */
+    cj_init_string_reader(&string_reader, contents, length);
+    if (cj_parse_tape(NULL, &string_reader.reader, &tape) != CJ_SUCCESS) {
+        abort();
+    }
+    cj_init_buffer_writer(&tape_writer, NULL);
+    if (!cj_save_tape_snapshot(&tape, &tape_writer.writer)) abort();
+    cj_tape_free(NULL, &tape);
+    if (tape_writer.length != snapshot.file.length
+            || memcmp(tape_writer.data, snapshot.file.data,
+                tape_writer.length) != 0) {
+        abort();
+    }
+    cj_close_snapshot(&snapshot);
+    /* the version, a word, the last byte, and everything but the header */
+    check_damaged_snapshot(&tape_writer, tape_writer.length, 16);
+    check_damaged_snapshot(&tape_writer, tape_writer.length, 56);
+    check_damaged_snapshot(&tape_writer, tape_writer.length,
+        tape_writer.length - 1);
+    check_damaged_snapshot(&tape_writer, tape_writer.length - 8,
+        tape_writer.length);
+    check_damaged_snapshot(&tape_writer, 56, tape_writer.length);
+    free(tape_writer.data);
+    check_inconsistent_snapshots();
+    if (remove(SNAPSHOT_PATH) != 0) abort();
+    return CJ_SUCCESS;
+}
+
+/* The number of copies of the file in each batch, after which comes one
+ * invalid input. */
+#define BATCH_COPIES 100
+
+/* Write a value to a string in memory, to compare with others. */
+static char *write_to_string(const CJValue *value) {
+    CJBufferWriter buffer_writer;
+    cj_init_buffer_writer(&buffer_writer, NULL);
+    if (!cj_write(&buffer_writer.writer, value, 0)) abort();
+    return buffer_writer.data;
+}
+
+/*
+ * Parse a batch of copies of the file twice with a batch parser, checking
+ * that each value is the same as expected, and freeing each through the
+ * allocator unless they are in arenas.
+ */
+static void check_batch(
+    CJBatchParser *parser,
+    const CJBatchInput *inputs,
+    CJParseResult result,
+    const char *expected,
+    bool arenas,
+    CJAllocator *allocator
+) {
+    CJValue outs[BATCH_COPIES + 1];
+    CJParseResult results[BATCH_COPIES + 1];
+    if (parser == NULL) abort();
+    for (int round = 0; round < 2; round++) {
+        if (cj_parse_batch(parser, inputs, BATCH_COPIES + 1, outs, results)) {
+            abort();
+        }
+        if (results[BATCH_COPIES] != CJ_SYNTAX_ERROR) abort();
+        for (size_t i = 0; i < BATCH_COPIES; i++) {
+            if (results[i] != result) abort();
+            if (result != CJ_SUCCESS) continue;
+            char *written = write_to_string(&outs[i]);
+            if (strcmp(written, expected) != 0) abort();
+            free(written);
+            if (!arenas) cj_free(allocator, &outs[i]);
+        }
+    }
+    cj_batch_parser_delete(parser);
+}
+
+/*
+ * Parse copies of the file in batches on several threads, with each way of
+ * allocating, and then parse it normally.
+ */
+static CJParseResult parse_batches(FILE *f, CJValue *value) {
+    CJBatchInput inputs[BATCH_COPIES + 1];
+    CJBatchOptions options;
+    size_t length = read_contents(f);
+    CJParseResult result = cj_parse_buffer(NULL, contents, length, value);
+    char *expected = result == CJ_SUCCESS ? write_to_string(value) : NULL;
+    for (size_t i = 0; i < BATCH_COPIES; i++) {
+        inputs[i].data = contents;
+        inputs[i].length = length;
+    }
+    inputs[BATCH_COPIES].data = "[1,";
+    inputs[BATCH_COPIES].length = 3;
+    cj_init_batch_options(&options);
+    options.thread_count = 4;
+    check_batch(cj_batch_parser_new(NULL, &options), inputs, result, expected,
+        false, NULL);
+    options.thread_count = 3;
+    options.arenas = true;
+    check_batch(cj_batch_parser_new(NULL, &options), inputs, result, expected,
+        true, NULL);
+    CJPool *batch_pool = cj_pool_new(NULL, 0);
+    if (batch_pool == NULL) abort();
+    CJPoolCache *cache = cj_pool_cache_new(batch_pool);
+    if (cache == NULL) abort();
+    options.thread_count = 2;
+    options.arenas = false;
+    options.pool = batch_pool;
+    check_batch(cj_batch_parser_new(NULL, &options), inputs, result, expected,
+        false, cj_pool_cache_allocator(cache));
+    cj_pool_delete(batch_pool);
+    /* one thread, with a batch of one */
+    CJValue out;
+    CJParseResult out_result;
+    CJBatchParser *parser = cj_batch_parser_new(NULL, NULL);
+    if (parser == NULL) abort();
+    if (cj_parse_batch(parser, inputs, 1, &out, &out_result)
+            != (result == CJ_SUCCESS) || out_result != result) {
+        abort();
+    }
+    if (result == CJ_SUCCESS) cj_free(NULL, &out);
+    cj_batch_parser_delete(parser);
+    free(expected);
+    return result;
+}
+
+/* Feed the contents to a push parser in chunks of the given size. */
+static CJParseResult push_contents(size_t length, size_t chunk, CJValue *value) {
+    CJPushParser *parser = cj_push_new(NULL, 0);
+    if (parser == NULL) abort();
+    for (size_t i = 0; i < length; i += chunk) {
+        size_t n = length - i < chunk ? length - i : chunk;
+        CJParseResult result = cj_push_feed(parser, contents + i, n);
+        if (result != CJ_NEED_MORE) break;
+    }
+    CJParseResult result = cj_push_finish(parser, value);
+    cj_push_delete(parser);
+    return result;
+}
+
+/* Parse the only value of a stream. */
+static CJParseResult next_value(CJReader *reader, CJValue *value) {
+    CJStream *stream = cj_stream_new(NULL, reader, 0);
+    if (stream == NULL) abort();
+    CJParseResult result = cj_parse_next(stream, value);
+    if (result == CJ_SUCCESS) {
+        /* anything after the value must be another one */
+        CJValue next;
+        CJParseResult end = cj_parse_next(stream, &next);
+        if (end != CJ_END_OF_STREAM) {
+            cj_free(NULL, value);
+            cj_free(NULL, &next);
+            result = end == CJ_SUCCESS ? CJ_SYNTAX_ERROR : end;
+        }
+    } else if (result == CJ_END_OF_STREAM) {
+        /* there was no value */
+        result = CJ_SYNTAX_ERROR;
+    }
+    cj_stream_delete(stream);
+    return result;
+}
+
+/* Check whether two values are the same. */
+static bool same_value(const CJValue *a, const CJValue *b) {
+    if (a->type != b->type) return false;
+    switch (a->type) {
+        case CJ_BOOLEAN:
+            return a->as.boolean == b->as.boolean;
+        case CJ_NUMBER:
+            return cj_number_to_double(a) == cj_number_to_double(b);
+        case CJ_STRING:
+            return a->as.string.length == b->as.string.length
+                && memcmp(a->as.string.chars, b->as.string.chars,
+                    a->as.string.length) == 0;
+        case CJ_ARRAY:
+            if (a->as.array.length != b->as.array.length) return false;
+            for (size_t i = 0; i < a->as.array.length; i++) {
+                if (!same_value(&a->as.array.elements[i],
+                        &b->as.array.elements[i])) {
+                    return false;
+                }
+            }
+            return true;
+        case CJ_OBJECT:
+            if (a->as.object.length != b->as.object.length) return false;
+            for (size_t i = 0; i < a->as.object.length; i++) {
+                const CJObjectMember *x = &a->as.object.members[i];
+                const CJObjectMember *y = &b->as.object.members[i];
+                if (x->key.length != y->key.length
+                        || memcmp(x->key.chars, y->key.chars, x->key.length)
+                        || !same_value(&x->value, &y->value)) {
+                    return false;
+                }
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+/* Copy a string read through a cursor, allocated as cj_free expects. */
+static void copy_cursor_string(
+    const char *chars,
+    size_t length,
+    CJString *out
+) {
+    out->length = length;
+    /* cj_free frees strings of any length that it didn't make */
+    out->chars = malloc(length + 1);
+    if (out->chars == NULL) abort();
+    memcpy(out->chars, chars, length);
+    out->chars[length] = '\0';
+}
+
+/*
+ * Check that each member of an object can be found from the cursor of the
+ * object, in reverse order, which wraps around.
+ */
+static void check_fields(
+    CJCursor *object,
+    const CJObject *members,
+    const char **starts
+) {
+    CJCursor found;
+    bool has_empty_key = false;
+    for (size_t i = members->length; i-- > 0;) {
+        const CJString *key = &members->members[i].key;
+        if (!cj_cursor_field(object, key->chars, key->length, &found)) abort();
+        /* with duplicate keys, any member with the key may be found */
+        size_t j = 0;
+        while (starts[j] != found.start) j++;
+        if (members->members[j].key.length != key->length
+                || memcmp(members->members[j].key.chars, key->chars,
+                    key->length) != 0) {
+            abort();
+        }
+        if (key->length == 0) has_empty_key = true;
+    }
+    if (!has_empty_key && cj_cursor_field(object, "", 0, &found)) abort();
+}
+
+/*
+ * Read a value through a cursor into a value, returning false if reading
+ * fails, which leaves the value for cj_free.
+ */
+static bool cursor_to_value(CJCursor *cursor, int depth, CJValue *out) {
+    CJCursor child;
+    const char *chars;
+    size_t length;
+    out->type = cj_cursor_type(cursor);
+    out->flags = 0;
+    switch (out->type) {
+        case CJ_NULL:
+            return cj_cursor_get_null(cursor);
+        case CJ_BOOLEAN:
+            return cj_cursor_get_boolean(cursor, &out->as.boolean);
+        case CJ_NUMBER: {
+            CJInt64 integer;
+            if (!cj_cursor_get_double(cursor, &out->as.number)) return false;
+            if (cj_cursor_get_int64(cursor, &integer)
+                    && (double) integer != out->as.number) {
+                abort();
+            }
+            return true;
+        }
+        case CJ_STRING:
+            /* nothing to free if reading fails */
+            out->as.string.chars = NULL;
+            out->as.string.length = 0;
+            /* reading as another type fails without an error */
+            if (cj_cursor_get_null(cursor)) abort();
+            chars = cj_cursor_get_string(cursor, &length);
+            if (chars == NULL) return false;
+            copy_cursor_string(chars, length, &out->as.string);
+            return true;
+        case CJ_ARRAY:
+            out->as.array.length = 0;
+            out->as.array.elements = NULL;
+            if (++depth == CJ_MAX_DEPTH) return false;
+            for (;;) {
+                if (!cj_cursor_next_element(cursor, &child)) break;
+                CJArray *array = &out->as.array;
+                array->elements = realloc(array->elements,
+                    (array->length + 1) * sizeof(CJValue));
+                if (array->elements == NULL) abort();
+                if (!cursor_to_value(&child, depth,
+                        &array->elements[array->length++])) {
+                    return false;
+                }
+            }
+            return true;
+        case CJ_OBJECT: {
+            CJObject *object = &out->as.object;
+            const char **starts = NULL;
+            bool read;
+            object->length = 0;
+            object->members = NULL;
+            if (++depth == CJ_MAX_DEPTH) return false;
+            for (;;) {
+                if (!cj_cursor_next_member(cursor, &chars, &length, &child)) {
+                    break;
+                }
+                object->members = realloc(object->members,
+                    (object->length + 1) * sizeof(CJObjectMember));
+                starts = realloc(starts,
+                    (object->length + 1) * sizeof(const char*));
+                if (object->members == NULL || starts == NULL) abort();
+                CJObjectMember *member = &object->members[object->length++];
+                starts[object->length - 1] = child.start;
+                copy_cursor_string(chars, length, &member->key);
+                member->value.type = CJ_NULL;
+                if (!cursor_to_value(&child, depth, &member->value)) {
+                    free(starts);
+                    return false;
+                }
+            }
+            read = cj_doc_result(cursor->doc) == CJ_SUCCESS;
+            if (read) check_fields(cursor, object, starts);
+            free(starts);
+            return read;
+        }
+    }
+    abort();
+}
+
+/* Open a document of a string through counting_allocator, at its root. */
+static CJDoc *open_root(const char *json, CJCursor *root) {
+    CJDoc *doc = cj_doc_open(&counting_allocator, json, strlen(json));
+    if (doc == NULL || !cj_doc_root(doc, root)) abort();
+    return doc;
+}
+
+/* Count the elements of an array without reading them. */
+static size_t count_elements(CJCursor *array) {
+    CJCursor element;
+    size_t count = 0;
+    while (cj_cursor_next_element(array, &element)) count++;
+    return count;
+}
+
+/* Check reading parts of documents, skipping the rest. */
+static void check_cursors(void) {
+    CJCursor root, child, grandchild, copy;
+    CJValue parsed;
+    const char *chars;
+    size_t length;
+    double number;
+    CJInt64 integer;
+    CJ_BOOL boolean;
+    CJDoc *doc = open_root("{\"a\": [1, {\"b\": \"]}\\\"\"}], "
+        "\"c\": {\"d\": [true]}, \"e\": \"x\\u0041\", \"n\": null}  ", &root);
+    chars = cj_cursor_get_string(&root, &length);
+    if (chars != NULL || cj_doc_result(doc) != CJ_SUCCESS) abort();
+    if (!cj_cursor_field(&root, "e", 1, &child)) abort();
+    chars = cj_cursor_get_string(&child, &length);
+    if (chars == NULL || length != 2 || strcmp(chars, "xA") != 0) abort();
+    /* earlier members are found by wrapping around */
+    if (!cj_cursor_field(&root, "a", 1, &child)) abort();
+    if (cj_cursor_type(&child) != CJ_ARRAY) abort();
+    if (!cj_cursor_field(&root, "c", 1, &child)) abort();
+    if (!cj_cursor_field(&child, "d", 1, &grandchild)) abort();
+    if (!cj_cursor_next_element(&grandchild, &child)) abort();
+    if (!cj_cursor_get_boolean(&child, &boolean) || !boolean) abort();
+    if (!cj_cursor_field(&root, "n", 1, &child)) abort();
+    if (cj_cursor_get_double(&child, &number)) abort();
+    if (!cj_cursor_get_null(&child)) abort();
+    /* a failed search leaves the object where it was */
+    if (cj_cursor_field(&root, "z", 1, &child)) abort();
+    if (cj_cursor_next_member(&root, &chars, &length, &child)) abort();
+    if (!cj_cursor_field(&root, "a", 1, &child)) abort();
+    if (cj_cursor_parse(&child, NULL, &parsed) != CJ_SUCCESS) abort();
+    if (parsed.type != CJ_ARRAY || parsed.as.array.length != 2) abort();
+    cj_free(NULL, &parsed);
+    if (cj_doc_result(doc) != CJ_SUCCESS) abort();
+    cj_doc_close(doc);
+
+    /* enough elements to need more than one window of the input */
+    size_t count = 3000;
+    const char *element = "{\"k\":[1,\"]\\\\\"]},";
+    char *json = malloc(count * strlen(element) + 4);
+    if (json == NULL) abort();
+    strcpy(json, "[");
+    for (size_t i = 0; i < count; i++) strcat(json, element);
+    strcat(json, "7]");
+    doc = open_root(json, &root);
+    copy = root;
+    if (count_elements(&root) != count + 1) abort();
+    /* skipping again from the start goes back before the index */
+    if (count_elements(&copy) != count + 1) abort();
+    if (cj_doc_result(doc) != CJ_SUCCESS) abort();
+    cj_doc_close(doc);
+    free(json);
+
+    doc = open_root("[9007199254740993, 1.5]", &root);
+    if (!cj_cursor_next_element(&root, &child)) abort();
+    if (!cj_cursor_get_int64(&child, &integer)) abort();
+    if (integer != 9007199254740993) abort();
+    if (!cj_cursor_next_element(&root, &child)) abort();
+    if (cj_cursor_get_int64(&child, &integer)) abort();
+    if (!cj_cursor_get_double(&child, &number) || number != 1.5) abort();
+    if (cj_cursor_next_element(&root, &child)) abort();
+    if (cj_doc_result(doc) != CJ_SUCCESS) abort();
+    cj_doc_close(doc);
+
+    /* errors stop the whole document */
+    doc = open_root("[1, tru]", &root);
+    if (!cj_cursor_next_element(&root, &child)) abort();
+    if (!cj_cursor_next_element(&root, &child)) abort();
+    if (cj_cursor_get_boolean(&child, &boolean)) abort();
+    if (cj_doc_result(doc) != CJ_SYNTAX_ERROR) abort();
+    copy = root;
+    if (cj_cursor_next_element(&copy, &child)) abort();
+    if (cj_doc_result(doc) != CJ_SYNTAX_ERROR) abort();
+    cj_doc_close(doc);
+    static const char *const invalid[] = {
+        "[[1,2] 3]", "[1,", "{\"a\":1} x", "{\"a\" 1}", "[\"a]", "[,1]",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        CJCursor parsed_root;
+        doc = open_root(invalid[i], &root);
+        parsed_root = root;
+        if (cj_cursor_type(&root) == CJ_ARRAY) {
+            count_elements(&root);
+        } else {
+            while (cj_cursor_next_member(&root, &chars, &length, &child)) {}
+        }
+        if (cj_doc_result(doc) != CJ_SYNTAX_ERROR) abort();
+        if (cj_cursor_parse(&parsed_root, NULL, &parsed)
+                != CJ_SYNTAX_ERROR) {
+            abort();
+        }
+        cj_doc_close(doc);
+    }
+    if (live_allocations != 0) abort();
+}
+
+/*
+ * Read the contents through cursors, and check that parsing the root value
+ * from its cursor gives the same value.
+ */
+static CJParseResult read_cursors(FILE *f, CJValue *value) {
+    CJCursor root;
+    CJValue parsed;
+    check_cursors();
+    size_t length = read_contents(f);
+    CJDoc *doc = cj_doc_open(NULL, contents, length);
+    if (doc == NULL) abort();
+    value->type = CJ_NULL;
+    if (!cj_doc_root(doc, &root)) {
+        CJParseResult result = cj_doc_result(doc);
+        cj_doc_close(doc);
+        return result;
+    }
+    bool read = cursor_to_value(&root, 0, value);
+    CJParseResult result = cj_doc_result(doc);
+    /* reading past the depth limit is stopped by the test, not the cursor */
+    if (!read && result == CJ_SUCCESS) result = CJ_TOO_MUCH_NESTING;
+    if (result == CJ_SUCCESS) {
+        if (cj_cursor_parse(&root, NULL, &parsed) != CJ_SUCCESS) abort();
+        if (!same_value(value, &parsed)) abort();
+        cj_free(NULL, &parsed);
+    } else {
+        cj_free(NULL, value);
+    }
+    cj_doc_close(doc);
+    return result;
+}
+
+/*
+ * Check that the next matches of a wildcard path are the values the given
+ * number of levels below a value, in order.
+ */
+static void check_wildcard(
+    const CJValue *v,
+    int levels,
+    const CJArray *matches,
+    size_t *next
+) {
+    if (levels == 0) {
+        if (*next == matches->length) abort();
+        if (!same_value(v, &matches->elements[(*next)++])) abort();
+    } else if (v->type == CJ_ARRAY) {
+        for (size_t i = 0; i < v->as.array.length; i++) {
+            check_wildcard(&v->as.array.elements[i], levels - 1, matches, next);
+        }
+    } else if (v->type == CJ_OBJECT) {
+        for (size_t i = 0; i < v->as.object.length; i++) {
+            check_wildcard(&v->as.object.members[i].value, levels - 1,
+                matches, next);
+        }
+    }
+}
+
+/* The paths to select, which overlap so that values are shared between them. */
+static const char *const select_paths[] = { "", "/*", "/*/*", "/0/~1~0" };
+#define SELECT_PATHS (sizeof(select_paths) / sizeof(select_paths[0]))
+
+/*
+ * Select the root value along with the values below it, twice with the same
+ * selector, and check that the selections agree.
+ */
+static CJParseResult select_values(CJReader *reader, FILE *f, CJValue *value) {
+    CJSelector *selector = cj_selector_new(NULL, select_paths, SELECT_PATHS,
+        CJ_PARSE_INTERN_KEYS);
+    CJStringReader string_reader;
+    CJValue outs[SELECT_PATHS], again[SELECT_PATHS];
+    if (selector == NULL) abort();
+    CJParseResult result = cj_parse_select(selector, reader, outs);
+    rewind(f);
+    size_t length = read_contents(f);
+    cj_init_string_reader(&string_reader, contents, length);
+    if (cj_parse_select(selector, &string_reader.reader, again) != result) {
+        abort();
+    }
+    cj_selector_delete(selector);
+    if (result != CJ_SUCCESS) return result;
+    for (size_t i = 0; i < SELECT_PATHS; i++) {
+        if (!same_value(&outs[i], &again[i])) abort();
+        cj_free(NULL, &again[i]);
+    }
+    /* the root is the only match of the empty pointer */
+    if (outs[0].as.array.length != 1) abort();
+    *value = outs[0].as.array.elements[0];
+    outs[0].as.array.length = 0;
+    cj_free(NULL, &outs[0]);
+    for (int levels = 1; levels <= 2; levels++) {
+        size_t next = 0;
+        check_wildcard(value, levels, &outs[levels].as.array, &next);
+        if (next != outs[levels].as.array.length) abort();
+        cj_free(NULL, &outs[levels]);
+    }
+    const CJValue *escaped = value->type == CJ_ARRAY
+        && value->as.array.length != 0 ? cj_object_get(
+        &value->as.array.elements[0], "/~", 2) : NULL;
+    if (outs[3].as.array.length != (escaped != NULL)) abort();
+    if (escaped != NULL
+            && !same_value(escaped, &outs[3].as.array.elements[0])) {
+        abort();
+    }
+    cj_free(NULL, &outs[3]);
+    interned = true;
+    return result;
+}
+
+/*
+ * Check that a parallel parse reports the same errors as a sequential one for
+ * root arrays closed with the wrong bracket, which look like arrays at first.
+ */
+static void check_parallel_errors(void) {
+    static const char *const inputs[] = {
+        "[1,2,3,4}", "[\"a\",\"b\"}", "[{\"a\":1},{\"b\":2}}", "[[1],[2]}"
+    };
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        size_t length = strlen(inputs[i]);
+        CJValue value;
+        if (cj_parse_buffer(NULL, inputs[i], length, &value)
+                != CJ_SYNTAX_ERROR) {
+            abort();
+        }
+        if (cj_parse_parallel(NULL, inputs[i], length, &value, 0, 4)
+                != CJ_SYNTAX_ERROR) {
+            abort();
+        }
+    }
+}
+
+/*
+ * Write arrays and objects in turn, the given number deep, ending in an empty
+ * array, and return the length of the text, which is at most four bytes for
+ * each level.
+ */
+static size_t write_nesting(char *out, size_t depth) {
+    size_t length = 0;
+    for (size_t i = 0; i < depth; i++) {
+        if (i % 2 == 0) {
+            out[length++] = '[';
+        } else {
+            memcpy(out + length, "{\"\":", 4);
+            length += 4;
+        }
+    }
+    out[length++] = '[';
+    out[length++] = ']';
+    for (size_t i = depth; i > 0; i--) out[length++] = i % 2 ? ']' : '}';
+    return length;
+}
+
+/*
+ * Check that nesting far deeper than CJ_MAX_DEPTH can be parsed, written, and
+ * freed with a higher limit, and that a lower limit is kept to.
+ */
+static void check_deep_nesting(void) {
+    enum { DEPTH = 200000 };
+    char *deep = malloc(4 * DEPTH + 2);
+    if (deep == NULL) abort();
+    size_t length = write_nesting(deep, DEPTH);
+    CJParseOptions options;
+    cj_init_parse_options(&options);
+    options.max_depth = DEPTH + 2;
+    CJStringReader string_reader;
+    CJValue value;
+    cj_init_string_reader(&string_reader, deep, length);
+    if (cj_parse_with_options(NULL, &string_reader.reader, &value, &options)
+            != CJ_SUCCESS) {
+        abort();
+    }
+    char *written = write_to_string(&value);
+    if (strlen(written) != length || memcmp(written, deep, length) != 0) {
+        abort();
+    }
+    free(written);
+    cj_free(NULL, &value);
+    options.max_depth = DEPTH + 1;
+    cj_init_string_reader(&string_reader, deep, length);
+    if (cj_parse_with_options(NULL, &string_reader.reader, &value, &options)
+            != CJ_TOO_MUCH_NESTING) {
+        abort();
+    }
+    free(deep);
+}
+
+#ifdef SMALL_STACKS
+/* The deepest nesting that CJ_MAX_DEPTH allows. */
+static char limit_nesting[4 * CJ_MAX_DEPTH];
+static size_t limit_nesting_length;
+
+/* Check that a selection matched the given text once. */
+static void check_selected(
+    const CJValue *out,
+    const char *json,
+    size_t length
+) {
+    if (out->as.array.length != 1) abort();
+    char *written = write_to_string(&out->as.array.elements[0]);
+    if (strlen(written) != length || memcmp(written, json, length) != 0) {
+        abort();
+    }
+    free(written);
+}
+
+/* Validate, parse, select, save, and write the deepest nesting allowed. */
+static void *walk_limit_nesting(void *arg) {
+    static const CJHandler no_handler;
+    const char *json = limit_nesting;
+    size_t length = limit_nesting_length;
+    CJStringReader string_reader;
+    (void) arg;
+    if (cj_validate_buffer(json, length) != CJ_SUCCESS) abort();
+    cj_init_string_reader(&string_reader, json, length);
+    if (cj_parse_events(NULL, &string_reader.reader, &no_handler, NULL)
+            != CJ_SUCCESS) {
+        abort();
+    }
+    CJTape tape;
+    cj_init_string_reader(&string_reader, json, length);
+    if (cj_parse_tape(NULL, &string_reader.reader, &tape) != CJ_SUCCESS
+            || cj_tape_next(&tape, 0) != tape.length) {
+        abort();
+    }
+    cj_tape_free(NULL, &tape);
+    /* one path all the way down, and one that copies the root's child */
+    static char down[2 * CJ_MAX_DEPTH];
+    for (size_t i = 0; i < CJ_MAX_DEPTH - 2; i++) memcpy(down + 2 * i, "/*", 2);
+    const char *pointers[] = { down, "", "/*" };
+    CJSelector *selector = cj_selector_new(NULL, pointers, 3, 0);
+    if (selector == NULL) abort();
+    CJValue outs[3];
+    cj_init_string_reader(&string_reader, json, length);
+    if (cj_parse_select(selector, &string_reader.reader, outs) != CJ_SUCCESS) {
+        abort();
+    }
+    check_selected(&outs[0], "[]", 2);
+    check_selected(&outs[1], json, length);
+    check_selected(&outs[2], json + 1, length - 2);
+    for (size_t i = 0; i < 3; i++) cj_free(NULL, &outs[i]);
+    cj_selector_delete(selector);
+    CJValue value;
+    if (cj_parse_buffer(NULL, json, length, &value) != CJ_SUCCESS) abort();
+    CJBufferWriter buffer_writer;
+    cj_init_buffer_writer(&buffer_writer, NULL);
+    if (!cj_save_snapshot(NULL, &value, &buffer_writer.writer)) abort();
+    free(buffer_writer.data);
+    char *written = write_to_string(&value);
+    if (strlen(written) != length || memcmp(written, json, length) != 0) {
+        abort();
+    }
+    free(written);
+    cj_free(NULL, &value);
+    return NULL;
+}
+
+/*
+ * Check that the deepest nesting allowed is walked on a thread with a stack
+ * far smaller than recursing would need.
+ */
+static void check_small_stack(void) {
+    limit_nesting_length = write_nesting(limit_nesting, CJ_MAX_DEPTH - 2);
+    pthread_attr_t attr;
+    pthread_t thread;
+    if (pthread_attr_init(&attr) != 0
+            || pthread_attr_setstacksize(&attr, 64 * 1024) != 0
+            || pthread_create(&thread, &attr, walk_limit_nesting, NULL) != 0
+            || pthread_join(thread, NULL) != 0) {
+        abort();
+    }
+    pthread_attr_destroy(&attr);
+}
+#endif
+
+/* Check whether any object in a value has two members with the same key. */
+static bool has_duplicate_keys(const CJValue *v) {
+    if (v->type == CJ_ARRAY) {
+        for (size_t i = 0; i < v->as.array.length; i++) {
+            if (has_duplicate_keys(&v->as.array.elements[i])) return true;
+        }
+    } else if (v->type == CJ_OBJECT) {
+        for (size_t i = 0; i < v->as.object.length; i++) {
+            const CJObjectMember *member = &v->as.object.members[i];
+            if (cj_object_get(v, member->key.chars, member->key.length)
+                    != &member->value) {
+                return true;
+            }
+            if (has_duplicate_keys(&member->value)) return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Parse the file twice with the same parser, once through a reader that splits
+ * everything and once from memory, and once more rejecting duplicate keys.
+ */
+static CJParseResult parse_reused(CJReader *reader, FILE *f, CJValue *value) {
+    CJParser *parser = cj_parser_new(NULL, NULL);
+    CJParseOptions options;
+    CJStringReader string_reader;
+    CJValue again;
+    if (parser == NULL) abort();
+    CJParseResult result = cj_parser_parse(parser, reader, value);
+    rewind(f);
+    size_t length = read_contents(f);
+    cj_init_string_reader(&string_reader, contents, length);
+    if (cj_parser_parse(parser, &string_reader.reader, &again) != result) {
+        abort();
+    }
+    cj_parser_delete(parser);
+    if (result == CJ_SUCCESS) {
+        if (!same_value(value, &again)) abort();
+        cj_free(NULL, &again);
+    }
+    cj_init_parse_options(&options);
+    options.flags = CJ_PARSE_REJECT_DUPLICATES;
+    parser = cj_parser_new(NULL, &options);
+    if (parser == NULL) abort();
+    cj_init_string_reader(&string_reader, contents, length);
+    CJParseResult strict = cj_parser_parse(parser, &string_reader.reader,
+        &again);
+    cj_parser_delete(parser);
+    if (result != CJ_SUCCESS) {
+        if (strict != result) abort();
+    } else if (has_duplicate_keys(value)) {
+        if (strict != CJ_DUPLICATE_KEY) abort();
+    } else {
+        if (strict != CJ_SUCCESS || !same_value(value, &again)) abort();
+        cj_free(NULL, &again);
+    }
+    return result;
+}
+
+/* A struct for checking decoding, with every type of field. */
+typedef struct {
+    double x;
+    double y;
+} Point;
+
+typedef struct Shape {
+    char *name;
+    CJ_BOOL visible;
+    int layer;
+    CJInt64 id;
+    Point origin;
+    Point *points;
+    size_t point_count;
+    char **tags;
+    size_t tag_count;
+    int *sizes;
+    size_t size_count;
+    struct Shape *children;
+    size_t child_count;
+} Shape;
+
+static const CJField point_fields[] = {
+    { "x", CJ_FIELD_DOUBLE, cj_offset_of(Point, x), NULL, CJ_FALSE, 0 },
+    { "y", CJ_FIELD_DOUBLE, cj_offset_of(Point, y), NULL, CJ_FALSE, 0 },
+};
+
+static const CJStructDesc point_desc = { sizeof(Point), point_fields, 2 };
+
+static const CJStructDesc shape_desc;
+
+static const CJField shape_fields[] = {
+    { "name", CJ_FIELD_STRING, cj_offset_of(Shape, name), NULL, CJ_FALSE, 0 },
+    { "visible", CJ_FIELD_BOOLEAN, cj_offset_of(Shape, visible), NULL,
+        CJ_FALSE, 0 },
+    { "layer", CJ_FIELD_INT, cj_offset_of(Shape, layer), NULL, CJ_FALSE, 0 },
+    { "id", CJ_FIELD_INT64, cj_offset_of(Shape, id), NULL, CJ_FALSE, 0 },
+    { "origin", CJ_FIELD_STRUCT, cj_offset_of(Shape, origin), &point_desc,
+        CJ_FALSE, 0 },
+    { "points", CJ_FIELD_STRUCT, cj_offset_of(Shape, points), &point_desc,
+        CJ_TRUE, cj_offset_of(Shape, point_count) },
+    { "tags", CJ_FIELD_STRING, cj_offset_of(Shape, tags), NULL, CJ_TRUE,
+        cj_offset_of(Shape, tag_count) },
+    { "sizes", CJ_FIELD_INT, cj_offset_of(Shape, sizes), NULL, CJ_TRUE,
+        cj_offset_of(Shape, size_count) },
+    { "children", CJ_FIELD_STRUCT, cj_offset_of(Shape, children), &shape_desc,
+        CJ_TRUE, cj_offset_of(Shape, child_count) },
+};
+
+static const CJStructDesc shape_desc = { sizeof(Shape), shape_fields, 9 };
+
+/* Decode a string into a shape, with the fields that have defaults reset. */
+static CJParseResult decode_shape(
+    CJDecoder *decoder,
+    const char *json,
+    Shape *shape
+) {
+    CJStringReader string_reader;
+    memset(shape, 0, sizeof(Shape));
+    shape->layer = 7;
+    cj_init_string_reader(&string_reader, json, strlen(json));
+    return cj_decode(decoder, &string_reader.reader, shape);
+}
+
+/* Check decoding into structs, and that it frees everything it allocates. */
+static void check_decoding(void) {
+    static const CJField duplicate_fields[] = {
+        { "x", CJ_FIELD_DOUBLE, 0, NULL, CJ_FALSE, 0 },
+        { "x", CJ_FIELD_INT, 0, NULL, CJ_FALSE, 0 },
+    };
+    static const CJStructDesc duplicate_desc = {
+        sizeof(double), duplicate_fields, 2
+    };
+    static const char *const mismatched[] = {
+        "[]", "{\"layer\":1.5}", "{\"layer\":\"1\"}", "{\"tags\":[\"a\",1]}",
+        "{\"children\":[{\"origin\":[]}]}", "{\"id\":9223372036854775808}",
+    };
+    if (cj_decoder_new(&counting_allocator, &duplicate_desc) != NULL) abort();
+    if (live_allocations != 0) abort();
+    CJDecoder *decoder = cj_decoder_new(&counting_allocator, &shape_desc);
+    if (decoder == NULL) abort();
+    Shape shape;
+    CJParseResult result = decode_shape(decoder, "{\"name\":\"a\\u0062\", "
+        "\"unknown\":{\"x\":[1,{\"y\":null}]},\"visible\":true,"
+        "\"id\":-9007199254740993,\"origin\":{\"x\":1.5,\"y\":-2,\"z\":0},"
+        "\"points\":[{\"x\":1,\"y\":2},{\"y\":4}],\"tags\":[\"one\",null],"
+        "\"sizes\":null,\"name\":\"shape\","
+        "\"children\":[{\"name\":\"child\",\"layer\":-1,\"tags\":[]}]}",
+        &shape);
+    if (result != CJ_SUCCESS) abort();
+    if (strcmp(shape.name, "shape") != 0 || !shape.visible) abort();
+    if (shape.layer != 7 || shape.id != -9007199254740993) abort();
+    if (shape.origin.x != 1.5 || shape.origin.y != -2) abort();
+    if (shape.point_count != 2 || shape.points[0].x != 1
+            || shape.points[0].y != 2 || shape.points[1].x != 0
+            || shape.points[1].y != 4) {
+        abort();
+    }
+    if (shape.tag_count != 2 || strcmp(shape.tags[0], "one") != 0
+            || shape.tags[1] != NULL) {
+        abort();
+    }
+    if (shape.sizes != NULL || shape.size_count != 0) abort();
+    if (shape.child_count != 1 || shape.children[0].layer != -1
+            || strcmp(shape.children[0].name, "child") != 0
+            || shape.children[0].tags != NULL) {
+        abort();
+    }
+    /* decoding again replaces what was decoded before */
+    CJStringReader string_reader;
+    const char *again = "{\"sizes\":[3,1,2],\"name\":null}";
+    cj_init_string_reader(&string_reader, again, strlen(again));
+    if (cj_decode(decoder, &string_reader.reader, &shape) != CJ_SUCCESS) {
+        abort();
+    }
+    if (shape.name != NULL || shape.size_count != 3 || shape.sizes[2] != 2) {
+        abort();
+    }
+    cj_decode_free(decoder, &shape);
+    for (size_t i = 0; i < sizeof(mismatched) / sizeof(mismatched[0]); i++) {
+        if (decode_shape(decoder, mismatched[i], &shape) != CJ_TYPE_MISMATCH) {
+            abort();
+        }
+        cj_decode_free(decoder, &shape);
+    }
+    if (decode_shape(decoder, "{\"layer\":tru}", &shape) != CJ_SYNTAX_ERROR) {
+        abort();
+    }
+    cj_decoder_delete(decoder);
+    /* the decoder keeps its scratch buffers until it is deleted */
+    if (live_allocations != 0) abort();
+}
+
+/*
+ * Decode into a struct with no fields, which skips every member, so that the
+ * result is the same as parsing unless the root value is not an object.
+ */
+static CJParseResult decode_values(FILE *f, CJValue *value) {
+    static const CJStructDesc empty_desc = { 1, NULL, 0 };
+    char buffer[1];
+    char dst;
+    CJFileReader file_reader;
+    check_decoding();
+    CJDecoder *decoder = cj_decoder_new(NULL, &empty_desc);
+    if (decoder == NULL) abort();
+    cj_init_file_reader(&file_reader, f, buffer, sizeof(buffer));
+    CJParseResult decoded = cj_decode(decoder, &file_reader.reader, &dst);
+    cj_decoder_delete(decoder);
+    rewind(f);
+    cj_init_file_reader(&file_reader, f, buffer, sizeof(buffer));
+    CJParseResult result = cj_parse(NULL, &file_reader.reader, value);
+    if (result == CJ_SUCCESS && value->type != CJ_OBJECT) {
+        if (decoded != CJ_TYPE_MISMATCH) abort();
+    } else if (decoded != result) {
+        abort();
+    }
+    return result;
+}
+
+#ifdef CJ_STATS
+/* Check that the statistics of a parse agree with its input and result. */
+static void check_stats(
+    const CJParseStats *stats,
+    CJParseResult result,
+    size_t length
+) {
+    if (stats->allocations < stats->frees) abort();
+    if (result == CJ_SUCCESS) {
+        if (stats->bytes_consumed != length) abort();
+        if (stats->error_offset != 0 || stats->max_depth == 0) abort();
+    } else if (stats->error_offset != stats->bytes_consumed
+            || stats->error_offset > length) {
+        abort();
+    }
+}
+
+/*
+ * Parse through a reader that splits everything, and then parse the contents
+ * again with a parser, checking the statistics of both.
+ */
+static CJParseResult parse_with_stats(FILE *f, CJValue *value) {
+    CJParseOptions options;
+    CJParseStats stats, again_stats;
+    char buffer[16];
+    CJFileReader file_reader;
+    CJStringReader string_reader;
+    CJValue again;
+    cj_init_parse_options(&options);
+    options.stats = &stats;
+    cj_init_file_reader(&file_reader, f, buffer, sizeof(buffer));
+    CJParseResult result = cj_parse_with_options(NULL, &file_reader.reader,
+        value, &options);
+    rewind(f);
+    size_t length = read_contents(f);
+    check_stats(&stats, result, length);
+    if (result == CJ_SUCCESS && (stats.bytes_read != length
+            || stats.reads <= length / sizeof(buffer))) {
+        abort();
+    }
+    /* one buffer in memory is read without calling the reader */
+    options.stats = &again_stats;
+    CJParser *parser = cj_parser_new(NULL, &options);
+    if (parser == NULL) abort();
+    cj_init_string_reader(&string_reader, contents, length);
+    if (cj_parser_parse(parser, &string_reader.reader, &again) != result) {
+        abort();
+    }
+    cj_parser_delete(parser);
+    check_stats(&again_stats, result, length);
+    if (again_stats.reads != 0 || again_stats.bytes_read != length) abort();
+    if (again_stats.error_offset != stats.error_offset
+            || again_stats.max_depth != stats.max_depth
+            || again_stats.escapes != stats.escapes
+            || again_stats.string_bytes != stats.string_bytes
+            || again_stats.slow_numbers != stats.slow_numbers) {
+        abort();
+    }
+    if (result == CJ_SUCCESS) cj_free(NULL, &again);
+    return result;
+}
+#endif
+
+/* Parse the file using the given mode. */
+static CJParseResult parse_file(
+    const char *mode,
+    const char *path,
+    FILE *f,
+    CJValue *value
+) {
     /* define a buffer for the reader */
     char buffer[128];
     CJFileReader file_reader;
     cj_init_file_reader(&file_reader, f, buffer, sizeof(buffer));
+    if (strcmp(mode, "default") == 0) {
+        check_hand_built_value();
+        return cj_parse(NULL, &file_reader.reader, value);
+    } else if (strcmp(mode, "stream1") == 0) {
+        /* refill for every byte */
+        cj_init_file_reader(&file_reader, f, buffer, 1);
+        return cj_parse(NULL, &file_reader.reader, value);
+    } else if (strcmp(mode, "buffer") == 0) {
+        size_t length = read_contents(f);
+        return cj_parse_buffer(NULL, contents, length, value);
+    } else if (strcmp(mode, "string") == 0) {
+        CJStringReader string_reader;
+        size_t length = read_contents(f);
+        cj_init_string_reader(&string_reader, contents, length);
+        return cj_parse(NULL, &string_reader.reader, value);
+    } else if (strcmp(mode, "pool") == 0) {
+        return parse_pooled(path, f, value);
+    } else if (strcmp(mode, "decode") == 0) {
+        return decode_values(f, value);
+#ifdef CJ_STATS
+    } else if (strcmp(mode, "stats") == 0) {
+        return parse_with_stats(f, value);
+#endif
+    } else if (strcmp(mode, "arena") == 0) {
+        /* use a tiny chunk size to exercise chunk growth */
+        cj_arena_init(&arena, NULL, 16);
+        return cj_parse_ex(&arena.allocator, &file_reader.reader, value,
+            CJ_PARSE_ARENA);
+    } else if (strcmp(mode, "lazy") == 0) {
+        /* numbers point into the buffer */
+        size_t length = read_contents(f);
+        check_lazy_int64();
+        return cj_parse_buffer_ex(NULL, contents, length, value,
+            CJ_PARSE_LAZY_NUMBERS);
+    } else if (strcmp(mode, "indexed") == 0) {
+        /* large objects are searched with an index instead of scanned */
+        indexed = true;
+        return cj_parse_ex(NULL, &file_reader.reader, value,
+            CJ_PARSE_INDEX_OBJECTS);
+    } else if (strcmp(mode, "intern") == 0) {
+        interned = true;
+        return cj_parse_ex(NULL, &file_reader.reader, value,
+            CJ_PARSE_INTERN_KEYS);
+    } else if (strcmp(mode, "events") == 0) {
+        /* print while parsing, leaving nothing to print afterwards */
+        CJParseResult result;
+        printer.first[0] = true;
+        result = cj_parse_events(NULL, &file_reader.reader,
+            &printing_handler, NULL);
+        value->type = CJ_NULL;
+        return result;
+    } else if (strcmp(mode, "push") == 0) {
+        return push_contents(read_contents(f), 7, value);
+    } else if (strcmp(mode, "push1") == 0) {
+        /* split every token */
+        return push_contents(read_contents(f), 1, value);
+    } else if (strcmp(mode, "insitu") == 0) {
+        /* strings are decoded inside the buffer */
+        size_t length = read_contents(f);
+        return cj_parse_insitu(NULL, contents, length, value);
+    } else if (strcmp(mode, "mapped") == 0) {
+        if (!cj_open_mapped_file_reader(&mapped_file_reader, path, NULL)) {
+            abort();
+        }
+        return cj_parse(NULL, &mapped_file_reader.reader, value);
+    } else if (strcmp(mode, "mappedinsitu") == 0) {
+        /* the mapping is private, so the file is left alone */
+        if (!cj_open_mapped_file_reader(&mapped_file_reader, path, NULL)) {
+            abort();
+        }
+        return cj_parse_insitu(NULL, mapped_file_reader.data,
+            mapped_file_reader.length, value);
+    } else if (strcmp(mode, "pretty") == 0) {
+        /* parsed like the default, but written differently */
+        return cj_parse(NULL, &file_reader.reader, value);
+    } else if (strcmp(mode, "next") == 0) {
+        return next_value(&file_reader.reader, value);
+    } else if (strcmp(mode, "validate") == 0) {
+        /* both ways of validating must agree with parsing */
+        CJParseResult result;
+        size_t length;
+        cj_init_file_reader(&file_reader, f, buffer, 1);
+        result = cj_validate(&file_reader.reader);
+        rewind(f);
+        length = read_contents(f);
+        if (cj_validate_buffer(contents, length) != result) abort();
+        if (cj_parse_buffer(NULL, contents, length, value) != result) abort();
+        return result;
+    } else if (strcmp(mode, "parser") == 0) {
+        cj_init_file_reader(&file_reader, f, buffer, 1);
+        return parse_reused(&file_reader.reader, f, value);
+    } else if (strcmp(mode, "deep") == 0) {
+        /* a higher limit, through a reader that splits everything */
+        CJParseOptions options;
+        check_deep_nesting();
+#ifdef SMALL_STACKS
+        check_small_stack();
+#endif
+        cj_init_parse_options(&options);
+        options.max_depth = 100 * CJ_MAX_DEPTH;
+        cj_init_file_reader(&file_reader, f, buffer, 1);
+        return cj_parse_with_options(NULL, &file_reader.reader, value,
+            &options);
+    } else if (strcmp(mode, "select") == 0) {
+        return select_values(&file_reader.reader, f, value);
+    } else if (strcmp(mode, "tape") == 0) {
+        return parse_tape(&file_reader.reader, value);
+    } else if (strcmp(mode, "snapshot") == 0) {
+        return snapshot_value(f, value);
+    } else if (strcmp(mode, "batch") == 0) {
+        return parse_batches(f, value);
+    } else if (strcmp(mode, "cursor") == 0) {
+        return read_cursors(f, value);
+    } else if (strcmp(mode, "twostage") == 0) {
+        size_t length = read_contents(f);
+        return cj_parse_buffer_ex(NULL, contents, length, value,
+            CJ_PARSE_TWO_STAGE);
+    } else if (strcmp(mode, "parallel") == 0) {
+        /* more threads than most arrays have elements */
+        size_t length = read_contents(f);
+        check_parallel_errors();
+        return cj_parse_parallel(NULL, contents, length, value, 0, 4);
+    } else if (strcmp(mode, "readahead") == 0) {
+        /* small buffers, so that each one is refilled many times */
+        CJReadAheadReader *read_ahead;
+        CJParseResult result;
+        cj_init_file_reader(&file_reader, f, buffer, 7);
+        read_ahead = cj_read_ahead_new(NULL, &file_reader.reader, 16, 3);
+        if (read_ahead == NULL) abort();
+        result = cj_parse(NULL, cj_read_ahead_reader(read_ahead), value);
+        cj_read_ahead_delete(read_ahead);
+        return result;
+    } else if (strcmp(mode, "lazystream") == 0) {
+        /* numbers are copied, and may cross buffers */
+        cj_init_file_reader(&file_reader, f, buffer, 1);
+        return cj_parse_ex(NULL, &file_reader.reader, value,
+            CJ_PARSE_LAZY_NUMBERS);
+    }
+    abort();
+}
+
+/* Free the value parsed using the given mode. */
+static void free_value(const char *mode, CJValue *value) {
+    if (strcmp(mode, "arena") == 0) {
+        cj_arena_release(&arena);
+    } else if (strcmp(mode, "pool") == 0) {
+        /* memory may be freed through another cache */
+        cj_free(cj_pool_cache_allocator(free_cache), value);
+        if (live_allocations != pool_allocations) abort();
+        cj_pool_cache_delete(free_cache);
+        cj_pool_cache_delete(parse_cache);
+        cj_pool_delete(pool);
+        if (live_allocations != 0) abort();
+    } else {
+        cj_free(NULL, value);
+    }
+    if (strncmp(mode, "mapped", 6) == 0) {
+        cj_close_mapped_file_reader(&mapped_file_reader);
+    }
+    free(contents);
+}
+
+int main(int argc, char *argv[]) {
+    FILE *f = fopen(argv[1], "r");
+    /* ensure the input file is open */
+    if (f == NULL) abort();
+    /* the parsing mode to test, if given */
+    const char *mode = argc > 2 ? argv[2] : "default";
     /* parse the input */
     CJValue value;
-    CJParseResult result = cj_parse(NULL, &file_reader.reader, &value);
+    CJParseResult result = parse_file(mode, argv[1], f, &value);
     /* close the file */
     fclose(f);
     /* handle result value */
     switch (result) {
         case CJ_SUCCESS:
-            write_json(&value);
-            cj_free(NULL, &value);
+            check_value(&value);
+            if (strcmp(mode, "pretty") == 0) {
+                write_pretty_json(&value);
+            } else if (strcmp(mode, "events") != 0) {
+                write_json(&value);
+            }
+            free_value(mode, &value);
             return EXIT_SUCCESS;
         case CJ_SYNTAX_ERROR: case CJ_TOO_MUCH_NESTING:
             return EXIT_FAILURE;
-        case CJ_OUT_OF_MEMORY: case CJ_READ_ERROR:
+        case CJ_OUT_OF_MEMORY: case CJ_READ_ERROR: case CJ_STOPPED:
+        case CJ_NEED_MORE: case CJ_END_OF_STREAM: case CJ_DUPLICATE_KEY:
+        case CJ_TYPE_MISMATCH:
             abort();
     }
 }